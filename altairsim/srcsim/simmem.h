@@ -24,8 +24,11 @@
 #ifndef SIMMEM_INC
 #define SIMMEM_INC
 
+#include <string.h>
+
 #include "sim.h"
 #include "simdefs.h"
+#include "generic-vram.h"
 #ifdef WANT_ICE
 #include "simice.h"
 #endif
@@ -100,6 +103,7 @@ static inline void memwrt(WORD addr, BYTE data)
 		memory[addr] = data;
 		mem_wp = 0;
 	}
+	vram_mark(addr);
 }
 
 static inline BYTE memrdr(WORD addr)
@@ -178,6 +182,7 @@ static inline void dma_write(WORD addr, BYTE data)
 {
 	if (p_tab[addr >> 8] == MEM_RW)
 		memory[addr] = data;
+	vram_mark(addr);
 }
 
 /*
@@ -199,6 +204,29 @@ static inline BYTE getmem(WORD addr)
 static inline void putmem(WORD addr, BYTE data)
 {
 	memory[addr] = data;
+	vram_mark(addr);
+}
+
+/* copy a block of memory like getmem() would, one page at a time */
+static inline void getmem_block(WORD addr, BYTE *dst, int len)
+{
+	register int n;
+
+	while (len > 0) {
+		n = 256 - (addr & 0xff);
+		if (n > len)
+			n = len;
+		if (p_tab[addr >> 8] != MEM_NONE)
+			memcpy(dst, &memory[addr], n);
+		else
+			memset(dst, 0xff, n);
+		if (tarbell_rom_active && tarbell_rom_enabled && addr <= 0x001f)
+			memcpy(dst, &tarbell_rom[addr],
+			       (n < 0x20 - addr) ? n : 0x20 - addr);
+		addr += n;
+		dst += n;
+		len -= n;
+	}
 }
 
 /*
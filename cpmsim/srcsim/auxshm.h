@@ -0,0 +1,95 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Copyright (C) 2026 by agent
+ *
+ * Shared memory rings for the auxiliary block transfer port, used by
+ * cpmsim and the host tools cpmsend and cpmrecv
+ *
+ * History:
+ * 18-OCT-2026 first version
+ */
+
+#ifndef AUXSHM_INC
+#define AUXSHM_INC
+
+#include <stdint.h>
+#include <string.h>
+
+#define AUXSHM_FILE	"/tmp/.z80pack/cpmsim.auxshm"
+#define AUXSHM_MAGIC	0x4d485358	/* set while the simulation runs */
+#define AUXSHM_RINGSZ	65536		/* size of the rings, power of 2 */
+
+/*
+ * Ring with one producer and one consumer process. Only the producer
+ * moves head and sets eof, only the consumer moves tail, both count up
+ * and wrap around. A host tool sets active while it is attached to the
+ * ring, the simulation only waits for the other side if it is set.
+ */
+typedef struct auxshm_ring {
+	uint32_t head;		/* bytes written, by producer */
+	uint32_t tail;		/* bytes read, by consumer */
+	uint32_t eof;		/* producer has sent all data */
+	uint32_t active;	/* host tool is attached */
+	uint8_t buf[AUXSHM_RINGSZ];
+} auxshm_ring_t;
+
+typedef struct auxshm {
+	uint32_t magic;
+	uint32_t ringsz;
+	auxshm_ring_t in;	/* from host to guest */
+	auxshm_ring_t out;	/* from guest to host */
+} auxshm_t;
+
+/* number of bytes which can be read, called by the consumer */
+static inline uint32_t auxshm_count(auxshm_ring_t *r)
+{
+	return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - r->tail;
+}
+
+/* number of bytes which can be written, called by the producer */
+static inline uint32_t auxshm_space(auxshm_ring_t *r)
+{
+	return AUXSHM_RINGSZ - (r->head - __atomic_load_n(&r->tail,
+							  __ATOMIC_ACQUIRE));
+}
+
+/* write up to n bytes, returns the number of bytes written */
+static inline uint32_t auxshm_put(auxshm_ring_t *r, const void *p, uint32_t n)
+{
+	uint32_t i = r->head & (AUXSHM_RINGSZ - 1);
+	uint32_t space = auxshm_space(r);
+	uint32_t m;
+
+	if (n > space)
+		n = space;
+	m = AUXSHM_RINGSZ - i;
+	if (m > n)
+		m = n;
+	memcpy(r->buf + i, p, m);
+	memcpy(r->buf, (const uint8_t *) p + m, n - m);
+	__atomic_store_n(&r->head, r->head + n, __ATOMIC_RELEASE);
+
+	return n;
+}
+
+/* read up to n bytes, returns the number of bytes read */
+static inline uint32_t auxshm_get(auxshm_ring_t *r, void *p, uint32_t n)
+{
+	uint32_t i = r->tail & (AUXSHM_RINGSZ - 1);
+	uint32_t count = auxshm_count(r);
+	uint32_t m;
+
+	if (n > count)
+		n = count;
+	m = AUXSHM_RINGSZ - i;
+	if (m > n)
+		m = n;
+	memcpy(p, r->buf + i, m);
+	memcpy((uint8_t *) p + m, r->buf, n - m);
+	__atomic_store_n(&r->tail, r->tail + n, __ATOMIC_RELEASE);
+
+	return n;
+}
+
+#endif /* !AUXSHM_INC */
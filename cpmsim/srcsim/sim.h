@@ -32,9 +32,15 @@
 /*#define HAS_CONFIG*/	/* has no configuration file */
 
 #define PIPES		/* use named pipes for auxiliary device */
+#define AUXSHM		/* shared memory for auxiliary block transfers */
 #define NETWORKING	/* TCP/IP networked serial ports */
-#define NUMSOC	4	/* number of server sockets */
-#define TCPASYNC	/* tcp/ip server can use async I/O */
+#ifndef NUMSOC
+#define NUMSOC	16	/* number of server sockets (max. 255), set in Makefile */
+#endif
+#if NUMSOC < 1 || NUMSOC > 255
+#error "NUMSOC must be in the range 1-255"
+#endif
+#define HAS_BDOS_TRAP	/* drives mapped to host directories by BDOS trap */
 /*#define CNETDEBUG*/	/* client network protocol debugger */
 /*#define SNETDEBUG*/	/* server network protocol debugger */
 
@@ -23,10 +23,23 @@
 #endif
 
 #include "unix_terminal.h"
+#include "unix_outbuf.h"
 
 #include "log.h"
 static const char *TAG = "system";
 
+#ifdef WANT_ICE
+/*
+ *	Write the output the CPU left in the buffers and reset the
+ *	terminal, before the ICE shows anything.
+ */
+static void ice_after_run(void)
+{
+	outbuf_flush_all();
+	reset_unix_terminal();
+}
+#endif
+
 /*
  *	This function initializes the terminal, loads boot code
  *	and then the Z80 CPU emulation is started.
@@ -42,7 +55,7 @@ void mon(void)
 
 #ifdef WANT_ICE
 	ice_before_go = set_unix_terminal;
-	ice_after_go = reset_unix_terminal;
+	ice_after_go = ice_after_run;
 	atexit(reset_unix_terminal);
 
 	ice_cmd_loop(0);
@@ -54,7 +67,8 @@ void mon(void)
 	/* start CPU emulation */
 	run_cpu();
 
-	/* reset terminal */
+	/* write buffered output and reset terminal */
+	outbuf_flush_all();
 	reset_unix_terminal();
 
 	/* check for CPU emulation errors and report */
@@ -103,17 +117,25 @@ int boot(int level)
 	strcat(fn, "/");
 	strcat(fn, disks[0].fn);
 
-	if ((fd = open(fn, O_RDONLY)) == -1) {
-		LOGE(TAG, "can't open file %s", fn);
-		close(fd);
-		return 1;
-	}
-	if (read(fd, buf, 128) != 128) {
-		LOGE(TAG, "can't read file %s", fn);
+	/* an overlay image has the boot sector in the overlay or base */
+	if (disks[0].cd != NULL) {
+		if (cowdisk_read(disks[0].cd, buf, 128, 0) != 128) {
+			LOGE(TAG, "can't read file %s", fn);
+			return 1;
+		}
+	} else {
+		if ((fd = open(fn, O_RDONLY)) == -1) {
+			LOGE(TAG, "can't open file %s", fn);
+			close(fd);
+			return 1;
+		}
+		if (read(fd, buf, 128) != 128) {
+			LOGE(TAG, "can't read file %s", fn);
+			close(fd);
+			return 1;
+		}
 		close(fd);
-		return 1;
 	}
-	close(fd);
 
 	for (i = 0; i < 128; i++)
 		putmem(i, buf[i]);
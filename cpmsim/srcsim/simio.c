@@ -74,6 +74,7 @@
  *
  *	 4 - auxiliary status
  *	 5 - auxiliary data
+ *	 6 - auxiliary block transfer command and count
  *
  *	10 - FDC drive
  *	11 - FDC track
@@ -110,6 +111,10 @@
  *	50 - client socket #1 status
  *	51 - client socket #1 data
  *
+ *	52 - select passive socket for ports 53 and 54, 0 = socket #1
+ *	53 - selected passive socket status
+ *	54 - selected passive socket data
+ *
  *	160 - hardware control
  */
 
@@ -134,9 +139,22 @@
 
 #include "rtc80.h"
 #include "simbdos.h"
+#ifdef HAS_BDOS_TRAP
+#include "simbdos-trap.h"
+#endif
+#include "unix_outbuf.h"
+#include "unix_blkio.h"
+#ifdef NETWORKING
+#include "generic-ring.h"
+#endif
+#ifdef AUXSHM
+#include <sys/mman.h>
+#include "auxshm.h"
+#endif
 
 #ifdef NETWORKING
 #include <stdio.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -179,6 +197,9 @@ static int printer;		/* fd for file "printer.txt" */
 static char fn[MAX_LFN];	/* path/filename for disk images */
 static int speed;		/* to reset CPU speed */
 static BYTE hwctl_lock = 0xff;	/* lock status hardware control port */
+static outbuf_t cons_ob;	/* output buffer console 0 */
+static outbuf_t prt_ob;		/* output buffer printer */
+static outbuf_t aux_ob;		/* output buffer auxiliary */
 
 #ifdef PIPES
 static int auxin;		/* fd for pipe "auxin" */
@@ -191,17 +212,57 @@ static int aux_in_lf;		/* linefeed flag for aux_in */
 static int aux_out;		/* fd for file "auxiliaryout.txt" */
 #endif
 
-#ifdef NETWORKING
+#ifdef AUXSHM
+#define AUXB_RECLEN	128	/* bytes of a block transfer */
+#define AUXB_TIMEOUT	5000000	/* us to wait for the host tool */
+static auxshm_t *auxshm;	/* shared memory for block transfers */
+static BYTE auxb_count;		/* bytes transferred by last command */
+#endif
 
-#define TELNET_TIMEOUT 800	/* telnet negotiation timeout in milliseconds */
+#ifdef NETWORKING
 
-static int ss[NUMSOC];		/* server socket descriptors */
-static int ssc[NUMSOC];		/* connected server socket descriptors */
-static int ss_port[NUMSOC];	/* TCP/IP port for server sockets */
-static int ss_telnet[NUMSOC];	/* telnet protocol flag for server sockets */
+/*
+ * The server sockets are served by a separate I/O thread, which accepts
+ * connections, does the telnet protocol and moves data between the
+ * sockets and two ring buffers per console. The I/O port handlers of
+ * the CPU only access the ring buffers.
+ */
+#define NCONS_BUFSIZE	4096	/* size of the ring buffers, power of 2 */
+
+typedef struct netcons {
+	int ss;			/* server socket descriptor */
+	int ssc;		/* connected socket, used by I/O thread */
+	int port;		/* TCP/IP port for server socket */
+	int telnet;		/* telnet protocol flag */
+	int tn_state;		/* telnet protocol state of input */
+	BYTE tn_cmd;		/* telnet option command received */
+	bool connected;		/* set by I/O thread, ssc is open */
+	ring_t rx;		/* input, from I/O thread to CPU */
+	ring_t tx;		/* output, from CPU to I/O thread */
+	uint64_t rx_t;		/* time input arrived in empty rx */
+	uint64_t tx_t;		/* time output was put in empty tx */
+	uint64_t in_bytes;	/* bytes received */
+	uint64_t out_bytes;	/* bytes sent */
+	uint64_t in_lat;	/* sum of input latencies in us */
+	uint64_t in_lat_max;	/* max. input latency in us */
+	uint64_t in_n;		/* number of input latencies */
+	uint64_t out_lat;	/* sum of output latencies in us */
+	uint64_t out_lat_max;	/* max. output latency in us */
+	uint64_t out_n;		/* number of output latencies */
+	BYTE rxbuf[NCONS_BUFSIZE];
+	BYTE txbuf[NCONS_BUFSIZE];
+} netcons_t;
+
+static netcons_t ncons[NUMSOC];	/* server socket consoles */
+static BYTE ncons_sel;		/* console selected with port 52 */
+static pthread_t io_thread;	/* I/O thread for the server sockets */
+static int io_pipe[2];		/* pipe to wake up the I/O thread */
+static bool io_sleeping;	/* I/O thread waits in poll() */
+static bool io_stop;		/* stop the I/O thread */
 static int cs;			/* client socket #1 descriptor */
 static int cs_port;		/* TCP/IP port for cs */
 static char cs_host[BUFSIZE];	/* hostname for cs */
+static outbuf_t cs_ob;		/* output buffer client socket #1 */
 
 #ifdef CNETDEBUG
 static int cdirection = -1; /* protocol direction, 0 = send, 1 = receive */
@@ -214,22 +275,37 @@ static int sdirection = -1; /* protocol direction, 0 = send 1 = receive */
 #endif /* NETWORKING */
 
 dskdef_t disks[16] = {
-	{ "drivea.dsk", &drivea, 77, 26 },
-	{ "driveb.dsk", &driveb, 77, 26 },
-	{ "drivec.dsk", &drivec, 77, 26 },
-	{ "drived.dsk", &drived, 77, 26 },
-	{ "drivee.dsk", &drivee,  0,  0 },
-	{ "drivef.dsk", &drivef,  0,  0 },
-	{ "driveg.dsk", &driveg,  0,  0 },
-	{ "driveh.dsk", &driveh,  0,  0 },
-	{ "drivei.dsk", &drivei, 255, 128 },
-	{ "drivej.dsk", &drivej, 255, 128 },
-	{ "drivek.dsk", &drivek, 255, 128 },
-	{ "drivel.dsk", &drivel, 255, 128 },
-	{ "drivem.dsk", &drivem,  0,  0 },
-	{ "driven.dsk", &driven,  0,  0 },
-	{ "driveo.dsk", &driveo,  0,  0 },
-	{ "drivep.dsk", &drivep, 256, 16384 }
+	{ "drivea.dsk", &drivea, 77, 26, NULL, NULL },
+	{ "driveb.dsk", &driveb, 77, 26, NULL, NULL },
+	{ "drivec.dsk", &drivec, 77, 26, NULL, NULL },
+	{ "drived.dsk", &drived, 77, 26, NULL, NULL },
+	{ "drivee.dsk", &drivee,  0,  0, NULL, NULL },
+	{ "drivef.dsk", &drivef,  0,  0, NULL, NULL },
+	{ "driveg.dsk", &driveg,  0,  0, NULL, NULL },
+	{ "driveh.dsk", &driveh,  0,  0, NULL, NULL },
+	{ "drivei.dsk", &drivei, 255, 128, NULL, NULL },
+	{ "drivej.dsk", &drivej, 255, 128, NULL, NULL },
+	{ "drivek.dsk", &drivek, 255, 128, NULL, NULL },
+	{ "drivel.dsk", &drivel, 255, 128, NULL, NULL },
+	{ "drivem.dsk", &drivem,  0,  0, NULL, NULL },
+	{ "driven.dsk", &driven,  0,  0, NULL, NULL },
+	{ "driveo.dsk", &driveo,  0,  0, NULL, NULL },
+	{ "drivep.dsk", &drivep, 256, 16384, NULL, NULL }
+};
+
+/*
+ *	Disk parameters of the BIOS for drives backed by a host
+ *	directory, which is used if the disk image is a directory
+ */
+static const BYTE xlt_8sssd[26] = {	/* sector skew 6 */
+	1, 7, 13, 19, 25, 5, 11, 17, 23, 3, 9, 15, 21,
+	2, 8, 14, 20, 26, 6, 12, 18, 24, 4, 10, 16, 22
+};
+static const hostdisk_dpb_t dpb_8sssd = {	/* drives A-D */
+	26, 3, 0, 242, 63, 2, xlt_8sssd
+};
+static const hostdisk_dpb_t dpb_hd4mb = {	/* drives I-L */
+	128, 4, 0, 2039, 1023, 0, NULL
 };
 
 /*
@@ -241,6 +317,8 @@ static BYTE prtd_in(void), prts_in(void);
 static void prtd_out(BYTE data), prts_out(BYTE data);
 static BYTE auxd_in(void), auxs_in(void);
 static void auxd_out(BYTE data), auxs_out(BYTE data);
+static BYTE auxb_in(void);
+static void auxb_out(BYTE data);
 static BYTE fdcd_in(void);
 static void fdcd_out(BYTE data);
 static BYTE fdct_in(void);
@@ -279,18 +357,27 @@ static BYTE cond4_in(void), cons4_in(void);
 static void cond4_out(BYTE data), cons4_out(BYTE data);
 static BYTE netd1_in(void), nets1_in(void);
 static void netd1_out(BYTE data), nets1_out(BYTE data);
+static BYTE consel_in(void), consm_in(void), condm_in(void);
+static void consel_out(BYTE data), consm_out(BYTE data), condm_out(BYTE data);
 
 /*
  *	Forward declaration of support functions
  */
 static void int_timer(int sig);
+#ifdef AUXSHM
+static void init_auxshm(void);
+#endif
+static void open_hostdisk(int i);
+static void open_cowdisk(int i);
+
+static BYTE net_status(int n), net_data_in(int n);
+static void net_data_out(int n, BYTE data);
 
 #ifdef NETWORKING
 static void net_server_config(void), net_client_config(void);
-static void init_server_socket(int n), telnet_negotiation(int fd);
-#ifdef TCPASYNC
-static void int_io(int sig);
-#endif
+static void init_server_socket(int n);
+static void *net_io_thread(void *arg);
+static void net_report(void);
 #endif
 
 /*
@@ -304,6 +391,7 @@ in_func_t *const port_in[256] = {
 	[  3] = prtd_in,
 	[  4] = auxs_in,
 	[  5] = auxd_in,
+	[  6] = auxb_in,
 	[ 10] = fdcd_in,
 	[ 11] = fdct_in,
 	[ 12] = fdcs_in,
@@ -332,6 +420,9 @@ in_func_t *const port_in[256] = {
 	[ 47] = cond4_in,
 	[ 50] = nets1_in,
 	[ 51] = netd1_in,
+	[ 52] = consel_in,
+	[ 53] = consm_in,
+	[ 54] = condm_in,
 	[160] = hwctl_in	/* virtual hardware control */
 };
 
@@ -346,6 +437,7 @@ out_func_t *const port_out[256] = {
 	[  3] = prtd_out,
 	[  4] = auxs_out,
 	[  5] = auxd_out,
+	[  6] = auxb_out,
 	[ 10] = fdcd_out,
 	[ 11] = fdct_out,
 	[ 12] = fdcs_out,
@@ -374,6 +466,9 @@ out_func_t *const port_out[256] = {
 	[ 47] = cond4_out,
 	[ 50] = nets1_out,
 	[ 51] = netd1_out,
+	[ 52] = consel_out,
+	[ 53] = consm_out,
+	[ 54] = condm_out,
 	[160] = hwctl_out,	/* virtual hardware control */
 	[161] = host_bdos_out	/* host file I/O hook */
 };
@@ -390,14 +485,13 @@ out_func_t *const port_out[256] = {
  *	   in a NULL pointer for fd in the dskdef structure,
  *	   so that this drive can't be used.
  *	5. Prepare TCP/IP sockets for serial port simulation
+ *	6. Setup the output buffers for console, printer, auxiliary
+ *	   and sockets
  */
 void init_io(void)
 {
 	register int i;
 	struct stat sbuf;
-#if defined(NETWORKING) && defined(TCPASYNC)
-	static struct sigaction newact;
-#endif
 
 #ifdef PIPES
 	/* check if /tmp/.z80pack exists */
@@ -439,6 +533,10 @@ void init_io(void)
 	}
 #endif
 
+#ifdef AUXSHM
+	init_auxshm();
+#endif
+
 	for (i = 0; i <= 15; i++) {
 
 		/* if option -d is used disks are there */
@@ -458,27 +556,129 @@ void init_io(void)
 		strcat(fn, "/");
 		strcat(fn, disks[i].fn);
 
+		if ((stat(fn, &sbuf) == 0) && S_ISDIR(sbuf.st_mode)) {
+			open_hostdisk(i);
+			continue;
+		}
+
 		if ((*disks[i].fd = open(fn, O_RDWR)) == -1)
 			if ((*disks[i].fd = open(fn, O_RDONLY)) == -1)
 				disks[i].fd = NULL;
+		if (disks[i].fd != NULL && cowdisk_probe(*disks[i].fd))
+			open_cowdisk(i);
 	}
 
+	outbuf_init(&cons_ob);
+	outbuf_init(&prt_ob);
+	outbuf_init(&aux_ob);
+
+#ifdef HAS_BDOS_TRAP
+	bdos_trap_init();
+#endif
+
 #ifdef NETWORKING
+	outbuf_init(&cs_ob);
+
 	net_server_config();
 	net_client_config();
 
-#ifdef TCPASYNC
-	newact.sa_handler = int_io;
-	sigemptyset(&newact.sa_mask);
-	newact.sa_flags = 0;
-	sigaction(SIGIO, &newact, NULL);
-#endif
-
-	for (i = 0; i < NUMSOC; i++)
+	for (i = 0; i < NUMSOC; i++) {
+		ring_init(&ncons[i].rx, ncons[i].rxbuf, NCONS_BUFSIZE);
+		ring_init(&ncons[i].tx, ncons[i].txbuf, NCONS_BUFSIZE);
 		init_server_socket(i);
+	}
+
+	/* start the I/O thread for the server sockets */
+	if (pipe(io_pipe) == -1) {
+		LOGE(TAG, "can't create pipe for I/O thread");
+		exit(EXIT_FAILURE);
+	}
+	fcntl(io_pipe[0], F_SETFL, fcntl(io_pipe[0], F_GETFL, 0) | O_NONBLOCK);
+	fcntl(io_pipe[1], F_SETFL, fcntl(io_pipe[1], F_GETFL, 0) | O_NONBLOCK);
+	if (pthread_create(&io_thread, NULL, net_io_thread, (void *) NULL)) {
+		LOGE(TAG, "can't create I/O thread");
+		exit(EXIT_FAILURE);
+	}
 #endif /* NETWORKING */
 }
 
+#ifdef AUXSHM
+/*
+ * Create and map the shared memory for the auxiliary block port
+ */
+static void init_auxshm(void)
+{
+	struct stat sbuf;
+	int fd;
+	void *p;
+
+	if (stat("/tmp/.z80pack", &sbuf) != 0)
+		mkdir("/tmp/.z80pack", 0777);
+	if ((fd = open(AUXSHM_FILE, O_RDWR | O_CREAT, 0666)) == -1) {
+		LOGW(TAG, "can't open %s", AUXSHM_FILE);
+		return;
+	}
+	if (ftruncate(fd, sizeof(auxshm_t)) == -1 ||
+	    (p = mmap(NULL, sizeof(auxshm_t), PROT_READ | PROT_WRITE,
+		      MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		LOGW(TAG, "can't map %s", AUXSHM_FILE);
+		close(fd);
+		return;
+	}
+	close(fd);
+	auxshm = p;
+	memset(auxshm, 0, sizeof(auxshm_t));
+	auxshm->ringsz = AUXSHM_RINGSZ;
+	__atomic_store_n(&auxshm->magic, AUXSHM_MAGIC, __ATOMIC_RELEASE);
+}
+#endif
+
+/*
+ * Use the host directory fn as drive i, the drive must have the
+ * geometry of a drive the BIOS has disk parameters for
+ */
+static void open_hostdisk(int i)
+{
+	const hostdisk_dpb_t *dpb;
+
+	if (disks[i].tracks == 77 && disks[i].sectors == 26)
+		dpb = &dpb_8sssd;
+	else if (disks[i].tracks == 255 && disks[i].sectors == 128)
+		dpb = &dpb_hd4mb;
+	else {
+		LOGW(TAG, "drive %c: can't be a host directory", i + 'A');
+		disks[i].fd = NULL;
+		return;
+	}
+	if ((disks[i].hd = hostdisk_open(fn, dpb, disks[i].tracks)) == NULL) {
+		disks[i].fd = NULL;
+		return;
+	}
+	*disks[i].fd = -1;
+	LOG(TAG, "Drive %c: is host directory %s\r\n", i + 'A', fn);
+}
+
+/*
+ * Use the overlay file fn as drive i, the base image it refers to is
+ * only read
+ */
+static void open_cowdisk(int i)
+{
+	bool rdonly = (fcntl(*disks[i].fd, F_GETFL) & O_ACCMODE) == O_RDONLY;
+
+	close(*disks[i].fd);
+	*disks[i].fd = -1;
+	if ((disks[i].cd = cowdisk_open(fn, rdonly)) == NULL) {
+		LOGE(TAG, "drive %c: overlay %s: %s", i + 'A', fn,
+		     errno == ESTALE ? "base image was changed"
+				     : strerror(errno));
+		disks[i].fd = NULL;
+		return;
+	}
+	LOG(TAG, "Drive %c: is overlay %s of %s\r\n", i + 'A', fn,
+	    cowdisk_base(disks[i].cd));
+}
+
 #ifdef NETWORKING
 /*
  * initialize a server socket
@@ -487,38 +687,33 @@ static void init_server_socket(int n)
 {
 	struct sockaddr_in sin;
 	int on = 1;
-#ifdef TCPASYNC
 	int i;
-#endif
 
-	if (ss_port[n] == 0)
+	if (ncons[n].port == 0)
 		return;
-	if ((ss[n] = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+	if ((ncons[n].ss = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
 		LOGE(TAG, "can't create server socket");
 		exit(EXIT_FAILURE);
 	}
-	if (setsockopt(ss[n], SOL_SOCKET, SO_REUSEADDR, (void *) &on,
+	if (setsockopt(ncons[n].ss, SOL_SOCKET, SO_REUSEADDR, (void *) &on,
 		       sizeof(on)) == -1) {
 		LOGE(TAG, "can't setsockopt SO_REUSEADDR on server socket");
 		exit(EXIT_FAILURE);
 	}
-#ifdef TCPASYNC
-	fcntl(ss[n], F_SETOWN, getpid());
-	i = fcntl(ss[n], F_GETFL, 0);
-	if (fcntl(ss[n], F_SETFL, i | O_ASYNC) == -1) {
-		LOGE(TAG, "can't fcntl O_ASYNC on server socket");
+	i = fcntl(ncons[n].ss, F_GETFL, 0);
+	if (fcntl(ncons[n].ss, F_SETFL, i | O_NONBLOCK) == -1) {
+		LOGE(TAG, "can't fcntl O_NONBLOCK on server socket");
 		exit(EXIT_FAILURE);
 	}
-#endif
 	memset((void *) &sin, 0, sizeof(sin));
 	sin.sin_family = AF_INET;
 	sin.sin_addr.s_addr = INADDR_ANY;
-	sin.sin_port = htons(ss_port[n]);
-	if (bind(ss[n], (struct sockaddr *) &sin, sizeof(sin)) == -1) {
+	sin.sin_port = htons(ncons[n].port);
+	if (bind(ncons[n].ss, (struct sockaddr *) &sin, sizeof(sin)) == -1) {
 		LOGE(TAG, "can't bind server socket");
 		exit(EXIT_FAILURE);
 	}
-	if (listen(ss[n], 0) == -1) {
+	if (listen(ncons[n].ss, 0) == -1) {
 		LOGE(TAG, "can't listen on server socket");
 		exit(EXIT_FAILURE);
 	}
@@ -545,7 +740,7 @@ static void net_server_config(void)
 			if ((*s == '\n') || (*s == '#'))
 				continue;
 			i = atoi(s);
-			if ((i < 1) || (i > 4)) {
+			if ((i < 1) || (i > NUMSOC)) {
 				LOGW(TAG, "console %d not supported", i);
 				continue;
 			}
@@ -553,15 +748,15 @@ static void net_server_config(void)
 				s++;
 			while ((*s == ' ') || (*s == '\t'))
 				s++;
-			ss_telnet[i - 1] = atoi(s);
+			ncons[i - 1].telnet = atoi(s);
 			while ((*s != ' ') && (*s != '\t'))
 				s++;
 			while ((*s == ' ') || (*s == '\t'))
 				s++;
-			ss_port[i - 1] = atoi(s);
+			ncons[i - 1].port = atoi(s);
 			LOG(TAG, "console %d listening on port %d, telnet = %s\r\n",
-			    i, ss_port[i - 1],
-			    ((ss_telnet[i - 1] > 0) ? "on" : "off"));
+			    i, ncons[i - 1].port,
+			    ((ncons[i - 1].telnet > 0) ? "on" : "off"));
 		}
 		fclose(fp);
 	}
@@ -612,31 +807,62 @@ static void net_client_config(void)
  *	2. The file "printer.txt" emulating a printer is closed.
  *	3. The named pipes "auxin" and "auxout" are closed.
  *	4. The receiving process for the aux serial port is stopped.
- *	5. All connected sockets are closed
+ *	5. All connected sockets are closed and the socket
+ *	   statistics are reported
  */
 void exit_io(void)
 {
 	register int i;
 
+	/* write all pending output */
+	outbuf_flush_all();
+
 	for (i = 0; i <= 15; i++)
-		if (disks[i].fd != NULL)
+		if (disks[i].hd != NULL) {
+			hostdisk_close(disks[i].hd);
+			disks[i].hd = NULL;
+		} else if (disks[i].cd != NULL) {
+			cowdisk_close(disks[i].cd);
+			disks[i].cd = NULL;
+		} else if (disks[i].fd != NULL)
 			close(*disks[i].fd);
 
-	if (printer != 0)
+#ifdef HAS_BDOS_TRAP
+	bdos_trap_exit();
+#endif
+
+	if (printer != 0) {
+		outbuf_drop(&prt_ob);
 		close(printer);
+	}
+
+#ifdef AUXSHM
+	if (auxshm != NULL) {
+		/* tell the host tools that the simulation is gone */
+		__atomic_store_n(&auxshm->magic, 0, __ATOMIC_RELEASE);
+		munmap(auxshm, sizeof(auxshm_t));
+		auxshm = NULL;
+	}
+#endif
 
 #ifdef PIPES
+	outbuf_drop(&aux_ob);
 	close(auxin);
 	close(auxout);
 	kill(pid_rec, SIGHUP);
 #endif
 
 #ifdef NETWORKING
-	for (i = 0; i < NUMSOC; i++)
-		if (ssc[i])
-			close(ssc[i]);
-	if (cs)
+	/* the I/O thread sends pending output and closes the sockets */
+	__atomic_store_n(&io_stop, true, __ATOMIC_SEQ_CST);
+	if (write(io_pipe[1], "", 1) == 1)
+		pthread_join(io_thread, NULL);
+	net_report();
+
+	if (cs) {
+		outbuf_drop(&cs_ob);
 		close(cs);
+	}
 #endif
 }
 
@@ -675,6 +901,9 @@ static BYTE cons_in(void)
 {
 	struct pollfd p[1];
 
+	/* guest waits for input, show what it has written */
+	outbuf_flush(&cons_ob);
+
 	if (++busy_loop_cnt >= MAX_BUSY_COUNT) {
 		sleep_for_ms(1);
 		busy_loop_cnt = 0;
@@ -697,69 +926,7 @@ static BYTE cons_in(void)
  */
 static BYTE cons1_in(void)
 {
-	BYTE status = 0;
-#ifdef NETWORKING
-	struct pollfd p[1];
-
-#ifndef TCPASYNC
-	socklen_t alen;
-	struct sockaddr_in fsin;
-	int go_away;
-	int on = 1;
-
-	if (ss[0] == 0)
-		return status;
-
-	p[0].fd = ss[0];
-	p[0].events = POLLIN;
-	p[0].revents = 0;
-	poll(p, 1, 0);
-
-	if (p[0].revents) {
-
-		alen = sizeof(fsin);
-
-		if (ssc[0] != 0) {
-			go_away = accept(ss[0],
-					 (struct sockaddr *) &fsin, &alen);
-			close(go_away);
-			goto ss0_done;
-		}
-
-		if ((ssc[0] = accept(ss[0], (struct sockaddr *) &fsin,
-				     &alen)) == -1) {
-			LOGW(TAG, "can't accept server socket");
-			ssc[0] = 0;
-		}
-
-		if (setsockopt(ssc[0], IPPROTO_TCP, TCP_NODELAY,
-			       (void *) &on, sizeof(on)) == -1) {
-			LOGW(TAG, "can't setsockopt TCP_NODELAY on server socket");
-		}
-
-		if (ss_telnet[0])
-			telnet_negotiation(ssc[0]);
-	}
-ss0_done:
-#endif /* !TCPASYNC */
-
-	if (ssc[0] != 0) {
-		p[0].fd = ssc[0];
-		p[0].events = POLLIN | POLLOUT;
-		p[0].revents = 0;
-		poll(p, 1, 0);
-		if (p[0].revents & POLLHUP) {
-			close(ssc[0]);
-			ssc[0] = 0;
-			return 0;
-		}
-		if (p[0].revents & POLLIN)
-			status |= 1;
-		if (p[0].revents & POLLOUT)
-			status |= 2;
-	}
-#endif /* NETWORKING */
-	return status;
+	return net_status(0);
 }
 
 /*
@@ -769,69 +936,7 @@ ss0_done:
  */
 static BYTE cons2_in(void)
 {
-	BYTE status = 0;
-#ifdef NETWORKING
-	struct pollfd p[1];
-
-#ifndef TCPASYNC
-	socklen_t alen;
-	struct sockaddr_in fsin;
-	int go_away;
-	int on = 1;
-
-	if (ss[1] == 0)
-		return status;
-
-	p[0].fd = ss[1];
-	p[0].events = POLLIN;
-	p[0].revents = 0;
-	poll(p, 1, 0);
-
-	if (p[0].revents) {
-
-		alen = sizeof(fsin);
-
-		if (ssc[1] != 0) {
-			go_away = accept(ss[1],
-					 (struct sockaddr *) &fsin, &alen);
-			close(go_away);
-			goto ss1_done;
-		}
-
-		if ((ssc[1] = accept(ss[1], (struct sockaddr *) &fsin,
-				     &alen)) == -1) {
-			LOGW(TAG, "can't accept server socket");
-			ssc[1] = 0;
-		}
-
-		if (setsockopt(ssc[1], IPPROTO_TCP, TCP_NODELAY,
-			       (void *) &on, sizeof(on)) == -1) {
-			LOGW(TAG, "can't setsockopt TCP_NODELAY on server socket");
-		}
-
-		if (ss_telnet[1])
-			telnet_negotiation(ssc[1]);
-	}
-ss1_done:
-#endif /* !TCPASYNC */
-
-	if (ssc[1] != 0) {
-		p[0].fd = ssc[1];
-		p[0].events = POLLIN | POLLOUT;
-		p[0].revents = 0;
-		poll(p, 1, 0);
-		if (p[0].revents & POLLHUP) {
-			close(ssc[1]);
-			ssc[1] = 0;
-			return 0;
-		}
-		if (p[0].revents & POLLIN)
-			status |= 1;
-		if (p[0].revents & POLLOUT)
-			status |= 2;
-	}
-#endif /* NETWORKING */
-	return status;
+	return net_status(1);
 }
 
 /*
@@ -841,69 +946,7 @@ ss1_done:
  */
 static BYTE cons3_in(void)
 {
-	BYTE status = 0;
-#ifdef NETWORKING
-	struct pollfd p[1];
-
-#ifndef TCPASYNC
-	socklen_t alen;
-	struct sockaddr_in fsin;
-	int go_away;
-	int on = 1;
-
-	if (ss[2] == 0)
-		return status;
-
-	p[0].fd = ss[2];
-	p[0].events = POLLIN;
-	p[0].revents = 0;
-	poll(p, 1, 0);
-
-	if (p[0].revents) {
-
-		alen = sizeof(fsin);
-
-		if (ssc[2] != 0) {
-			go_away = accept(ss[2],
-					 (struct sockaddr *) &fsin, &alen);
-			close(go_away);
-			goto ss2_done;
-		}
-
-		if ((ssc[2] = accept(ss[2], (struct sockaddr *) &fsin,
-				     &alen)) == -1) {
-			LOGW(TAG, "can't accept server socket");
-			ssc[2] = 0;
-		}
-
-		if (setsockopt(ssc[2], IPPROTO_TCP, TCP_NODELAY,
-			       (void *) &on, sizeof(on)) == -1) {
-			LOGW(TAG, "can't setsockopt TCP_NODELAY on server socket");
-		}
-
-		if (ss_telnet[2])
-			telnet_negotiation(ssc[2]);
-	}
-ss2_done:
-#endif /* !TCPASYNC */
-
-	if (ssc[2] != 0) {
-		p[0].fd = ssc[2];
-		p[0].events = POLLIN | POLLOUT;
-		p[0].revents = 0;
-		poll(p, 1, 0);
-		if (p[0].revents & POLLHUP) {
-			close(ssc[2]);
-			ssc[2] = 0;
-			return 0;
-		}
-		if (p[0].revents & POLLIN)
-			status |= 1;
-		if (p[0].revents & POLLOUT)
-			status |= 2;
-	}
-#endif /* NETWORKING */
-	return status;
+	return net_status(2);
 }
 
 /*
@@ -913,69 +956,7 @@ ss2_done:
  */
 static BYTE cons4_in(void)
 {
-	BYTE status = 0;
-#ifdef NETWORKING
-	struct pollfd p[1];
-
-#ifndef TCPASYNC
-	socklen_t alen;
-	struct sockaddr_in fsin;
-	int go_away;
-	int on = 1;
-
-	if (ss[3] == 0)
-		return status;
-
-	p[0].fd = ss[3];
-	p[0].events = POLLIN;
-	p[0].revents = 0;
-	poll(p, 1, 0);
-
-	if (p[0].revents) {
-
-		alen = sizeof(fsin);
-
-		if (ssc[3] != 0) {
-			go_away = accept(ss[3],
-					 (struct sockaddr *) &fsin, &alen);
-			close(go_away);
-			goto ss3_done;
-		}
-
-		if ((ssc[3] = accept(ss[3], (struct sockaddr *) &fsin,
-				     &alen)) == -1) {
-			LOGW(TAG, "can't accept server socket");
-			ssc[3] = 0;
-		}
-
-		if (setsockopt(ssc[3], IPPROTO_TCP, TCP_NODELAY,
-			       (void *) &on, sizeof(on)) == -1) {
-			LOGW(TAG, "can't setsockopt TCP_NODELAY on server socket");
-		}
-
-		if (ss_telnet[3])
-			telnet_negotiation(ssc[3]);
-	}
-ss3_done:
-#endif /* !TCPASYNC */
-
-	if (ssc[3] != 0) {
-		p[0].fd = ssc[3];
-		p[0].events = POLLIN | POLLOUT;
-		p[0].revents = 0;
-		poll(p, 1, 0);
-		if (p[0].revents & POLLHUP) {
-			close(ssc[3]);
-			ssc[3] = 0;
-			return 0;
-		}
-		if (p[0].revents & POLLIN)
-			status |= 1;
-		if (p[0].revents & POLLOUT)
-			status |= 2;
-	}
-#endif /* NETWORKING */
-	return status;
+	return net_status(3);
 }
 
 /*
@@ -1034,11 +1015,13 @@ static BYTE nets1_in(void)
 	}
 
 	if (cs != 0) {
+		outbuf_flush(&cs_ob);
 		p[0].fd = cs;
 		p[0].events = POLLIN | POLLOUT;
 		p[0].revents = 0;
 		poll(p, 1, 0);
 		if (p[0].revents & POLLHUP) {
+			outbuf_drop(&cs_ob);
 			close(cs);
 			cs = 0;
 			return (BYTE) 0;
@@ -1114,6 +1097,7 @@ static BYTE cond_in(void)
 	char c;
 
 	busy_loop_cnt = 0;
+	outbuf_flush(&cons_ob);
 	if (read(fileno(stdin), &c, 1) != 1)
 		LOGE(TAG, "can't read console 0");
 	return (BYTE) c;
@@ -1124,36 +1108,7 @@ static BYTE cond_in(void)
  */
 static BYTE cond1_in(void)
 {
-	char c;
-#ifdef NETWORKING
-	char x;
-
-	if (read(ssc[0], &c, 1) != 1) {
-		if ((errno == EAGAIN) || (errno == EINTR)) {
-			close(ssc[0]);
-			ssc[0] = 0;
-			return (BYTE) 0;
-		} else {
-			LOGE(TAG, "can't read console 1");
-			cpu_error = IOERROR;
-			cpu_state = ST_STOPPED;
-			return (BYTE) 0;
-		}
-	}
-	if (ss_telnet[0] && (c == '\r'))
-		if (read(ssc[0], &x, 1) != 1)
-			LOGE(TAG, "can't read console 1");
-#ifdef SNETDEBUG
-	if (sdirection != 1) {
-		printf("\n<- ");
-		sdirection = 1;
-	}
-	printf("%02x ", (BYTE) c);
-#endif
-#else /* !NETWORKING */
-	c = 0;
-#endif
-	return (BYTE) c;
+	return net_data_in(0);
 }
 
 /*
@@ -1161,73 +1116,15 @@ static BYTE cond1_in(void)
  */
 static BYTE cond2_in(void)
 {
-	char c;
-#ifdef NETWORKING
-	char x;
-
-	if (read(ssc[1], &c, 1) != 1) {
-		if ((errno == EAGAIN) || (errno == EINTR)) {
-			close(ssc[1]);
-			ssc[1] = 0;
-			return (BYTE) 0;
-		} else {
-			LOGE(TAG, "can't read console 2");
-			cpu_error = IOERROR;
-			cpu_state = ST_STOPPED;
-			return (BYTE) 0;
-		}
-	}
-	if (ss_telnet[1] && (c == '\r'))
-		if (read(ssc[1], &x, 1) != 1)
-			LOGE(TAG, "can't read console 2");
-#ifdef SNETDEBUG
-	if (sdirection != 1) {
-		printf("\n<- ");
-		sdirection = 1;
-	}
-	printf("%02x ", (BYTE) c);
-#endif
-#else /* !NETWORKING */
-	c = 0;
-#endif
-	return (BYTE) c;
-}
+	return net_data_in(1);
+}
 
 /*
  *	I/O handler for read console 3 data
  */
 static BYTE cond3_in(void)
 {
-	char c;
-#ifdef NETWORKING
-	char x;
-
-	if (read(ssc[2], &c, 1) != 1) {
-		if ((errno == EAGAIN) || (errno == EINTR)) {
-			close(ssc[2]);
-			ssc[2] = 0;
-			return (BYTE) 0;
-		} else {
-			LOGE(TAG, "can't read console 3");
-			cpu_error = IOERROR;
-			cpu_state = ST_STOPPED;
-			return (BYTE) 0;
-		}
-	}
-	if (ss_telnet[2] && (c == '\r'))
-		if (read(ssc[2], &x, 1) != 1)
-			LOGE(TAG, "can't read console 3");
-#ifdef SNETDEBUG
-	if (sdirection != 1) {
-		printf("\n<- ");
-		sdirection = 1;
-	}
-	printf("%02x ", (BYTE) c);
-#endif
-#else /* !NETWORKING */
-	c = 0;
-#endif
-	return (BYTE) c;
+	return net_data_in(2);
 }
 
 /*
@@ -1235,36 +1132,7 @@ static BYTE cond3_in(void)
  */
 static BYTE cond4_in(void)
 {
-	char c;
-#ifdef NETWORKING
-	char x;
-
-	if (read(ssc[3], &c, 1) != 1) {
-		if ((errno == EAGAIN) || (errno == EINTR)) {
-			close(ssc[3]);
-			ssc[3] = 0;
-			return (BYTE) 0;
-		} else {
-			LOGE(TAG, "can't read console 4");
-			cpu_error = IOERROR;
-			cpu_state = ST_STOPPED;
-			return (BYTE) 0;
-		}
-	}
-	if (ss_telnet[3] && (c == '\r'))
-		if (read(ssc[3], &x, 1) != 1)
-			LOGE(TAG, "can't read console 4");
-#ifdef SNETDEBUG
-	if (sdirection != 1) {
-		printf("\n<- ");
-		sdirection = 1;
-	}
-	printf("%02x ", (BYTE) c);
-#endif
-#else /* !NETWORKING */
-	c = 0;
-#endif
-	return (BYTE) c;
+	return net_data_in(3);
 }
 
 /*
@@ -1275,6 +1143,7 @@ static BYTE netd1_in(void)
 	char c;
 
 #ifdef NETWORKING
+	outbuf_flush(&cs_ob);
 	if (read(cs, &c, 1) != 1) {
 		LOGE(TAG, "can't read client socket");
 		cpu_error = IOERROR;
@@ -1296,19 +1165,15 @@ static BYTE netd1_in(void)
 
 /*
  *	I/O handler for write console 0 data:
- *	the output is written to the terminal
+ *	the output is buffered and written to the terminal
+ *	when the guest polls for input, or after a short delay
  */
 static void cond_out(BYTE data)
 {
-again:
-	if (write(fileno(stdout), (char *) &data, 1) != 1) {
-		if (errno == EINTR) {
-			goto again;
-		} else {
-			LOGE(TAG, "can't write console 0");
-			cpu_error = IOERROR;
-			cpu_state = ST_STOPPED;
-		}
+	if (outbuf_put(&cons_ob, fileno(stdout), data) == -1) {
+		LOGE(TAG, "can't write console 0");
+		cpu_error = IOERROR;
+		cpu_state = ST_STOPPED;
 	}
 }
 
@@ -1318,27 +1183,7 @@ again:
  */
 static void cond1_out(BYTE data)
 {
-#ifdef NETWORKING
-#ifdef SNETDEBUG
-	if (sdirection != 0) {
-		printf("\n-> ");
-		sdirection = 0;
-	}
-	printf("%02x ", (BYTE) data);
-#endif
-again:
-	if (write(ssc[0], (char *) &data, 1) != 1) {
-		if (errno == EINTR) {
-			goto again;
-		} else {
-			LOGE(TAG, "can't write console 1");
-			cpu_error = IOERROR;
-			cpu_state = ST_STOPPED;
-		}
-	}
-#else /* !NETWORKING */
-	UNUSED(data);
-#endif
+	net_data_out(0, data);
 }
 
 /*
@@ -1347,27 +1192,7 @@ again:
  */
 static void cond2_out(BYTE data)
 {
-#ifdef NETWORKING
-#ifdef SNETDEBUG
-	if (sdirection != 0) {
-		printf("\n-> ");
-		sdirection = 0;
-	}
-	printf("%02x ", (BYTE) data);
-#endif
-again:
-	if (write(ssc[1], (char *) &data, 1) != 1) {
-		if (errno == EINTR) {
-			goto again;
-		} else {
-			LOGE(TAG, "can't write console 2");
-			cpu_error = IOERROR;
-			cpu_state = ST_STOPPED;
-		}
-	}
-#else /* !NETWORKING */
-	UNUSED(data);
-#endif
+	net_data_out(1, data);
 }
 
 /*
@@ -1376,27 +1201,7 @@ again:
  */
 static void cond3_out(BYTE data)
 {
-#ifdef NETWORKING
-#ifdef SNETDEBUG
-	if (sdirection != 0) {
-		printf("\n-> ");
-		sdirection = 0;
-	}
-	printf("%02x ", (BYTE) data);
-#endif
-again:
-	if (write(ssc[2], (char *) &data, 1) != 1) {
-		if (errno == EINTR) {
-			goto again;
-		} else {
-			LOGE(TAG, "can't write console 3");
-			cpu_error = IOERROR;
-			cpu_state = ST_STOPPED;
-		}
-	}
-#else /* !NETWORKING */
-	UNUSED(data);
-#endif
+	net_data_out(2, data);
 }
 
 /*
@@ -1405,27 +1210,7 @@ again:
  */
 static void cond4_out(BYTE data)
 {
-#ifdef NETWORKING
-#ifdef SNETDEBUG
-	if (sdirection != 0) {
-		printf("\n-> ");
-		sdirection = 0;
-	}
-	printf("%02x ", (BYTE) data);
-#endif
-again:
-	if (write(ssc[3], (char *) &data, 1) != 1) {
-		if (errno == EINTR) {
-			goto again;
-		} else {
-			LOGE(TAG, "can't write console 4");
-			cpu_error = IOERROR;
-			cpu_state = ST_STOPPED;
-		}
-	}
-#else /* !NETWORKING */
-	UNUSED(data);
-#endif
+	net_data_out(3, data);
 }
 
 /*
@@ -1442,21 +1227,89 @@ static void netd1_out(BYTE data)
 	}
 	printf("%02x ", (BYTE) data);
 #endif
-again:
-	if (write(cs, (char *) &data, 1) != 1) {
-		if (errno == EINTR) {
-			goto again;
-		} else {
-			LOGE(TAG, "can't write client socket");
-			cpu_error = IOERROR;
-			cpu_state = ST_STOPPED;
-		}
+	if (outbuf_put(&cs_ob, cs, data) == -1) {
+		LOGE(TAG, "can't write client socket");
+		cpu_error = IOERROR;
+		cpu_state = ST_STOPPED;
 	}
 #else /* !NETWORKING */
 	UNUSED(data);
 #endif
 }
 
+/*
+ *	I/O handler for read console select:
+ *	return the selected console
+ */
+static BYTE consel_in(void)
+{
+#ifdef NETWORKING
+	return ncons_sel;
+#else
+	return (BYTE) 0xff;
+#endif
+}
+
+/*
+ *	I/O handler for write console select:
+ *	select the console for ports 53 and 54, 0 = console 1
+ */
+static void consel_out(BYTE data)
+{
+#ifdef NETWORKING
+	ncons_sel = data;
+#else
+	UNUSED(data);
+#endif
+}
+
+/*
+ *	I/O handler for read selected console status:
+ *	bit 0 = 1: input available
+ *	bit 1 = 1: output writable
+ */
+static BYTE consm_in(void)
+{
+#ifdef NETWORKING
+	return net_status(ncons_sel);
+#else
+	return (BYTE) 0;
+#endif
+}
+
+/*
+ *	I/O handler for write selected console status:
+ *	no function
+ */
+static void consm_out(BYTE data)
+{
+	UNUSED(data);
+}
+
+/*
+ *	I/O handler for read selected console data
+ */
+static BYTE condm_in(void)
+{
+#ifdef NETWORKING
+	return net_data_in(ncons_sel);
+#else
+	return (BYTE) 0;
+#endif
+}
+
+/*
+ *	I/O handler for write selected console data
+ */
+static void condm_out(BYTE data)
+{
+#ifdef NETWORKING
+	net_data_out(ncons_sel, data);
+#else
+	UNUSED(data);
+#endif
+}
+
 /*
  *	I/O handler for read printer status:
  *	the printer is ready all the time
@@ -1501,15 +1354,10 @@ static void prtd_out(BYTE data)
 	}
 
 	if (data != '\r') {
-again:
-		if (write(printer, (char *) &data, 1) != 1) {
-			if (errno == EINTR) {
-				goto again;
-			} else {
-				LOGE(TAG, "can't write to printer.txt");
-				cpu_error = IOERROR;
-				cpu_state = ST_STOPPED;
-			}
+		if (outbuf_put(&prt_ob, printer, data) == -1) {
+			LOGE(TAG, "can't write to printer.txt");
+			cpu_error = IOERROR;
+			cpu_state = ST_STOPPED;
 		}
 	}
 }
@@ -1596,7 +1444,7 @@ static void auxd_out(BYTE data)
 		return;
 
 	if (data != '\r')
-		if (write(auxout, (char *) &data, 1) != 1)
+		if (outbuf_put(&aux_ob, auxout, data) == -1)
 			LOGE(TAG, "can't write to auxout pipe");
 #else
 	if (data == 0)
@@ -1612,17 +1460,97 @@ static void auxd_out(BYTE data)
 	}
 
 	if (data == 0x1a) {
+		outbuf_flush(&aux_ob);
+		outbuf_drop(&aux_ob);
 		close(aux_out);
 		aux_out = 0;
 		return;
 	}
 
 	if (data != '\r')
-		if (write(aux_out, (char *) &data, 1) != 1)
+		if (outbuf_put(&aux_ob, aux_out, data) == -1)
 			LOGE(TAG, "can't write to auxiliaryout.txt");
 #endif
 }
 
+/*
+ *	I/O handler for read aux block count:
+ *	return number of bytes transferred by the last block command
+ */
+static BYTE auxb_in(void)
+{
+#ifdef AUXSHM
+	return auxb_count;
+#else
+	return (BYTE) 0;
+#endif
+}
+
+/*
+ *	I/O handler for write aux block command:
+ *	transfer up to 128 bytes between the DMA address
+ *	and the shared memory rings of the host tools,
+ *	0 = read, 1 = write, 2 = end of output
+ *
+ *	A read returns less than 128 bytes only for the last
+ *	block the host sends, and 0 bytes if there is no more.
+ *	Both wait while the host tool is attached but not ready,
+ *	at most AUXB_TIMEOUT.
+ */
+static void auxb_out(BYTE data)
+{
+#ifdef AUXSHM
+	register int i;
+	WORD addr = (dmadh << 8) + dmadl;
+	BYTE buf[AUXB_RECLEN];
+	auxshm_ring_t *r;
+	uint64_t t = 0;
+
+	auxb_count = 0;
+	if (auxshm == NULL)
+		return;
+
+	switch (data) {
+	case 0:	/* read */
+		r = &auxshm->in;
+		while (auxshm_count(r) < AUXB_RECLEN &&
+		       !__atomic_load_n(&r->eof, __ATOMIC_ACQUIRE) &&
+		       __atomic_load_n(&r->active, __ATOMIC_ACQUIRE)) {
+			if (t == 0)
+				t = get_clock_us();
+			else if (get_clock_us() - t > AUXB_TIMEOUT)
+				break;
+			sleep_for_us(100);
+		}
+		auxb_count = auxshm_get(r, buf, AUXB_RECLEN);
+		for (i = 0; i < auxb_count; i++)
+			dma_write(addr + i, buf[i]);
+		break;
+	case 1:	/* write */
+		r = &auxshm->out;
+		for (i = 0; i < AUXB_RECLEN; i++)
+			buf[i] = dma_read(addr + i);
+		while (auxshm_space(r) < AUXB_RECLEN &&
+		       __atomic_load_n(&r->active, __ATOMIC_ACQUIRE)) {
+			if (t == 0)
+				t = get_clock_us();
+			else if (get_clock_us() - t > AUXB_TIMEOUT)
+				break;
+			sleep_for_us(100);
+		}
+		auxb_count = auxshm_put(r, buf, AUXB_RECLEN);
+		break;
+	case 2:	/* end of output */
+		__atomic_store_n(&auxshm->out.eof, 1, __ATOMIC_RELEASE);
+		break;
+	default:
+		break;
+	}
+#else
+	UNUSED(data);
+#endif
+}
+
 /*
  *	I/O handler for read FDC drive:
  *	return the current drive
@@ -1723,6 +1651,7 @@ static void fdco_out(BYTE data)
 {
 	register int i;
 	off_t pos;
+	ssize_t n;
 	static char buf[128];
 
 	if (disks[drive].fd == NULL) {
@@ -1738,13 +1667,19 @@ static void fdco_out(BYTE data)
 		return;
 	}
 	pos = (((off_t) track) * ((off_t) disks[drive].sectors) + sector - 1) << 7;
-	if (lseek(*disks[drive].fd, pos, SEEK_SET) == -1L) {
+	if (pos < 0) {
 		status = 4;
 		return;
 	}
 	switch (data) {
 	case 0:	/* read */
-		if (read(*disks[drive].fd, buf, 128) != 128)
+		if (disks[drive].hd != NULL)
+			n = hostdisk_read(disks[drive].hd, buf, 128, pos);
+		else if (disks[drive].cd != NULL)
+			n = cowdisk_read(disks[drive].cd, buf, 128, pos);
+		else
+			n = blk_read(*disks[drive].fd, buf, 128, pos);
+		if (n != 128)
 			status = 5;
 		else {
 			for (i = 0; i < 128; i++)
@@ -1755,7 +1690,13 @@ static void fdco_out(BYTE data)
 	case 1:	/* write */
 		for (i = 0; i < 128; i++)
 			buf[i] = dma_read((dmadh << 8) + dmadl + i);
-		if (write(*disks[drive].fd, buf, 128) != 128)
+		if (disks[drive].hd != NULL)
+			n = hostdisk_write(disks[drive].hd, buf, 128, pos);
+		else if (disks[drive].cd != NULL)
+			n = cowdisk_write(disks[drive].cd, buf, 128, pos);
+		else
+			n = blk_write(*disks[drive].fd, buf, 128, pos);
+		if (n != 128)
 			status = 6;
 		else
 			status = 0;
@@ -2102,100 +2043,478 @@ static void int_timer(int sig)
 	int_data = 0xff;	/* RST 38H for IM 0, 0FFH for IM 2 */
 }
 
-#if defined(NETWORKING) && defined(TCPASYNC)
 /*
- *	SIGIO interrupt handler
+ *	Status of server socket console n:
+ *	bit 0 = 1: input available
+ *	bit 1 = 1: output writable
  */
-static void int_io(int sig)
+static BYTE net_status(int n)
 {
-	register int i;
-	struct sockaddr_in fsin;
-	socklen_t alen;
-	struct pollfd p[NUMSOC];
-	int go_away;
-	int on = 1;
+	BYTE status = 0;
+#ifdef NETWORKING
+	netcons_t *c = &ncons[n];
 
-	UNUSED(sig);
+	if (n >= NUMSOC)
+		return status;
 
-	for (i = 0; i < NUMSOC; i++) {
-		p[i].fd = ss[i];
-		p[i].events = POLLIN;
-		p[i].revents = 0;
+	if (!__atomic_load_n(&c->connected, __ATOMIC_ACQUIRE)) {
+		/* forget input left from the last connection */
+		ring_flush(&c->rx);
+		return status;
 	}
+	if (ring_count(&c->rx) > 0)
+		status |= 1;
+	if (ring_space(&c->tx) > 0)
+		status |= 2;
+#else /* !NETWORKING */
+	UNUSED(n);
+#endif
+	return status;
+}
 
-	poll(p, NUMSOC, 0);
+#ifdef NETWORKING
+/*
+ *	Add a latency sample to a sum and maximum
+ */
+static inline void net_latency(uint64_t t, uint64_t *sum, uint64_t *max,
+			       uint64_t *cnt)
+{
+	t = get_clock_us() - t;
+	*sum += t;
+	if (t > *max)
+		*max = t;
+	(*cnt)++;
+}
 
-	for (i = 0; i < NUMSOC; i++) {
-		if ((ss[i] != 0) && (p[i].revents)) {
-			alen = sizeof(fsin);
-
-			if (ssc[i] != 0) {
-				go_away = accept(ss[i],
-						 (struct sockaddr *) &fsin,
-						 &alen);
-				close(go_away);
-				return;
-			}
+/*
+ *	Wake up the I/O thread if it is waiting in poll(),
+ *	called after output was put into a ring buffer
+ */
+static void net_wake(void)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_exchange_n(&io_sleeping, false, __ATOMIC_SEQ_CST))
+		if (write(io_pipe[1], "", 1) != 1)
+			LOGD(TAG, "can't wake up I/O thread");
+}
+#endif
 
-			if ((ssc[i] = accept(ss[i], (struct sockaddr *) &fsin,
-					     &alen)) == -1) {
-				LOGW(TAG, "can't accept on server socket");
-				ssc[i] = 0;
-			}
+/*
+ *	Read data from server socket console n,
+ *	waits for input if there is none
+ */
+static BYTE net_data_in(int n)
+{
+	BYTE data = 0;
+#ifdef NETWORKING
+	netcons_t *c = &ncons[n];
+	uint64_t t;
 
-			if (setsockopt(ssc[i], IPPROTO_TCP, TCP_NODELAY,
-				       (void *) &on, sizeof(on)) == -1) {
-				LOGW(TAG, "can't setsockopt TCP_NODELAY on server socket");
-			}
+	if (n >= NUMSOC)
+		return data;
 
-			if (ss_telnet[i])
-				telnet_negotiation(ssc[i]);
-		}
+	while (ring_count(&c->rx) == 0) {
+		if (!__atomic_load_n(&c->connected, __ATOMIC_ACQUIRE))
+			return data;
+		sleep_for_ms(1);
+	}
+
+	/* time from arrival of the input until the guest read it */
+	if ((t = __atomic_exchange_n(&c->rx_t, 0, __ATOMIC_ACQ_REL)) != 0)
+		net_latency(t, &c->in_lat, &c->in_lat_max, &c->in_n);
+
+	ring_get(&c->rx, &data, 1);
+#ifdef SNETDEBUG
+	if (sdirection != 1) {
+		printf("\n<- ");
+		sdirection = 1;
+	}
+	printf("%02x ", data);
+#endif
+#else /* !NETWORKING */
+	UNUSED(n);
+#endif
+	return data;
+}
+
+/*
+ *	Write data to server socket console n,
+ *	waits if the output ring buffer is full
+ */
+static void net_data_out(int n, BYTE data)
+{
+#ifdef NETWORKING
+	netcons_t *c = &ncons[n];
+
+	if (n >= NUMSOC)
+		return;
+
+#ifdef SNETDEBUG
+	if (sdirection != 0) {
+		printf("\n-> ");
+		sdirection = 0;
+	}
+	printf("%02x ", data);
+#endif
+
+	while (ring_space(&c->tx) == 0) {
+		/* output without connection is lost */
+		if (!__atomic_load_n(&c->connected, __ATOMIC_ACQUIRE))
+			return;
+		net_wake();
+		sleep_for_us(100);
 	}
+	if (!__atomic_load_n(&c->connected, __ATOMIC_ACQUIRE))
+		return;
+
+	if (ring_space(&c->tx) == NCONS_BUFSIZE)
+		__atomic_store_n(&c->tx_t, get_clock_us(), __ATOMIC_RELEASE);
+	ring_put(&c->tx, &data, 1);
+	net_wake();
+#else /* !NETWORKING */
+	UNUSED(n);
+	UNUSED(data);
+#endif
 }
-#endif /* NETWORKING && TCPASYNC */
 
 #ifdef NETWORKING
 /*
- *	do the telnet option negotiation
+ *	The rest is the I/O thread for the server sockets
  */
-void telnet_negotiation(int fd)
+
+/* telnet protocol */
+#define TN_SE		240
+#define TN_SB		250
+#define TN_WILL		251
+#define TN_WONT		252
+#define TN_DO		253
+#define TN_DONT		254
+#define TN_IAC		255
+#define TN_ECHO		1
+#define TN_SGA		3
+
+/* states of the telnet input filter */
+#define TS_DATA		0	/* normal data */
+#define TS_CR		1	/* CR received */
+#define TS_IAC		2	/* IAC received */
+#define TS_OPT		3	/* option command received */
+#define TS_SB		4	/* in subnegotiation */
+#define TS_SBIAC	5	/* IAC in subnegotiation */
+
+/*
+ *	Send data to a socket from the I/O thread, used for the
+ *	few bytes of the telnet protocol
+ */
+static void net_send(netcons_t *c, const BYTE *p, int len)
+{
+	if (write(c->ssc, p, len) != len)
+		LOGW(TAG, "can't send telnet option to port %d", c->port);
+}
+
+/*
+ *	Remove the telnet protocol from the received data in buf,
+ *	the options we need are requested when the connection is made,
+ *	all others offered are rejected. Returns the remaining length.
+ */
+static int net_telnet(netcons_t *c, BYTE *buf, int len)
+{
+	int i, n = 0;
+	BYTE b, reply[3];
+
+	for (i = 0; i < len; i++) {
+		b = buf[i];
+		switch (c->tn_state) {
+		case TS_CR:
+			/* telnet client sends \r\n or \r\0, drop second */
+			c->tn_state = TS_DATA;
+			if (b == '\n' || b == '\0')
+				break;
+			/* fall through */
+		case TS_DATA:
+			if (b == TN_IAC)
+				c->tn_state = TS_IAC;
+			else {
+				buf[n++] = b;
+				if (b == '\r')
+					c->tn_state = TS_CR;
+			}
+			break;
+		case TS_IAC:
+			if (b == TN_IAC) {
+				buf[n++] = b;
+				c->tn_state = TS_DATA;
+			} else if (b >= TN_WILL && b <= TN_DONT) {
+				c->tn_cmd = b;
+				c->tn_state = TS_OPT;
+			} else if (b == TN_SB)
+				c->tn_state = TS_SB;
+			else
+				c->tn_state = TS_DATA;
+			break;
+		case TS_OPT:
+			c->tn_state = TS_DATA;
+			LOGD(TAG, "telnet: %d %d %d", TN_IAC, c->tn_cmd, b);
+			if (b == TN_ECHO || b == TN_SGA)
+				break;	/* answers to our requests */
+			reply[0] = TN_IAC;
+			reply[2] = b;
+			if (c->tn_cmd == TN_WILL) {
+				reply[1] = TN_DONT;
+				net_send(c, reply, 3);
+			} else if (c->tn_cmd == TN_DO) {
+				reply[1] = TN_WONT;
+				net_send(c, reply, 3);
+			}
+			break;
+		case TS_SB:
+			if (b == TN_IAC)
+				c->tn_state = TS_SBIAC;
+			break;
+		case TS_SBIAC:
+			c->tn_state = (b == TN_SE) ? TS_DATA : TS_SB;
+			break;
+		default:
+			break;
+		}
+	}
+
+	return n;
+}
+
+/*
+ *	Accept a connection on the server socket of a console, a second
+ *	connection to the same console is closed right away
+ */
+static void net_accept(netcons_t *c)
+{
+	static const BYTE options[6] = {
+		TN_IAC, TN_WILL, TN_SGA,	/* character mode */
+		TN_IAC, TN_WILL, TN_ECHO	/* we echo */
+	};
+	int fd, on = 1;
+
+	if ((fd = accept(c->ss, NULL, NULL)) == -1) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			LOGW(TAG, "can't accept server socket");
+		return;
+	}
+	if (c->ssc != 0) {
+		close(fd);
+		return;
+	}
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+	if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
+		       (void *) &on, sizeof(on)) == -1) {
+		LOGW(TAG, "can't setsockopt TCP_NODELAY on server socket");
+	}
+
+	c->ssc = fd;
+	c->tn_state = TS_DATA;
+	if (c->telnet)
+		net_send(c, options, sizeof(options));
+	__atomic_store_n(&c->connected, true, __ATOMIC_RELEASE);
+}
+
+/*
+ *	Close the connection of a console, output not sent is dropped
+ */
+static void net_close(netcons_t *c)
+{
+	__atomic_store_n(&c->connected, false, __ATOMIC_RELEASE);
+	close(c->ssc);
+	c->ssc = 0;
+	ring_flush(&c->tx);
+}
+
+/*
+ *	Move received data of a console into its input ring buffer,
+ *	reads no more than fits into the ring buffer
+ */
+static void net_read(netcons_t *c)
+{
+	BYTE buf[NCONS_BUFSIZE];
+	unsigned space = ring_space(&c->rx);
+	int n;
+
+	if (space == 0)
+		return;
+	if ((n = read(c->ssc, buf, space)) <= 0) {
+		if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK &&
+			       errno != EINTR))
+			net_close(c);
+		return;
+	}
+	c->in_bytes += n;
+	if (c->telnet)
+		n = net_telnet(c, buf, n);
+	if (n > 0) {
+		if (space == NCONS_BUFSIZE)
+			__atomic_store_n(&c->rx_t, get_clock_us(),
+					 __ATOMIC_RELEASE);
+		ring_put(&c->rx, buf, n);
+	}
+}
+
+/*
+ *	Send data from the output ring buffer of a console
+ */
+static void net_write(netcons_t *c)
+{
+	const BYTE *p;
+	unsigned len;
+	int n;
+	uint64_t t;
+
+	p = ring_rptr(&c->tx, &len);
+	if (len == 0)
+		return;
+	if ((n = write(c->ssc, p, len)) < 0) {
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			net_close(c);
+		return;
+	}
+	ring_skip(&c->tx, n);
+	c->out_bytes += n;
+
+	/* time from the guest writing the output until it is sent */
+	if ((t = __atomic_exchange_n(&c->tx_t, 0, __ATOMIC_ACQ_REL)) != 0)
+		net_latency(t, &c->out_lat, &c->out_lat_max, &c->out_n);
+}
+
+/*
+ *	Send the output still in the ring buffers and close all
+ *	connections, the I/O thread is stopped
+ */
+static void net_shutdown(void)
 {
-	static unsigned char will_echo[3] = {255, 251, 1};
-	static unsigned char char_mode[3] = {255, 251, 3};
 	struct pollfd p[1];
-	BYTE c[3];
+	netcons_t *c;
+	int i, tries;
+
+	for (i = 0, c = ncons; i < NUMSOC; i++, c++) {
+		if (c->ssc == 0)
+			continue;
+		for (tries = 0; tries < 10 && c->ssc != 0 &&
+			     ring_count(&c->tx) > 0; tries++) {
+			p[0].fd = c->ssc;
+			p[0].events = POLLOUT;
+			p[0].revents = 0;
+			poll(p, 1, 100);
+			if (p[0].revents & POLLOUT)
+				net_write(c);
+		}
+		if (c->ssc != 0)
+			net_close(c);
+	}
+}
+
+/*
+ *	Thread which serves all server sockets. It waits in poll() for
+ *	connections, input and output space on the sockets, and for the
+ *	pipe written to by the CPU when there is output to send.
+ */
+static void *net_io_thread(void *arg)
+{
+	struct pollfd p[2 * NUMSOC + 1];
+	netcons_t *con[2 * NUMSOC + 1];
+	netcons_t *c;
+	sigset_t set;
+	char buf[64];
+	int i, n;
 
-	/* send the telnet options we need */
-	if (write(fd, &char_mode, 3) != 3)
-		LOGE(TAG, "can't send char_mode telnet option");
-	if (write(fd, &will_echo, 3) != 3)
-		LOGE(TAG, "can't send will_echo telnet option");
+	UNUSED(arg);
 
-	/* and reject all others offered */
-	p[0].fd = fd;
-	p[0].events = POLLIN;
-	while (true) {
-		/* wait for input */
-		p[0].revents = 0;
-		poll(p, 1, TELNET_TIMEOUT);
+	/* leave the signals of the simulation to the CPU thread */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
 
-		/* done if no more input */
-		if (! p[0].revents)
-			break;
+	while (!__atomic_load_n(&io_stop, __ATOMIC_SEQ_CST)) {
+		/* announce sleep before looking at the output rings,
+		   so that output put there afterwards wakes us up */
+		__atomic_store_n(&io_sleeping, true, __ATOMIC_SEQ_CST);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+		n = 0;
+		p[n].fd = io_pipe[0];
+		p[n].events = POLLIN;
+		con[n++] = NULL;
+		for (i = 0, c = ncons; i < NUMSOC; i++, c++) {
+			if (c->ss == 0)
+				continue;
+			p[n].fd = c->ss;
+			p[n].events = POLLIN;
+			con[n++] = c;
+			if (c->ssc == 0) {
+				/* drop output written without connection */
+				ring_flush(&c->tx);
+				continue;
+			}
+			p[n].fd = c->ssc;
+			p[n].events = 0;
+			if (ring_space(&c->rx) > 0)
+				p[n].events |= POLLIN;
+			if (ring_count(&c->tx) > 0)
+				p[n].events |= POLLOUT;
+			con[n++] = c;
+		}
+
+		for (i = 0; i < n; i++)
+			p[i].revents = 0;
+		if (poll(p, n, 100) == -1 && errno != EINTR)
+			LOGW(TAG, "I/O thread poll failed");
+		__atomic_store_n(&io_sleeping, false, __ATOMIC_SEQ_CST);
+
+		if (p[0].revents & POLLIN)
+			while (read(io_pipe[0], buf, sizeof(buf)) > 0)
+				;
+
+		for (i = 1; i < n; i++) {
+			c = con[i];
+			if (p[i].fd == c->ss) {
+				if (p[i].revents & POLLIN)
+					net_accept(c);
+				continue;
+			}
+			if (p[i].fd != c->ssc)
+				continue;	/* closed in the meantime */
+			if (p[i].revents & POLLIN)
+				net_read(c);
+			if (c->ssc != 0 && (p[i].revents & POLLOUT))
+				net_write(c);
+			if (c->ssc != 0 &&
+			    (p[i].revents & (POLLHUP | POLLERR | POLLNVAL))
+			    && !(p[i].revents & POLLIN))
+				net_close(c);
+		}
+	}
+
+	net_shutdown();
+
+	pthread_exit(NULL);
+}
+
+/*
+ *	Report the statistics of the server socket consoles used
+ */
+static void net_report(void)
+{
+	netcons_t *c;
+	int i;
 
-		/* else read the option */
-		if (read(fd, &c, 3) != 3)
-			LOGE(TAG, "can't read telnet option");
-		LOGD(TAG, "telnet: %d %d %d", c[0], c[1], c[2]);
-		if (c[2] == 1 || c[2] == 3)
-			continue;	/* ignore answers to our requests */
-		if (c[1] == 251)	/* and reject other options */
-			c[1] = 254;
-		else if (c[1] == 253)
-			c[1] = 252;
-		if (write(fd, &c, 3) != 3)
-			LOGE(TAG, "can't write telnet option");
+	for (i = 0, c = ncons; i < NUMSOC; i++, c++) {
+		if (c->in_bytes == 0 && c->out_bytes == 0)
+			continue;
+		LOG(TAG, "console %d: %" PRIu64 " bytes in, %" PRIu64
+		    " bytes out\r\n", i + 1, c->in_bytes, c->out_bytes);
+		if (c->in_n)
+			LOG(TAG, "  input latency avg %" PRIu64 " us, "
+			    "max %" PRIu64 " us\r\n", c->in_lat / c->in_n,
+			    c->in_lat_max);
+		if (c->out_n)
+			LOG(TAG, "  output latency avg %" PRIu64 " us, "
+			    "max %" PRIu64 " us\r\n", c->out_lat / c->out_n,
+			    c->out_lat_max);
 	}
 }
 #endif /* NETWORKING */
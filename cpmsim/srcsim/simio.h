@@ -9,6 +9,8 @@
 
 #include "sim.h"
 #include "simdefs.h"
+#include "unix_hostdisk.h"
+#include "unix_cowdisk.h"
 
 #define IO_DATA_UNUSED	0xff	/* data returned on unused ports */
 
@@ -20,6 +22,8 @@ typedef struct dskdef {
 	int *fd;			/* file descriptor */
 	unsigned int tracks;		/* number of tracks */
 	unsigned int sectors;		/* number of sectors */
+	hostdisk_t *hd;			/* host directory or NULL */
+	cowdisk_t *cd;			/* overlay image or NULL */
 } dskdef_t;
 
 extern dskdef_t disks[16];
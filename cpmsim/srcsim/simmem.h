@@ -40,9 +40,12 @@
 #include "simice.h"
 #endif
 
-#ifdef BUS_8080
+#if defined(BUS_8080) || defined(HAS_BDOS_TRAP)
 #include "simglb.h"
 #endif
+#ifdef HAS_BDOS_TRAP
+#include "simbdos-trap.h"
+#endif
 
 #define MAXSEG 16		/* max. number of memory banks */
 #define SEGSIZ 49152		/* default size of one bank = 48 KBytes */
@@ -110,6 +113,12 @@ static inline BYTE memrdr(WORD addr)
 			data = *(memory[selbnk] + addr);
 	}
 
+#ifdef HAS_BDOS_TRAP
+	/* opcode fetch at the BDOS entry, PC was incremented already */
+	if (bdos_trap_on && addr == BDOS_ENTRY && PC == BDOS_ENTRY + 1)
+		data = bdos_trap(data);
+#endif
+
 #ifdef BUS_8080
 	cpu_bus &= ~CPU_M1;
 	cpu_bus |= CPU_WO | CPU_MEMR;
@@ -0,0 +1,91 @@
+/*
+ * create, commit and discard copy-on-write overlays of disk images
+ *
+ * Copyright (C) 2026 by agent
+ *
+ * History:
+ * 18-OCT-2026 first version
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "unix_cowdisk.h"
+
+static const char usage[] =
+	"usage: cowdisk create base-image overlay\n"
+	"       cowdisk commit | discard | info overlay";
+
+static cowdisk_t *open_overlay(const char *fn, int rdonly)
+{
+	cowdisk_t *cd;
+
+	if ((cd = cowdisk_open(fn, rdonly)) == NULL) {
+		fprintf(stderr, "%s: %s\n", fn, errno == ESTALE
+			? "base image was changed, overlay can't be used"
+			: errno == EINVAL ? "not an overlay file"
+					  : strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	return cd;
+}
+
+/*
+ *	The overlays must not be in use by a running simulation.
+ *
+ *	create:  make a new empty overlay for the base image
+ *	commit:  write the sectors of the overlay into the base image
+ *		 and empty the overlay, other overlays of the base
+ *		 image become unusable
+ *	discard: empty the overlay, dropping all changes
+ *	info:	 show the base image and the number of changed sectors
+ */
+int main(int argc, char *argv[])
+{
+	cowdisk_t *cd;
+	const char *cmd;
+	uint32_t n;
+
+	if (argc < 3) {
+		puts(usage);
+		exit(EXIT_FAILURE);
+	}
+	cmd = argv[1];
+	if (strcmp(cmd, "create") == 0 && argc == 4) {
+		if (cowdisk_create(argv[2], argv[3]) == -1) {
+			fprintf(stderr, "%s: %s\n", errno == EEXIST ? argv[3]
+				: argv[2], strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+	} else if (strcmp(cmd, "commit") == 0 && argc == 3) {
+		cd = open_overlay(argv[2], 0);
+		n = cowdisk_count(cd);
+		if (cowdisk_commit(cd) == -1) {
+			fprintf(stderr, "%s: %s\n", cowdisk_base(cd),
+				strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+		printf("%u sectors written to %s\n", n, cowdisk_base(cd));
+		cowdisk_close(cd);
+	} else if (strcmp(cmd, "discard") == 0 && argc == 3) {
+		cd = open_overlay(argv[2], 0);
+		n = cowdisk_count(cd);
+		if (cowdisk_discard(cd) == -1) {
+			perror(argv[2]);
+			exit(EXIT_FAILURE);
+		}
+		printf("%u sectors discarded\n", n);
+		cowdisk_close(cd);
+	} else if (strcmp(cmd, "info") == 0 && argc == 3) {
+		cd = open_overlay(argv[2], 1);
+		printf("base image: %s\n", cowdisk_base(cd));
+		printf("changed sectors: %u\n", cowdisk_count(cd));
+		cowdisk_close(cd);
+	} else {
+		puts(usage);
+		exit(EXIT_FAILURE);
+	}
+	return EXIT_SUCCESS;
+}
@@ -13,6 +13,7 @@
  * 20-MAR-2017 renamed pipe
  * 19-APR-2024 don't use exit() in signal handler and switch to sigaction()
  * 27-APR-2024 improve error handling
+ * 18-OCT-2026 option -m receives binary through the shared memory ring
  */
 
 #include <unistd.h>
@@ -22,11 +23,16 @@
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/mman.h>
+
+#include "../srcsim/auxshm.h"
 
 #define UNUSED(x) (void) (x)
 
 int signal_catched;
 
+void recvshm(const char *);
+
 int main(int argc, char *argv[])
 {
 	char c;
@@ -37,8 +43,12 @@ int main(int argc, char *argv[])
 
 	fdout = 0;
 
+	if (argc == 3 && strcmp(argv[1], "-m") == 0) {
+		recvshm(argv[2]);
+		return EXIT_SUCCESS;
+	}
 	if (argc != 2) {
-		puts("usage: cpmrecv filename &");
+		puts("usage: cpmrecv [-m] filename &");
 		exit(EXIT_FAILURE);
 	}
 	if ((fdin = open("/tmp/.z80pack/cpmsim.auxout", O_RDONLY)) == -1) {
@@ -87,3 +97,62 @@ void int_handler(int sig)
 
 	signal_catched = 1;
 }
+
+/*
+ * Receive a file unchanged through the shared memory ring of the
+ * auxiliary block port, until the guest signals the end of output
+ */
+void recvshm(const char *fn)
+{
+	static char buf[BUFSIZ];
+	auxshm_t *shm;
+	auxshm_ring_t *r;
+	uint32_t n;
+	int fd, fdout;
+
+	if ((fd = open(AUXSHM_FILE, O_RDWR)) == -1 ||
+	    (shm = mmap(NULL, sizeof(auxshm_t), PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		perror(AUXSHM_FILE);
+		exit(EXIT_FAILURE);
+	}
+	close(fd);
+	if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != AUXSHM_MAGIC ||
+	    shm->ringsz != AUXSHM_RINGSZ) {
+		fprintf(stderr, "%s: cpmsim isn't running\n", AUXSHM_FILE);
+		exit(EXIT_FAILURE);
+	}
+	if ((fdout = creat(fn, 0644)) == -1) {
+		perror(fn);
+		exit(EXIT_FAILURE);
+	}
+	r = &shm->out;
+	__atomic_store_n(&r->active, 1, __ATOMIC_RELEASE);
+
+	for (;;) {
+		if ((n = auxshm_get(r, buf, BUFSIZ)) > 0) {
+			if (write(fdout, buf, n) != (ssize_t) n) {
+				perror(fn);
+				exit(EXIT_FAILURE);
+			}
+			continue;
+		}
+		if (__atomic_load_n(&r->eof, __ATOMIC_ACQUIRE)) {
+			/* the guest may have written more before the eof */
+			if (auxshm_count(r) > 0)
+				continue;
+			break;
+		}
+		if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE)
+		    != AUXSHM_MAGIC) {
+			fputs("cpmsim has stopped\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+		usleep(100);
+	}
+
+	__atomic_store_n(&r->eof, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&r->active, 0, __ATOMIC_RELEASE);
+	close(fdout);
+	munmap(shm, sizeof(auxshm_t));
+}
@@ -11,6 +11,7 @@
  * 09-MAR-2016 moved pipes to /tmp/.z80pack
  * 20-MAR-2017 renamed pipe
  * 27-APR-2024 improve error handling
+ * 18-OCT-2026 option -m sends binary through the shared memory ring
  */
 
 #include <unistd.h>
@@ -19,8 +20,12 @@
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/mman.h>
+
+#include "../srcsim/auxshm.h"
 
 void sendbuf(ssize_t);
+void sendshm(void);
 
 char buf[BUFSIZ];
 char cr = '\r';
@@ -30,8 +35,17 @@ int main(int argc, char *argv[])
 {
 	ssize_t n;
 
+	if (argc == 3 && strcmp(argv[1], "-m") == 0) {
+		if ((fdin = open(argv[2], O_RDONLY)) == -1) {
+			perror(argv[2]);
+			exit(EXIT_FAILURE);
+		}
+		sendshm();
+		close(fdin);
+		return EXIT_SUCCESS;
+	}
 	if (argc != 2) {
-		puts("usage: cpmsend filename &");
+		puts("usage: cpmsend [-m] filename &");
 		exit(EXIT_FAILURE);
 	}
 	if ((fdin = open(argv[1], O_RDONLY)) == -1) {
@@ -74,3 +88,64 @@ void sendbuf(ssize_t size)
 		}
 	}
 }
+
+/*
+ * Send the file unchanged through the shared memory ring of the
+ * auxiliary block port, waits until the simulation has read it
+ */
+void sendshm(void)
+{
+	auxshm_t *shm;
+	auxshm_ring_t *r;
+	ssize_t n;
+	uint32_t m;
+	int fd;
+
+	if ((fd = open(AUXSHM_FILE, O_RDWR)) == -1 ||
+	    (shm = mmap(NULL, sizeof(auxshm_t), PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		perror(AUXSHM_FILE);
+		exit(EXIT_FAILURE);
+	}
+	close(fd);
+	if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != AUXSHM_MAGIC ||
+	    shm->ringsz != AUXSHM_RINGSZ) {
+		fprintf(stderr, "%s: cpmsim isn't running\n", AUXSHM_FILE);
+		exit(EXIT_FAILURE);
+	}
+	r = &shm->in;
+	__atomic_store_n(&r->eof, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&r->active, 1, __ATOMIC_RELEASE);
+
+	while ((n = read(fdin, buf, BUFSIZ)) > 0) {
+		m = 0;
+		while (m < (uint32_t) n) {
+			m += auxshm_put(r, buf + m, n - m);
+			if (m < (uint32_t) n) {
+				if (__atomic_load_n(&shm->magic,
+						    __ATOMIC_ACQUIRE)
+				    != AUXSHM_MAGIC) {
+					fputs("cpmsim has stopped\n", stderr);
+					exit(EXIT_FAILURE);
+				}
+				usleep(100);
+			}
+		}
+	}
+	if (n == -1) {
+		perror("read");
+		exit(EXIT_FAILURE);
+	}
+
+	__atomic_store_n(&r->eof, 1, __ATOMIC_RELEASE);
+	while (auxshm_space(r) < AUXSHM_RINGSZ) {
+		if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE)
+		    != AUXSHM_MAGIC) {
+			fputs("cpmsim has stopped\n", stderr);
+			exit(EXIT_FAILURE);
+		}
+		usleep(1000);
+	}
+	__atomic_store_n(&r->active, 0, __ATOMIC_RELEASE);
+	munmap(shm, sizeof(auxshm_t));
+}
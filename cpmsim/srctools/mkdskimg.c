@@ -15,6 +15,7 @@
  * 14-JAN-2016 make disk file in directory drives if exists, in cwd otherwise
  * 14-MAR-2016 renamed the used disk images to drivex.dsk
  * 27-APR-2024 improve error handling
+ * 18-OCT-2026 options -s for sparse and -p for preallocated images
  */
 
 #include <unistd.h>
@@ -32,6 +33,52 @@
 #define HD2TRACK	256
 #define HD2SECTOR	16384
 
+#define CHUNK		128	/* sectors written at once */
+
+/*
+ *	Disk formats, with the reserved tracks and the number of
+ *	sectors used by the directory from the DPB of the BIOS. The
+ *	8" formats have the directory in 16 sectors with skew 6 spread
+ *	over the first data track, so the whole track is counted.
+ */
+static const struct format {
+	char drive;
+	int tracks;
+	int sectors;
+	int offset;
+	int dirsecs;
+} formats[] = {
+	{ 'a', TRACK, SECTOR, 2, SECTOR },
+	{ 'b', TRACK, SECTOR, 2, SECTOR },
+	{ 'c', TRACK, SECTOR, 2, SECTOR },
+	{ 'd', TRACK, SECTOR, 2, SECTOR },
+	{ 'i', HDTRACK, HDSECTOR, 0, 256 },
+	{ 'j', HDTRACK, HDSECTOR, 0, 256 },
+	{ 'p', HD2TRACK, HD2SECTOR, 0, 2048 },
+	{ 0, 0, 0, 0, 0 }
+};
+
+static unsigned char sectors[CHUNK * 128];
+
+/*
+ *	Write n sectors filled with 0xe5 at offset pos
+ */
+static void fill(int fd, const char *fn, off_t pos, long n)
+{
+	ssize_t len, w;
+
+	while (n > 0) {
+		len = (n > CHUNK ? CHUNK : n) * 128;
+		if ((w = pwrite(fd, (char *) sectors, len, pos)) != len) {
+			fprintf(stderr, "%s: %s\n", fn,
+				w == -1 ? strerror(errno) : "short write");
+			exit(EXIT_FAILURE);
+		}
+		pos += len;
+		n -= len / 128;
+	}
+}
+
 /*
  *	This program creates image files for the following disk formats:
  *
@@ -42,32 +89,45 @@
  *		drive I:	4MB harddisk
  *		drive J:	4MB harddisk
  *		drive P:	512MB harddisk
+ *
+ *	Without option all sectors are filled with 0xe5. With option -s
+ *	only the directory is written and the image is extended to its
+ *	size with ftruncate(), the rest of the file is a hole which
+ *	reads as zeros and uses no space on the host. Option -p does
+ *	the same, but allocates the space for the image on the host.
  */
 int main(int argc, char *argv[])
 {
 	register int i;
 	int fd;
-	char drive;
-	ssize_t n;
+	char mode = 0;
 	struct stat sb;
-	static unsigned char sector[128];
+	const struct format *f;
+	off_t size;
 	static char fn[64];
 	static char ddir[] = "disks";
 	static char dn[] = "drive?.dsk";
-	static char usage[] = "usage: mkdskimg a | b | c | d | i | j | p";
+	static char usage[] = "usage: mkdskimg [-s | -p] a | b | c | d | i | j | p";
 
+	if (argc == 3 && (strcmp(argv[1], "-s") == 0 ||
+			  strcmp(argv[1], "-p") == 0)) {
+		mode = argv[1][1];
+		argc--;
+		argv++;
+	}
 	if (argc != 2) {
 		puts(usage);
 		exit(EXIT_FAILURE);
 	}
 	i = *argv[1];
-	if (argc != 2 ||
-	    (i != 'a' && i != 'b' && i != 'c' && i != 'd' && i != 'i'
-	     && i != 'j' && i != 'p')) {
+	for (f = formats; f->drive != 0; f++)
+		if (f->drive == i)
+			break;
+	if (f->drive == 0 || argv[1][1] != '\0') {
 		puts(usage);
 		exit(EXIT_FAILURE);
 	}
-	dn[5] = drive = (char) i;
+	dn[5] = (char) i;
 	if (stat(ddir, &sb) == 0 && S_ISDIR(sb.st_mode)) {
 		strcpy(fn, ddir);
 		strcat(fn, "/");
@@ -75,7 +135,7 @@ int main(int argc, char *argv[])
 	} else {
 		strcpy(fn, dn);
 	}
-	memset((char *) sector, 0xe5, 128);
+	memset((char *) sectors, 0xe5, sizeof(sectors));
 	if ((fd = open(fn, O_RDONLY)) != -1) {
 		close(fd);
 		printf("disk file \"%s\" exists, aborting\n", fn);
@@ -85,30 +145,23 @@ int main(int argc, char *argv[])
 		perror(fn);
 		exit(EXIT_FAILURE);
 	}
-	if (drive <= 'd') {
-		for (i = 0; i < TRACK * SECTOR; i++)
-			if ((n = write(fd, (char *) sector, 128)) != 128) {
-				fprintf(stderr, "%s: %s\n", fn,
-					n == -1 ? strerror(errno)
-						: "short write");
-				exit(EXIT_FAILURE);
-			}
-	} else if (drive == 'i' || drive == 'j') {
-		for (i = 0; i < HDTRACK * HDSECTOR; i++)
-			if ((n = write(fd, (char *) sector, 128)) != 128) {
-				fprintf(stderr, "%s: %s\n", fn,
-					n == -1 ? strerror(errno)
-						: "short write");
-				exit(EXIT_FAILURE);
-			}
-	} else if (drive == 'p') {
-		for (i = 0; i < HD2TRACK * HD2SECTOR; i++)
-			if ((n = write(fd, (char *) sector, 128)) != 128) {
-				fprintf(stderr, "%s: %s\n", fn,
-					n == -1 ? strerror(errno)
-						: "short write");
-				exit(EXIT_FAILURE);
-			}
+	size = (off_t) f->tracks * f->sectors * 128;
+	if (mode == 'p' && (i = posix_fallocate(fd, 0, size)) != 0) {
+		/* not supported by the file system, write all sectors */
+		if (i != EINVAL && i != EOPNOTSUPP) {
+			fprintf(stderr, "%s: %s\n", fn, strerror(i));
+			exit(EXIT_FAILURE);
+		}
+		mode = 0;
+	}
+	if (mode == 0)
+		fill(fd, fn, 0, (long) f->tracks * f->sectors);
+	else {
+		if (ftruncate(fd, size) == -1) {
+			perror(fn);
+			exit(EXIT_FAILURE);
+		}
+		fill(fd, fn, (off_t) f->offset * f->sectors * 128, f->dirsecs);
 	}
 	close(fd);
 	return EXIT_SUCCESS;
@@ -0,0 +1,131 @@
+;*****************************************************************************
+;
+;  AUXGET.ASM - CP/M program to read a file sent by cpmsend -m on the host
+;	into the CP/M file system. Designed to run under the cpmsim
+;	simulator of z80pack, the data comes through the shared memory
+;	ring of the auxiliary block port. The last record is filled up
+;	with CTRL-Z.
+;
+;	Rev	 Date	  Desc
+;	1.0	10/18/26  agent, Original
+;
+;*****************************************************************************
+
+; BDOS equates
+
+BDOS	equ	5		;BDOS entry point
+PRINT	equ	9		;BDOS write string to console
+CLOSEF	equ	16		;BDOS close file
+DELETEF	equ	19		;BDOS delete file
+WRITEF	equ	21		;BDOS write file
+MAKEF	equ	22		;BDOS make file
+
+; CP/M default File Control Block (FCB)
+
+FCB	equ	5Ch		;location of default CP/M FCB
+FCBFN	equ	FCB+1		;location of file name
+FCBCR	equ	FCB+32		;current record
+DEFDMA	equ	80h		;CP/M default DMA address
+
+; cpmsim ports
+
+DMAL	equ	15		;DMA address low
+DMAH	equ	16		;DMA address high
+AUXB	equ	6		;OUT block command, IN bytes transferred
+BREAD	equ	0		;read up to 128 bytes from the host
+
+; Misc equates
+
+CR	equ	13		;ASCII for carriage return
+LF	equ	10		;ASCII for line feed
+CTRLZ	equ	1Ah		;CP/M end of file
+
+	org	0100h		;CP/M load and entry address
+;-----------------------------------------------------------------------------
+; Main program
+;-----------------------------------------------------------------------------
+	lxi	d,mHelp		;DE->help message
+	lda	FCBFN		;look at 1st character of 1st file name
+	cpi	' '		;anything there?
+	jz	exitMsg		;no, display help message and exit
+
+	lxi	d,FCB		;DE->FCB made by command processor
+	mvi	c,DELETEF	;delete an old file
+	call	BDOS
+	lxi	d,FCB
+	mvi	c,MAKEF		;C=make file command
+	call	BDOS
+	lxi	d,mMakErr	;DE->can't create file message
+	inr	a		;test for FF (make file fail)
+	jz	exitMsg		;create failed, exit
+	xra	a		;zero current record in the FCB
+	sta	FCBCR
+
+;-----------------------------------------------------------------------------
+; Copy the blocks from the host record by record, until a block is
+;    shorter than a record
+;-----------------------------------------------------------------------------
+rdRec	mvi	a,DEFDMA	;block port transfers to the default DMA
+	out	DMAL
+	xra	a
+	out	DMAH
+	mvi	a,BREAD		;read a block from the host
+	out	AUXB
+	in	AUXB		;A=number of bytes read
+	ora	a		;any?
+	jz	done		;no, all read
+
+	push	psw		;save count
+	cpi	128		;full record?
+	jz	wrtRec		;yes
+
+	adi	DEFDMA		;HL->first byte not read
+	mov	l,a
+	mvi	h,0
+fill	mvi	m,CTRLZ		;fill up the record with CTRL-Z
+	inr	l
+	jnz	fill		;until the end of the DMA buffer
+
+wrtRec	lxi	d,FCB		;DE->output file FCB
+	mvi	c,WRITEF	;C=write file sequential
+	call	BDOS
+	ora	a		;test for write error
+	jnz	wrtErr
+
+	pop	psw		;restore count
+	cpi	128		;full record?
+	jz	rdRec		;yes, read the next one
+
+done	lxi	d,mDone		;DE->success message
+	jmp	exitCls		;close file, display message and exit
+
+wrtErr	pop	psw		;remove count
+	lxi	d,mWrtErr	;DE->write error message
+
+;-----------------------------------------------------------------------------
+; exitMsg - Display message pointed to by DE and exit to CP/M
+; exitCls - also closes the file
+;-----------------------------------------------------------------------------
+exitCls	push	d		;save message pointer
+	lxi	d,FCB		;DE->file FCB
+	mvi	c,CLOSEF	;C=close file command
+	call	BDOS
+	pop	d		;DE->exit message
+
+exitMsg	mvi	c,PRINT		;display message passed in DE
+	call	BDOS
+	jmp	0		;exit to CP/M
+
+;-----------------------------------------------------------------------------
+;  String Constants
+;-----------------------------------------------------------------------------
+mHelp	db	CR,LF
+	db	'AUXGET.COM v1.0 - Read file sent by cpmsend -m',CR,LF
+	db	LF
+	db	'Usage: AUXGET <filename>',CR,LF,'$'
+
+mMakErr	db	CR,LF,'Cannot create file',CR,LF,'$'
+mWrtErr	db	CR,LF,'Write error',CR,LF,'$'
+mDone	db	CR,LF,'File received from host',CR,LF,'$'
+
+	end
@@ -0,0 +1,112 @@
+;*****************************************************************************
+;
+;  AUXPUT.ASM - CP/M program to write a file from the CP/M file system to
+;	cpmrecv -m on the host. Designed to run under the cpmsim simulator
+;	of z80pack, the data goes through the shared memory ring of the
+;	auxiliary block port. All records of the file are sent, the host
+;	file is a multiple of 128 bytes long.
+;
+;	Rev	 Date	  Desc
+;	1.0	10/18/26  agent, Original
+;
+;*****************************************************************************
+
+; BDOS equates
+
+BDOS	equ	5		;BDOS entry point
+PRINT	equ	9		;BDOS write string to console
+OPENF	equ	15		;BDOS open file
+CLOSEF	equ	16		;BDOS close file
+READF	equ	20		;BDOS read file
+
+; CP/M default File Control Block (FCB)
+
+FCB	equ	5Ch		;location of default CP/M FCB
+FCBFN	equ	FCB+1		;location of file name
+FCBCR	equ	FCB+32		;current record
+DEFDMA	equ	80h		;CP/M default DMA address
+
+; cpmsim ports
+
+DMAL	equ	15		;DMA address low
+DMAH	equ	16		;DMA address high
+AUXB	equ	6		;OUT block command, IN bytes transferred
+BWRITE	equ	1		;write 128 bytes to the host
+BEND	equ	2		;end of output
+
+; Misc equates
+
+CR	equ	13		;ASCII for carriage return
+LF	equ	10		;ASCII for line feed
+
+	org	0100h		;CP/M load and entry address
+;-----------------------------------------------------------------------------
+; Main program
+;-----------------------------------------------------------------------------
+	lxi	d,mHelp		;DE->help message
+	lda	FCBFN		;look at 1st character of 1st file name
+	cpi	' '		;anything there?
+	jz	exitMsg		;no, display help message and exit
+
+	xra	a		;zero current record in the FCB
+	sta	FCBCR
+	lxi	d,FCB		;DE->FCB made by command processor
+	mvi	c,OPENF		;C=open file command
+	call	BDOS
+	lxi	d,mNoFile	;DE->file not found message
+	inr	a		;test for FFh error
+	jz	exitMsg		;file not found, exit
+
+;-----------------------------------------------------------------------------
+; Copy the file record by record to the host
+;-----------------------------------------------------------------------------
+rdRec	lxi	d,FCB		;DE->input file FCB
+	mvi	c,READF		;C=read file sequential
+	call	BDOS
+	ora	a		;end of file?
+	jnz	done		;yes
+
+	mvi	a,DEFDMA	;block port transfers from the default DMA
+	out	DMAL
+	xra	a
+	out	DMAH
+	mvi	a,BWRITE	;write the record to the host
+	out	AUXB
+	in	AUXB		;A=number of bytes written
+	cpi	128		;all of them?
+	jz	rdRec		;yes, read the next one
+
+	lxi	d,mHstErr	;DE->host error message
+	jmp	exitCls		;close file, display message and exit
+
+done	mvi	a,BEND		;tell the host that all was sent
+	out	AUXB
+	lxi	d,mDone		;DE->success message
+
+;-----------------------------------------------------------------------------
+; exitMsg - Display message pointed to by DE and exit to CP/M
+; exitCls - also closes the file
+;-----------------------------------------------------------------------------
+exitCls	push	d		;save message pointer
+	lxi	d,FCB		;DE->file FCB
+	mvi	c,CLOSEF	;C=close file command
+	call	BDOS
+	pop	d		;DE->exit message
+
+exitMsg	mvi	c,PRINT		;display message passed in DE
+	call	BDOS
+	jmp	0		;exit to CP/M
+
+;-----------------------------------------------------------------------------
+;  String Constants
+;-----------------------------------------------------------------------------
+mHelp	db	CR,LF
+	db	'AUXPUT.COM v1.0 - Write file to cpmrecv -m',CR,LF
+	db	LF
+	db	'Usage: AUXPUT <filename>',CR,LF,'$'
+
+mNoFile	db	CR,LF,'File not found',CR,LF,'$'
+mHstErr	db	CR,LF,'Host not receiving',CR,LF,'$'
+mDone	db	CR,LF,'File sent to host',CR,LF,'$'
+
+	end
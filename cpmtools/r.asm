@@ -1,11 +1,12 @@
 ;*****************************************************************************
 ;
-;  R.ASM - CP/M program to read a file from the host PC into the CP/M file
+;  R.ASM - CP/M program to read files from the host PC into the CP/M file
 ;	system. Designed to run under the z80pack simulator. Requires the
-;	simbdos.c module in z80pack to support host file I/O. 
+;	simbdos.c module in z80pack to support host file I/O.
 ;
 ;	Rev	 Date	  Desc
 ;	1.0	10/2/19   Mike Douglas, Original
+;	1.1	10/18/26  agent, wildcards, multi-record reads
 ;
 ;*****************************************************************************
 
@@ -15,12 +16,19 @@ BDOS	equ	5		;BDOS entry point
 PRINT	equ	9		;BDOS write string to console
 OPENF	equ	15		;BDOS open file
 CLOSEF	equ	16		;BDOS close file
+SEARCHF	equ	17		;BDOS search for first
+SEARCHN	equ	18		;BDOS search for next
 DELETEF	equ	19		;BDOS delete file
 READF	equ	20		;BDOS read file
 WRITEF	equ	21		;BDOS write file
 MAKEF	equ	22		;BDOS make file
 SETDMA	equ	26		;BDOS set DMA address
 
+; Host only functions
+
+READN	equ	120		;read multiple records, DE->buffer, B=count
+NRECS	equ	128		;records read at once
+
 ; CP/M default File Control Block (FCB)
 
 FCB	equ	5Ch		;location of default CP/M FCB
@@ -41,20 +49,49 @@ LF	equ	10		;ascii for line feed
 ;-----------------------------------------------------------------------------
 	call	vfyFcb		;verify the FCB from command line
 
+	lxi	d,DEFDMA	;host directory entries go to the default
+	mvi	c,SETDMA	;   buffer
+	call	pcBdos		;set buffer address
+
+	lxi	d,patFcb	;DE->FCB with the file name to look for
+	mvi	c,SEARCHF	;C=search for first file
+	call	pcBdos
+	inr	a		;test for FFh, no file found
+	jnz	nxtFile		;found one, copy it
+
+	lxi	h,FCBFN		;HL->file name given
+	call	setMsg		;copy it into the message
+	lxi	d,mFile		;display file name
+	mvi	c,PRINT
+	call	BDOS
+	lxi	d,mNoFile	;DE->file not found message
+	jmp	exitMsg		;display message and exit
+
+nxtFile	call	setFcb		;set up FCBs for the file found
+
 	lxi	d,mFile		;display file name
 	mvi	c,PRINT
 	call	BDOS
 
 	call	opnFile		;open the files
 	call	cpyFile		;perform the copy
+	call	clsFile		;close the files
 
 	lxi	d,mDone		;DE->success message
-	jmp	exitM2F		;close files, display exit message and exit
-			
-;-----------------------------------------------------------------------------	
-; vfyFcb - Verify a valid file to copy has been specified on the command
-;    line. Copy the default FCB containing the file name to inFcb. Also
-;    copy the file name with space supression into mFName.
+	mvi	c,PRINT
+	call	BDOS
+
+	lxi	d,patFcb	;DE->FCB with the file name to look for
+	mvi	c,SEARCHN	;C=search for next file
+	call	pcBdos
+	inr	a		;test for FFh, no more files
+	jnz	nxtFile		;found one, copy it
+	jmp	0		;exit to CP/M
+
+;-----------------------------------------------------------------------------
+; vfyFcb - Verify a file to copy has been specified on the command line.
+;    Copy the default FCB containing the file name to patFcb, the name
+;    may contain wildcards.
 ;-----------------------------------------------------------------------------
 vfyFcb	lxi	d,mHelp		;DE->help message
 	lda	FCBFN		;look at 1st character of 1st file name
@@ -62,58 +99,70 @@ vfyFcb	lxi	d,mHelp		;DE->help message
 	jz	exitMsg		;no, display help message and exit
 
 	lxi	h,FCB		;HL->FCB made by command processor
-	lxi	d,inFcb		;DE->copy of FCB
+	lxi	d,patFcb	;DE->copy of FCB
 	mvi	b,16		;B=number of bytes to move
+	jmp	move
 
-copyFcb	mov	a,m		;copy command line FCB to inFcb
-	stax	d
-	inx	h
-	inx	d
-	dcr	b
-	jnz	copyFcb
+;-----------------------------------------------------------------------------
+; setFcb - Put the name of the host file found into the destination FCB
+;    and copy it to inFcb. Also copy the file name with space suppression
+;    into mFName.
+;-----------------------------------------------------------------------------
+setFcb	lxi	h,DEFDMA+1	;HL->file name in the directory entry
+	lxi	d,FCBFN		;DE->file name in destination FCB
+	mvi	b,11		;B=number of bytes to move
+	call	move
+
+	xra	a		;clear extent and record counts
+	sta	FCB+12
+	sta	FCB+13
+	sta	FCB+14
+	sta	FCB+15
+	sta	FCBCR		;zero current record the FCB
+
+	lxi	h,FCB		;HL->destination FCB
+	lxi	d,inFcb		;DE->FCB for the host file
+	mvi	b,16		;B=number of bytes to move
+	call	move
 
-; Copy space suppressed filename to mFName and verify no wildcards
+	lxi	h,FCBFN		;HL->file name
+				;fall through into setMsg
 
-	lxi	h,FCBFN		;HL->filename in FCB
+;-----------------------------------------------------------------------------
+; setMsg - Copy space suppressed filename at (HL) to mFName
+;-----------------------------------------------------------------------------
+setMsg	push	h		;save file name pointer
 	lxi	d,mFName	;DE->filename in output message
 	mvi	b,8		;B=number of bytes to move
 	call	copyFn		;copy filename
-	
+
 	mvi	a,'.'		;insert '.' before extension
 	stax	d
 	inx	d
-	
-	lxi	h,FCBEXT	;copy extension
-	mvi	b,3
+
+	pop	h		;HL->extension
+	lxi	b,8
+	dad	b
+	mvi	b,3		;copy extension
 	call	copyFn
-	
+
 	dcx	d		;if no extension, get rid of '.'
 	ldax	d
 	cpi	'.'
 	jz	term$		;no extension, insert terminator
-	
+
 	inx	d		;bump past end of extension
 
 term$	mvi	a,'$'		;add trailing '$' terminator
 	stax	d
 	ret
-	
-;-----------------------------------------------------------------------------	
+
+;-----------------------------------------------------------------------------
 ; opnFile - Open the input and output files
 ;-----------------------------------------------------------------------------
-; Set the buffer address for disk reads and writes
-
-opnFile	lxi	d,DEFDMA	;use the CP/M default buffer
-	mvi	c,SETDMA
-	call	pcBdos		;set buffer address
-
-	lxi	d,DEFDMA	;use the CP/M default buffer
-	mvi	c,SETDMA
-	call	BDOS		;set buffer address
-	
 ; Open the input file on the PC
 
-	lxi	d,inFcb		;DE->FCB for input file on PC
+opnFile	lxi	d,inFcb		;DE->FCB for input file on PC
 	mvi	c,OPENF		;C=open file command
 	call	pcBdos
 
@@ -123,9 +172,6 @@ opnFile	lxi	d,DEFDMA	;use the CP/M default buffer
 
 ; Delete and then open the output file on the CP/M file system
 
-	xra	a		;zero current record the FCB
-	sta	FCBCR
-
 	lxi	d,FCB		;DE->destination FCB
 	mvi	c,DELETEF	;C=delete file command
 	call	BDOS		;delete the destination file
@@ -133,7 +179,7 @@ opnFile	lxi	d,DEFDMA	;use the CP/M default buffer
 	lxi	d,FCB		;DE->destination FCB
 	mvi	c,MAKEF		;C=make file command
 	call	BDOS		;create the destination file
-	
+
 	lxi	d,mMakErr	;DE->can't create file message
 	inr	a		;test for FF (make file fail)
 	jz	exitM1F		;create failed, close one file & exit
@@ -141,31 +187,61 @@ opnFile	lxi	d,DEFDMA	;use the CP/M default buffer
 	lxi	d,FCB		;DE->destination FCB
 	mvi	c,OPENF		;C=open file command
 	call	BDOS		;open the destination file
-	
+
 	lxi	d,mNoFile	;DE->file not found message
 	inr	a		;test for FFh error
 	jz	exitM1F		;file not found, close one file & exit
-	
+
 	ret
-	
-;-----------------------------------------------------------------------------	
-; cpyFile - Copy the input file from the PC to the output file in CP/M
+
 ;-----------------------------------------------------------------------------
-cpyFile	lxi	d,inFcb		;DE->input file FCB
-	mvi	c,READF		;C=read file sequential
-	call	pcBdos
+; cpyFile - Copy the input file from the PC to the output file in CP/M.
+;    Up to NRECS records are read from the PC at once into the buffer,
+;    then written record by record.
+;-----------------------------------------------------------------------------
+cpyFile	lxi	d,buffer	;DE->buffer for the records
+	mvi	b,NRECS		;B=number of records to read
+	mvi	c,READN		;C=read multiple records
+	call	pcBdos		;B returns number of records read
 	ora	a		;end of file?
 	rnz			;yes, file copy is done
 
+	lxi	h,buffer	;HL->first record
+
+cpyRec	push	b		;save record count
+	push	h		;save record pointer
+	xchg			;DE->record
+	mvi	c,SETDMA
+	call	BDOS		;set buffer address
+
 	lxi	d,FCB		;DE->output file FCB
 	mvi	c,WRITEF	;C=write file sequential
 	call	BDOS
+	pop	h		;restore record pointer
+	pop	b		;restore record count
 	ora	a		;test for write error
-	jz	cpyFile		;no error, do next record
+	jnz	wrtErr		;write error
 
-	lxi	d,mWrtErr	;DE->write error message
+	lxi	d,128		;HL->next record
+	dad	d
+	dcr	b		;all records written?
+	jnz	cpyRec		;no, write the next one
+	jmp	cpyFile		;yes, read the next records
+
+wrtErr	lxi	d,mWrtErr	;DE->write error message
 	jmp	exitM2F		;display error, close two files & exit
 
+;-----------------------------------------------------------------------------
+; clsFile - Close the input and output files
+;-----------------------------------------------------------------------------
+clsFile	lxi	d,FCB		;DE->destination FCB
+	mvi	c,CLOSEF	;C=close file command
+	call	BDOS		;close destination file
+
+	lxi	d,inFcb		;DE->source file FCB
+	mvi	c,CLOSEF	;C=close file command
+	jmp	pcBdos		;close source file
+
 ;-----------------------------------------------------------------------------
 ; exitMsg - Display message pointed to by DE and exit to CP/M
 ; exitM1F - also closes the input file
@@ -189,7 +265,7 @@ exitMsg	mvi	c,PRINT		;display message passed in DE
 
 ;-----------------------------------------------------------------------------
 ; pcBdos - Call the PC "BDOS" by putting the complement of the command
-;     (passed in C) into A, then doing an OUT to PCPORT to call the 
+;     (passed in C) into A, then doing an OUT to PCPORT to call the
 ;     simulator hook for PC file I/O.
 ;-----------------------------------------------------------------------------
 pcBdos	mov	a,c		;set A = not C
@@ -197,39 +273,41 @@ pcBdos	mov	a,c		;set A = not C
 	out	PCPORT		;call the PC "BDOS"
 	ret
 
-;-----------------------------------------------------------------------------	
-; copyFn - Copy from (HL) to (DE). Abort with error if '?' found which
-;     indicates a wildcard was used (not supported). Stop copying when
-;     space is found or length in B has been copied.
+;-----------------------------------------------------------------------------
+; copyFn - Copy from (HL) to (DE). Stop copying when space is found
+;     or length in B has been copied.
 ;-----------------------------------------------------------------------------
 copyFn	mov	a,m		;copy file name byte
 	stax	d
-	
-	cpi	'?'		;wildcard used?
-	jz	wildErr		;yes, not supported
-	
+
 	cpi	' '		;space?
 	rz			;yes, done
-	
+
 	inx  	h		;bump pointers
 	inx	d
 	dcr	b
 	jnz	copyFn		;copy until B reaches zero
-	
+
 	ret
 
-wildErr	lxi	d,mNoWild	;DE->no wildcard message
-	jmp	exitMsg		;display message and exit
+;-----------------------------------------------------------------------------
+; move - Copy B bytes from (HL) to (DE)
+;-----------------------------------------------------------------------------
+move	mov	a,m		;copy byte
+	stax	d
+	inx	h		;bump pointers
+	inx	d
+	dcr	b
+	jnz	move		;copy until B reaches zero
+	ret
 
 ;-----------------------------------------------------------------------------
 ;  String Constants
 ;-----------------------------------------------------------------------------
 mHelp	db	CR,LF
- 	db	'R.COM v1.0 - Read file from host PC into CP/M',CR,LF
+ 	db	'R.COM v1.1 - Read files from host PC into CP/M',CR,LF
 	db	LF
- 	db	'Usage: R <filename>',CR,LF,'$'
-
-mNoWild	db	CR,LF,'Wildcards not supported',CR,LF,'$'
+ 	db	'Usage: R <filename>, wildcards are allowed',CR,LF,'$'
 
 mFile	db	CR,LF,'File '
 mFName	ds	16
@@ -237,12 +315,17 @@ mFName	ds	16
 mNoFile	db	' not found',CR,LF,'$'
 mMakErr	db	' - cannot create file',CR,LF,'$'
 mWrtErr	db	' - write error, disk full?',CR,LF,'$'
-mDone	db	' read from host, written to CP/M',CR,LF,'$'
+mDone	db	' read from host, written to CP/M$'
 
 ;-----------------------------------------------------------------------------
 ;  Data Area
 ;-----------------------------------------------------------------------------
 inFcb	dw	0,0,0,0,0,0,0,0,0	;36 byte FCB
 	dw	0,0,0,0,0,0,0,0,0
-	
+
+patFcb	dw	0,0,0,0,0,0,0,0,0	;36 byte FCB with file name to look for
+	dw	0,0,0,0,0,0,0,0,0
+
+buffer	equ	$		;NRECS records read from the PC
+
 	end
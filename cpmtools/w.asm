@@ -6,6 +6,7 @@
 ;
 ;	Rev	 Date	  Desc
 ;	1.0	10/2/19   Mike Douglas, Original
+;	1.1	10/18/26  agent, multi-record writes
 ;
 ;*****************************************************************************
 
@@ -21,6 +22,11 @@ WRITEF	equ	21		;BDOS write file
 MAKEF	equ	22		;BDOS make file
 SETDMA	equ	26		;BDOS set DMA address
 
+; Host only functions
+
+WRITEN	equ	121		;write multiple records, DE->buffer, B=count
+NRECS	equ	128		;records written at once
+
 ; CP/M default File Control Block (FCB)
 
 FCB	equ	5Ch		;location of default CP/M FCB
@@ -101,19 +107,9 @@ term$	mvi	a,'$'		;add trailing '$' terminator
 ;-----------------------------------------------------------------------------	
 ; opnFile - Open the input and output files
 ;-----------------------------------------------------------------------------
-; Set the buffer address for disk reads and writes
-
-opnFile	lxi	d,DEFDMA	;use the CP/M default buffer
-	mvi	c,SETDMA
-	call	pcBdos		;set buffer address
-
-	lxi	d,DEFDMA	;use the CP/M default buffer
-	mvi	c,SETDMA
-	call	BDOS		;set buffer address
-	
 ; Open the input file on the CP/M machine
 
-	xra	a		;zero current record the FCB
+opnFile	xra	a		;zero current record the FCB
 	sta	FCBCR
 
 	lxi	d,FCB		;DE->FCB for input from CP/M
@@ -138,19 +134,48 @@ opnFile	lxi	d,DEFDMA	;use the CP/M default buffer
 	ret
 	
 ;-----------------------------------------------------------------------------	
-; cpyFile - Copy the input file from CP/M to the output file on the PC
+; cpyFile - Copy the input file from CP/M to the output file on the PC.
+;    Up to NRECS records are read record by record into the buffer,
+;    then written to the PC at once.
 ;-----------------------------------------------------------------------------
-cpyFile	lxi	d,FCB		;DE->input file FCB
+cpyFile	lxi	h,buffer	;HL->buffer for the records
+	mvi	b,0		;B=number of records read
+
+rdRec	push	b		;save record count
+	push	h		;save record pointer
+	xchg			;DE->record
+	mvi	c,SETDMA
+	call	BDOS		;set buffer address
+
+	lxi	d,FCB		;DE->input file FCB
 	mvi	c,READF		;C=read file sequential
 	call	BDOS
+	pop	h		;restore record pointer
+	pop	b		;restore record count
 	ora	a		;end of file?
-	rnz			;yes, file copy is done
+	jnz	wrtRecs		;yes, write the records read and done
+
+	lxi	d,128		;HL->next record
+	dad	d
+	inr	b		;count record
+	mov	a,b
+	cpi	NRECS		;buffer full?
+	jnz	rdRec		;no, read the next one
 
-	lxi	d,outFcb	;DE->output file FCB
-	mvi	c,WRITEF	;C=write file sequential
+	call	wrtRecs		;write the buffer
+	jmp	cpyFile		;read the next records
+
+; Write the B records in the buffer to the PC
+
+wrtRecs	mov	a,b		;any records read?
+	ora	a
+	rz			;no
+
+	lxi	d,buffer	;DE->first record
+	mvi	c,WRITEN	;C=write multiple records
 	call	pcBdos		;write destination file
 	ora	a		;test for write error
-	jz	cpyFile		;no error, do next record
+	rz			;no error
 
 	lxi	d,mWrtErr	;DE->write error message
 	jmp	exitM2F		;display error, close two files & exit
@@ -214,7 +239,7 @@ wildErr	lxi	d,mNoWild	;DE->no wildcard message
 ;  String Constants
 ;-----------------------------------------------------------------------------
 mHelp	db	CR,LF
- 	db	'W.COM v1.0 - Write file to host PC from CP/M',CR,LF
+ 	db	'W.COM v1.1 - Write file to host PC from CP/M',CR,LF
 	db	LF
  	db	'Usage: W <filename>',CR,LF,'$'
 
@@ -233,5 +258,7 @@ mDone	db	' written to host PC',CR,LF,'$'
 ;-----------------------------------------------------------------------------
 outFcb	dw	0,0,0,0,0,0,0,0,0	;36 byte FCB
 	dw	0,0,0,0,0,0,0,0,0
+
+buffer	equ	$		;NRECS records written to the PC
 	
 	end
@@ -48,6 +48,7 @@
 #include "simctl.h"
 
 #include "unix_terminal.h"
+#include "unix_outbuf.h"
 #ifdef HAS_NETSERVER
 #include "netsrv.h"
 #endif
@@ -109,6 +110,15 @@ void mon(void)
 
 #ifdef FRONTPANEL
 	if (F_flag) {
+#ifdef HAS_NETSERVER
+		if (H_flag) {
+			/* initialize front panel without graphics */
+			if (!fp_initHeadless(confdir, "panel.conf")) {
+				LOGE(TAG, "frontpanel error");
+				exit(EXIT_FAILURE);
+			}
+		} else {
+#endif
 #ifndef WANT_SDL
 		XInitThreads();
 #endif
@@ -120,6 +130,9 @@ void mon(void)
 #ifdef WANT_SDL
 		fp_win_id = simsdl_create(&fp_win_funcs);
 #endif
+#ifdef HAS_NETSERVER
+		}
+#endif
 
 		fp_addQuitCallback(quit_callback);
 		fp_framerate(fp_fps);
@@ -235,6 +248,9 @@ void mon(void)
 	}
 #endif
 
+	/* write output still buffered */
+	outbuf_flush_all();
+
 #ifndef WANT_ICE
 	/* reset terminal */
 	reset_unix_terminal();
@@ -260,6 +276,11 @@ void mon(void)
 
 		/* shutdown frontpanel */
 #ifdef WANT_SDL
+#ifdef HAS_NETSERVER
+		if (H_flag)
+			fp_quit();
+		else
+#endif
 		simsdl_destroy(fp_win_id);
 #else
 		fp_quit();
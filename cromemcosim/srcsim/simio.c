@@ -64,6 +64,7 @@
 #include "cromemco-wdi.h"
 #include "simbdos.h"
 #include "unix_network.h"
+#include "unix_outbuf.h"
 #include "unix_terminal.h"
 #ifdef HAS_MODEM
 #include "generic-at-modem.h"
@@ -285,6 +286,9 @@ void exit_io(void)
 {
 	register int i;
 
+	/* write pending terminal and socket output */
+	outbuf_flush_all();
+
 	wdi_exit();
 
 	/* close line printer files */
@@ -315,6 +319,7 @@ void reset_io(void)
 	cromemco_fdc_reset();
 	th_suspend = false;	/* resume timing thread */
 	selbnk = 0;
+	vram_invalidate();
 	cromemco_dazzler_off();
 	wdi_exit();
 	wdi_init();
@@ -472,6 +477,7 @@ static void mmu_out(BYTE data)
 	}
 
 	selbnk = sel;
+	vram_invalidate();
 }
 
 /*
@@ -814,6 +820,7 @@ void ice_break(void)
 	newact.sa_flags = 0;
 	sigaction(SIGALRM, &newact, NULL);
 
+	outbuf_flush_all();
 	reset_unix_terminal();
 }
 #endif
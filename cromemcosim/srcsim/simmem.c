@@ -172,7 +172,6 @@ void init_memory(void)
 
 void reset_fdc_rom_map(void)
 {
-
 	register int i;
 
 	LOGD(TAG, "FDC BANK ROM %s", fdc_rom_active ? "ON" : "OFF");
@@ -186,4 +185,6 @@ void reset_fdc_rom_map(void)
 			MEM_RELEASE(i);
 		}
 	}
+
+	vram_invalidate();
 }
@@ -23,8 +23,11 @@
 #ifndef SIMMEM_INC
 #define SIMMEM_INC
 
+#include <string.h>
+
 #include "sim.h"
 #include "simdefs.h"
+#include "generic-vram.h"
 #ifdef WANT_ICE
 #include "simice.h"
 #endif
@@ -128,6 +131,7 @@ static inline void memwrt(WORD addr, BYTE data)
 					*(memory[i] + addr) = data;
 			}
 		}
+		vram_mark(addr);
 	}
 }
 
@@ -197,6 +201,7 @@ static inline void dma_write(WORD addr, BYTE data)
 	} else if (selbnk || p_tab[addr >> 8] == MEM_RW) {
 		*(memory[selbnk] + addr) = data;
 	}
+	vram_mark(addr);
 }
 
 /*
@@ -220,6 +225,50 @@ static inline void putmem(WORD addr, BYTE data)
 	} else {
 		*(memory[selbnk] + addr) = data;
 	}
+	vram_mark(addr);
+}
+
+/* copy a block of memory like getmem() would, one page at a time */
+static inline void getmem_block(WORD addr, BYTE *dst, int len)
+{
+	register int n;
+
+	while (len > 0) {
+		n = 256 - (addr & 0xff);
+		if (n > len)
+			n = len;
+		if (fdc_rom_active && (addr >> 13) == 0x6) {
+			memcpy(dst, fdc_banked_rom + addr - 0xC000, n);
+		} else if (selbnk || p_tab[addr >> 8] != MEM_NONE) {
+			memcpy(dst, memory[selbnk] + addr, n);
+		} else {
+			memset(dst, 0xff, n);
+		}
+		addr += n;
+		dst += n;
+		len -= n;
+	}
+}
+
+/* copy a block into memory like dma_write() would, one page at a time */
+static inline void dma_write_block(WORD addr, const BYTE *src, int len)
+{
+	register int n;
+
+	while (len > 0) {
+		n = 256 - (addr & 0xff);
+		if (n > len)
+			n = len;
+		if (fdc_rom_active && (addr >> 13) == 0x6) {
+			/* ROM is not written */
+		} else if (selbnk || p_tab[addr >> 8] == MEM_RW) {
+			memcpy(memory[selbnk] + addr, src, n);
+		}
+		vram_mark_range(addr, n);
+		addr += n;
+		src += n;
+		len -= n;
+	}
 }
 
 #endif /* !SIMMEM_INC */
@@ -37,6 +37,7 @@ extern "C" {
 extern int	fp_test(int n);
 extern int	fp_init2(const char *cfg_root_path, const char *cfg_fname, int size);
 extern int	fp_init(const char *cfg_fname);
+extern int	fp_initHeadless(const char *cfg_root_path, const char *cfg_fname);
 extern void	fp_openWindow(void);
 #ifdef WANT_SDL
 extern void	fp_procEvent(SDL_Event *event);
@@ -52,6 +53,13 @@ extern void	fp_sampleLightGroup(int groupnum, int clockwarp);
 extern void	fp_sampleSwitches(void);
 extern void	fp_quit(void);
 
+/* headless operation */
+
+extern int	fp_describe(char *buf, int len);
+extern int	fp_numLights(void);
+extern void	fp_getLights(uint8_t *levels);
+extern int	fp_switchAction(int n, int state);
+
 /* data binding functions */
 
 extern void	fp_bindPowerFlag(uint8_t *addr);
@@ -21,6 +21,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #ifdef WANT_SDL
 #include <SDL.h>
@@ -298,6 +299,116 @@ int fp_init2(const char *cfg_root_path, const char *cfg_fname, int size)
 	return 1;
 }
 
+// initialize the panel without any graphics, the lights are integrated
+// as usual and can be read with fp_getLights()
+
+int fp_initHeadless(const char *cfg_root_path, const char *cfg_fname)
+{
+	printf("FrontPanel Simulator v2.1C Copyright (C) 2007-2015 by John Kichury\n");
+
+	panel = Lpanel_new();
+	panel->headless = true;
+	Parser_init(&parser);
+
+	if (cfg_root_path)
+		Lpanel_setConfigRootPath(panel, cfg_root_path);
+
+	fp_framerate(30.);
+
+	if (!Lpanel_readConfig(panel, cfg_fname)) {
+		fprintf(stderr, "fp_initHeadless: error initializing the panel\n");
+		return 0;
+	}
+
+#ifdef WANT_SDL
+	data_sample_lock = SDL_CreateMutex();
+#else
+	pthread_mutex_init(&data_lock, NULL);
+	pthread_mutex_init(&data_sample_lock, NULL);
+#endif
+
+	return 1;
+}
+
+// write a JSON description of the lights and switches into buf,
+// returns the length of the string or -1 if buf is too small
+
+int fp_describe(char *buf, int len)
+{
+	int i, n = 0;
+	lpLight_t *light;
+	lpSwitch_t *sw;
+
+	if (panel == NULL)
+		return -1;
+
+#define FP_DESC(...)							\
+	do {								\
+		n += snprintf(&buf[n], (n < len) ? len - n : 0, __VA_ARGS__); \
+	} while (0)
+
+	FP_DESC("{\"bbox\":[%.3f,%.3f,%.3f,%.3f],\"lights\":[",
+		panel->bbox.xyz_min[0], panel->bbox.xyz_min[1],
+		panel->bbox.xyz_max[0], panel->bbox.xyz_max[1]);
+	for (i = 0; i < panel->num_lights; i++) {
+		light = panel->lights[i];
+		FP_DESC("%s{\"name\":\"%s\",\"x\":%.3f,\"y\":%.3f,\"size\":%.3f,"
+			"\"color\":[%.2f,%.2f,%.2f]}", i ? "," : "", light->name,
+			light->parms->pos[0], light->parms->pos[1],
+			light->parms->scale[0], light->parms->color[0],
+			light->parms->color[1], light->parms->color[2]);
+	}
+	FP_DESC("],\"switches\":[");
+	for (i = 0; i < panel->num_switches; i++) {
+		sw = panel->switches[i];
+		FP_DESC("%s{\"name\":\"%s\",\"x\":%.3f,\"y\":%.3f,\"size\":%.3f,"
+			"\"op\":%d,\"state\":%d}", i ? "," : "", sw->name,
+			sw->parms->pos[0], sw->parms->pos[1], sw->parms->scale[0],
+			sw->operation, sw->state);
+	}
+	FP_DESC("]}");
+
+#undef FP_DESC
+
+	return (n < len) ? n : -1;
+}
+
+int fp_numLights(void)
+{
+	return panel ? panel->num_lights : 0;
+}
+
+// get the brightness of all lights as values from 0 - 255
+
+void fp_getLights(uint8_t *levels)
+{
+#ifdef WANT_SDL
+	SDL_LockMutex(data_sample_lock);
+#else
+	pthread_mutex_lock(&data_sample_lock);
+#endif
+
+	Lpanel_getLevels(panel, levels);
+
+#ifdef WANT_SDL
+	SDL_UnlockMutex(data_sample_lock);
+#else
+	pthread_mutex_unlock(&data_sample_lock);
+#endif
+}
+
+// operate switch n like a mouse click would, state is one of FP_SW_*
+
+int fp_switchAction(int n, int state)
+{
+	if (panel == NULL || n < 0 || n >= panel->num_switches ||
+	    state < FP_SW_DOWN || state > FP_SW_CENTER)
+		return 0;
+
+	lpSwitch_action(panel->switches[n], state);
+	return 1;
+}
+
 #ifdef WANT_SDL
 
 void fp_openWindow(void)
@@ -405,18 +516,19 @@ void fp_addQuitCallback(void (*cbfunc)(void))
 void fp_quit(void)
 {
 #ifdef WANT_SDL
-	Lpanel_destroyWindow(panel);
+	if (!panel->headless)
+		Lpanel_destroyWindow(panel);
 
 	SDL_DestroyMutex(data_sample_lock);
 #else /* !WANT_SDL */
 	int i;
-	bool okay = false;
+	bool okay = panel->headless;
 
 	pthread_mutex_lock(&data_lock);
 	thread_info.run = 0;
 	pthread_mutex_unlock(&data_lock);
 
-	for (i = 0; i < 10; i++) {
+	for (i = 0; i < 10 && !okay; i++) {
 		pthread_mutex_lock(&data_lock);
 		if (thread_info.running == 0) {
 			okay = true;
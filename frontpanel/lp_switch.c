@@ -690,7 +690,8 @@ int Lpanel_addSwitch(Lpanel_t *p, const char *name, lp_obj_parm_t *obj, const ch
 				strcat(sound_path, result->strings[0]);
 				sound_path[len] = 0;
 
-				if ((sw->on_sound = Mix_LoadWAV(sound_path)) == NULL) {
+				if (!p->headless &&
+				    (sw->on_sound = Mix_LoadWAV(sound_path)) == NULL) {
 					printf("Could not load switch 'onsound' '%s'.\n",
 					       sound_path);
 					free(sound_path);
@@ -712,7 +713,8 @@ int Lpanel_addSwitch(Lpanel_t *p, const char *name, lp_obj_parm_t *obj, const ch
 				strcat(sound_path, result->strings[0]);
 				sound_path[len] = 0;
 
-				if ((sw->off_sound = Mix_LoadWAV(sound_path)) == NULL) {
+				if (!p->headless &&
+				    (sw->off_sound = Mix_LoadWAV(sound_path)) == NULL) {
 					printf("Could not load switch 'offsound' '%s'.\n",
 					       sound_path);
 					free(sound_path);
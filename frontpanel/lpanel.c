@@ -270,6 +270,11 @@ static void sampleData64invert(lpLight_t *p)
 	p->state = bit;
 }
 
+static void sampleBus(lpLight_t *p)
+{
+	lpBus_sample(p->bus, *p->simclock);
+}
+
 Lpanel_t *Lpanel_new(void)
 {
 	Lpanel_t *p = (Lpanel_t *) calloc(1, sizeof(Lpanel_t));
@@ -308,10 +313,20 @@ void Lpanel_init(Lpanel_t *p)		// initializer
 	p->max_lights = 0;
 	p->lights = NULL;
 
+	p->num_buses = 0;
+	p->max_buses = 0;
+	p->buses = NULL;
+
+	p->num_sample_lights = 0;
+	p->sample_lights = NULL;
+	p->sample_lights_valid = false;
+
 	p->num_switches = p->max_switches = 0;
 	p->switches = NULL;
 	p->mom_switch_pressed = NULL;
 
+	p->headless = false;
+
 	p->default_clock = 0;
 	p->old_clock = 0;
 	p->simclock = &p->default_clock;
@@ -329,6 +344,10 @@ void Lpanel_init(Lpanel_t *p)		// initializer
 		p->light_groups[i].num_items = 0;
 		p->light_groups[i].max_items = 0;
 		p->light_groups[i].list = NULL;
+		p->light_groups[i].buses = NULL;
+		p->light_groups[i].sample_lights = NULL;
+		p->light_groups[i].num_buses = 0;
+		p->light_groups[i].num_sample_lights = 0;
 	}
 
 	// init light graphics
@@ -419,6 +438,21 @@ void Lpanel_fini(Lpanel_t *p)		// finalizer
 			lpLight_delete(p->lights[i]);
 	p->num_lights = p->max_lights = 0;
 
+	for (i = 0; i < p->num_buses; i++)
+		lpBus_delete(p->buses[i]);
+	if (p->buses) {
+		free(p->buses);
+		p->buses = NULL;
+	}
+	p->num_buses = p->max_buses = 0;
+
+	if (p->sample_lights) {
+		free(p->sample_lights);
+		p->sample_lights = NULL;
+	}
+	p->num_sample_lights = 0;
+	p->sample_lights_valid = false;
+
 	for (i = 0; i < p->num_objects; i++)
 		if (p->objects[i])
 			lpObject_delete(p->objects[i]);
@@ -436,6 +470,12 @@ void Lpanel_fini(Lpanel_t *p)		// finalizer
 		}
 		p->light_groups[i].num_items = 0;
 		p->light_groups[i].max_items = 0;
+		free(p->light_groups[i].buses);
+		p->light_groups[i].buses = NULL;
+		free(p->light_groups[i].sample_lights);
+		p->light_groups[i].sample_lights = NULL;
+		p->light_groups[i].num_buses = 0;
+		p->light_groups[i].num_sample_lights = 0;
 	}
 
 	lpTextures_fini(&p->textures);
@@ -546,6 +586,7 @@ int Lpanel_addLightToGroup(Lpanel_t *p, int lightnum, int groupnum)
 	}
 	p->light_groups[groupnum].list[p->light_groups[groupnum].num_items] = lightnum;
 	p->light_groups[groupnum].num_items++;
+	p->sample_lights_valid = false;
 	return 1;
 }
 
@@ -576,8 +617,7 @@ bool Lpanel_bindLight8(Lpanel_t *p, const char *name, void *loc, int start_bit_n
 		light = Lpanel_findLightByName(p, namelist[i]);
 
 		if (light) {
-			lpLight_bindData8(light, (uint8_t *) loc);
-			lpLight_setBitNumber(light, bitnum - 1);
+			lpLight_bindBus(light, Lpanel_findBus(p, loc, 8), bitnum - 1, false);
 		} else {
 			if (!p->ignore_bind_errors)
 				fprintf(stderr, "bindLight8: light %s not found\n",
@@ -623,11 +663,8 @@ bool Lpanel_bindLight8invert(Lpanel_t *p, const char *name, void *loc, int start
 		light = Lpanel_findLightByName(p, namelist[i]);
 
 		if (light) {
-			if (mask & (0x1 << (bitnum - 1)))
-				lpLight_bindData8invert(light, (uint8_t *) loc);
-			else
-				lpLight_bindData8(light, (uint8_t *) loc);
-			lpLight_setBitNumber(light, bitnum - 1);
+			lpLight_bindBus(light, Lpanel_findBus(p, loc, 8), bitnum - 1,
+					(mask >> (bitnum - 1)) & 1);
 		} else {
 			if (!p->ignore_bind_errors)
 				fprintf(stderr, "bindLight8invert: light %s not found\n",
@@ -670,8 +707,7 @@ bool Lpanel_bindLight16(Lpanel_t *p, const char *name, void *loc, int start_bit_
 		light = Lpanel_findLightByName(p, namelist[i]);
 
 		if (light) {
-			lpLight_bindData16(light, (uint16_t *) loc);
-			lpLight_setBitNumber(light, bitnum - 1);
+			lpLight_bindBus(light, Lpanel_findBus(p, loc, 16), bitnum - 1, false);
 		} else {
 			if (!p->ignore_bind_errors)
 				fprintf(stderr, "bindLight16: light %s not found\n",
@@ -752,11 +788,8 @@ bool Lpanel_bindLight16invert(Lpanel_t *p, const char *name, void *loc, int star
 		light = Lpanel_findLightByName(p, namelist[i]);
 
 		if (light) {
-			if (mask & (0x1 << (bitnum - 1)))
-				lpLight_bindData16invert(light, (uint16_t *) loc);
-			else
-				lpLight_bindData16(light, (uint16_t *) loc);
-			lpLight_setBitNumber(light, bitnum - 1);
+			lpLight_bindBus(light, Lpanel_findBus(p, loc, 16), bitnum - 1,
+					(mask >> (bitnum - 1)) & 1);
 		} else {
 			if (!p->ignore_bind_errors)
 				fprintf(stderr, "bindLight16invert: light %s not found\n",
@@ -799,8 +832,7 @@ bool Lpanel_bindLight32(Lpanel_t *p, const char *name, void *loc, int start_bit_
 		light = Lpanel_findLightByName(p, namelist[i]);
 
 		if (light) {
-			lpLight_bindData32(light, (uint32_t *) loc);
-			lpLight_setBitNumber(light, bitnum - 1);
+			lpLight_bindBus(light, Lpanel_findBus(p, loc, 32), bitnum - 1, false);
 		} else {
 			if (!p->ignore_bind_errors)
 				fprintf(stderr, "bindLight32: light %s not found\n",
@@ -844,11 +876,8 @@ bool Lpanel_bindLight32invert(Lpanel_t *p, const char *name, void *loc, int star
 		light = Lpanel_findLightByName(p, namelist[i]);
 
 		if (light) {
-			if (mask & (0x1 << (bitnum - 1)))
-				lpLight_bindData32invert(light, (uint32_t *) loc);
-			else
-				lpLight_bindData32(light, (uint32_t *) loc);
-			lpLight_setBitNumber(light, bitnum - 1);
+			lpLight_bindBus(light, Lpanel_findBus(p, loc, 32), bitnum - 1,
+					(mask >> (bitnum - 1)) & 1);
 		} else {
 			if (!p->ignore_bind_errors)
 				fprintf(stderr, "bindLight32invert: light %s not found\n",
@@ -891,8 +920,7 @@ bool Lpanel_bindLight64(Lpanel_t *p, const char *name, void *loc, int start_bit_
 		light = Lpanel_findLightByName(p, namelist[i]);
 
 		if (light) {
-			lpLight_bindData64(light, (uint64_t *) loc);
-			lpLight_setBitNumber(light, bitnum - 1);
+			lpLight_bindBus(light, Lpanel_findBus(p, loc, 64), bitnum - 1, false);
 		} else {
 			if (!p->ignore_bind_errors)
 				fprintf(stderr, "bindLight64: light %s not found\n",
@@ -936,11 +964,8 @@ bool Lpanel_bindLight64invert(Lpanel_t *p, const char *name, void *loc, int star
 		light = Lpanel_findLightByName(p, namelist[i]);
 
 		if (light) {
-			if (mask & (0x1 << (bitnum - 1)))
-				lpLight_bindData64invert(light, (uint64_t *) loc);
-			else
-				lpLight_bindData64(light, (uint64_t *) loc);
-			lpLight_setBitNumber(light, bitnum - 1);
+			lpLight_bindBus(light, Lpanel_findBus(p, loc, 64), bitnum - 1,
+					(mask >> (bitnum - 1)) & 1);
 		} else {
 			if (!p->ignore_bind_errors)
 				fprintf(stderr, "bindLight64invert: light %s not found\n",
@@ -1046,6 +1071,32 @@ void Lpanel_draw(Lpanel_t *p)
 	glDisable(GL_POLYGON_OFFSET_LINE);
 }
 
+// get the brightness of all lights as values from 0 - 255,
+// used instead of Lpanel_draw() when running headless
+
+void Lpanel_getLevels(Lpanel_t *p, uint8_t *levels)
+{
+	int i;
+	float level;
+	lpLight_t *light;
+
+	for (i = 0; i < p->num_lights; i++) {
+		light = p->lights[i];
+		lpLight_update(light);
+
+		if (light->bindtype == LBINDTYPE_BIT && !*light->runflag)
+			level = (float) light->state;
+		else
+			level = light->intensity;
+
+		if (level < 0.0)
+			level = 0.0;
+		else if (level > 1.0)
+			level = 1.0;
+		levels[i] = (uint8_t) (level * 255.0 + 0.5);
+	}
+}
+
 void Lpanel_growLights(Lpanel_t *p)
 {
 	lpLight_t **new_lights;
@@ -1056,6 +1107,84 @@ void Lpanel_growLights(Lpanel_t *p)
 	p->lights = new_lights;
 }
 
+void Lpanel_growBuses(Lpanel_t *p)
+{
+	lpBus_t **new_buses;
+
+	new_buses = (lpBus_t **) realloc(p->buses,
+					 sizeof(lpBus_t *) * (p->num_buses + 8));
+	p->max_buses += 8;
+	p->buses = new_buses;
+}
+
+// find the bus for a data word, create it if it doesn't exist yet
+
+lpBus_t *Lpanel_findBus(Lpanel_t *p, void *loc, int width)
+{
+	int i;
+
+	for (i = 0; i < p->num_buses; i++) {
+		if (p->buses[i]->dataptr == loc && p->buses[i]->width == width)
+			return p->buses[i];
+	}
+
+	if (p->num_buses + 1 > p->max_buses)
+		Lpanel_growBuses(p);
+
+	p->buses[p->num_buses] = lpBus_new(loc, width);
+	return p->buses[p->num_buses++];
+}
+
+// rebuild the list of lights that still need to be sampled one by one,
+// and for each light group its distinct buses and lights without a bus
+
+static bool sampleLight(lpLight_t *light)
+{
+	return light->bus == NULL && light->sampleDataFunc != sampleData8_error;
+}
+
+static void Lpanel_updateLightGroup(Lpanel_t *p, lp_light_group_t *g)
+{
+	int i, j;
+	lpLight_t *light;
+
+	free(g->buses);
+	free(g->sample_lights);
+	g->buses = (lpBus_t **) malloc(sizeof(lpBus_t *) * (g->num_items + 1));
+	g->sample_lights = (lpLight_t **) malloc(sizeof(lpLight_t *) * (g->num_items + 1));
+	g->num_buses = g->num_sample_lights = 0;
+
+	for (i = 0; i < g->num_items; i++) {
+		light = p->lights[g->list[i]];
+		if (light->bus) {
+			for (j = 0; j < g->num_buses; j++)
+				if (g->buses[j] == light->bus)
+					break;
+			if (j == g->num_buses)
+				g->buses[g->num_buses++] = light->bus;
+		} else if (sampleLight(light))
+			g->sample_lights[g->num_sample_lights++] = light;
+	}
+}
+
+void Lpanel_updateSampleLights(Lpanel_t *p)
+{
+	int i;
+
+	free(p->sample_lights);
+	p->sample_lights = (lpLight_t **) malloc(sizeof(lpLight_t *) * (p->num_lights + 1));
+	p->num_sample_lights = 0;
+
+	for (i = 0; i < p->num_lights; i++)
+		if (sampleLight(p->lights[i]))
+			p->sample_lights[p->num_sample_lights++] = p->lights[i];
+
+	for (i = 0; i < LP_MAX_LIGHT_GROUPS; i++)
+		Lpanel_updateLightGroup(p, &p->light_groups[i]);
+
+	p->sample_lights_valid = true;
+}
+
 void Lpanel_growSwitches(Lpanel_t *p)
 {
 	lpSwitch_t **new_switches;
@@ -1225,7 +1354,8 @@ bool Lpanel_readConfig(Lpanel_t *p, const char *_fname)
 			strcat(sound_path, token);
 			sound_path[len] = 0;
 
-			if ((p->fan_sound = Mix_LoadWAV(sound_path)) == NULL) {
+			if (!p->headless &&
+			    (p->fan_sound = Mix_LoadWAV(sound_path)) == NULL) {
 				printf("Error on line %d of config file %s\n",
 				       lineno, fname);
 				printf("could not load sound '%s'.\n", sound_path);
@@ -1539,6 +1669,12 @@ bool Lpanel_readConfig(Lpanel_t *p, const char *_fname)
 			strcat(texture_path, token);
 			texture_path[len] = 0;
 
+			// nothing is rendered when running headless
+			if (p->headless) {
+				free(texture_path);
+				continue;
+			}
+
 			if (!(p->curr_object->texture_num = lpTextures_addTexture(&p->textures,
 										  texture_path))) {
 				printf("Error on line %d of config file %s\n", lineno, fname);
@@ -1728,8 +1864,14 @@ void Lpanel_sampleData(Lpanel_t *p)
 	}
 	p->old_clock = *p->simclock;
 
-	for (i = 0; i < p->num_lights; i++)
-		lpLight_sampleData(p->lights[i]);
+	for (i = 0; i < p->num_buses; i++)
+		lpBus_sample(p->buses[i], *p->simclock);
+
+	if (!p->sample_lights_valid)
+		Lpanel_updateSampleLights(p);
+
+	for (i = 0; i < p->num_sample_lights; i++)
+		lpLight_sampleData(p->sample_lights[i]);
 }
 
 void Lpanel_sampleDataWarp(Lpanel_t *p, int clockwarp)
@@ -1738,8 +1880,14 @@ void Lpanel_sampleDataWarp(Lpanel_t *p, int clockwarp)
 
 	p->clock_warp = clockwarp;
 
-	for (i = 0; i < p->num_lights; i++)
-		lpLight_sampleData(p->lights[i]);
+	for (i = 0; i < p->num_buses; i++)
+		lpBus_sample(p->buses[i], *p->simclock);
+
+	if (!p->sample_lights_valid)
+		Lpanel_updateSampleLights(p);
+
+	for (i = 0; i < p->num_sample_lights; i++)
+		lpLight_sampleData(p->sample_lights[i]);
 
 	p->clock_warp = 0;
 }
@@ -1747,16 +1895,26 @@ void Lpanel_sampleDataWarp(Lpanel_t *p, int clockwarp)
 void Lpanel_sampleLightGroup(Lpanel_t *p, int groupnum, int clockval)
 {
 	int i;
+	lp_light_group_t *g;
 
 	if (groupnum < 0 || groupnum >= LP_MAX_LIGHT_GROUPS) {
 		fprintf(stderr, "sampleLightGroup: groupnum (%d) must be in the "
 			"range of (0-%d).\n", groupnum, LP_MAX_LIGHT_GROUPS - 1);
+		return;
 	}
 
+	if (!p->sample_lights_valid)
+		Lpanel_updateSampleLights(p);
+
 	p->clock_warp = clockval;
 
-	for (i = 0; i < p->light_groups[groupnum].num_items; i++)
-		lpLight_sampleData(p->lights[p->light_groups[groupnum].list[i]]);
+	// the lights of a group mostly share a few data words,
+	// so sample each of them only once
+	g = &p->light_groups[groupnum];
+	for (i = 0; i < g->num_buses; i++)
+		lpBus_sample(g->buses[i], *p->simclock);
+	for (i = 0; i < g->num_sample_lights; i++)
+		lpLight_sampleData(g->sample_lights[i]);
 
 	p->clock_warp = 0;
 }
@@ -1780,6 +1938,80 @@ void Lpanel_ignoreBindErrors(Lpanel_t *p, bool f)
 	p->ignore_bind_errors = f;
 };
 
+// -----------
+// lpBus class
+// -----------
+
+lpBus_t *lpBus_new(void *dataptr, int width)
+{
+	lpBus_t *p = (lpBus_t *) calloc(1, sizeof(lpBus_t));
+
+	if (p) {
+		p->dataptr = dataptr;
+		p->width = width;
+	}
+
+	return p;
+}
+
+void lpBus_delete(lpBus_t *p)
+{
+	free(p);
+}
+
+// add the length of the current run to the on time of all bits set in
+// the sampled value, the loop is branch free so the compiler can vectorize it
+
+static void lpBus_credit(lpBus_t *p)
+{
+	int i;
+	uint64_t dt, value;
+
+	dt = p->old_clock - p->run_start;
+	value = p->value;
+
+	if (dt && value)
+		for (i = 0; i < p->width; i++)
+			p->on_time[i] += dt & -((value >> i) & 0x01);
+
+	p->run_start = p->old_clock;
+}
+
+void lpBus_sample(lpBus_t *p, uint64_t clock)
+{
+	uint64_t value;
+
+	switch (p->width) {
+	case 8:
+		value = *(uint8_t *) p->dataptr;
+		break;
+	case 16:
+		value = *(uint16_t *) p->dataptr;
+		break;
+	case 32:
+		value = *(uint32_t *) p->dataptr;
+		break;
+	default:
+		value = *(uint64_t *) p->dataptr;
+		break;
+	}
+	value ^= p->invert;
+
+	// the time since the last sample counts for the new value,
+	// so only a change of the value ends the current run
+	if (value != p->value) {
+		lpBus_credit(p);
+		p->value = value;
+	}
+	p->old_clock = clock;
+	p->nsamples++;
+}
+
+void lpBus_flush(lpBus_t *p)
+{
+	lpBus_credit(p);
+}
+
 // -------------
 // lpLight class
 // -------------
@@ -1810,6 +2042,9 @@ void lpLight_init(lpLight_t *p)
 	p->obj_refname = NULL;
 	p->obj_ref = NULL;
 	p->sampleDataFunc = sampleData8_error;
+	p->bus = NULL;
+	p->on_base = 0;
+	p->bus_samples = 0;
 	p->drawFunc = drawLightGraphics;
 	p->t1 = p->t2 = p->on_time = 1;
 	p->start_clock = 0;
@@ -1851,7 +2086,10 @@ void lpLight_bindSimclock(lpLight_t *p, uint64_t *addr, int *clockwarp)
 	p->clock_warp = clockwarp;
 }
 
-void lpLight_draw(lpLight_t *p)
+// update intensity and color of a light, this is everything drawing a
+// light does besides the graphics
+
+void lpLight_update(lpLight_t *p)
 {
 	int i;
 	// float *fp;
@@ -1859,6 +2097,10 @@ void lpLight_draw(lpLight_t *p)
 	switch (p->bindtype) {
 
 	case LBINDTYPE_BIT:
+		if (p->bus) {
+			p->state = (p->bus->value >> p->bitnum) & 0x01;
+			p->dirty = (p->bus_samples != p->bus->nsamples);
+		}
 		if (*p->runflag) {
 			if (p->dirty)
 				lpLight_calcIntensity(p);
@@ -1905,6 +2147,11 @@ void lpLight_draw(lpLight_t *p)
 			fprintf(stderr, "draw: %s %f\n", p->name, p->intensity);
 		}
 #endif
+}
+
+void lpLight_draw(lpLight_t *p)
+{
+	lpLight_update(p);
 
 	glPushMatrix();
 	glTranslatef(p->parms->pos[0], p->parms->pos[1], p->parms->pos[2]);
@@ -1933,16 +2180,27 @@ void lpLight_print(lpLight_t *p)
 	       p->parms->color[2]);
 }
 
+// take the light off its bus when it gets bound to something else
+
+static void lpLight_unbindBus(lpLight_t *p)
+{
+	p->bus = NULL;
+	if (p->panel)
+		p->panel->sample_lights_valid = false;
+}
+
 void lpLight_bindData8(lpLight_t *p, uint8_t *ptr)
 {
 	p->sampleDataFunc = sampleData8;
 	p->dataptr = (uint8_t *) ptr;
+	lpLight_unbindBus(p);
 }
 
 void lpLight_bindData8invert(lpLight_t *p, uint8_t *ptr)
 {
 	p->sampleDataFunc = sampleData8invert;
 	p->dataptr = (uint8_t *) ptr;
+	lpLight_unbindBus(p);
 }
 
 void lpLight_bindData16(lpLight_t *p, uint16_t *ptr)
@@ -1950,6 +2208,7 @@ void lpLight_bindData16(lpLight_t *p, uint16_t *ptr)
 	// xyzzy
 	p->sampleDataFunc = sampleData16;
 	p->dataptr = (uint16_t *) ptr;
+	lpLight_unbindBus(p);
 }
 
 void lpLight_bindDatafv(lpLight_t *p, float *ptr)
@@ -1957,36 +2216,67 @@ void lpLight_bindDatafv(lpLight_t *p, float *ptr)
 	p->sampleDataFunc = sampleDatafv;
 	p->dataptr = (float *) ptr;
 	p->bindtype = LBINDTYPE_FLOATV;
+	lpLight_unbindBus(p);
 }
 
 void lpLight_bindData16invert(lpLight_t *p, uint16_t *ptr)
 {
 	p->sampleDataFunc = sampleData16invert;
 	p->dataptr = (uint16_t *) ptr;
+	lpLight_unbindBus(p);
 }
 
 void lpLight_bindData32(lpLight_t *p, uint32_t *ptr)
 {
 	p->sampleDataFunc = sampleData32;
 	p->dataptr = (uint32_t *) ptr;
+	lpLight_unbindBus(p);
 }
 
 void lpLight_bindData32invert(lpLight_t *p, uint32_t *ptr)
 {
 	p->sampleDataFunc = sampleData32invert;
 	p->dataptr = (uint32_t *) ptr;
+	lpLight_unbindBus(p);
 }
 
 void lpLight_bindData64(lpLight_t *p, uint64_t *ptr)
 {
 	p->sampleDataFunc = sampleData64;
 	p->dataptr = (uint64_t *) ptr;
+	lpLight_unbindBus(p);
 }
 
 void lpLight_bindData64invert(lpLight_t *p, uint64_t *ptr)
 {
 	p->sampleDataFunc = sampleData64invert;
 	p->dataptr = (uint64_t *) ptr;
+	lpLight_unbindBus(p);
+}
+
+void lpLight_bindBus(lpLight_t *p, lpBus_t *bus, int bitnum, bool invert)
+{
+	if (bitnum >= bus->width) {
+		fprintf(stderr, "bindBus: light %s bitnum %d exceeds bus width %d\n",
+			p->name, bitnum + 1, bus->width);
+		return;
+	}
+
+	p->sampleDataFunc = sampleBus;
+	p->dataptr = bus->dataptr;
+	p->bindtype = LBINDTYPE_BIT;
+	p->bus = bus;
+	p->bitnum = bitnum;
+	p->on_base = bus->on_time[bitnum];
+	p->bus_samples = bus->nsamples;
+
+	if (invert)
+		bus->invert |= (uint64_t) 1 << bitnum;
+	else
+		bus->invert &= ~((uint64_t) 1 << bitnum);
+
+	if (p->panel)
+		p->panel->sample_lights_valid = false;
 }
 
 void lpLight_calcIntensity(lpLight_t *p)
@@ -1995,6 +2285,13 @@ void lpLight_calcIntensity(lpLight_t *p)
 	// unsigned int dt;
 	uint64_t clock_delta;
 
+	// pick up the on time the bus accumulated for this light
+	if (p->bus) {
+		lpBus_flush(p->bus);
+		p->on_time = p->bus->on_time[p->bitnum] - p->on_base;
+		p->old_clock = p->bus->old_clock;
+	}
+
 	clock_delta = p->old_clock - p->start_clock;
 	if (clock_delta == 0) {
 		// p->intensity = 0.;
@@ -2019,6 +2316,10 @@ void lpLight_calcIntensity(lpLight_t *p)
 	p->start_clock = *p->simclock;
 	p->on_time = 0;
 	p->dirty = false;
+	if (p->bus) {
+		p->on_base = p->bus->on_time[p->bitnum];
+		p->bus_samples = p->bus->nsamples;
+	}
 
 	for (i = 0; i < 3; i++) {
 		p->color[i] = p->parms->color[i] * p->intensity + p->parms->color[i] * .2;
@@ -43,6 +43,7 @@
 // forward references
 
 struct lpLight;
+struct lpBus;
 struct lpSwitch;
 struct Lpanel;
 
@@ -90,6 +91,12 @@ typedef struct lp_light_group {
 	int 	num_items,
 		max_items,
 		*list;
+
+	struct lpBus	**buses;	// distinct data words of the lights
+	struct lpLight	**sample_lights; // lights not bound to a bus
+
+	int	num_buses,
+		num_sample_lights;
 } lp_light_group_t;
 
 #include "lp_gfx.h"
@@ -107,6 +114,16 @@ typedef struct Lpanel {
 
 	struct lpLight	**lights;
 
+	struct lpBus	**buses;	// data words bound to lights
+
+	int		num_buses,
+			max_buses;
+
+	struct lpLight	**sample_lights; // lights not bound to a bus
+
+	int		num_sample_lights;
+	bool		sample_lights_valid;
+
 	lp_light_group_t light_groups[LP_MAX_LIGHT_GROUPS];
 
 	lpSwitch_t	**switches;
@@ -145,6 +162,8 @@ typedef struct Lpanel {
 	lpTextures_t	textures;
 
 	// public variables
+	bool		headless;	// no window, lights are read by fp_getLights()
+
 	uint64_t	default_clock,
 			*simclock,
 			old_clock;
@@ -205,6 +224,9 @@ extern void		Lpanel_fini(Lpanel_t *p);
 
 extern void		Lpanel_genGraphicsData(Lpanel_t *p);
 extern void		Lpanel_growLights(Lpanel_t *p);
+extern void		Lpanel_growBuses(Lpanel_t *p);
+extern struct lpBus	*Lpanel_findBus(Lpanel_t *p, void *loc, int width);
+extern void		Lpanel_updateSampleLights(Lpanel_t *p);
 extern void		Lpanel_growObjects(Lpanel_t *p);
 extern void		Lpanel_growAlphaObjects(Lpanel_t *p);
 extern void		Lpanel_growSwitches(Lpanel_t *p);
@@ -234,6 +256,7 @@ extern void		Lpanel_bindSimclock(Lpanel_t *p, uint64_t *addr);
 extern void		Lpanel_bindRunFlag(Lpanel_t *p, uint8_t *addr);
 
 extern void		Lpanel_draw(Lpanel_t *p);
+extern void		Lpanel_getLevels(Lpanel_t *p, uint8_t *levels);
 extern struct lpLight	*Lpanel_findLightByName(Lpanel_t *p, char *name);
 extern lpObject_t	*Lpanel_findObjectByName(Lpanel_t *p, char *name);
 
@@ -305,6 +328,31 @@ extern void		Lpanel_make_cursor_text(Lpanel_t *p);
 
 extern void		Lpanel_draw_stats(Lpanel_t *p);
 
+// class lpBus
+// -----------
+// A data word of 8, 16, 32 or 64 bits that is sampled as a whole. All lights
+// bound to the same word share one bus. The on time of the bits is only
+// accumulated when the sampled word changes, so the sampling cost depends on
+// the number of bound words and not on the number of lights.
+
+typedef struct lpBus {
+	void		*dataptr;	// pointer to data word to sample
+	int		width;		// 8, 16, 32 or 64 bits
+	uint64_t	invert;		// mask of bits to invert after sampling
+	uint64_t	value;		// last sampled (inverted) value
+
+	uint64_t	run_start,	// clock when value was first sampled
+			old_clock,	// clock of last sample
+			nsamples;	// number of samples taken
+
+	uint64_t	on_time[64];	// accumulated on time per bit
+} lpBus_t;
+
+extern lpBus_t		*lpBus_new(void *dataptr, int width);
+extern void		lpBus_delete(lpBus_t *p);
+extern void		lpBus_sample(lpBus_t *p, uint64_t clock);
+extern void		lpBus_flush(lpBus_t *p);
+
 // class lpLight
 // -------------
 
@@ -330,6 +378,10 @@ typedef struct lpLight {
 	int		datatype;	// datatype dataptr points to
 	int		bitnum;		// bit in data controlling this light
 
+	lpBus_t		*bus;		// bus if bound to a data word
+	uint64_t	on_base,	// bus on time at start_clock
+			bus_samples;	// bus samples at last intensity calc
+
 	char		*obj_refname;	// name of object if this light references one.
 	lpObject_t	*obj_ref;	// pointer to object if this light references one.
 
@@ -374,11 +426,13 @@ extern void		lpLight_bindData32(lpLight_t *p, uint32_t *ptr);
 extern void		lpLight_bindData32invert(lpLight_t *p, uint32_t *ptr);
 extern void		lpLight_bindData64(lpLight_t *p, uint64_t *ptr);
 extern void		lpLight_bindData64invert(lpLight_t *p, uint64_t *ptr);
+extern void		lpLight_bindBus(lpLight_t *p, lpBus_t *bus, int bitnum, bool invert);
 
 extern void		lpLight_bindSimclock(lpLight_t *p, uint64_t *addr, int *clockwarp);
 
 extern void		lpLight_calcIntensity(lpLight_t *p);
 extern void		lpLight_draw(lpLight_t *p);
+extern void		lpLight_update(lpLight_t *p);
 extern void		lpLight_print(lpLight_t *p);
 
 extern void		lpLight_setupData(lpLight_t *p);
@@ -54,6 +54,7 @@
 #ifdef UNIX_TERMINAL
 #include "unix_terminal.h"
 #endif
+#include "unix_outbuf.h"
 #ifdef HAS_NETSERVER
 #include "netsrv.h"
 #endif
@@ -97,6 +98,18 @@ static win_funcs_t fp_win_funcs = {
 #endif
 #endif /* FRONTPANEL */
 
+#ifdef WANT_ICE
+/*
+ *	Write the output the CPU left in the buffers and reset the
+ *	terminal, before the ICE shows anything.
+ */
+static void ice_after_run(void)
+{
+	outbuf_flush_all();
+	reset_unix_terminal();
+}
+#endif
+
 /*
  *	This function initializes the front panel and terminal.
  *	Then the machine waits to be operated from the front panel,
@@ -114,6 +127,15 @@ void mon(void)
 
 #ifdef FRONTPANEL
 	if (F_flag) {
+#ifdef HAS_NETSERVER
+		if (H_flag) {
+			/* initialize front panel without graphics */
+			if (!fp_initHeadless(confdir, "panel.conf")) {
+				LOGE(TAG, "frontpanel error");
+				exit(EXIT_FAILURE);
+			}
+		} else {
+#endif
 #ifndef WANT_SDL
 		XInitThreads();
 #endif
@@ -126,6 +148,9 @@ void mon(void)
 #ifdef WANT_SDL
 		fp_win_id = simsdl_create(&fp_win_funcs);
 #endif
+#ifdef HAS_NETSERVER
+		}
+#endif
 
 		fp_addQuitCallback(quit_callback);
 		fp_framerate(fp_fps);
@@ -223,7 +248,7 @@ void mon(void)
 #endif /* FRONTPANEL */
 #ifdef WANT_ICE
 		ice_before_go = set_unix_terminal;
-		ice_after_go = reset_unix_terminal;
+		ice_after_go = ice_after_run;
 		atexit(reset_unix_terminal);
 
 		ice_cmd_loop(0);
@@ -235,6 +260,9 @@ void mon(void)
 	}
 #endif
 
+	/* write output still buffered */
+	outbuf_flush_all();
+
 #ifdef UNIX_TERMINAL
 #ifndef WANT_ICE
 	/* reset terminal */
@@ -261,6 +289,11 @@ void mon(void)
 
 		/* stop frontpanel */
 #ifdef WANT_SDL
+#ifdef HAS_NETSERVER
+		if (H_flag)
+			fp_quit();
+		else
+#endif
 		simsdl_destroy(fp_win_id);
 #else
 		fp_quit();
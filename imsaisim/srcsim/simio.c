@@ -66,6 +66,7 @@
 #include "rtc80.h"
 #include "simbdos.h"
 #include "unix_network.h"
+#include "unix_outbuf.h"
 #ifdef HAS_CYCLOPS
 #include "cromemco-88ccc.h"
 #endif
@@ -313,6 +314,9 @@ void exit_io(void)
 {
 	register int i;
 
+	/* write pending terminal and socket output */
+	outbuf_flush_all();
+
 	/* close line printer file */
 	if (printer != 0)
 		close(printer);
@@ -572,6 +576,7 @@ static void mmu_out(BYTE data)
 	}
 
 	selbnk = data;
+	vram_invalidate();
 }
 
 #ifdef HAS_APU
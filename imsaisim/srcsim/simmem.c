@@ -291,6 +291,7 @@ void reset_memory(void)
 	cyclecount = 0;
 #endif
 	selbnk = 0;
+	vram_invalidate();
 }
 
 void ctrl_port_out(BYTE data)
@@ -27,8 +27,11 @@
 #ifndef SIMMEM_INC
 #define SIMMEM_INC
 
+#include <string.h>
+
 #include "sim.h"
 #include "simdefs.h"
+#include "generic-vram.h"
 #ifdef WANT_ICE
 #include "simice.h"
 #endif
@@ -142,6 +145,7 @@ static inline void memwrt(WORD addr, BYTE data)
 		*(banks[selbnk] + addr) = data;
 	}
 
+	vram_mark(addr);
 }
 
 static inline BYTE memrdr(WORD addr)
@@ -237,6 +241,7 @@ static inline void dma_write(WORD addr, BYTE data)
 	} else {
 		*(banks[selbnk] + addr) = data;
 	}
+	vram_mark(addr);
 }
 
 /*
@@ -261,6 +266,30 @@ static inline void putmem(WORD addr, BYTE data)
 	} else {
 		*(banks[selbnk] + addr) = data;
 	}
+	vram_mark(addr);
+}
+
+/* copy a block of memory like getmem() would, one page at a time */
+static inline void getmem_block(WORD addr, BYTE *dst, int len)
+{
+	register int n;
+
+	while (len > 0) {
+		n = 256 - (addr & 0xff);
+		if (n > len)
+			n = len;
+		if ((selbnk == 0) || (addr >= SEGSIZ)) {
+			if (p_tab[addr >> 8] != MEM_NONE)
+				memcpy(dst, &_MEMMAPPED(addr), n);
+			else
+				memset(dst, 0xff, n);
+		} else {
+			memcpy(dst, banks[selbnk] + addr, n);
+		}
+		addr += n;
+		dst += n;
+		len -= n;
+	}
 }
 
 /*
@@ -274,6 +303,7 @@ static inline void fp_write(WORD addr, BYTE data)
 	} else {
 		*(banks[selbnk] + addr) = data;
 	}
+	vram_mark(addr);
 }
 
 #endif /* !SIMMEM_INC */
@@ -25,6 +25,8 @@
 #include "simglb.h"
 #include "simport.h"
 
+#include "unix_blkio.h"
+
 #include "altair-88-dcdd.h"
 
 /* #define LOG_LOCAL_LEVEL LOG_DEBUG */
@@ -426,10 +428,7 @@ void altair_dsk_data_out(BYTE data)
 		}
 		/* write sector */
 		pos = (track[disk] * SPT + rwsec) * SEC_SZ;
-		if (lseek(fd, pos, SEEK_SET) != pos) {
-			LOGE(TAG, "can't seek to sector %d track %d",
-			     rwsec, track[disk]);
-		} else if (write(fd, buf, SEC_SZ) != SEC_SZ) {
+		if (blk_write(fd, buf, SEC_SZ, pos) != SEC_SZ) {
 			LOGE(TAG, "can't write sector %d track %d",
 			     rwsec, track[disk]);
 		}
@@ -455,10 +454,7 @@ BYTE altair_dsk_data_in(void)
 		} else {
 			/* read sector */
 			pos = (track[disk] * SPT + rwsec) * SEC_SZ;
-			if (lseek(fd, pos, SEEK_SET) != pos) {
-				LOGE(TAG, "can't seek to sector %d track %d",
-				     rwsec, track[disk]);
-			} else if (read(fd, buf, SEC_SZ) != SEC_SZ) {
+			if (blk_read(fd, buf, SEC_SZ, pos) != SEC_SZ) {
 				LOGE(TAG, "can't read sector %d track %d",
 				     rwsec, track[disk]);
 			}
@@ -29,6 +29,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #ifdef WANT_SDL
 #include <SDL.h>
 #else
@@ -50,8 +51,8 @@
 #ifdef HAS_DAZZLER
 
 #ifdef HAS_NETSERVER
-#include <string.h>
 #include "netsrv.h"
+#include "fbdiff.h"
 #endif
 
 #if !defined(WANT_SDL) || defined(HAS_NETSERVER)
@@ -71,91 +72,48 @@ static int size = WSIZE;
 static int dazzler_win_id = -1;
 static SDL_Window *window;
 static SDL_Renderer *renderer;
-static uint8_t colors[16][3] = {
-	{ 0x00, 0x00, 0x00 },
-	{ 0x80, 0x00, 0x00 },
-	{ 0x00, 0x80, 0x00 },
-	{ 0x80, 0x80, 0x00 },
-	{ 0x00, 0x00, 0x80 },
-	{ 0x80, 0x00, 0x80 },
-	{ 0x00, 0x80, 0x80 },
-	{ 0x80, 0x80, 0x80 },
-	{ 0x00, 0x00, 0x00 },
-	{ 0xFF, 0x00, 0x00 },
-	{ 0x00, 0xFF, 0x00 },
-	{ 0xFF, 0xFF, 0x00 },
-	{ 0x00, 0x00, 0xFF },
-	{ 0xFF, 0x00, 0xFF },
-	{ 0x00, 0xFF, 0xFF },
-	{ 0xFF, 0xFF, 0xFF }
-};
-static uint8_t grays[16][3] = {
-	{ 0x00, 0x00, 0x00 },
-	{ 0x11, 0x11, 0x11 },
-	{ 0x22, 0x22, 0x22 },
-	{ 0x33, 0x33, 0x33 },
-	{ 0x44, 0x44, 0x44 },
-	{ 0x55, 0x55, 0x55 },
-	{ 0x66, 0x66, 0x66 },
-	{ 0x77, 0x77, 0x77 },
-	{ 0x88, 0x88, 0x88 },
-	{ 0x99, 0x99, 0x99 },
-	{ 0xAA, 0xAA, 0xAA },
-	{ 0xBB, 0xBB, 0xBB },
-	{ 0xCC, 0xCC, 0xCC },
-	{ 0xDD, 0xDD, 0xDD },
-	{ 0xEE, 0xEE, 0xEE },
-	{ 0xFF, 0xFF, 0xFF }
-};
+static SDL_Texture *texture;
 #else /* !WANT_SDL */
 static Display *display;
+static Visual *visual;
 static Window window;
 static int screen;
 static GC gc;
-static XWindowAttributes wa;
-static Pixmap pixmap;
 static Colormap colormap;
-static XColor colors[16];
-static XColor grays[16];
-static char color0[] =  "#000000";
-static char color1[] =  "#800000";
-static char color2[] =  "#008000";
-static char color3[] =  "#808000";
-static char color4[] =  "#000080";
-static char color5[] =  "#800080";
-static char color6[] =  "#008080";
-static char color7[] =  "#808080";
-static char color8[] =  "#000000";
-static char color9[] =  "#FF0000";
-static char color10[] = "#00FF00";
-static char color11[] = "#FFFF00";
-static char color12[] = "#0000FF";
-static char color13[] = "#FF00FF";
-static char color14[] = "#00FFFF";
-static char color15[] = "#FFFFFF";
-static char gray0[] =   "#000000";
-static char gray1[] =   "#111111";
-static char gray2[] =   "#222222";
-static char gray3[] =   "#333333";
-static char gray4[] =   "#444444";
-static char gray5[] =   "#555555";
-static char gray6[] =   "#666666";
-static char gray7[] =   "#777777";
-static char gray8[] =   "#888888";
-static char gray9[] =   "#999999";
-static char gray10[] =  "#AAAAAA";
-static char gray11[] =  "#BBBBBB";
-static char gray12[] =  "#CCCCCC";
-static char gray13[] =  "#DDDDDD";
-static char gray14[] =  "#EEEEEE";
-static char gray15[] =  "#FFFFFF";
+static XImage *ximage;
+static uint32_t *ximage_pixels;
+static bool truecolor;		/* XRGB8888 pixels can be put as they are */
+static unsigned long xcolors[16], xgrays[16]; /* pixels of other visuals */
 #endif /* !WANT_SDL */
 
+/* palettes as XRGB8888 pixels */
+static const uint32_t colors[16] = {
+	0x000000, 0x800000, 0x008000, 0x808000,
+	0x000080, 0x800080, 0x008080, 0x808080,
+	0x000000, 0xFF0000, 0x00FF00, 0xFFFF00,
+	0x0000FF, 0xFF00FF, 0x00FFFF, 0xFFFFFF
+};
+static const uint32_t grays[16] = {
+	0x000000, 0x111111, 0x222222, 0x333333,
+	0x444444, 0x555555, 0x666666, 0x777777,
+	0x888888, 0x999999, 0xAAAAAA, 0xBBBBBB,
+	0xCCCCCC, 0xDDDDDD, 0xEEEEEE, 0xFFFFFF
+};
+
+/* one frame in DAZZLER resolution, up to 128x128 pixels */
+static uint32_t pixels[128 * 128];
+static BYTE vram[2048];
+
 /* DAZZLER stuff */
 static bool state;
 static WORD dma_addr;
 static BYTE flags = 64;
 static BYTE format;
+static bool redraw = true;		/* draw all of the next frame */
+static WORD drawn_addr;			/* DMA address and format */
+static BYTE drawn_format;		/* of the last frame drawn */
+static WORD tracked_addr;		/* memory tracked for writes */
+static int tracked_len;			/* 0 if none */
 
 #if !defined(WANT_SDL) || defined(HAS_NETSERVER)
 /* UNIX stuff */
@@ -167,6 +125,22 @@ static void ws_clear(void);
 static BYTE formatBuf = 0;
 #endif
 
+#ifndef WANT_SDL
+/* allocate a XRGB8888 color in the colormap, returns its pixel */
+static unsigned long alloc_color(uint32_t rgb)
+{
+	XColor c;
+
+	c.red = ((rgb >> 16) & 0xff) * 0x101;
+	c.green = ((rgb >> 8) & 0xff) * 0x101;
+	c.blue = (rgb & 0xff) * 0x101;
+	c.flags = DoRed | DoGreen | DoBlue;
+	if (!XAllocColor(display, colormap, &c))
+		return BlackPixel(display, screen);
+	return c.pixel;
+}
+#endif
+
 /* create the SDL2 or X11 window for DAZZLER display */
 static void open_display(void)
 {
@@ -177,18 +151,45 @@ static void open_display(void)
 				  size, size, 0);
 	renderer = SDL_CreateRenderer(window, -1, (SDL_RENDERER_ACCELERATED |
 						   SDL_RENDERER_PRESENTVSYNC));
+	/* the frame is scaled to the window size by the renderer */
+	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_XRGB8888,
+				    SDL_TEXTUREACCESS_STREAMING, 128, 128);
 #else /* !WANT_SDL */
 	Window rootwindow;
+	XSetWindowAttributes swa;
 	XSizeHints *size_hints = XAllocSizeHints();
 	Atom wm_delete_window;
+	XVisualInfo vinfo;
+	int i;
 
 	display = XOpenDisplay(NULL);
 	XLockDisplay(display);
 	screen = DefaultScreen(display);
-	rootwindow = RootWindow(display, screen);
-	XGetWindowAttributes(display, rootwindow, &wa);
-	window = XCreateSimpleWindow(display, rootwindow, 0, 0,
-				     size, size, 1, 0, 0);
+	truecolor = XMatchVisualInfo(display, screen, 24, TrueColor, &vinfo);
+	if (!truecolor) {
+		/* use the default visual with allocated colors */
+		vinfo.visual = DefaultVisual(display, screen);
+		vinfo.depth = DefaultDepth(display, screen);
+		vinfo.screen = screen;
+	}
+	rootwindow = RootWindow(display, vinfo.screen);
+	visual = vinfo.visual;
+	if (truecolor)
+		colormap = XCreateColormap(display, rootwindow, visual,
+					   AllocNone);
+	else {
+		colormap = DefaultColormap(display, screen);
+		for (i = 0; i < 16; i++) {
+			xcolors[i] = alloc_color(colors[i]);
+			xgrays[i] = alloc_color(grays[i]);
+		}
+	}
+	swa.border_pixel = 0;
+	swa.colormap = colormap;
+	swa.event_mask = ExposureMask;
+	window = XCreateWindow(display, rootwindow, 0, 0, size, size,
+			       1, vinfo.depth, InputOutput, visual,
+			       CWBorderPixel | CWColormap | CWEventMask, &swa);
 	XStoreName(display, window, "Cromemco DAzzLER");
 	size_hints->flags = PSize | PMinSize | PMaxSize;
 	size_hints->min_width = size;
@@ -201,77 +202,22 @@ static void open_display(void)
 	XFree(size_hints);
 	wm_delete_window = XInternAtom(display, "WM_DELETE_WINDOW", False);
 	XSetWMProtocols(display, window, &wm_delete_window, 1);
-	colormap = DefaultColormap(display, 0);
 	gc = XCreateGC(display, window, 0, NULL);
-	XSetFillStyle(display, gc, FillSolid);
-	pixmap = XCreatePixmap(display, rootwindow, size, size,
-			       wa.depth);
-
-	XParseColor(display, colormap, color0, &colors[0]);
-	XAllocColor(display, colormap, &colors[0]);
-	XParseColor(display, colormap, color1, &colors[1]);
-	XAllocColor(display, colormap, &colors[1]);
-	XParseColor(display, colormap, color2, &colors[2]);
-	XAllocColor(display, colormap, &colors[2]);
-	XParseColor(display, colormap, color3, &colors[3]);
-	XAllocColor(display, colormap, &colors[3]);
-	XParseColor(display, colormap, color4, &colors[4]);
-	XAllocColor(display, colormap, &colors[4]);
-	XParseColor(display, colormap, color5, &colors[5]);
-	XAllocColor(display, colormap, &colors[5]);
-	XParseColor(display, colormap, color6, &colors[6]);
-	XAllocColor(display, colormap, &colors[6]);
-	XParseColor(display, colormap, color7, &colors[7]);
-	XAllocColor(display, colormap, &colors[7]);
-	XParseColor(display, colormap, color8, &colors[8]);
-	XAllocColor(display, colormap, &colors[8]);
-	XParseColor(display, colormap, color9, &colors[9]);
-	XAllocColor(display, colormap, &colors[9]);
-	XParseColor(display, colormap, color10, &colors[10]);
-	XAllocColor(display, colormap, &colors[10]);
-	XParseColor(display, colormap, color11, &colors[11]);
-	XAllocColor(display, colormap, &colors[11]);
-	XParseColor(display, colormap, color12, &colors[12]);
-	XAllocColor(display, colormap, &colors[12]);
-	XParseColor(display, colormap, color13, &colors[13]);
-	XAllocColor(display, colormap, &colors[13]);
-	XParseColor(display, colormap, color14, &colors[14]);
-	XAllocColor(display, colormap, &colors[14]);
-	XParseColor(display, colormap, color15, &colors[15]);
-	XAllocColor(display, colormap, &colors[15]);
-
-	XParseColor(display, colormap, gray0, &grays[0]);
-	XAllocColor(display, colormap, &grays[0]);
-	XParseColor(display, colormap, gray1, &grays[1]);
-	XAllocColor(display, colormap, &grays[1]);
-	XParseColor(display, colormap, gray2, &grays[2]);
-	XAllocColor(display, colormap, &grays[2]);
-	XParseColor(display, colormap, gray3, &grays[3]);
-	XAllocColor(display, colormap, &grays[3]);
-	XParseColor(display, colormap, gray4, &grays[4]);
-	XAllocColor(display, colormap, &grays[4]);
-	XParseColor(display, colormap, gray5, &grays[5]);
-	XAllocColor(display, colormap, &grays[5]);
-	XParseColor(display, colormap, gray6, &grays[6]);
-	XAllocColor(display, colormap, &grays[6]);
-	XParseColor(display, colormap, gray7, &grays[7]);
-	XAllocColor(display, colormap, &grays[7]);
-	XParseColor(display, colormap, gray8, &grays[8]);
-	XAllocColor(display, colormap, &grays[8]);
-	XParseColor(display, colormap, gray9, &grays[9]);
-	XAllocColor(display, colormap, &grays[9]);
-	XParseColor(display, colormap, gray10, &grays[10]);
-	XAllocColor(display, colormap, &grays[10]);
-	XParseColor(display, colormap, gray11, &grays[11]);
-	XAllocColor(display, colormap, &grays[11]);
-	XParseColor(display, colormap, gray12, &grays[12]);
-	XAllocColor(display, colormap, &grays[12]);
-	XParseColor(display, colormap, gray13, &grays[13]);
-	XAllocColor(display, colormap, &grays[13]);
-	XParseColor(display, colormap, gray14, &grays[14]);
-	XAllocColor(display, colormap, &grays[14]);
-	XParseColor(display, colormap, gray15, &grays[15]);
-	XAllocColor(display, colormap, &grays[15]);
+	if (truecolor) {
+		ximage_pixels = (uint32_t *) malloc(size * size *
+						    sizeof(uint32_t));
+		ximage = XCreateImage(display, visual, vinfo.depth, ZPixmap,
+				      0, (char *) ximage_pixels, size, size,
+				      32, 0);
+		/* force little-endian pixels, Xlib will convert if necessary */
+		ximage->byte_order = LSBFirst;
+	} else {
+		/* pixels are stored with XPutPixel() in the visual's format */
+		ximage = XCreateImage(display, visual, vinfo.depth, ZPixmap,
+				      0, NULL, size, size, 32, 0);
+		ximage->data = (char *) malloc(ximage->bytes_per_line * size);
+		ximage_pixels = (uint32_t *) ximage->data;
+	}
 
 	XMapWindow(display, window);
 	XUnlockDisplay(display);
@@ -282,14 +228,21 @@ static void open_display(void)
 static void close_display(void)
 {
 #ifdef WANT_SDL
+	SDL_DestroyTexture(texture);
+	texture = NULL;
 	SDL_DestroyRenderer(renderer);
 	renderer = NULL;
 	SDL_DestroyWindow(window);
 	window = NULL;
 #else
 	XLockDisplay(display);
-	XFreePixmap(display, pixmap);
+	free(ximage_pixels);
+	ximage->data = NULL;
+	XDestroyImage(ximage);
 	XFreeGC(display, gc);
+	XDestroyWindow(display, window);
+	if (truecolor)
+		XFreeColormap(display, colormap);
 	XUnlockDisplay(display);
 	XCloseDisplay(display);
 	display = NULL;
@@ -308,10 +261,45 @@ static void kill_thread(void)
 }
 #endif
 
+/* track writes to the memory shown while on, 512 or 2048 bytes */
+static void track_frame(void)
+{
+	int len = state ? ((format & 32) ? 2048 : 512) : 0;
+
+	if (len == tracked_len && (len == 0 || dma_addr == tracked_addr))
+		return;
+	if (tracked_len)
+		vram_untrack(VRAM_DAZZLER, tracked_addr, tracked_len);
+	if (len)
+		vram_track(VRAM_DAZZLER, dma_addr, len);
+	tracked_addr = dma_addr;
+	tracked_len = len;
+}
+
+/*
+ * get the 64 byte blocks of the frame buffer written since the last
+ * frame, all of them if the frame must be drawn completely
+ */
+static uint64_t frame_dirty(void)
+{
+	uint64_t dirty = vram_dirty(VRAM_DAZZLER, dma_addr,
+				    (format & 32) ? 2048 : 512);
+
+	if (redraw || dma_addr != drawn_addr || format != drawn_format) {
+		redraw = false;
+		drawn_addr = dma_addr;
+		drawn_format = format;
+		dirty = ~((uint64_t) 0);
+	}
+
+	return dirty;
+}
+
 /* switch DAZZLER off from front panel */
 void cromemco_dazzler_off(void)
 {
 	state = false;
+	track_frame();
 
 #ifdef WANT_SDL
 #ifdef HAS_NETSERVER
@@ -343,365 +331,207 @@ void cromemco_dazzler_off(void)
 /* process SDL event */
 static void process_event(SDL_Event *event)
 {
-	UNUSED(event);
+	if (event->type == SDL_WINDOWEVENT &&
+	    event->window.windowID == SDL_GetWindowID(window) &&
+	    event->window.event == SDL_WINDOWEVENT_EXPOSED)
+		redraw = true;
 }
 
-static inline void set_fg_color(int i)
+#endif /* WANT_SDL */
+
+/* get the number of pixels per row and column of the graphics format */
+static inline int frame_side(void)
 {
-	SDL_SetRenderDrawColor(renderer,
-			       colors[i][0], colors[i][1], colors[i][2],
-			       SDL_ALPHA_OPAQUE);
+	if (format & 64)
+		return (format & 32) ? 128 : 64;
+	else
+		return (format & 32) ? 64 : 32;
 }
 
-static inline void set_fg_gray(int i)
+/*
+ * convert one frame from DMA memory into pixels, 2048 bytes of memory
+ * are shown as four quadrants with 512 bytes each
+ */
+static void draw_frame(void)
 {
-	SDL_SetRenderDrawColor(renderer,
-			       grays[i][0], grays[i][1], grays[i][2],
-			       SDL_ALPHA_OPAQUE);
+	const uint32_t *pal = (format & 16) ? colors : grays;
+	uint32_t quads[16][4];
+	int side = frame_side();
+	int nquad = (format & 32) ? 4 : 1;
+	int qside = (format & 32) ? side / 2 : side;
+	int q, x, y, i;
+	uint32_t *row;
+	BYTE *p = vram;
+
+	getmem_block(dma_addr, vram, nquad * 512);
+
+	if (format & 64) {
+		/* hires, one color from lower nibble in graphics format, */
+		/* each byte holds 4x2 pixels, lookup 4 pixels per row */
+		for (i = 0; i < 16; i++)
+			for (x = 0; x < 4; x++)
+				quads[i][x] = ((i >> x) & 1) ?
+					pal[format & 0x0f] : colors[0];
+
+		for (q = 0; q < nquad; q++) {
+			row = &pixels[(q >> 1) * qside * side + (q & 1) * qside];
+			for (y = 0; y < qside; y += 2) {
+				for (x = 0; x < qside; x += 4) {
+					i = *p++;
+					memcpy(&row[x], quads[(i & 0x03) |
+							      ((i >> 2) & 0x0c)],
+					       sizeof(quads[0]));
+					memcpy(&row[side + x],
+					       quads[((i >> 2) & 0x03) |
+						     ((i >> 4) & 0x0c)],
+					       sizeof(quads[0]));
+				}
+				row += 2 * side;
+			}
+		}
+	} else {
+		/* lowres, each byte holds 2 pixels as color nibbles */
+		for (q = 0; q < nquad; q++) {
+			row = &pixels[(q >> 1) * qside * side + (q & 1) * qside];
+			for (y = 0; y < qside; y++) {
+				for (x = 0; x < qside; x += 2) {
+					i = *p++;
+					row[x] = pal[i & 0x0f];
+					row[x + 1] = pal[i >> 4];
+				}
+				row += side;
+			}
+		}
+	}
 }
 
-static inline void fill_rect(int x, int y, int w, int h)
+#ifdef WANT_SDL
+
+/* upload the frame into the texture, the renderer scales it */
+static void show_frame(void)
 {
-	SDL_Rect r = {x, y, w, h};
+	int side = frame_side();
+	SDL_Rect r = {0, 0, side, side};
 
-	SDL_RenderFillRect(renderer, &r);
+	SDL_UpdateTexture(texture, &r, pixels, side * sizeof(uint32_t));
+	SDL_RenderCopy(renderer, texture, &r, NULL);
+	SDL_RenderPresent(renderer);
 }
 
 #else /* !WANT_SDL */
 
-static inline void set_fg_color(int i)
+/* get the pixel of the allocated color for a XRGB8888 palette entry */
+static unsigned long xpixel(uint32_t rgb)
 {
-	XSetForeground(display, gc, colors[i].pixel);
-}
+	int i;
 
-static inline void set_fg_gray(int i)
-{
-	XSetForeground(display, gc, grays[i].pixel);
+	for (i = 0; i < 16; i++) {
+		if (colors[i] == rgb)
+			return xcolors[i];
+		if (grays[i] == rgb)
+			return xgrays[i];
+	}
+	return xcolors[0];
 }
 
-static inline void fill_rect(int x, int y, int w, int h)
+/* show_frame() for visuals other than 24-bit TrueColor */
+static void show_frame_xpixels(int side, int psize)
 {
-	XFillRectangle(display, pixmap, gc, x, y, w, h);
-}
+	int x, y, i, j;
+	unsigned long pixel;
+	uint32_t *src = pixels;
+
+	for (y = 0; y < side; y++, src += side)
+		for (x = 0; x < side; x++) {
+			pixel = xpixel(src[x]);
+			for (j = 0; j < psize; j++)
+				for (i = 0; i < psize; i++)
+					XPutPixel(ximage, x * psize + i,
+						  y * psize + j, pixel);
+		}
 
-#endif /* !WANT_SDL */
+	XPutImage(display, window, gc, ximage, 0, 0, 0, 0, size, size);
+}
 
-/* draw pixels for one frame in hires */
-static void draw_hires(void)
+/* scale the frame to the window size and put it into the window */
+static void show_frame(void)
 {
-	int psize, x, y, i;
-	WORD addr = dma_addr;
-
-	/* set color or grayscale from lower nibble in graphics format */
-	i = format & 0x0f;
-	if (format & 16)
-		set_fg_color(i);
-	else
-		set_fg_gray(i);
-	if (format & 32) {	/* 2048 bytes memory */
-		psize = size / 128;	/* size of one pixel for 128x128 */
-		for (y = 0; y < 64; y += 2) {
-			for (x = 0; x < 64;) {
-				i = dma_read(addr);
-				if (i & 1)
-					fill_rect(x * psize, y * psize, psize, psize);
-				if (i & 2)
-					fill_rect((x + 1) * psize, y * psize, psize, psize);
-				if (i & 4)
-					fill_rect(x * psize, (y + 1) * psize, psize, psize);
-				if (i & 8)
-					fill_rect((x + 1) * psize, (y + 1) * psize, psize, psize);
-				if (i & 16)
-					fill_rect((x + 2) * psize, y * psize, psize, psize);
-				if (i & 32)
-					fill_rect((x + 3) * psize, y * psize, psize, psize);
-				if (i & 64)
-					fill_rect((x + 2) * psize, (y + 1) * psize, psize, psize);
-				if (i & 128)
-					fill_rect((x + 3) * psize, (y + 1) * psize, psize, psize);
-				x += 4;
-				addr++;
-			}
-		}
-		for (y = 0; y < 64; y += 2) {
-			for (x = 64; x < 128;) {
-				i = dma_read(addr);
-				if (i & 1)
-					fill_rect(x * psize, y * psize, psize, psize);
-				if (i & 2)
-					fill_rect((x + 1) * psize, y * psize, psize, psize);
-				if (i & 4)
-					fill_rect(x * psize, (y + 1) * psize, psize, psize);
-				if (i & 8)
-					fill_rect((x + 1) * psize, (y + 1) * psize, psize, psize);
-				if (i & 16)
-					fill_rect((x + 2) * psize, y * psize, psize, psize);
-				if (i & 32)
-					fill_rect((x + 3) * psize, y * psize, psize, psize);
-				if (i & 64)
-					fill_rect((x + 2) * psize, (y + 1) * psize, psize, psize);
-				if (i & 128)
-					fill_rect((x + 3) * psize, (y + 1) * psize, psize, psize);
-				x += 4;
-				addr++;
-			}
-		}
-		for (y = 64; y < 128; y += 2) {
-			for (x = 0; x < 64;) {
-				i = dma_read(addr);
-				if (i & 1)
-					fill_rect(x * psize, y * psize, psize, psize);
-				if (i & 2)
-					fill_rect((x + 1) * psize, y * psize, psize, psize);
-				if (i & 4)
-					fill_rect(x * psize, (y + 1) * psize, psize, psize);
-				if (i & 8)
-					fill_rect((x + 1) * psize, (y + 1) * psize, psize, psize);
-				if (i & 16)
-					fill_rect((x + 2) * psize, y * psize, psize, psize);
-				if (i & 32)
-					fill_rect((x + 3) * psize, y * psize, psize, psize);
-				if (i & 64)
-					fill_rect((x + 2) * psize, (y + 1) * psize, psize, psize);
-				if (i & 128)
-					fill_rect((x + 3) * psize, (y + 1) * psize, psize, psize);
-				x += 4;
-				addr++;
-			}
-		}
-		for (y = 64; y < 128; y += 2) {
-			for (x = 64; x < 128;) {
-				i = dma_read(addr);
-				if (i & 1)
-					fill_rect(x * psize, y * psize, psize, psize);
-				if (i & 2)
-					fill_rect((x + 1) * psize, y * psize, psize, psize);
-				if (i & 4)
-					fill_rect(x * psize, (y + 1) * psize, psize, psize);
-				if (i & 8)
-					fill_rect((x + 1) * psize, (y + 1) * psize, psize, psize);
-				if (i & 16)
-					fill_rect((x + 2) * psize, y * psize, psize, psize);
-				if (i & 32)
-					fill_rect((x + 3) * psize, y * psize, psize, psize);
-				if (i & 64)
-					fill_rect((x + 2) * psize, (y + 1) * psize, psize, psize);
-				if (i & 128)
-					fill_rect((x + 3) * psize, (y + 1) * psize, psize, psize);
-				x += 4;
-				addr++;
-			}
-		}
-	} else {		/* 512 bytes memory */
-		psize = size / 64;	/* size of one pixel for 64x64 */
-		for (y = 0; y < 64; y += 2) {
-			for (x = 0; x < 64;) {
-				i = dma_read(addr);
-				if (i & 1)
-					fill_rect(x * psize, y * psize, psize, psize);
-				if (i & 2)
-					fill_rect((x + 1) * psize, y * psize, psize, psize);
-				if (i & 4)
-					fill_rect(x * psize, (y + 1) * psize, psize, psize);
-				if (i & 8)
-					fill_rect((x + 1) * psize, (y + 1) * psize, psize, psize);
-				if (i & 16)
-					fill_rect((x + 2) * psize, y * psize, psize, psize);
-				if (i & 32)
-					fill_rect((x + 3) * psize, y * psize, psize, psize);
-				if (i & 64)
-					fill_rect((x + 2) * psize, (y + 1) * psize, psize, psize);
-				if (i & 128)
-					fill_rect((x + 3) * psize, (y + 1) * psize, psize, psize);
-				x += 4;
-				addr++;
-			}
-		}
+	int side = frame_side();
+	int psize = size / side;
+	int x, y, k;
+	uint32_t *src = pixels, *dst = ximage_pixels, *p;
+
+	if (!truecolor) {
+		show_frame_xpixels(side, psize);
+		return;
 	}
-}
 
-/* draw pixels for one frame in lowres */
-static void draw_lowres(void)
-{
-	int psize, x, y, i;
-	WORD addr = dma_addr;
-
-	/* get size of DMA memory and draw the pixels */
-	if (format & 32) {	/* 2048 bytes memory */
-		psize = size / 64;	/* size of one pixel for 64x64 */
-		for (y = 0; y < 32; y++) {
-			for (x = 0; x < 32;) {
-				i = dma_read(addr) & 0x0f;
-				if (format & 16)
-					set_fg_color(i);
-				else
-					set_fg_gray(i);
-				fill_rect(x * psize, y * psize, psize, psize);
-				x++;
-				i = (dma_read(addr) & 0xf0) >> 4;
-				if (format & 16)
-					set_fg_color(i);
-				else
-					set_fg_gray(i);
-				fill_rect(x * psize, y * psize, psize, psize);
-				x++;
-				addr++;
-			}
-		}
-		for (y = 0; y < 32; y++) {
-			for (x = 32; x < 64;) {
-				i = dma_read(addr) & 0x0f;
-				if (format & 16)
-					set_fg_color(i);
-				else
-					set_fg_gray(i);
-				fill_rect(x * psize, y * psize, psize, psize);
-				x++;
-				i = (dma_read(addr) & 0xf0) >> 4;
-				if (format & 16)
-					set_fg_color(i);
-				else
-					set_fg_gray(i);
-				fill_rect(x * psize, y * psize, psize, psize);
-				x++;
-				addr++;
-			}
-		}
-		for (y = 32; y < 64; y++) {
-			for (x = 0; x < 32;) {
-				i = dma_read(addr) & 0x0f;
-				if (format & 16)
-					set_fg_color(i);
-				else
-					set_fg_gray(i);
-				fill_rect(x * psize, y * psize, psize, psize);
-				x++;
-				i = (dma_read(addr) & 0xf0) >> 4;
-				if (format & 16)
-					set_fg_color(i);
-				else
-					set_fg_gray(i);
-				fill_rect(x * psize, y * psize, psize, psize);
-				x++;
-				addr++;
-			}
-		}
-		for (y = 32; y < 64; y++) {
-			for (x = 32; x < 64;) {
-				i = dma_read(addr) & 0x0f;
-				if (format & 16)
-					set_fg_color(i);
-				else
-					set_fg_gray(i);
-				fill_rect(x * psize, y * psize, psize, psize);
-				x++;
-				i = (dma_read(addr) & 0xf0) >> 4;
-				if (format & 16)
-					set_fg_color(i);
-				else
-					set_fg_gray(i);
-				fill_rect(x * psize, y * psize, psize, psize);
-				x++;
-				addr++;
-			}
-		}
-	} else {		/* 512 bytes memory */
-		psize = size / 32;	/* size of one pixel for 32x32 */
-		for (y = 0; y < 32; y++) {
-			for (x = 0; x < 32;) {
-				i = dma_read(addr) & 0x0f;
-				if (format & 16)
-					set_fg_color(i);
-				else
-					set_fg_gray(i);
-				fill_rect(x * psize, y * psize, psize, psize);
-				x++;
-				i = (dma_read(addr) & 0xf0) >> 4;
-				if (format & 16)
-					set_fg_color(i);
-				else
-					set_fg_gray(i);
-				fill_rect(x * psize, y * psize, psize, psize);
-				x++;
-				addr++;
-			}
-		}
+	for (y = 0; y < side; y++) {
+		p = dst;
+		for (x = 0; x < side; x++)
+			for (k = 0; k < psize; k++)
+				*p++ = src[x];
+		for (k = 1; k < psize; k++)
+			memcpy(dst + k * size, dst, size * sizeof(uint32_t));
+		src += side;
+		dst += psize * size;
 	}
+
+	XPutImage(display, window, gc, ximage, 0, 0, 0, 0, size, size);
 }
 
+#endif /* !WANT_SDL */
+
 #ifdef HAS_NETSERVER
 static uint8_t dblbuf[2048];
+static uint8_t snapbuf[2048];
+
+/* a message holds spans of [format, addr, len, data] */
+#define MSG_HDRLEN 6
+static uint8_t msgbuf[FBDIFF_BUFSIZE(2048, MSG_HDRLEN)];
 
-static struct {
-	uint16_t format;
-	uint16_t addr;
-	uint16_t len;
-	uint8_t buf[2048];
-} msg;
+static void msg_hdr(uint8_t *p, int addr, int len)
+{
+	p[0] = format;
+	p[1] = 0;
+	p[2] = addr & 0xff;
+	p[3] = addr >> 8;
+	p[4] = len & 0xff;
+	p[5] = len >> 8;
+}
 
 static void ws_clear(void)
 {
 	memset(dblbuf, 0, 2048);
-
-	msg.format = 0;
-	msg.addr = 0xFFFF;
-	msg.len = 0;
-	net_device_send(DEV_DZLR, (char *) &msg, msg.len + 6);
+	formatBuf = 0;
+
+	/* format 0, addr 0xFFFF, len 0 clears the screen */
+	msgbuf[0] = msgbuf[1] = 0;
+	msgbuf[2] = msgbuf[3] = 0xff;
+	msgbuf[4] = msgbuf[5] = 0;
+	net_device_send(DEV_DZLR, (char *) msgbuf, MSG_HDRLEN);
+	redraw = true;
 	LOGD(TAG, "Clear the screen.");
 }
 
 static void ws_refresh(void)
 {
 	int len = (format & 32) ? 2048 : 512;
-	int addr;
-	int i, n, x, la_count;
-	bool cont;
-	uint8_t val;
-
-	for (i = 0; i < len; i++) {
-		addr = i;
-		n = 0;
-		la_count = 0;
-		cont = true;
-		while (cont && (i < len)) {
-			val = dma_read(dma_addr + i);
-			while ((val != dblbuf[i]) && (i < len)) {
-				dblbuf[i++] = val;
-				msg.buf[n++] = val;
-				cont = false;
-				val = dma_read(dma_addr + i);
-			}
-			if (cont)
-				break;
-			x = 0;
-#define LOOKAHEAD 6
-			/* look-ahead up to n bytes for next change */
-			while ((x < LOOKAHEAD) && !cont && (i < len)) {
-				val = dma_read(dma_addr + i++);
-				msg.buf[n++] = val;
-				la_count++;
-				val = dma_read(dma_addr + i);
-				if ((i < len) && (val != dblbuf[i])) {
-					cont = true;
-				}
-				x++;
-			}
-			if (!cont) {
-				n -= x;
-				la_count -= x;
-			}
-		}
-		if (n || (format != formatBuf)) {
-			formatBuf = format;
-			msg.format = format;
-			msg.addr = addr;
-			msg.len = n;
-			net_device_send(DEV_DZLR, (char *) &msg, msg.len + 6);
-			LOGD(TAG, "BUF update 0x%04X-0x%04X "
-			     "len: %d format: 0x%02X l/a: %d",
-			     msg.addr, msg.addr + msg.len,
-			     msg.len, msg.format, la_count);
-		}
+	int n;
+
+	getmem_block(dma_addr, snapbuf, len);
+	n = fbdiff_encode(snapbuf, dblbuf, len, MSG_HDRLEN, msg_hdr, msgbuf);
+
+	/* an empty span tells the client about the new format */
+	if (n == 0 && format != formatBuf) {
+		msg_hdr(msgbuf, 0, 0);
+		n = MSG_HDRLEN;
+	}
+	formatBuf = format;
+
+	if (n) {
+		net_device_send(DEV_DZLR, (char *) msgbuf, n);
+		LOGD(TAG, "BUF update len: %d format: 0x%02X", n, format);
 	}
 }
 #endif /* HAS_NETSERVER */
@@ -713,21 +543,22 @@ static void update_display(bool tick)
 	UNUSED(tick);
 
 	/* draw one frame dependent on graphics format */
-	set_fg_color(0);
-	SDL_RenderClear(renderer);
-	if (state) {		/* draw frame if on */
-		if (format & 64)
-			draw_hires();
-		else
-			draw_lowres();
-		SDL_RenderPresent(renderer);
+	if (state) {		/* draw frame if on and changed */
+		if (frame_dirty()) {
+			draw_frame();
+			show_frame();
+		}
 
 		/* frame done, set frame flag for 4ms */
 		flags = 0;
 		sleep_for_ms(4);
 		flags = 64;
-	} else
+	} else {
+		SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
+		SDL_RenderClear(renderer);
 		SDL_RenderPresent(renderer);
+		redraw = true;
+	}
 }
 
 static win_funcs_t dazzler_funcs = {
@@ -744,6 +575,9 @@ static void *update_thread(void *arg)
 {
 	uint64_t t;
 	long tleft;
+#ifndef WANT_SDL
+	XEvent event;
+#endif
 
 	UNUSED(arg);
 
@@ -758,26 +592,33 @@ static void *update_thread(void *arg)
 #endif
 #ifndef WANT_SDL
 				XLockDisplay(display);
-				set_fg_color(0);
-				fill_rect(0, 0, size, size);
-				if (format & 64)
-					draw_hires();
-				else
-					draw_lowres();
-				XCopyArea(display, pixmap, window, gc, 0, 0,
-					  size, size, 0, 0);
-				XSync(display, True);
+				while (XCheckTypedWindowEvent(display, window,
+							      Expose, &event))
+					redraw = true;
+				/* only draw the frame if memory was written */
+				if (frame_dirty()) {
+					draw_frame();
+					show_frame();
+					XSync(display, True);
+				}
 				XUnlockDisplay(display);
 #endif
 #ifdef HAS_NETSERVER
 			} else {
-				if (net_device_alive(DEV_DZLR)) {
-					ws_refresh();
+				if (net_device_watched(DEV_DZLR)) {
+					/* a new client or lost output */
+					/* needs a cleared screen and a */
+					/* full frame, memory which is 0 */
+					/* isn't sent again */
+					if (net_device_resync(DEV_DZLR))
+						ws_clear();
+					if (frame_dirty())
+						ws_refresh();
 				} else {
-					if (msg.format) {
-						memset(dblbuf, 0, 2048);
-						msg.format = 0;
-					}
+					/* new client needs a full frame */
+					memset(dblbuf, 0, 2048);
+					formatBuf = 0;
+					redraw = true;
 				}
 			}
 #endif
@@ -803,8 +644,12 @@ static void *update_thread(void *arg)
 
 void cromemco_dazzler_ctl_out(BYTE data)
 {
+	WORD addr;
+
 	/* get DMA address for display memory */
-	dma_addr = (data & 0x7f) << 9;
+	addr = (data & 0x7f) << 9;
+
+	dma_addr = addr;
 
 	/* switch DAZZLER on/off */
 	if (data & 128) {
@@ -825,6 +670,7 @@ void cromemco_dazzler_ctl_out(BYTE data)
 		}
 #endif
 		state = true;
+		track_frame();
 #if defined(WANT_SDL) && defined(HAS_NETSERVER)
 		if (n_flag) {
 #endif
@@ -843,6 +689,7 @@ void cromemco_dazzler_ctl_out(BYTE data)
 	} else {
 		if (state) {
 			state = false;
+			track_frame();
 			sleep_for_ms(50);
 #ifdef HAS_NETSERVER
 			if (!n_flag) {
@@ -888,6 +735,7 @@ BYTE cromemco_dazzler_flags_in(void)
 void cromemco_dazzler_format_out(BYTE data)
 {
 	format = data;
+	track_frame();
 }
 
 #endif /* HAS_DAZZLER */
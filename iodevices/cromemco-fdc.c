@@ -53,6 +53,7 @@
 #include "simmem.h"
 
 #include "diskmanager.h"
+#include "unix_blkio.h"
 #include "cromemco-fdc.h"
 
 #include "log.h"
@@ -438,18 +439,9 @@ BYTE cromemco_fdc_data_in(void)
 				close(fd);
 				return (BYTE) 0;
 			}
-			/* seek to sector */
-			pos = get_pos();
-			if (lseek(fd, pos, SEEK_SET) == -1L) {
-				state = FDC_IDLE;	/* abort command */
-				fdc_flags |= 1;		/* set EOJ */
-				fdc_flags &= ~128;	/* reset DRQ */
-				fdc_stat = 0x10;	/* sector not found */
-				close(fd);
-				return (BYTE) 0;
-			}
 			/* read the sector */
-			if (read(fd, buf, secsz) != secsz) {
+			pos = get_pos();
+			if (pos == -1L || blk_read(fd, buf, secsz, pos) != secsz) {
 				state = FDC_IDLE;	/* abort command */
 				fdc_flags |= 1;		/* set EOJ */
 				fdc_flags &= ~128;	/* reset DRQ */
@@ -516,7 +508,7 @@ BYTE cromemco_fdc_data_in(void)
  */
 void cromemco_fdc_data_out(BYTE data)
 {
-	off_t pos;		/* seek position */
+	static off_t pos;	/* position in disk image */
 	int lastsec;		/* last sector of a track */
 	static int wrtstat;	/* state while writing (formatting) tracks */
 	static int bcnt;	/* byte counter for sector data */
@@ -575,9 +567,9 @@ void cromemco_fdc_data_out(BYTE data)
 				close(fd);
 				return;
 			}
-			/* seek to sector */
+			/* position of sector */
 			pos = get_pos();
-			if (lseek(fd, pos, SEEK_SET) == -1L) {
+			if (pos == -1L) {
 				state = FDC_IDLE;	/* abort command */
 				fdc_flags |= 1;		/* set EOJ */
 				fdc_flags &= ~128;	/* reset DRQ */
@@ -593,7 +585,7 @@ void cromemco_fdc_data_out(BYTE data)
 			state = FDC_IDLE;		/* done */
 			fdc_flags |= 1;			/* set EOJ */
 			fdc_flags &= ~128;		/* reset DRQ */
-			if (write(fd, buf, secsz) == secsz)
+			if (blk_write(fd, buf, secsz, pos) == secsz)
 				fdc_stat = 0;
 			else
 				fdc_stat = 0x20;	/* write fault */
@@ -656,10 +648,10 @@ void cromemco_fdc_data_out(BYTE data)
 					disks[disk].sectors = SPT5DD;
 				}
 			}
-			/* seek to track */
+			/* position of track */
 			fdc_sec = 1;
 			pos = get_pos();
-			if (lseek(fd, pos, SEEK_SET) == -1L) {
+			if (pos == -1L) {
 				state = FDC_IDLE;	/* abort command */
 				fdc_flags |= 1;		/* set EOJ */
 				fdc_flags &= ~128;	/* reset DRQ */
@@ -687,10 +679,11 @@ void cromemco_fdc_data_out(BYTE data)
 				return;
 			} else {
 				secs++;
-				if (write(fd, buf, bcnt) == bcnt)
+				if (blk_write(fd, buf, bcnt, pos) == bcnt)
 					fdc_stat = 0;
 				else
 					fdc_stat = 0x20; /* write fault */
+				pos += bcnt;
 				wrtstat = 1;
 			}
 		}
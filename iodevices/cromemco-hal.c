@@ -26,6 +26,7 @@
 
 #include "unix_terminal.h"
 #include "unix_network.h"
+#include "unix_outbuf.h"
 #ifdef HAS_NETSERVER
 #include "netsrv.h"
 #endif
@@ -119,6 +120,8 @@ static void net_tty_out(int dev, BYTE data)
 
 /* -------------------- STDIO HAL -------------------- */
 
+static outbuf_t stdio_ob;	/* output buffer for the terminal */
+
 static bool stdio_alive(int dev)
 {
 	UNUSED(dev);
@@ -132,6 +135,9 @@ static void stdio_status(int dev, BYTE *stat)
 
 	UNUSED(dev);
 
+	/* guest polls, show what it has written */
+	outbuf_flush(&stdio_ob);
+
 	p[0].fd = fileno(stdin);
 	p[0].events = POLLIN;
 	p[0].revents = 0;
@@ -155,6 +161,8 @@ static int stdio_in(int dev)
 
 	UNUSED(dev);
 
+	outbuf_flush(&stdio_ob);
+
 again:
 	/* if no input waiting return last */
 	p[0].fd = fileno(stdin);
@@ -179,20 +187,17 @@ static void stdio_out(int dev, BYTE data)
 {
 	UNUSED(dev);
 
-again:
-	if (write(fileno(stdout), (char *) &data, 1) != 1) {
-		if (errno == EINTR)
-			goto again;
-		else {
-			LOGE(TAG, "can't write data");
-			cpu_error = IOERROR;
-			cpu_state = ST_STOPPED;
-		}
+	if (outbuf_put(&stdio_ob, fileno(stdout), data) == -1) {
+		LOGE(TAG, "can't write data");
+		cpu_error = IOERROR;
+		cpu_state = ST_STOPPED;
 	}
 }
 
 /* -------------------- SOCKET SERVER HAL -------------------- */
 
+static outbuf_t scktsrv_ob[NUMNSOC];	/* output buffers for the sockets */
+
 static bool scktsrv_alive(int dev)
 {
 	return ncons[dev].ssc != 0; /* SCKTSRV is alive if there is an open socket */
@@ -204,12 +209,14 @@ static void scktsrv_status(int dev, BYTE *stat)
 
 	/* if socket is connected check for I/O */
 	if (ncons[dev].ssc != 0) {
+		outbuf_flush(&scktsrv_ob[dev]);
 		p[0].fd = ncons[dev].ssc;
 		p[0].events = POLLIN;
 		p[0].revents = 0;
 		poll(p, 1, 0);
 		*stat &= (BYTE) (~3);
 		if (p[0].revents & POLLHUP) {
+			outbuf_drop(&scktsrv_ob[dev]);
 			close(ncons[dev].ssc);
 			ncons[dev].ssc = 0;
 			*stat = 0;
@@ -230,6 +237,8 @@ static int scktsrv_in(int dev)
 	if (ncons[dev].ssc == 0)
 		return -1;
 
+	outbuf_flush(&scktsrv_ob[dev]);
+
 	/* if no input waiting return last */
 	p[0].fd = ncons[dev].ssc;
 	p[0].events = POLLIN;
@@ -241,6 +250,7 @@ static int scktsrv_in(int dev)
 	if (read(ncons[dev].ssc, &data, 1) != 1) {
 		if ((errno == EAGAIN) || (errno == EINTR)) {
 			/* EOF, close socket and return last */
+			outbuf_drop(&scktsrv_ob[dev]);
 			close(ncons[dev].ssc);
 			ncons[dev].ssc = 0;
 			return -1;
@@ -267,15 +277,10 @@ static void scktsrv_out(int dev, BYTE data)
 	if (ncons[dev].ssc == 0)
 		return;
 
-again:
-	if (write(ncons[dev].ssc, &data, 1) != 1) {
-		if (errno == EINTR) {
-			goto again;
-		} else {
-			LOGE(TAG, "can't write socket %d data", dev);
-			cpu_error = IOERROR;
-			cpu_state = ST_STOPPED;
-		}
+	if (outbuf_put(&scktsrv_ob[dev], ncons[dev].ssc, data) == -1) {
+		LOGE(TAG, "can't write socket %d data", dev);
+		cpu_error = IOERROR;
+		cpu_state = ST_STOPPED;
 	}
 }
 
@@ -444,6 +449,16 @@ static void hal_init(void)
 
 void hal_reset(void)
 {
+	int i;
+	static bool outbuf_ready;
+
+	if (!outbuf_ready) {
+		outbuf_init(&stdio_ob);
+		for (i = 0; i < NUMNSOC; i++)
+			outbuf_init(&scktsrv_ob[i]);
+		outbuf_ready = true;
+	}
+
 	hal_init();
 	hal_report();
 }
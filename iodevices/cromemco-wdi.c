@@ -15,6 +15,8 @@
 #include <string.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <signal.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -28,6 +30,7 @@
 #ifdef HAS_NETSERVER
 #include "netsrv.h"
 #endif
+#include "unix_blkio.h"
 #include "cromemco-wdi.h"
 
 #define LOG_LOCAL_LEVEL LOG_ERROR
@@ -208,10 +211,234 @@ static struct {
 	int unit;	/* current selected hard disk unit*/
 } wdi;
 
+/*
+ * The disk image files are read and written by a worker thread, so that
+ * the CPU thread doesn't wait for the host. When the heads are moved
+ * the whole track is read into a track cache while the guest waits for
+ * SEEK COMPLETE, the DMA of a sector then is a copy from the cache.
+ * Written sectors update the cache and are written behind in the order
+ * they were written by the guest.
+ */
+#define WDI_TRACK_SIZE	(WDI_SECTORS * WDI_BLOCK_SIZE)
+#define WDI_WQUEUE	32	/* sectors queued for writing */
+
+typedef enum trk_state { TRK_EMPTY, TRK_LOADING, TRK_VALID } trk_state_t;
+
+static struct {
+	pthread_mutex_t mtx;
+	pthread_cond_t work;	/* worker waits for something to do */
+	pthread_cond_t done;	/* CPU thread waits for a track or queue space */
+	bool running;		/* worker thread started */
+	bool busy;		/* worker is reading or writing */
+	struct {
+		trk_state_t state;
+		int head;
+		int cyl;
+		unsigned gen;	/* counts load requests */
+		uint32_t bad;	/* sectors which couldn't be read */
+		int err;	/* errno of a failed write behind */
+		BYTE data[WDI_TRACK_SIZE];
+	} trk[WDI_UNITS];
+	struct {
+		int unit;
+		off_t pos;
+		BYTE data[WDI_BLOCK_SIZE];
+	} wq[WDI_WQUEUE];
+	unsigned whead;		/* sectors queued */
+	unsigned wtail;		/* sectors written */
+} io = {
+	.mtx = PTHREAD_MUTEX_INITIALIZER,
+	.work = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER
+};
+
+static off_t wdi_track_pos(int unit, int head, int cyl)
+{
+	const int c = disk_param[wdi.hd[unit].type].cyl;
+
+	return ((off_t) head * c + cyl) * WDI_TRACK_SIZE;
+}
+
+/*
+ * read a track from the image file, if that fails the sectors are read
+ * one by one, so that only the bad ones fault
+ * returns a mask of the sectors which couldn't be read
+ */
+static uint32_t wdi_read_track(int unit, int fd, off_t pos, BYTE *buf)
+{
+	uint32_t bad = 0;
+	int i;
+
+	if (blk_read(fd, buf, WDI_TRACK_SIZE, pos) == WDI_TRACK_SIZE)
+		return 0;
+
+	for (i = 0; i < WDI_SECTORS; i++, buf += WDI_BLOCK_SIZE,
+	     pos += WDI_BLOCK_SIZE) {
+		if (blk_read(fd, buf, WDI_BLOCK_SIZE, pos) != WDI_BLOCK_SIZE) {
+			LOGE(TAG, "DISK READ ERROR UNIT [%d] - POS %lld",
+			     unit, (long long) pos);
+			memset(buf, 0xe5, WDI_BLOCK_SIZE);
+			bad |= 1U << i;
+		}
+	}
+	return bad;
+}
+
+/* write a sector to the image file, a failure is reported later */
+static void wdi_write_sector(int unit, int fd, off_t pos, const BYTE *buf)
+{
+	if (blk_write(fd, buf, WDI_BLOCK_SIZE, pos) != WDI_BLOCK_SIZE) {
+		LOGE(TAG, "DISK WRITE ERROR UNIT [%d] - %s", unit, strerror(errno));
+		__atomic_store_n(&io.trk[unit].err, errno ? errno : EIO,
+				 __ATOMIC_RELAXED);
+	}
+}
+
+/*
+ * Worker thread, writes queued sectors first, so that a track read
+ * afterwards sees them, then reads requested tracks
+ */
+static void *wdi_worker(void *arg)
+{
+	static BYTE tbuf[WDI_TRACK_SIZE];
+	int unit, n;
+	off_t pos;
+	unsigned gen;
+	uint32_t bad;
+	sigset_t set;
+
+	UNUSED(arg);
+
+	/* leave the signals of the simulation to the other threads */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	pthread_mutex_lock(&io.mtx);
+	while (true) {
+		if (io.wtail != io.whead) {
+			n = io.wtail % WDI_WQUEUE;
+			io.busy = true;
+			pthread_mutex_unlock(&io.mtx);
+
+			unit = io.wq[n].unit;
+			wdi_write_sector(unit, wdi.hd[unit].fd, io.wq[n].pos,
+					 io.wq[n].data);
+
+			pthread_mutex_lock(&io.mtx);
+			io.busy = false;
+			io.wtail++;
+			pthread_cond_broadcast(&io.done);
+			continue;
+		}
+
+		for (unit = 0; unit < WDI_UNITS; unit++)
+			if (io.trk[unit].state == TRK_LOADING)
+				break;
+		if (unit == WDI_UNITS) {
+			pthread_cond_wait(&io.work, &io.mtx);
+			continue;
+		}
+
+		pos = wdi_track_pos(unit, io.trk[unit].head, io.trk[unit].cyl);
+		gen = io.trk[unit].gen;
+		io.busy = true;
+		pthread_mutex_unlock(&io.mtx);
+
+		bad = wdi_read_track(unit, wdi.hd[unit].fd, pos, tbuf);
+
+		pthread_mutex_lock(&io.mtx);
+		io.busy = false;
+		/* a seek to another track meanwhile requested that one */
+		if (io.trk[unit].gen == gen) {
+			memcpy(io.trk[unit].data, tbuf, WDI_TRACK_SIZE);
+			io.trk[unit].bad = bad;
+			__atomic_store_n(&io.trk[unit].state, TRK_VALID,
+					 __ATOMIC_RELAXED);
+		}
+		pthread_cond_broadcast(&io.done);
+	}
+
+	/* never reached */
+	pthread_exit(NULL);
+}
+
+/*
+ * Request the track unit is on to be read into the cache, if it isn't
+ * there already. Without worker thread it is read right away. io.mtx
+ * must be locked.
+ */
+static void wdi_load_locked(int unit, int head, int cyl)
+{
+	if (io.trk[unit].state == TRK_EMPTY || io.trk[unit].head != head ||
+	    io.trk[unit].cyl != cyl) {
+		io.trk[unit].head = head;
+		io.trk[unit].cyl = cyl;
+		io.trk[unit].gen++;
+		if (io.running) {
+			__atomic_store_n(&io.trk[unit].state, TRK_LOADING,
+					 __ATOMIC_RELAXED);
+			pthread_cond_signal(&io.work);
+		} else {
+			io.trk[unit].bad = wdi_read_track(unit,
+						wdi.hd[unit].fd,
+						wdi_track_pos(unit, head, cyl),
+						io.trk[unit].data);
+			io.trk[unit].state = TRK_VALID;
+		}
+	}
+}
+
+/* start reading the track the heads of unit are moved to */
+static void wdi_load(int unit, int head, int cyl)
+{
+	if (!wdi.hd[unit].online)
+		return;
+
+	pthread_mutex_lock(&io.mtx);
+	wdi_load_locked(unit, head, cyl);
+	pthread_mutex_unlock(&io.mtx);
+}
+
+/*
+ * Get the track unit is on into the cache and wait until it is read,
+ * io.mtx must be locked
+ */
+static void wdi_wait_track(int unit)
+{
+	wdi_load_locked(unit, wdi.hd[unit].status.hav, wdi.hd[unit].status.cav);
+	while (io.trk[unit].state == TRK_LOADING)
+		pthread_cond_wait(&io.done, &io.mtx);
+}
+
+/* the seek isn't complete before the track is in the cache */
+static bool wdi_loaded(int unit)
+{
+	return unit >= WDI_UNITS || __atomic_load_n(&io.trk[unit].state,
+			       __ATOMIC_RELAXED) != TRK_LOADING;
+}
+
+/* returns true if one of the sectors of unit written behind failed */
+static bool wdi_write_failed(int unit)
+{
+	return unit < WDI_UNITS && __atomic_exchange_n(&io.trk[unit].err, 0, __ATOMIC_RELAXED) != 0;
+}
+
 void wdi_exit(void)
 {
 	int unit;
 
+	/* write queued sectors and empty the track cache */
+	pthread_mutex_lock(&io.mtx);
+	for (unit = 0; unit < WDI_UNITS; unit++) {
+		io.trk[unit].state = TRK_EMPTY;
+		io.trk[unit].gen++;
+	}
+	while (io.wtail != io.whead || io.busy)
+		pthread_cond_wait(&io.done, &io.mtx);
+	for (unit = 0; unit < WDI_UNITS; unit++)
+		io.trk[unit].err = 0;
+	pthread_mutex_unlock(&io.mtx);
+
 	for (unit = 0; unit < WDI_UNITS; unit++) {
 		if (wdi.hd[unit].fd) {
 			fsync(wdi.hd[unit].fd);
@@ -335,6 +562,18 @@ again:
 	LOG(TAG, "\r\n");
 
 	wdi.unit = 0;
+
+	if (!io.running) {
+		pthread_t thread;
+
+		if (pthread_create(&thread, NULL, wdi_worker, (void *) NULL)) {
+			LOGE(TAG, "can't create I/O thread, disks are "
+			     "accessed synchronously");
+		} else {
+			pthread_detach(thread);
+			io.running = true;
+		}
+	}
 }
 
 #ifdef HAS_NETSERVER
@@ -366,125 +605,171 @@ static off_t wdi_pos(BYTE *buf)
 
 static Tstates_t wdi_dma_write(BYTE bus_ack)
 {
-	int i;
+	int unit = wdi.unit;
+	int n;
 
 	if (!bus_ack)
 		return 0;
 
-	LOGI(TAG, "WRITE: head: %d, cyl: %x", wdi.hd[wdi.unit].status.hav,
-	     wdi.hd[wdi.unit].status.cav);
+	if (!wdi.hd[unit].online) {
+		wdi.hd[unit]._fault = 0; /* SET FAULT */
+		return 0;
+	}
+
+	LOGI(TAG, "WRITE: head: %d, cyl: %x", wdi.hd[unit].status.hav,
+	     wdi.hd[unit].status.cav);
 	LOGI(TAG, "            start: %04x, addr: %04x, len: %d", wdi.dma.wr4.b_start,
 	     wdi.dma.wr4.b_addr_counter, wdi.dma.wr0.len);
 
 	if (wdi.dma.wr0.len >= WDI_MAX_BUFFER) {
-		wdi.hd[wdi.unit]._fault = 0; /* SET FAULT */
+		wdi.hd[unit]._fault = 0; /* SET FAULT */
 		LOGE(TAG, "DMA length: %d > buffer: %d", wdi.dma.wr0.len, WDI_MAX_BUFFER);
 		return 0;
 	}
 
-	for (i = 0; i <= wdi.dma.wr0.len; i++)
-		buffer[i] = dma_read(wdi.dma.wr4.b_addr_counter++);
+	getmem_block(wdi.dma.wr4.b_addr_counter, buffer, wdi.dma.wr0.len + 1);
+	wdi.dma.wr4.b_addr_counter += wdi.dma.wr0.len + 1;
 
 	LOGI(TAG, "            SYNC: %02x, HEAD: %02x, CYL: %02x%02x, SEC: %02x",
 	     buffer[0], buffer[1], buffer[3], buffer[2], buffer[4]);
 
 	int cyl = (buffer[3] << 8) | buffer[2];
 
-	if (wdi.hd[wdi.unit].status.hav != buffer[1]) {
+	if (wdi.hd[unit].status.hav != buffer[1]) {
 		LOGE(TAG, "DISK WRITE ERROR UNIT [%d] - BAD HEAD %d : %d",
-		     wdi.unit, wdi.hd[wdi.unit].status.hav, buffer[1]);
-		wdi.hd[wdi.unit]._fault = 0; /* SET FAULT */
+		     unit, wdi.hd[unit].status.hav, buffer[1]);
+		wdi.hd[unit]._fault = 0; /* SET FAULT */
 		return 0;
 	}
-	if (wdi.hd[wdi.unit].status.cav != cyl) {
+	if (wdi.hd[unit].status.cav != cyl) {
 		LOGE(TAG, "DISK WRITE ERROR UNIT [%d] - BAD CYLINDER %d : %d",
-		     wdi.unit, wdi.hd[wdi.unit].status.cav, cyl);
-		wdi.hd[wdi.unit]._fault = 0; /* SET FAULT */
+		     unit, wdi.hd[unit].status.cav, cyl);
+		wdi.hd[unit]._fault = 0; /* SET FAULT */
+		return 0;
+	}
+	if (buffer[4] >= WDI_SECTORS) {
+		LOGE(TAG, "DISK WRITE ERROR UNIT [%d] - BAD SECTOR %d",
+		     unit, buffer[4]);
+		wdi.hd[unit]._fault = 0; /* SET FAULT */
 		return 0;
 	}
 
 	struct stat s;
 
-	fstat(wdi.hd[wdi.unit].fd, &s);
+	fstat(wdi.hd[unit].fd, &s);
 	if (s.st_mode & S_IWUSR)
-		wdi.hd[wdi.unit].status.write_prot = 0;
+		wdi.hd[unit].status.write_prot = 0;
 	else
-		wdi.hd[wdi.unit].status.write_prot = 1;
+		wdi.hd[unit].status.write_prot = 1;
 
 	off_t pos = wdi_pos(&buffer[1]);
 
-	if (lseek(wdi.hd[wdi.unit].fd, pos, SEEK_SET) == -1L) {
-		wdi.hd[wdi.unit]._fault = 0; /* write fault */
-		return 0;
+	pthread_mutex_lock(&io.mtx);
+
+	/* update the cached track, one being read is waited for */
+	if (io.trk[unit].state != TRK_EMPTY && io.trk[unit].head == buffer[1] &&
+	    io.trk[unit].cyl == cyl) {
+		while (io.trk[unit].state == TRK_LOADING)
+			pthread_cond_wait(&io.done, &io.mtx);
+		memcpy(io.trk[unit].data + buffer[4] * WDI_BLOCK_SIZE,
+		       &buffer[5], WDI_BLOCK_SIZE);
+		io.trk[unit].bad &= ~(1U << buffer[4]);
 	}
 
-	/* write the sector */
-	if (write(wdi.hd[wdi.unit].fd, &buffer[5], WDI_BLOCK_SIZE) == WDI_BLOCK_SIZE)
-		wdi.hd[wdi.unit]._fault = 1;
-	else
-		wdi.hd[wdi.unit]._fault = 0; /* write fault */
+	/* queue the sector for the worker, or write it now */
+	if (io.running) {
+		while (io.whead - io.wtail == WDI_WQUEUE)
+			pthread_cond_wait(&io.done, &io.mtx);
+		n = io.whead % WDI_WQUEUE;
+		io.wq[n].unit = unit;
+		io.wq[n].pos = pos;
+		memcpy(io.wq[n].data, &buffer[5], WDI_BLOCK_SIZE);
+		io.whead++;
+		pthread_cond_signal(&io.work);
+	} else
+		wdi_write_sector(unit, wdi.hd[unit].fd, pos, &buffer[5]);
+
+	pthread_mutex_unlock(&io.mtx);
 
-	// if (fsync(wdi.hd[wdi.unit].fd) == -1) {
-	// 	LOGW(TAG, "WRITE: SYNC FAILED - %s [%d]", strerror(errno), errno);
-	// };
+	/* write fault, maybe of a sector written behind before */
+	wdi.hd[unit]._fault = !wdi_write_failed(unit);
 
 	return wdi.dma.wr0.len * 3; /* 3 t-states per byte of DMA */
 }
 
 static Tstates_t wdi_dma_read(BYTE bus_ack)
 {
-	register int v;
-	int i;
+	int unit = wdi.unit;
+	int len = wdi.dma.wr0.len;
+	int n, m;
 
 	if (!bus_ack)
 		return 0;
 
-	buffer[0] = wdi.hd[wdi.unit].status.hav;
-	buffer[1] = wdi.hd[wdi.unit].status.cav & 0xff;
-	buffer[2] = wdi.hd[wdi.unit].status.cav >> 8;
-	buffer[3] = wdi.hd[wdi.unit].sector;
+	if (!wdi.hd[unit].online) {
+		wdi.hd[unit]._fault = 0; /* SET FAULT */
+		return 0;
+	}
+
+	if (len >= WDI_MAX_BUFFER) {
+		wdi.hd[unit]._fault = 0; /* SET FAULT */
+		LOGE(TAG, "DMA length: %d > buffer: %d", len, WDI_MAX_BUFFER);
+		return 0;
+	}
+
+	buffer[0] = wdi.hd[unit].status.hav;
+	buffer[1] = wdi.hd[unit].status.cav & 0xff;
+	buffer[2] = wdi.hd[unit].status.cav >> 8;
+	buffer[3] = wdi.hd[unit].sector;
 
 	LOGI(TAG, "READ %s: head: %d, cyl: %d, sec: %d",
-	     (wdi.dma.wr0.len == 4) ? "HEADER" : "DATA",
-	     wdi.hd[wdi.unit].status.hav, wdi.hd[wdi.unit].status.cav,
-	     wdi.hd[wdi.unit].sector);
+	     (len == 4) ? "HEADER" : "DATA",
+	     wdi.hd[unit].status.hav, wdi.hd[unit].status.cav,
+	     wdi.hd[unit].sector);
 	LOGI(TAG, "           start: %04x, addr: %04x, len: %d", wdi.dma.wr4.b_start,
-	     wdi.dma.wr4.b_addr_counter, wdi.dma.wr0.len);
+	     wdi.dma.wr4.b_addr_counter, len);
 
-	wdi.hd[wdi.unit].sector++;
-	wdi.hd[wdi.unit].sector %= WDI_SECTORS;
+	wdi.hd[unit].sector++;
+	wdi.hd[unit].sector %= WDI_SECTORS;
 
 	struct stat s;
 
-	fstat(wdi.hd[wdi.unit].fd, &s);
+	fstat(wdi.hd[unit].fd, &s);
 	if (s.st_mode & S_IWUSR)
-		wdi.hd[wdi.unit].status.write_prot = 0;
+		wdi.hd[unit].status.write_prot = 0;
 	else
-		wdi.hd[wdi.unit].status.write_prot = 1;
+		wdi.hd[unit].status.write_prot = 1;
 
-	off_t pos = wdi_pos(buffer);
-
-	if (lseek(wdi.hd[wdi.unit].fd, pos, SEEK_SET) == -1L) {
-		wdi.hd[wdi.unit]._fault = 0; /* read fault */
+	if (wdi_write_failed(unit)) {
+		wdi.hd[unit]._fault = 0; /* write fault of a sector written behind */
 		return 0;
 	}
 
-	/* read the sector */
-	if (read(wdi.hd[wdi.unit].fd, &buffer[4], WDI_BLOCK_SIZE) == WDI_BLOCK_SIZE)
-		wdi.hd[wdi.unit]._fault = 1;
-	else {
-		wdi.hd[wdi.unit]._fault = 0; /* read fault */
+	/* the sector is copied from the track cache, header first */
+	pthread_mutex_lock(&io.mtx);
+	wdi_wait_track(unit);
+	if (io.trk[unit].bad & (1U << buffer[3])) {
+		pthread_mutex_unlock(&io.mtx);
+		wdi.hd[unit]._fault = 0; /* read fault */
 		return 0;
 	}
-
-	for (i = 0; i < wdi.dma.wr0.len; i++) {
-		v = buffer[i];
-
-		dma_write(wdi.dma.wr4.b_addr_counter, v);
-		wdi.dma.wr4.b_addr_counter++;
+	n = (len < 4) ? len : 4;
+	m = (len - n < WDI_BLOCK_SIZE) ? len - n : WDI_BLOCK_SIZE;
+	dma_write_block(wdi.dma.wr4.b_addr_counter, buffer, n);
+	dma_write_block(wdi.dma.wr4.b_addr_counter + n,
+			io.trk[unit].data + buffer[3] * WDI_BLOCK_SIZE, m);
+	pthread_mutex_unlock(&io.mtx);
+	/* bytes after the sector are 0 */
+	if (len > n + m) {
+		memset(&buffer[4], 0, len - n - m);
+		dma_write_block(wdi.dma.wr4.b_addr_counter + n + m,
+				&buffer[4], len - n - m);
 	}
 
-	return wdi.dma.wr0.len * 3;  /* 3 t-states per byte of DMA */
+	wdi.dma.wr4.b_addr_counter += len;
+	wdi.hd[unit]._fault = 1;
+
+	return len * 3;  /* 3 t-states per byte of DMA */
 }
 
 BYTE cromemco_wdi_pio0a_data_in(void)
@@ -540,7 +825,7 @@ BYTE cromemco_wdi_pio1a_data_in(void)
 		val ^= 0x40;
 
 	if (wdi.hd[wdi.unit].online) { /* Only respond if online */
-		if (!wdi.hd[wdi.unit].status.seeking)
+		if (!wdi.hd[wdi.unit].status.seeking && wdi_loaded(wdi.unit))
 			val ^= 0x20; /* _SEEK_COMPLETE if not SEEKING */
 		if (wdi.pio1._cmd_stb)
 			val ^= 0x80; /* _CMD_AK on _CMD_STB */
@@ -557,6 +842,8 @@ BYTE cromemco_wdi_pio1b_data_in(void)
 	BYTE val = wdi.pio1.dir_B; /* pull inputs HIGH */
 
 	if (wdi.hd[wdi.unit].online) { /* Only respond if online */
+		if (wdi_write_failed(wdi.unit))
+			wdi.hd[wdi.unit]._fault = 0;
 		if (!wdi.hd[wdi.unit]._fault)
 			val ^= 0x02;
 		if (!wdi.hd[wdi.unit]._crc_error) /* Note: CRC_ERROR is not inverted */
@@ -702,6 +989,7 @@ static void command_bus_strobe(void)
 		wdi.hd[wdi.unit].status.rezeroing = 0;
 		wdi.hd[wdi.unit].status.on_cyl = 1;
 		wdi.hd[wdi.unit].status.unit_rdy = 1;
+		wdi_load(wdi.unit, 0, 0);
 	}
 	/* Only seek if online */
 	if (wdi.hd[wdi.unit].status.seeking && wdi.hd[wdi.unit].online) {
@@ -714,6 +1002,8 @@ static void command_bus_strobe(void)
 		wdi.hd[wdi.unit].status.seeking = 0;
 		wdi.hd[wdi.unit].status.on_cyl = 1;
 		wdi.hd[wdi.unit].status.unit_rdy = 1;
+		wdi_load(wdi.unit, wdi.hd[wdi.unit].status.hav,
+			 wdi.hd[wdi.unit].status.cav);
 	}
 
 	switch (bus) {
@@ -778,6 +1068,10 @@ static void command_bus_strobe(void)
 			wdi.hd[wdi.unit].status.on_cyl = 0;
 			wdi.hd[wdi.unit].status.unit_rdy = 0;
 
+			/* the seek overlaps with the guest running */
+			wdi_load(wdi.unit, wdi.hd[wdi.unit].command.has,
+				 wdi.hd[wdi.unit].command.cas);
+
 			LOGI(TAG, "DISK COMMAND 1 - CYL: %03x", wdi.hd[wdi.unit].status.cav);
 		}
 		break;
@@ -803,7 +1097,8 @@ static void command_bus_strobe(void)
 	case 4:
 		wdi.pio0.data_B = wdi.hd[wdi.unit].status.unit_rdy;
 		wdi.pio0.data_B |= wdi.hd[wdi.unit].status.on_cyl << 1;
-		wdi.pio0.data_B |= wdi.hd[wdi.unit].status.seeking << 2;
+		wdi.pio0.data_B |= (wdi.hd[wdi.unit].status.seeking ||
+				    !wdi_loaded(wdi.unit)) << 2;
 		wdi.pio0.data_B |= wdi.hd[wdi.unit].status.rezeroing << 3;
 		wdi.pio0.data_B |= wdi.hd[wdi.unit].status.illegal_address << 6;
 		break;
@@ -26,7 +26,8 @@
  *
  * The diskmanager provides functions to:
  *	- populate the array from the file
- *	- write the array to the file
+ *	- write the array to the file, only if it changed, to a temporary
+ *	  file which is renamed, so the disk map is never left incomplete
  *	- insert a disk
  *	    - stat() disk image files to validate them before inserting
  *	    - reject inserting the same disk image in 2 disk drives
@@ -43,9 +44,19 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <signal.h>
+#include <pthread.h>
 #include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#define HAS_INOTIFY
+#endif
 
 #include "sim.h"
 #include "simdefs.h"
@@ -65,6 +76,10 @@ static char *file_start;
 
 #define APPENDTOPATH(file) strncpy(file_start, file, MAX_LFN - strlen(path));
 
+#ifdef HAS_NETSERVER
+static void lib_init(const char *dir);
+#endif
+
 typedef enum disk_err {
 	SUCCESS,
 	INVALID_DISK_NUM,
@@ -122,6 +137,9 @@ static disk_err_t insertDisk(int disk, const char *image)
 
 static void writeDiskmap(void)
 {
+	static char *written[_MAX_DISK];	/* disk map in the file */
+	static bool valid;
+	char tmp[MAX_LFN + 16];
 	FILE *map;
 	int i;
 
@@ -130,17 +148,50 @@ static void writeDiskmap(void)
 		return;
 	}
 
+	/* nothing to do if no disk changed since the last write */
+	if (valid) {
+		for (i = 0; i < _MAX_DISK; i++) {
+			if ((written[i] == NULL) != (DISKNAME(i) == NULL))
+				break;
+			if (written[i] != NULL && strcmp(written[i], DISKNAME(i)))
+				break;
+		}
+		if (i == _MAX_DISK)
+			return;
+	}
+
+	/* write a hidden temporary file and rename it over the disk map */
+	*file_start = '\0';
+	snprintf(tmp, sizeof(tmp), "%s.%s.tmp", path, DISKMAP);
 	APPENDTOPATH(DISKMAP);
 
-	map = fopen(path, "w");
+	map = fopen(tmp, "w");
 	if (map == NULL) {
-		LOGW(TAG, "Can't create disk map: %s", path);
+		LOGW(TAG, "Can't create disk map: %s", tmp);
 		return;
 	}
 
 	for (i = 0; i < _MAX_DISK; i++)
 		fprintf(map, "%s\n", DISKNAME(i) == NULL ? "#" : DISKNAME(i));
+	if (fflush(map) != 0 || fsync(fileno(map)) != 0) {
+		LOGW(TAG, "Can't write disk map: %s, error: %d", tmp, errno);
+		fclose(map);
+		unlink(tmp);
+		return;
+	}
 	fclose(map);
+
+	if (rename(tmp, path) != 0) {
+		LOGW(TAG, "Can't replace disk map: %s, error: %d", path, errno);
+		unlink(tmp);
+		return;
+	}
+
+	for (i = 0; i < _MAX_DISK; i++) {
+		free(written[i]);
+		written[i] = (DISKNAME(i) == NULL) ? NULL : strdup(DISKNAME(i));
+	}
+	valid = true;
 }
 
 void readDiskmap(char *path_name)
@@ -160,6 +211,10 @@ void readDiskmap(char *path_name)
 	strncat(path, "/", MAX_LFN - strlen(path));
 	file_start = path + strlen(path);
 
+#ifdef HAS_NETSERVER
+	lib_init(path_name);
+#endif
+
 	APPENDTOPATH(DISKMAP);
 	LOGD(TAG, "LIB: path: %s, diskmap: %s", path, file_start);
 
@@ -266,6 +321,386 @@ static disk_err_t ejectDisk(int disk)
 	return INVALID_DISK_NUM;
 }
 
+/**
+ * Index of the disk library:
+ *
+ * The image files in the library directory are scanned once when the
+ * disk map is read, after that the index is kept up to date from
+ * inotify events on Linux. On other systems the directory is scanned
+ * again when its modification time changes. The JSON sent for LIB:
+ * is built once per change of the index, every other request gets the
+ * cached copy, or 304 if the browser has it already.
+ */
+
+typedef struct lib_entry {
+	char *name;
+	long long size;
+	time_t mtime;
+} lib_entry_t;
+
+static pthread_mutex_t lib_mtx = PTHREAD_MUTEX_INITIALIZER;
+static char lib_dir[MAX_LFN + 1];	/* library directory, "" if none */
+static lib_entry_t *lib;		/* entries sorted by name */
+static int lib_num, lib_max;
+static unsigned lib_gen;		/* incremented on every change */
+static time_t lib_epoch;		/* start time, part of the ETag */
+static time_t lib_dir_mtime;		/* directory mtime of the last scan */
+static bool lib_ok = true;		/* directory could be read */
+#ifdef HAS_INOTIFY
+static bool lib_watched;		/* inotify thread is running */
+#endif
+
+/*
+ * JSON of the library, never changed after it is built. It is freed
+ * when the index changed and no request is sending it anymore.
+ */
+typedef struct lib_json {
+	int refs;			/* the cache and requests sending it */
+	unsigned gen;			/* lib_gen it was built from */
+	char *buf;
+	size_t len, size;
+} lib_json_t;
+
+static lib_json_t *lib_json[2];		/* names only, and with details */
+
+/**
+ * Guess the disk format from the image size, the same sizes are
+ * recognized by the Cromemco FDC
+ */
+static const char *lib_geometry(long long size)
+{
+	switch (size) {
+	case 92160:
+		return "5.25\\\" SS SD";
+	case 184320:
+		return "5.25\\\" DS SD";
+	case 201984:
+		return "5.25\\\" SS DD";
+	case 406784:
+		return "5.25\\\" DS DD";
+	case 256256:
+		return "8\\\" SS SD";
+	case 512512:
+		return "8\\\" DS SD";
+	case 625920:
+		return "8\\\" SS DD";
+	case 1256704:
+	case 1261568:
+		return "8\\\" DS DD";
+	default:
+		return (size >= 1048576) ? "HD" : "";
+	}
+}
+
+/* find name, returns its index or where it is to be inserted as -index-1 */
+static int lib_find(const char *name)
+{
+	int lo = 0, hi = lib_num - 1, mid, cmp;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		cmp = strcmp(lib[mid].name, name);
+		if (cmp == 0)
+			return mid;
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return -lo - 1;
+}
+
+/* update the entry of one file after a change, lib_mtx must be locked */
+static void lib_update(const char *name)
+{
+	char fullpath[2 * MAX_LFN + 2];
+	struct stat sb;
+	int i;
+	bool exists;
+
+	/* hidden files, like the temporary disk map, are not listed */
+	if (*lib_dir == '\0' || *name == '.')
+		return;
+
+	snprintf(fullpath, sizeof(fullpath), "%s/%s", lib_dir, name);
+	exists = (stat(fullpath, &sb) != -1 && S_ISREG(sb.st_mode));
+	i = lib_find(name);
+
+	if (i >= 0 && !exists) {
+		free(lib[i].name);
+		memmove(&lib[i], &lib[i + 1], (lib_num - i - 1) * sizeof(lib_entry_t));
+		lib_num--;
+	} else if (exists) {
+		if (i < 0) {
+			if (lib_num == lib_max) {
+				lib_max = lib_max ? 2 * lib_max : 256;
+				lib = (lib_entry_t *) realloc(lib, lib_max * sizeof(lib_entry_t));
+			}
+			i = -i - 1;
+			memmove(&lib[i + 1], &lib[i], (lib_num - i) * sizeof(lib_entry_t));
+			lib_num++;
+			lib[i].name = strdup(name);
+		} else if (lib[i].size == sb.st_size && lib[i].mtime == sb.st_mtime)
+			return;
+		lib[i].size = sb.st_size;
+		lib[i].mtime = sb.st_mtime;
+	} else
+		return;
+
+	lib_gen++;
+}
+
+/* read the whole directory, lib_mtx must be locked */
+static void lib_scan(void)
+{
+	DIR *dir;
+	struct dirent *e;
+	struct stat sb;
+	int i;
+
+	for (i = 0; i < lib_num; i++)
+		free(lib[i].name);
+	lib_num = 0;
+	lib_gen++;
+
+	if (stat(lib_dir, &sb) != -1)
+		lib_dir_mtime = sb.st_mtime;
+	if ((dir = opendir(lib_dir)) == NULL) {
+		if (lib_ok)
+			LOGW(TAG, "Can't read disk library %s", lib_dir);
+		lib_ok = false;
+		return;
+	}
+	lib_ok = true;
+	while ((e = readdir(dir)) != NULL)
+		lib_update(e->d_name);
+	closedir(dir);
+
+	LOGD(TAG, "LIB: %d images in %s", lib_num, lib_dir);
+}
+
+#ifdef HAS_INOTIFY
+/* thread which applies inotify events of the library directory */
+static void *lib_watch(void *arg)
+{
+	int fd = (int) (intptr_t) arg;
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	sigset_t set;
+	ssize_t len;
+	char *p;
+	bool gone = false;
+
+	/* leave the signals of the simulation to the other threads */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	while ((len = read(fd, buf, sizeof(buf))) != 0) {
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		pthread_mutex_lock(&lib_mtx);
+		for (p = buf; p < buf + len; p += sizeof(*ev) + ev->len) {
+			ev = (const struct inotify_event *) p;
+			if (ev->mask & IN_Q_OVERFLOW)
+				lib_scan();
+			else if (ev->mask & IN_IGNORED)
+				gone = true;	/* directory was removed */
+			else if (ev->len > 0)
+				lib_update(ev->name);
+		}
+		pthread_mutex_unlock(&lib_mtx);
+		if (gone)
+			break;
+	}
+
+	LOGW(TAG, "Disk library watch ended");
+	pthread_mutex_lock(&lib_mtx);
+	lib_watched = false;
+	pthread_mutex_unlock(&lib_mtx);
+	close(fd);
+
+	return NULL;
+}
+#endif
+
+/* build the index of the library directory dir */
+static void lib_init(const char *dir)
+{
+#ifdef HAS_INOTIFY
+	pthread_t thread;
+	int fd;
+#endif
+
+	pthread_mutex_lock(&lib_mtx);
+	if (strcmp(lib_dir, dir) == 0) {
+		pthread_mutex_unlock(&lib_mtx);
+		return;
+	}
+	strncpy(lib_dir, dir, MAX_LFN);
+	lib_dir[MAX_LFN] = '\0';
+	lib_epoch = time(NULL);
+	lib_scan();
+
+#ifdef HAS_INOTIFY
+	if (!lib_watched) {
+		fd = inotify_init();
+		if (fd == -1 || inotify_add_watch(fd, lib_dir, IN_CREATE |
+						  IN_DELETE | IN_MOVED_FROM |
+						  IN_MOVED_TO | IN_CLOSE_WRITE |
+						  IN_ATTRIB) == -1) {
+			LOGW(TAG, "Can't watch disk library, error: %d", errno);
+			if (fd != -1)
+				close(fd);
+		} else if (pthread_create(&thread, NULL, lib_watch,
+					  (void *) (intptr_t) fd)) {
+			LOGW(TAG, "Can't create disk library thread");
+			close(fd);
+		} else {
+			pthread_detach(thread);
+			lib_watched = true;
+		}
+	}
+#endif
+	pthread_mutex_unlock(&lib_mtx);
+}
+
+/*
+ * make sure the index is current, returns false if the directory
+ * can't be read, lib_mtx must be locked
+ */
+static bool lib_check(void)
+{
+	struct stat sb;
+
+	if (stat(lib_dir, &sb) == -1) {
+		lib_ok = false;
+		return false;
+	}
+#ifdef HAS_INOTIFY
+	if (lib_watched && lib_ok)
+		return true;
+#endif
+	/* without notification look at the directory */
+	if (!lib_ok || sb.st_mtime != lib_dir_mtime)
+		lib_scan();
+	return lib_ok;
+}
+
+/* append to a JSON buffer */
+static void lib_append(lib_json_t *j, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	while (true) {
+		va_start(ap, fmt);
+		n = vsnprintf(j->buf + j->len, j->size - j->len, fmt, ap);
+		va_end(ap);
+		if (n >= 0 && j->len + n < j->size)
+			break;
+		j->size = 2 * j->size + n + 1;
+		j->buf = (char *) realloc(j->buf, j->size);
+	}
+	j->len += n;
+}
+
+/* drop a reference to a JSON buffer, lib_mtx must be locked */
+static void lib_release(lib_json_t *j)
+{
+	if (--j->refs == 0) {
+		free(j->buf);
+		free(j);
+	}
+}
+
+/*
+ * JSON of the library, k = 1 with size, time and format, returned with
+ * a reference for the caller, lib_mtx must be locked
+ */
+static lib_json_t *lib_build_json(int k)
+{
+	lib_json_t *j;
+	int i;
+
+	if (lib_json[k] == NULL || lib_json[k]->gen != lib_gen) {
+		j = (lib_json_t *) calloc(1, sizeof(lib_json_t));
+		j->refs = 1;
+		lib_append(j, "[");
+		for (i = 0; i < lib_num; i++) {
+			if (k)
+				lib_append(j, "%c{ \"filename\":\"%s\",\"size\":%lld,"
+					   "\"mtime\":%lld,\"format\":\"%s\"}",
+					   (i > 0) ? ',' : ' ', lib[i].name,
+					   lib[i].size, (long long) lib[i].mtime,
+					   lib_geometry(lib[i].size));
+			else
+				lib_append(j, "%c\"%s\"", (i > 0) ? ',' : ' ',
+					   lib[i].name);
+		}
+		lib_append(j, "]");
+		j->gen = lib_gen;
+		if (lib_json[k] != NULL)
+			lib_release(lib_json[k]);
+		lib_json[k] = j;
+	}
+	lib_json[k]->refs++;
+	return lib_json[k];
+}
+
+/*
+ * send the library as JSON, or 304 if the client has it, the lock
+ * isn't held while writing to the client
+ */
+static void sendLibrary(HttpdConnection_t *conn, bool details)
+{
+	const char *inm = mg_get_header(conn, "If-None-Match");
+	char etag[32];
+	int k = details ? 1 : 0;
+	lib_json_t *j;
+
+	pthread_mutex_lock(&lib_mtx);
+	if (!lib_check()) {
+		pthread_mutex_unlock(&lib_mtx);
+		httpdStartResponse(conn, 404);
+		httpdEndHeaders(conn);
+		return;
+	}
+	j = lib_build_json(k);
+	snprintf(etag, sizeof(etag), "\"lib%d-%lx-%x\"", k,
+		 (unsigned long) lib_epoch, j->gen);
+	pthread_mutex_unlock(&lib_mtx);
+
+	if (inm != NULL && strstr(inm, etag) != NULL) {
+		httpdPrintf(conn, "HTTP/1.1 304 Not Modified\r\n");
+		httpdHeader(conn, "ETag", etag);
+		httpdEndHeaders(conn);
+	} else {
+		httpdStartResponse(conn, 200);
+		httpdHeader(conn, "Content-Type", "application/json");
+		httpdHeader(conn, "Cache-Control", "no-cache");
+		httpdHeader(conn, "ETag", etag);
+		httpdPrintf(conn, "Content-Length: %lu\r\n",
+			    (unsigned long) j->len);
+		httpdEndHeaders(conn);
+		mg_write(conn, j->buf, j->len);
+	}
+
+	pthread_mutex_lock(&lib_mtx);
+	lib_release(j);
+	pthread_mutex_unlock(&lib_mtx);
+}
+
+/* a file was changed by a request, don't wait for the notification */
+static void lib_changed(const char *name)
+{
+	pthread_mutex_lock(&lib_mtx);
+	lib_update(name);
+	pthread_mutex_unlock(&lib_mtx);
+}
+
 /**
  * Web Server handlers for LIB: and X:DSK:
  *
@@ -285,11 +720,13 @@ int LibraryHandler(HttpdConnection_t *conn, void *unused)
 
 	switch (req->method) {
 	case HTTP_GET:
-		DirectoryHandler(conn, path);
+		sendLibrary(conn, req->args[0] && *req->args[0] == 'S');
 		break;
 	case HTTP_PUT:
 		UploadHandler(conn, path);
 		LOGI(TAG, "PUT image: image uploaded.");
+		if (req->args[0] != NULL)
+			lib_changed(req->args[0]);
 		break;
 	case HTTP_DELETE:
 		if (req->len > 0) {
@@ -312,6 +749,7 @@ int LibraryHandler(HttpdConnection_t *conn, void *unused)
 				httpdEndHeaders(conn);
 			} else {
 				LOGI(TAG, "DELETE image: %s, deleted.", path);
+				lib_changed(file_start);
 				httpdStartResponse(conn, 200);
 				httpdEndHeaders(conn);
 				httpdPrintf(conn, "Deleted");
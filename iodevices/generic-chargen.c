@@ -0,0 +1,141 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Common I/O devices used by various simulated machines
+ *
+ * Copyright (C) 2026 by agent
+ *
+ * Character generator for text mode video boards
+ *
+ * History:
+ * 18-OCT-2026 first version, shared by IMSAI VIO and ProcTec VDM-1
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "generic-chargen.h"
+
+/* initialize the character generator with a character ROM and colors */
+void chargen_init(chargen_t *cg, const char *glyphs, int nglyphs,
+		  int gw, int gh, const uint8_t fg[3], const uint8_t bg[3])
+{
+	memset(cg, 0, sizeof(chargen_t));
+	cg->glyphs = glyphs;
+	cg->nglyphs = nglyphs;
+	cg->gw = gw;
+	cg->gh = gh;
+	cg->fg = (fg[0] << 16) | (fg[1] << 8) | fg[2];
+	cg->bg = (bg[0] << 16) | (bg[1] << 8) | bg[2];
+}
+
+/*
+ * Render all glyphs for a screen of cols x rows cells. Each glyph pixel
+ * is scaled to xscale x yscale pixels, with scanlines every glyph row
+ * takes slf pixel rows and only the first of them is drawn.
+ */
+static void render_atlas(chargen_t *cg)
+{
+	int g, x, y, px, py;
+	const char *glyph;
+	uint32_t *p, *inv, on, off;
+	int cellsize = cg->cw * cg->ch;
+
+	free(cg->atlas);
+	cg->atlas = (uint32_t *) malloc(2 * cg->nglyphs * cellsize *
+					sizeof(uint32_t));
+
+	for (g = 0; g < cg->nglyphs; g++) {
+		glyph = cg->glyphs + g * cg->gh * cg->gw;
+		p = cg->atlas + 2 * g * cellsize;
+		inv = p + cellsize;
+		for (py = 0; py < cg->ch; py++) {
+			y = py / (cg->yscale * cg->slf);
+			for (px = 0; px < cg->cw; px++) {
+				x = px / cg->xscale;
+				if (py % cg->slf) {
+					/* scanline gap */
+					on = off = 0;
+				} else if (glyph[y * cg->gw + x] == 1) {
+					on = cg->fg;
+					off = cg->bg;
+				} else {
+					on = cg->bg;
+					off = cg->fg;
+				}
+				*p++ = on;
+				*inv++ = off;
+			}
+		}
+	}
+}
+
+/* set up for a screen of cols x rows cells, render glyphs if needed */
+void chargen_setup(chargen_t *cg, int cols, int rows,
+		   int xscale, int yscale, int slf)
+{
+	if (cg->atlas == NULL || xscale != cg->xscale ||
+	    yscale != cg->yscale || slf != cg->slf) {
+		cg->xscale = xscale;
+		cg->yscale = yscale;
+		cg->slf = slf;
+		cg->cw = cg->gw * xscale;
+		cg->ch = cg->gh * yscale * slf;
+		render_atlas(cg);
+	}
+
+	if (cg->shown == NULL || cols * rows > cg->cols * cg->rows) {
+		free(cg->shown);
+		cg->shown = (int *) malloc(cols * rows * sizeof(int));
+	}
+	cg->cols = cols;
+	cg->rows = rows;
+	chargen_invalidate(cg);
+}
+
+/* forget what is shown, the next chargen_put() of each cell draws */
+void chargen_invalidate(chargen_t *cg)
+{
+	int i;
+
+	for (i = 0; i < cg->cols * cg->rows; i++)
+		cg->shown[i] = -1;
+}
+
+/*
+ * Show glyph in cell col, row of the frame buffer fb with pitch pixels
+ * per row. Returns true if the cell was drawn, false if it was shown
+ * already.
+ */
+bool chargen_put(chargen_t *cg, int col, int row, int glyph,
+		 bool inv, uint32_t *fb, int pitch)
+{
+	int i = row * cg->cols + col;
+	int code = (glyph << 1) | inv;
+	int y;
+	uint32_t *src, *dst;
+
+	if (cg->shown[i] == code)
+		return false;
+	cg->shown[i] = code;
+
+	src = cg->atlas + code * cg->cw * cg->ch;
+	dst = fb + row * cg->ch * pitch + col * cg->cw;
+	for (y = 0; y < cg->ch; y++) {
+		memcpy(dst, src, cg->cw * sizeof(uint32_t));
+		src += cg->cw;
+		dst += pitch;
+	}
+
+	return true;
+}
+
+/* release the rendered glyphs */
+void chargen_free(chargen_t *cg)
+{
+	free(cg->atlas);
+	cg->atlas = NULL;
+	free(cg->shown);
+	cg->shown = NULL;
+	cg->cols = cg->rows = 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Common I/O devices used by various simulated machines
+ *
+ * Copyright (C) 2026 by agent
+ *
+ * Character generator for text mode video boards
+ *
+ * History:
+ * 18-OCT-2026 first version, shared by IMSAI VIO and ProcTec VDM-1
+ */
+
+#ifndef GENERIC_CHARGEN_INC
+#define GENERIC_CHARGEN_INC
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * All glyphs of a character ROM are rendered once in normal and inverse
+ * video into 32-bit XRGB pixels, displaying a character is a copy of
+ * its cell. The last character shown in each cell is remembered, so that
+ * only cells with a different character or attribute are copied.
+ */
+typedef struct chargen {
+	const char *glyphs;	/* character ROM, one char per pixel */
+	int nglyphs;		/* number of glyphs */
+	int gw, gh;		/* glyph width and height */
+	uint32_t fg, bg;	/* foreground and background pixel */
+	int xscale, yscale;	/* pixel scale factors */
+	int slf;		/* scanlines factor */
+	int cw, ch;		/* cell width and height in pixels */
+	uint32_t *atlas;	/* pixels of all glyphs, normal and inverse */
+	int cols, rows;		/* number of cells */
+	int *shown;		/* glyph shown in each cell, -1 if none */
+} chargen_t;
+
+extern void chargen_init(chargen_t *cg, const char *glyphs, int nglyphs,
+			 int gw, int gh, const uint8_t fg[3],
+			 const uint8_t bg[3]);
+extern void chargen_setup(chargen_t *cg, int cols, int rows,
+			  int xscale, int yscale, int slf);
+extern void chargen_invalidate(chargen_t *cg);
+extern bool chargen_put(chargen_t *cg, int col, int row, int glyph,
+			bool inv, uint32_t *fb, int pitch);
+extern void chargen_free(chargen_t *cg);
+
+#endif /* !GENERIC_CHARGEN_INC */
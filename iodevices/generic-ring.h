@@ -0,0 +1,137 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Common I/O devices used by various simulated machines
+ *
+ * Copyright (C) 2026 by agent
+ *
+ * Byte ring buffer for passing data between two threads
+ *
+ * History:
+ * 18-OCT-2026 first version, used for the cpmsim network consoles
+ */
+
+#ifndef GENERIC_RING_INC
+#define GENERIC_RING_INC
+
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Ring buffer with one producer and one consumer thread, no locks are
+ * needed. Only the producer moves head and only the consumer moves
+ * tail, both count up and wrap around, the buffer index is the counter
+ * modulo size, which must be a power of two.
+ */
+typedef struct ring {
+	unsigned head;		/* bytes written, by producer */
+	unsigned tail;		/* bytes read, by consumer */
+	unsigned size;		/* size of buf, a power of two */
+	uint8_t *buf;
+} ring_t;
+
+static inline void ring_init(ring_t *r, uint8_t *buf, unsigned size)
+{
+	r->head = r->tail = 0;
+	r->size = size;
+	r->buf = buf;
+}
+
+/* number of bytes which can be read, called by the consumer */
+static inline unsigned ring_count(ring_t *r)
+{
+	return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - r->tail;
+}
+
+/* number of bytes which can be written, called by the producer */
+static inline unsigned ring_space(ring_t *r)
+{
+	return r->size - (r->head - __atomic_load_n(&r->tail,
+						    __ATOMIC_ACQUIRE));
+}
+
+/* write up to n bytes, returns the number of bytes written */
+static inline unsigned ring_put(ring_t *r, const void *p, unsigned n)
+{
+	unsigned i = r->head & (r->size - 1);
+	unsigned space = ring_space(r);
+	unsigned m;
+
+	if (n > space)
+		n = space;
+	m = r->size - i;
+	if (m > n)
+		m = n;
+	memcpy(r->buf + i, p, m);
+	memcpy(r->buf, (const uint8_t *) p + m, n - m);
+	__atomic_store_n(&r->head, r->head + n, __ATOMIC_RELEASE);
+
+	return n;
+}
+
+/* read up to n bytes, returns the number of bytes read */
+static inline unsigned ring_get(ring_t *r, void *p, unsigned n)
+{
+	unsigned i = r->tail & (r->size - 1);
+	unsigned count = ring_count(r);
+	unsigned m;
+
+	if (n > count)
+		n = count;
+	m = r->size - i;
+	if (m > n)
+		m = n;
+	memcpy(p, r->buf + i, m);
+	memcpy((uint8_t *) p + m, r->buf, n - m);
+	__atomic_store_n(&r->tail, r->tail + n, __ATOMIC_RELEASE);
+
+	return n;
+}
+
+/* copy up to n bytes without removing them, called by the consumer */
+static inline unsigned ring_peek(ring_t *r, void *p, unsigned n)
+{
+	unsigned i = r->tail & (r->size - 1);
+	unsigned count = ring_count(r);
+	unsigned m;
+
+	if (n > count)
+		n = count;
+	m = r->size - i;
+	if (m > n)
+		m = n;
+	memcpy(p, r->buf + i, m);
+	memcpy((uint8_t *) p + m, r->buf, n - m);
+
+	return n;
+}
+
+/*
+ * Return a pointer to the bytes which can be read without wrapping
+ * around and their number in *n, called by the consumer. Together
+ * with ring_skip() data can be written to a file without copying.
+ */
+static inline const uint8_t *ring_rptr(ring_t *r, unsigned *n)
+{
+	unsigned i = r->tail & (r->size - 1);
+
+	*n = ring_count(r);
+	if (*n > r->size - i)
+		*n = r->size - i;
+	return r->buf + i;
+}
+
+/* remove n bytes which were read with ring_rptr() */
+static inline void ring_skip(ring_t *r, unsigned n)
+{
+	__atomic_store_n(&r->tail, r->tail + n, __ATOMIC_RELEASE);
+}
+
+/* discard all bytes which can be read, called by the consumer */
+static inline void ring_flush(ring_t *r)
+{
+	__atomic_store_n(&r->tail, __atomic_load_n(&r->head, __ATOMIC_ACQUIRE),
+			 __ATOMIC_RELEASE);
+}
+
+#endif /* !GENERIC_RING_INC */
@@ -0,0 +1,87 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Common I/O devices used by various simulated machines
+ *
+ * Copyright (C) 2026 by agent
+ *
+ * Write tracking for video memory
+ *
+ * The CPU only stores into the dirty maps, so marking needs no locking.
+ * A display thread resets the blocks of its map before reading their
+ * memory, a write racing with that gets the block marked again and
+ * redrawn with the next frame. Only the users of a block are changed
+ * by more than one thread, this is done under a lock.
+ *
+ * History:
+ * 18-OCT-2026 moved here from the simmem.c of altairsim, cromemcosim
+ *	       and imsaisim, one dirty map for each display device
+ */
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "sim.h"
+#include "simdefs.h"
+#include "generic-vram.h"
+
+BYTE vram_users[VRAM_BLOCKS];			/* bit set for each user */
+BYTE vram_blocks[VRAM_USERS][VRAM_BLOCKS];	/* dirty maps */
+
+static pthread_mutex_t users_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+/* track writes to a range for a user, all of it is dirty at the start */
+void vram_track(int user, WORD addr, int len)
+{
+	register int i;
+
+	pthread_mutex_lock(&users_mtx);
+	for (i = addr >> VRAM_SHIFT; i <= (addr + len - 1) >> VRAM_SHIFT; i++) {
+		vram_blocks[user][i & (VRAM_BLOCKS - 1)] = 1;
+		vram_users[i & (VRAM_BLOCKS - 1)] |= 1 << user;
+	}
+	pthread_mutex_unlock(&users_mtx);
+}
+
+void vram_untrack(int user, WORD addr, int len)
+{
+	register int i;
+
+	pthread_mutex_lock(&users_mtx);
+	for (i = addr >> VRAM_SHIFT; i <= (addr + len - 1) >> VRAM_SHIFT; i++)
+		vram_users[i & (VRAM_BLOCKS - 1)] &= ~(1 << user);
+	pthread_mutex_unlock(&users_mtx);
+}
+
+/* mark all tracked memory dirty, e.g. after a bank switch */
+void vram_invalidate(void)
+{
+	register int i;
+
+	for (i = 0; i < VRAM_BLOCKS; i++)
+		if (vram_users[i])
+			vram_mark(i << VRAM_SHIFT);
+}
+
+/*
+ * Return the dirty blocks of a tracked range of up to 4 KB for a user
+ * and reset them, bit 0 is the block containing addr.
+ */
+uint64_t vram_dirty(int user, WORD addr, int len)
+{
+	register int i, n;
+	BYTE *p;
+	uint64_t mask = 0;
+
+	n = ((addr + len - 1) >> VRAM_SHIFT) - (addr >> VRAM_SHIFT);
+	for (i = 0; i <= n && i < 64; i++) {
+		p = &vram_blocks[user][((addr >> VRAM_SHIFT) + i)
+				       & (VRAM_BLOCKS - 1)];
+		if (*p) {
+			*p = 0;
+			mask |= (uint64_t) 1 << i;
+		}
+	}
+
+	return mask;
+}
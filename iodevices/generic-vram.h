@@ -0,0 +1,65 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Common I/O devices used by various simulated machines
+ *
+ * Copyright (C) 2026 by agent
+ *
+ * Write tracking for video memory
+ *
+ * History:
+ * 18-OCT-2026 moved here from the simmem.c of altairsim, cromemcosim
+ *	       and imsaisim, one dirty map for each display device
+ */
+
+#ifndef GENERIC_VRAM_INC
+#define GENERIC_VRAM_INC
+
+#include <stdint.h>
+
+#include "sim.h"
+#include "simdefs.h"
+
+/*
+ * Display devices register the memory they show and only redraw the
+ * 64 byte blocks written since their last frame. Each device has its
+ * own dirty map, so the ranges of different devices may overlap. The
+ * memory accessors of a machine call vram_mark() for every write.
+ */
+#define VRAM_SHIFT	6			/* 64 byte blocks */
+#define VRAM_BLOCKS	(65536 >> VRAM_SHIFT)
+
+#define VRAM_DAZZLER	0			/* users of the tracking */
+#define VRAM_VIO	1
+#define VRAM_VDM	2
+#define VRAM_USERS	3
+
+extern BYTE vram_users[VRAM_BLOCKS];
+extern BYTE vram_blocks[VRAM_USERS][VRAM_BLOCKS];
+
+extern void vram_track(int user, WORD addr, int len);
+extern void vram_untrack(int user, WORD addr, int len);
+extern void vram_invalidate(void);
+extern uint64_t vram_dirty(int user, WORD addr, int len);
+
+/* mark a block dirty for all users tracking it */
+static inline void vram_mark(WORD addr)
+{
+	register int i;
+	register BYTE u = vram_users[addr >> VRAM_SHIFT];
+
+	if (u)
+		for (i = 0; i < VRAM_USERS; i++)
+			if (u & (1 << i))
+				vram_blocks[i][addr >> VRAM_SHIFT] = 1;
+}
+
+static inline void vram_mark_range(WORD addr, int len)
+{
+	register int i;
+
+	for (i = addr >> VRAM_SHIFT; i <= (addr + len - 1) >> VRAM_SHIFT; i++)
+		vram_mark(i << VRAM_SHIFT);
+}
+
+#endif /* !GENERIC_VRAM_INC */
@@ -44,6 +44,7 @@
 #include "simmem.h"
 
 #include "diskmanager.h"
+#include "unix_blkio.h"
 #ifdef HAS_NETSERVER
 #include "netsrv.h"
 #endif
@@ -384,13 +385,13 @@ do_format:
 			goto done;
 		}
 		pos = (track * spt + sector - 1) * SEC_SZ;
-		if (lseek(fd, pos, SEEK_SET) == -1L) {
+		if (pos < 0) {
 			dma_write(addr + DD_RESULT, 0x92);
 			goto done;
 		}
 		for (i = 0; i < SEC_SZ; i++)
 			blksec[i] = dma_read(dma_addr + i);
-		if (write(fd, blksec, SEC_SZ) != SEC_SZ) {
+		if (blk_write(fd, blksec, SEC_SZ, pos) != SEC_SZ) {
 			dma_write(addr + DD_RESULT, 0x93);
 			goto done;
 		}
@@ -407,11 +408,11 @@ do_format:
 			goto done;
 		}
 		pos = (track * spt + sector - 1) * SEC_SZ;
-		if (lseek(fd, pos, SEEK_SET) == -1L) {
+		if (pos < 0) {
 			dma_write(addr + DD_RESULT, 0x92);
 			goto done;
 		}
-		if (read(fd, blksec, SEC_SZ) != SEC_SZ) {
+		if (blk_read(fd, blksec, SEC_SZ, pos) != SEC_SZ) {
 			dma_write(addr + DD_RESULT, 0x93);
 			goto done;
 		}
@@ -427,12 +428,8 @@ do_format:
 			goto done;
 		}
 		pos = track * spt * SEC_SZ;
-		if (lseek(fd, pos, SEEK_SET) == -1L) {
-			dma_write(addr + DD_RESULT, 0x92);
-			goto done;
-		}
-		for (i = 0; i < spt; i++) {
-			if (write(fd, &blksec, SEC_SZ) != SEC_SZ) {
+		for (i = 0; i < spt; i++, pos += SEC_SZ) {
+			if (blk_write(fd, &blksec, SEC_SZ, pos) != SEC_SZ) {
 				dma_write(addr + DD_RESULT, 0x93);
 				goto done;
 			}
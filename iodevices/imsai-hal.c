@@ -26,6 +26,7 @@
 
 #include "unix_terminal.h"
 #include "unix_network.h"
+#include "unix_outbuf.h"
 #include "imsai-vio.h"
 #ifdef HAS_NETSERVER
 #include "netsrv.h"
@@ -188,6 +189,8 @@ static void net_ptr_out(BYTE data)
 
 /* -------------------- STDIO HAL -------------------- */
 
+static outbuf_t stdio_ob;	/* output buffer for the terminal */
+
 static bool stdio_alive(void)
 {
 	return true; /* STDIO is always alive */
@@ -197,6 +200,9 @@ static void stdio_status(BYTE *stat)
 {
 	struct pollfd p[1];
 
+	/* guest polls, show what it has written */
+	outbuf_flush(&stdio_ob);
+
 	p[0].fd = fileno(stdin);
 	p[0].events = POLLIN;
 	p[0].revents = 0;
@@ -217,6 +223,8 @@ static int stdio_in(void)
 	int data;
 	struct pollfd p[1];
 
+	outbuf_flush(&stdio_ob);
+
 again:
 	/* if no input waiting return last */
 	p[0].fd = fileno(stdin);
@@ -239,20 +247,17 @@ again:
 
 static void stdio_out(BYTE data)
 {
-again:
-	if (write(fileno(stdout), (char *) &data, 1) != 1) {
-		if (errno == EINTR)
-			goto again;
-		else {
-			LOGE(TAG, "can't write data");
-			cpu_error = IOERROR;
-			cpu_state = ST_STOPPED;
-		}
+	if (outbuf_put(&stdio_ob, fileno(stdout), data) == -1) {
+		LOGE(TAG, "can't write data");
+		cpu_error = IOERROR;
+		cpu_state = ST_STOPPED;
 	}
 }
 
 /* -------------------- SOCKET SERVER HAL -------------------- */
 
+static outbuf_t scktsrv_ob;	/* output buffer for the socket */
+
 static bool scktsrv_alive(void)
 {
 	struct pollfd p[1];
@@ -281,6 +286,7 @@ static void scktsrv_status(BYTE *stat)
 
 	/* if socket is connected check for I/O */
 	if (ucons[0].ssc != 0) {
+		outbuf_flush(&scktsrv_ob);
 		p[0].fd = ucons[0].ssc;
 		p[0].events = POLLIN | POLLOUT;
 		p[0].revents = 0;
@@ -303,6 +309,8 @@ static int scktsrv_in(void)
 	if (ucons[0].ssc == 0)
 		return -1;
 
+	outbuf_flush(&scktsrv_ob);
+
 	/* if no input waiting return last */
 	p[0].fd = ucons[0].ssc;
 	p[0].events = POLLIN;
@@ -313,6 +321,7 @@ static int scktsrv_in(void)
 
 	if (read(ucons[0].ssc, &data, 1) != 1) {
 		/* EOF, close socket and return last */
+		outbuf_drop(&scktsrv_ob);
 		close(ucons[0].ssc);
 		ucons[0].ssc = 0;
 		return -1;
@@ -323,31 +332,15 @@ static int scktsrv_in(void)
 
 static void scktsrv_out(BYTE data)
 {
-	struct pollfd p[1];
-
 	/* return if socket not connected */
 	if (ucons[0].ssc == 0)
 		return;
 
-	/* if output not possible close socket and return */
-	p[0].fd = ucons[0].ssc;
-	p[0].events = POLLOUT;
-	p[0].revents = 0;
-	poll(p, 1, 0);
-	if (!(p[0].revents & POLLOUT)) {
+	/* if output not possible close socket */
+	if (outbuf_put(&scktsrv_ob, ucons[0].ssc, data) == -1) {
+		outbuf_drop(&scktsrv_ob);
 		close(ucons[0].ssc);
 		ucons[0].ssc = 0;
-		return;
-	}
-
-again:
-	if (write(ucons[0].ssc, &data, 1) != 1) {
-		if (errno == EINTR)
-			goto again;
-		else {
-			close(ucons[0].ssc);
-			ucons[0].ssc = 0;
-		}
 	}
 }
 
@@ -513,6 +506,14 @@ static void hal_init(void)
 
 void hal_reset(void)
 {
+	static bool outbuf_ready;
+
+	if (!outbuf_ready) {
+		outbuf_init(&stdio_ob);
+		outbuf_init(&scktsrv_ob);
+		outbuf_ready = true;
+	}
+
 	hal_init();
 	hal_report();
 }
@@ -25,6 +25,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #ifdef WANT_SDL
 #include <SDL.h>
 #else
@@ -43,8 +44,8 @@
 #endif
 
 #ifdef HAS_NETSERVER
-#include <string.h>
 #include "netsrv.h"
+#include "fbdiff.h"
 #endif
 
 #if !defined(WANT_SDL) || defined(HAS_NETSERVER)
@@ -55,6 +56,7 @@ static const char *TAG = "VIO";
 
 #include "imsai-vio-charset.h"
 #include "imsai-vio.h"
+#include "generic-chargen.h"
 
 #define XOFF		10		/* use some offset inside the window */
 #define YOFF		15		/* for the drawing area */
@@ -68,28 +70,26 @@ uint8_t bg_color[3] = {48, 48, 48};	/* default background color */
 uint8_t fg_color[3] = {255, 255, 255};	/* default foreground color */
 static int xsize, ysize;		/* window size */
 static int xscale, yscale;
-static int sx, sy;
+static uint32_t *pixels;		/* window contents as XRGB8888 */
+static chargen_t chargen;
 #ifdef WANT_SDL
 static int vio_win_id = -1;
 static SDL_Window *window;
 static SDL_Renderer *renderer;
 static SDL_Texture *texture;
-static uint8_t *pixels;
-static int pitch;
-static uint8_t color[3];
 static char keybuf[KEYBUF_LEN];		/* typeahead buffer */
 static int keyn, keyin, keyout;
 static SDL_mutex *keybuf_mutex;
 #else /* !WANT_SDL */
 static Display *display;
+static Visual *visual;
 static Window window;
 static int screen;
 static GC gc;
-static XWindowAttributes wa;
-static Pixmap pixmap;
 static Colormap colormap;
-static XColor black, bg, fg;
-static char black_color[] = "#000000";	/* black */
+static XImage *ximage;
+static bool truecolor;		/* XRGB8888 pixels can be put as they are */
+static unsigned long xfg, xbg;	/* pixels of other visuals */
 static XEvent event;
 static KeySym key;
 static char text[10];
@@ -101,6 +101,7 @@ static int mode;		/* video mode written to command port memory */
 static int modebuf;			/* and double buffer for it */
 static int vmode, res;			/* video mode, resolution */
 static bool inv;			/* inverse */
+static bool redraw;			/* draw all of the next frame */
 #if !defined(WANT_SDL) || defined(HAS_NETSERVER)
 static bool kbd_status;			/* keyboard status */
 static int kbd_data;			/* keyboard data */
@@ -109,12 +110,32 @@ static int kbd_data;			/* keyboard data */
 static pthread_t thread;
 #endif
 
+#ifndef WANT_SDL
+/* allocate a XRGB8888 color in the colormap, returns its pixel */
+static unsigned long alloc_color(uint32_t rgb)
+{
+	XColor c;
+
+	c.red = ((rgb >> 16) & 0xff) * 0x101;
+	c.green = ((rgb >> 8) & 0xff) * 0x101;
+	c.blue = (rgb & 0xff) * 0x101;
+	c.flags = DoRed | DoGreen | DoBlue;
+	if (!XAllocColor(display, colormap, &c))
+		return BlackPixel(display, screen);
+	return c.pixel;
+}
+#endif
+
 /* create the SDL2 or X11 window for VIO display */
 static void open_display(void)
 {
 	xsize = 560 + (XOFF * 2);
 	ysize = (240 * slf) + (YOFF * 2);
 
+	pixels = (uint32_t *) calloc(xsize * ysize, sizeof(uint32_t));
+	chargen_init(&chargen, &charset[0][0][0], 256, 7, 10,
+		     fg_color, bg_color);
+
 #ifdef WANT_SDL
 	window = SDL_CreateWindow("IMSAI VIO",
 				  SDL_WINDOWPOS_UNDEFINED,
@@ -122,7 +143,7 @@ static void open_display(void)
 				  xsize, ysize, 0);
 	renderer = SDL_CreateRenderer(window, -1, (SDL_RENDERER_ACCELERATED |
 						   SDL_RENDERER_PRESENTVSYNC));
-	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_XRGB8888,
 				    SDL_TEXTUREACCESS_STREAMING, xsize, ysize);
 
 	keybuf_mutex = SDL_CreateMutex();
@@ -131,17 +152,37 @@ static void open_display(void)
 	SDL_RenderPresent(renderer);
 #else /* !WANT_SDL */
 	Window rootwindow;
+	XSetWindowAttributes swa;
 	XSizeHints *size_hints = XAllocSizeHints();
 	Atom wm_delete_window;
-	char buf[8];
+	XVisualInfo vinfo;
 
 	display = XOpenDisplay(NULL);
 	XLockDisplay(display);
 	screen = DefaultScreen(display);
-	rootwindow = RootWindow(display, screen);
-	XGetWindowAttributes(display, rootwindow, &wa);
-	window = XCreateSimpleWindow(display, rootwindow, 0, 0,
-				     xsize, ysize, 1, 0, 0);
+	truecolor = XMatchVisualInfo(display, screen, 24, TrueColor, &vinfo);
+	if (!truecolor) {
+		/* use the default visual with allocated colors */
+		vinfo.visual = DefaultVisual(display, screen);
+		vinfo.depth = DefaultDepth(display, screen);
+		vinfo.screen = screen;
+	}
+	rootwindow = RootWindow(display, vinfo.screen);
+	visual = vinfo.visual;
+	if (truecolor)
+		colormap = XCreateColormap(display, rootwindow, visual,
+					   AllocNone);
+	else {
+		colormap = DefaultColormap(display, screen);
+		xfg = alloc_color(chargen.fg);
+		xbg = alloc_color(chargen.bg);
+	}
+	swa.border_pixel = 0;
+	swa.colormap = colormap;
+	swa.event_mask = KeyPressMask | ExposureMask;
+	window = XCreateWindow(display, rootwindow, 0, 0, xsize, ysize,
+			       1, vinfo.depth, InputOutput, visual,
+			       CWBorderPixel | CWColormap | CWEventMask, &swa);
 	XStoreName(display, window, "IMSAI VIO");
 	size_hints->flags = PSize | PMinSize | PMaxSize;
 	size_hints->min_width = xsize;
@@ -154,19 +195,18 @@ static void open_display(void)
 	XFree(size_hints);
 	wm_delete_window = XInternAtom(display, "WM_DELETE_WINDOW", False);
 	XSetWMProtocols(display, window, &wm_delete_window, 1);
-	XSelectInput(display, window, KeyPressMask);
-	colormap = DefaultColormap(display, 0);
 	gc = XCreateGC(display, window, 0, NULL);
-	pixmap = XCreatePixmap(display, rootwindow, xsize, ysize, wa.depth);
-
-	XParseColor(display, colormap, black_color, &black);
-	XAllocColor(display, colormap, &black);
-	sprintf(buf, "#%02X%02X%02X", bg_color[0], bg_color[1], bg_color[2]);
-	XParseColor(display, colormap, buf, &bg);
-	XAllocColor(display, colormap, &bg);
-	sprintf(buf, "#%02X%02X%02X", fg_color[0], fg_color[1], fg_color[2]);
-	XParseColor(display, colormap, buf, &fg);
-	XAllocColor(display, colormap, &fg);
+	if (truecolor) {
+		ximage = XCreateImage(display, visual, vinfo.depth, ZPixmap,
+				      0, (char *) pixels, xsize, ysize, 32, 0);
+		/* force little-endian pixels, Xlib will convert if necessary */
+		ximage->byte_order = LSBFirst;
+	} else {
+		/* pixels are stored with XPutPixel() in the visual's format */
+		ximage = XCreateImage(display, visual, vinfo.depth, ZPixmap,
+				      0, NULL, xsize, ysize, 32, 0);
+		ximage->data = (char *) malloc(ximage->bytes_per_line * ysize);
+	}
 
 	XMapWindow(display, window);
 	XSync(display, True);
@@ -184,11 +224,19 @@ static void close_display(void)
 	SDL_DestroyWindow(window);
 #else
 	XLockDisplay(display);
-	XFreePixmap(display, pixmap);
+	if (truecolor)
+		ximage->data = NULL;
+	XDestroyImage(ximage);
 	XFreeGC(display, gc);
+	XDestroyWindow(display, window);
+	if (truecolor)
+		XFreeColormap(display, colormap);
 	XUnlockDisplay(display);
 	XCloseDisplay(display);
 #endif
+	chargen_free(&chargen);
+	free(pixels);
+	pixels = NULL;
 }
 
 #if !defined(WANT_SDL) || defined(HAS_NETSERVER)
@@ -207,6 +255,7 @@ static void kill_thread(void)
 void imsai_vio_off(void)
 {
 	state = false;		/* tell web refresh thread to stop */
+	vram_untrack(VRAM_VIO, 0xf000, 2048);
 
 #ifdef WANT_SDL
 #ifdef HAS_NETSERVER
@@ -229,149 +278,6 @@ void imsai_vio_off(void)
 
 #ifdef WANT_SDL
 
-static inline void set_fg_color(void)
-{
-	color[0] = fg_color[0];
-	color[1] = fg_color[1];
-	color[2] = fg_color[2];
-}
-
-static inline void set_bg_color(void)
-{
-	color[0] = bg_color[0];
-	color[1] = bg_color[1];
-	color[2] = bg_color[2];
-}
-
-static inline void draw_point(int x, int y)
-{
-	uint8_t *p = pixels + y * pitch + x * 4;
-
-	p[3] = color[0];
-	p[2] = color[1];
-	p[1] = color[2];
-	p[0] = SDL_ALPHA_OPAQUE;
-}
-
-#else /* !WANT_SDL */
-
-static inline void set_fg_color(void)
-{
-	XSetForeground(display, gc, fg.pixel);
-}
-
-static inline void set_bg_color(void)
-{
-	XSetForeground(display, gc, bg.pixel);
-}
-
-static inline void draw_point(int x, int y)
-{
-	XDrawPoint(display, pixmap, gc, x, y);
-}
-
-#endif /* !WANT_SDL */
-
-/* display characters 80-FF from bits 0-6, bit 7 = inverse video */
-static void dc1(BYTE c)
-{
-	register int x, y;
-	bool cinv = (c & 128) ? true : false;
-
-	for (x = 0; x < 7; x++) {
-		for (y = 0; y < 10; y++) {
-			if (charset[(c << 1) & 0xff][y][x] == 1) {
-				if (cinv == inv)
-					set_fg_color();
-				else
-					set_bg_color();
-			} else {
-				if (cinv == inv)
-					set_bg_color();
-				else
-					set_fg_color();
-			}
-			draw_point(sx + (x * xscale), sy + (y * yscale * slf));
-			if (res & 1)
-				draw_point(sx + (x * xscale) + 1,
-					   sy + (y * yscale * slf));
-			if (res & 2)
-				draw_point(sx + (x * xscale),
-					   sy + (y * yscale * slf) + (1 * slf));
-			if ((res & 3) == 3)
-				draw_point(sx + (x * xscale) + 1,
-					   sy + (y * yscale * slf) + (1 * slf));
-		}
-	}
-}
-
-/* display characters 00-7F from bits 0-6, bit 7 = inverse video */
-static void dc2(BYTE c)
-{
-	register int x, y;
-	bool cinv = (c & 128) ? true : false;
-
-	for (x = 0; x < 7; x++) {
-		for (y = 0; y < 10; y++) {
-			if (charset[c & 0x7f][y][x] == 1) {
-				if (cinv == inv)
-					set_fg_color();
-				else
-					set_bg_color();
-			} else {
-				if (cinv == inv)
-					set_bg_color();
-				else
-					set_fg_color();
-			}
-			draw_point(sx + (x * xscale), sy + (y * yscale * slf));
-			if (res & 1)
-				draw_point(sx + (x * xscale) + 1,
-					   sy + (y * yscale * slf));
-			if (res & 2)
-				draw_point(sx + (x * xscale),
-					   sy + (y * yscale * slf) + (1 * slf));
-			if ((res & 3) == 3)
-				draw_point(sx + (x * xscale) + 1,
-					   sy + (y * yscale * slf) + (1 * slf));
-		}
-	}
-}
-
-/* display characters 00-FF from bits 0-7, inverse video from command word */
-static void dc3(BYTE c)
-{
-	register int x, y;
-
-	for (x = 0; x < 7; x++) {
-		for (y = 0; y < 10; y++) {
-			if (charset[c][y][x] == 1) {
-				if (!inv)
-					set_fg_color();
-				else
-					set_bg_color();
-			} else {
-				if (!inv)
-					set_bg_color();
-				else
-					set_fg_color();
-			}
-			draw_point(sx + (x * xscale), sy + (y * yscale * slf));
-			if (res & 1)
-				draw_point(sx + (x * xscale) + 1,
-					   sy + (y * yscale * slf));
-			if (res & 2)
-				draw_point(sx + (x * xscale),
-					   sy + (y * yscale * slf) + (1 * slf));
-			if ((res & 3) == 3)
-				draw_point(sx + (x * xscale) + 1,
-					   sy + (y * yscale * slf) + (1 * slf));
-		}
-	}
-}
-
-#ifdef WANT_SDL
-
 /*
  * Enqueue a keyboard character
  */
@@ -407,6 +313,9 @@ static void process_event(SDL_Event *event)
 			case SDL_WINDOWEVENT_FOCUS_LOST:
 				SDL_StopTextInput();
 				break;
+			case SDL_WINDOWEVENT_EXPOSED:
+				redraw = true;
+				break;
 			default:
 				break;
 			}
@@ -459,8 +368,10 @@ static inline void event_handler(void)
 	/* if there is a keyboard event get it and convert with keymap */
 	if (display != NULL && XEventsQueued(display, QueuedAlready) > 0) {
 		XNextEvent(display, &event);
-		if ((event.type == KeyPress) &&
-		    XLookupString(&event.xkey, text, 1, &key, 0) == 1) {
+		if (event.type == Expose)
+			redraw = true;
+		else if ((event.type == KeyPress) &&
+			 XLookupString(&event.xkey, text, 1, &key, 0) == 1) {
 			kbd_data = text[0];
 			kbd_status = true;
 		}
@@ -478,19 +389,51 @@ static inline void event_handler(void)
 
 #endif /* !WANT_SDL */
 
-/* refresh the display buffer dependent on video mode */
-static void refresh(void)
+/*
+ * get the 64 byte blocks of the video memory written since the last
+ * frame, all of them if the frame must be drawn completely
+ */
+static uint64_t frame_dirty(void)
+{
+	uint64_t dirty = vram_dirty(VRAM_VIO, 0xf000, 2048);
+
+	if (redraw) {
+		redraw = false;
+		dirty = ~((uint64_t) 0);
+	}
+
+	return dirty;
+}
+
+/* check if the memory of a row was written */
+static inline bool row_dirty(uint64_t dirty, int addr, int len)
+{
+	int first = addr >> VRAM_SHIFT;
+	int last = (addr + len - 1) >> VRAM_SHIFT;
+
+	return (dirty >> first) & ((2ULL << (last - first)) - 1);
+}
+
+/*
+ * refresh the cells of the display buffer in dirty blocks, the changed
+ * pixel rows are returned in y0 - y1, nothing changed if y0 >= y1
+ */
+static void refresh(uint64_t dirty, int *y0, int *y1)
 {
 	static int cols, rows;
-	static BYTE c;
 	register int x, y;
+	BYTE c;
+	int glyph;
+	bool cinv, changed;
+	uint32_t *fb = pixels + YOFF * xsize + XOFF;
 
-	sx = XOFF;
-	sy = YOFF;
+	*y0 = ysize;
+	*y1 = 0;
 
 	mode = getmem(0xf7ff);
 	if (mode != modebuf) {
 		modebuf = mode;
+		dirty = ~((uint64_t) 0);
 
 		vmode = (mode >> 2) & 3;
 		res = mode & 3;
@@ -511,89 +454,91 @@ static void refresh(void)
 			rows = 24;
 			yscale = 1;
 		}
+
+		chargen_setup(&chargen, cols, rows, xscale, yscale, slf);
 	}
 
-	switch (vmode) {
-	case 0:	/* Video mode 0: video off, screen blanked */
+	if (vmode == 0) {	/* Video mode 0: video off, screen blanked */
 #if !defined(WANT_SDL) || defined(HAS_NETSERVER)
 		event_handler();
 #endif
-#ifdef WANT_SDL
-		SDL_SetRenderDrawColor(renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
-		SDL_RenderClear(renderer);
-#else
-		XSetForeground(display, gc, black.pixel);
-		XFillRectangle(display, pixmap, gc, 0, 0, xsize, ysize);
-#endif
-		break;
-
-	case 1: /* Video mode 1: display character codes 80-FF */
-		for (y = 0; y < rows; y++) {
-			sx = XOFF;
-#if !defined(WANT_SDL) || defined(HAS_NETSERVER)
-			event_handler();
-#endif
-			for (x = 0; x < cols; x++) {
-				c = getmem(0xf000 + (y * cols) + x);
-				dc1(c);
-				sx += (res & 1) ? 14 : 7;
-			}
-			sy += (res & 2) ? 20 * slf : 10 * slf;
+		if (dirty) {
+			memset(pixels, 0, xsize * ysize * sizeof(uint32_t));
+			chargen_invalidate(&chargen);
+			*y0 = 0;
+			*y1 = ysize;
 		}
-		break;
+		return;
+	}
 
-	case 2:	/* Video mode 2: display character codes 00-7F */
-		for (y = 0; y < rows; y++) {
-			sx = XOFF;
+	for (y = 0; y < rows; y++) {
 #if !defined(WANT_SDL) || defined(HAS_NETSERVER)
-			event_handler();
+		event_handler();
 #endif
-			for (x = 0; x < cols; x++) {
-				c = getmem(0xf000 + (y * cols) + x);
-				dc2(c);
-				sx += (res & 1) ? 14 : 7;
+		if (!row_dirty(dirty, y * cols, cols))
+			continue;
+		changed = false;
+		for (x = 0; x < cols; x++) {
+			c = getmem(0xf000 + (y * cols) + x);
+			switch (vmode) {
+			case 1:	/* Video mode 1: character codes 80-FF */
+				glyph = (c << 1) & 0xff;
+				cinv = (c & 128) ? !inv : inv;
+				break;
+			case 2:	/* Video mode 2: character codes 00-7F */
+				glyph = c & 0x7f;
+				cinv = (c & 128) ? !inv : inv;
+				break;
+			default: /* Video mode 3: character codes 00-FF */
+				glyph = c;
+				cinv = inv;
+				break;
 			}
-			sy += (res & 2) ? 20 * slf : 10 * slf;
+			changed |= chargen_put(&chargen, x, y, glyph, cinv,
+					       fb, xsize);
 		}
-		break;
-
-	case 3:	/* Video mode 3: display character codes 00-FF */
-		for (y = 0; y < rows; y++) {
-			sx = XOFF;
-#if !defined(WANT_SDL) || defined(HAS_NETSERVER)
-			event_handler();
-#endif
-			for (x = 0; x < cols; x++) {
-				c = getmem(0xf000 + (y * cols) + x);
-				dc3(c);
-				sx += (res & 1) ? 14 : 7;
-			}
-			sy += (res & 2) ? 20 * slf : 10 * slf;
+		if (changed) {
+			if (*y0 > YOFF + y * chargen.ch)
+				*y0 = YOFF + y * chargen.ch;
+			*y1 = YOFF + (y + 1) * chargen.ch;
 		}
-		break;
 	}
 }
 
 #ifdef HAS_NETSERVER
 static uint8_t dblbuf[2048];
+static uint8_t snapbuf[2048];
 
-static struct {
-	uint16_t addr;
-	union {
-		uint16_t len;
-		uint16_t mode;
-	};
-	uint8_t buf[2048];
-} msg;
+/* a message holds spans of [addr, len, data], 0xf7ff as addr is */
+/* followed by the video mode instead of the length */
+#define MSG_HDRLEN 4
+static uint8_t msgbuf[MSG_HDRLEN + FBDIFF_BUFSIZE(2048, MSG_HDRLEN)];
+
+static void msg_hdr(uint8_t *p, int addr, int len)
+{
+	addr += 0xf000;
+	p[0] = addr & 0xff;
+	p[1] = addr >> 8;
+	p[2] = len & 0xff;
+	p[3] = len >> 8;
+}
 
 static void ws_refresh(void)
 {
 	static int cols, rows;
+	uint64_t dirty = frame_dirty();
+	bool full = false;
+	int n = 0, i;
+
+	/* a new client or lost output needs a full frame */
+	if (net_device_resync(DEV_VIO))
+		modebuf = -1;
 
 	mode = getmem(0xf7ff);
 	if (mode != modebuf) {
 		modebuf = mode;
-		memset(dblbuf, 0, 2048);
+		full = true;
+		dirty = ~((uint64_t) 0);
 
 		res = mode & 3;
 
@@ -609,57 +554,26 @@ static void ws_refresh(void)
 			rows = 24;
 		}
 
-		msg.mode = mode;
-		msg.addr = 0xf7ff;
-		net_device_send(DEV_VIO, (char *) &msg, 4);
+		msg_hdr(msgbuf, 0x7ff, mode);
+		n = MSG_HDRLEN;
 		LOGD(__func__, "MODE change");
 	}
 
 	event_handler();
 
-	int len = rows * cols;
-	int addr;
-	int i, n, x;
-	bool cont;
-	uint8_t val;
-
-	for (i = 0; i < len; i++) {
-		addr = i;
-		n = 0;
-		cont = true;
-		while (cont && (i < len)) {
-			val = getmem(0xf000 + i);
-			while ((val != dblbuf[i]) && (i < len)) {
-				dblbuf[i++] = val;
-				msg.buf[n++] = val;
-				cont = false;
-				val = getmem(0xf000 + i);
-			}
-			if (cont)
-				break;
-			x = 0;
-#define LOOKAHEAD 4
-			/* look-ahead up to 4 bytes for next change */
-			while ((x < LOOKAHEAD) && !cont && (i < len)) {
-				val = getmem(0xf000 + i++);
-				msg.buf[n++] = val;
-				val = getmem(0xf000 + i);
-				if ((i < len) && (val != dblbuf[i])) {
-					cont = true;
-				}
-				x++;
-			}
-			if (!cont) {
-				n -= x;
-			}
-		}
-		if (n) {
-			msg.addr = 0xf000 + addr;
-			msg.len = n;
-			net_device_send(DEV_VIO, (char *) &msg, msg.len + 4);
-			LOGD(__func__, "BUF update FROM %04X TO %04X",
-			     msg.addr, msg.addr + msg.len);
-		}
+	if (dirty) {
+		getmem_block(0xf000, snapbuf, rows * cols);
+		/* no byte of the previous frame matches, so all are sent */
+		if (full)
+			for (i = 0; i < rows * cols; i++)
+				dblbuf[i] = ~snapbuf[i];
+		n += fbdiff_encode(snapbuf, dblbuf, rows * cols, MSG_HDRLEN,
+				   msg_hdr, msgbuf + n);
+	}
+
+	if (n) {
+		net_device_send(DEV_VIO, (char *) msgbuf, n);
+		LOGD(__func__, "BUF update len: %d", n);
 	}
 }
 #endif /* HAS_NETSERVER */
@@ -668,14 +582,28 @@ static void ws_refresh(void)
 /* function for updating the display */
 static void update_display(bool tick)
 {
+	uint64_t dirty;
+	int y0, y1;
+
 	UNUSED(tick);
 
-	/* update display window */
-	SDL_LockTexture(texture, NULL, (void **) &pixels, &pitch);
-	refresh();
-	SDL_UnlockTexture(texture);
-	SDL_RenderCopy(renderer, texture, NULL, NULL);
-	SDL_RenderPresent(renderer);
+	/* update display window if video memory was written, */
+	/* only the pixel rows with changed characters are uploaded */
+	if ((dirty = frame_dirty())) {
+		refresh(dirty, &y0, &y1);
+		if (dirty == ~((uint64_t) 0)) {
+			y0 = 0;
+			y1 = ysize;
+		}
+		if (y0 < y1) {
+			SDL_Rect r = {0, y0, xsize, y1 - y0};
+
+			SDL_UpdateTexture(texture, &r, pixels + y0 * xsize,
+					  xsize * sizeof(uint32_t));
+			SDL_RenderCopy(renderer, texture, NULL, NULL);
+			SDL_RenderPresent(renderer);
+		}
+	}
 }
 
 static win_funcs_t vio_funcs = {
@@ -686,12 +614,38 @@ static win_funcs_t vio_funcs = {
 };
 #endif /* !WANT_SDL */
 
+#ifndef WANT_SDL
+/* put the pixel rows y0 - y1 into the window */
+static void put_rows(int y0, int y1)
+{
+	int x, y;
+	uint32_t *p;
+
+	if (!truecolor) {
+		/* convert into the pixels of other visuals */
+		for (y = y0; y < y1; y++) {
+			p = pixels + y * xsize;
+			for (x = 0; x < xsize; x++)
+				XPutPixel(ximage, x, y,
+					  p[x] == chargen.fg ? xfg :
+					  p[x] == chargen.bg ? xbg :
+					  BlackPixel(display, screen));
+		}
+	}
+	XPutImage(display, window, gc, ximage, 0, y0, 0, y0, xsize, y1 - y0);
+}
+#endif
+
 #if !defined(WANT_SDL) || defined(HAS_NETSERVER)
 /* thread for updating the X11 display or web server */
 static void *update_thread(void *arg)
 {
 	uint64_t t;
 	long tleft;
+#ifndef WANT_SDL
+	uint64_t dirty;
+	int y0, y1;
+#endif
 
 	UNUSED(arg);
 
@@ -706,11 +660,17 @@ static void *update_thread(void *arg)
 			pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 			XLockDisplay(display);
 
-			/* update display window */
-			refresh();
-			XCopyArea(display, pixmap, window, gc, 0, 0,
-				  xsize, ysize, 0, 0);
-			XSync(display, False);
+			/* update display window, only changed pixel rows */
+			dirty = frame_dirty();
+			refresh(dirty, &y0, &y1);
+			if (dirty == ~((uint64_t) 0)) {
+				y0 = 0;
+				y1 = ysize;
+			}
+			if (y0 < y1) {
+				put_rows(y0, y1);
+				XSync(display, False);
+			}
 
 			/* unlock display, thread can be canceled again */
 			XUnlockDisplay(display);
@@ -752,6 +712,8 @@ void imsai_vio_init(void)
 
 	state = true;
 	modebuf = -1;
+	redraw = true;
+	vram_track(VRAM_VIO, 0xf000, 2048);
 	putmem(0xf7ff, 0x00);
 
 #if defined(WANT_SDL) && defined(HAS_NETSERVER)
@@ -26,6 +26,8 @@
 #include "simmem.h"
 #include "simio.h"
 
+#include "unix_blkio.h"
+
 #ifdef HAS_ISBC201
 
 #include "mds-isbc201.h"
@@ -104,7 +106,7 @@ static BYTE ioerr;		/* I/O complete error bits */
 static char fndir[MAX_LFN];	/* directory path for disk image */
 static char fn[MAX_LFN];	/* path/filename for disk image */
 static int fd;			/* fd for disk file i/o */
-static BYTE buf[SEC_SZ];	/* buffer for one sector */
+static BYTE buf[SPT * SEC_SZ];	/* buffer for a track of sectors */
 static pthread_mutex_t status_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /* these are our disk drives */
@@ -184,6 +186,7 @@ void isbc201_iopbh_out(BYTE data)
 #endif
 	int i, drive, op;
 	off_t pos;
+	ssize_t n;
 	struct stat s;
 
 	iopb_addr |= data << 8;
@@ -280,18 +283,12 @@ void isbc201_iopbh_out(BYTE data)
 				}
 				b = dma_read(addr++);
 
-				/* seek to sector */
-				pos = (taddr * SPT + saddr - 1) * SEC_SZ;
-				if (lseek(fd, pos, SEEK_SET) == (off_t) -1) {
-					ioerr = IO_SEEK;
-					goto fdone;
-				}
-
 				/* fill buffer with data byte */
 				memset(buf, b, SEC_SZ);
 
 				/* write sector */
-				if (write(fd, buf, SEC_SZ) != SEC_SZ) {
+				pos = (taddr * SPT + saddr - 1) * SEC_SZ;
+				if (blk_write(fd, buf, SEC_SZ, pos) != SEC_SZ) {
 					ioerr = IO_OURUN;
 					goto fdone;
 				}
@@ -303,20 +300,14 @@ void isbc201_iopbh_out(BYTE data)
 			 * IOPB buffer address.
 			 */
 
-			/* seek to track */
-			pos = taddr * SPT * SEC_SZ;
-			if (lseek(fd, pos, SEEK_SET) == (off_t) -1) {
-				ioerr = IO_SEEK;
-				goto fdone;
-			}
-
 			/* fill buffer with data byte */
 			b = dma_read(addr);
 			memset(buf, b, SEC_SZ);
 
 			/* write a track of sectors */
-			for (i = 0; i < SPT; i++) {
-				if (write(fd, buf, SEC_SZ) != SEC_SZ) {
+			pos = taddr * SPT * SEC_SZ;
+			for (i = 0; i < SPT; i++, pos += SEC_SZ) {
+				if (blk_write(fd, buf, SEC_SZ, pos) != SEC_SZ) {
 					ioerr = IO_OURUN;
 					goto fdone;
 				}
@@ -353,23 +344,17 @@ void isbc201_iopbh_out(BYTE data)
 			goto rdone;
 		}
 
-		/* seek to sector */
+		/* read the sectors with one transfer */
 		pos = (taddr * SPT + saddr - 1) * SEC_SZ;
-		if (lseek(fd, pos, SEEK_SET) == (off_t) -1) {
-			ioerr = IO_SEEK;
-			goto rdone;
+		n = blk_read(fd, buf, nsec * SEC_SZ, pos);
+		if (n != nsec * SEC_SZ) {
+			ioerr = IO_OURUN;
+			/* only the sectors read completely are transferred */
+			n = (n < 0) ? 0 : n - n % SEC_SZ;
 		}
-
-		/* read the sectors */
-		for (; nsec > 0; nsec--) {
-			if (read(fd, buf, SEC_SZ) != SEC_SZ) {
-				ioerr = IO_OURUN;
-				goto rdone;
-			}
-			if (op == OP_READ) {
-				for (i = 0; i < SEC_SZ; i++)
-					dma_write(addr++, buf[i]);
-			}
+		if (op == OP_READ) {
+			for (i = 0; i < n; i++)
+				dma_write(addr++, buf[i]);
 		}
 
 	rdone:
@@ -404,22 +389,12 @@ void isbc201_iopbh_out(BYTE data)
 			goto wdone;
 		}
 
-		/* seek to sector */
+		/* write the sectors with one transfer */
+		for (i = 0; i < nsec * SEC_SZ; i++)
+			buf[i] = dma_read(addr++);
 		pos = (taddr * SPT + saddr - 1) * SEC_SZ;
-		if (lseek(fd, pos, SEEK_SET) == (off_t) -1) {
-			ioerr = IO_SEEK;
-			goto wdone;
-		}
-
-		/* write sectors */
-		for (; nsec > 0; nsec--) {
-			for (i = 0; i < SEC_SZ; i++)
-				buf[i] = dma_read(addr++);
-			if (write(fd, buf, SEC_SZ) != SEC_SZ) {
-				ioerr = IO_OURUN;
-				goto wdone;
-			}
-		}
+		if (blk_write(fd, buf, nsec * SEC_SZ, pos) != nsec * SEC_SZ)
+			ioerr = IO_OURUN;
 
 	wdone:
 		close(fd);
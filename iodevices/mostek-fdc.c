@@ -24,6 +24,8 @@
 #include "simdefs.h"
 #include "simglb.h"
 
+#include "unix_blkio.h"
+
 #include "log.h"
 static const char *TAG = "FLP-80";
 
@@ -353,17 +355,9 @@ BYTE fdc1771_data_in(void)
 				return (BYTE) 0;
 			}
 
-			/* seek to sector */
-			pos = (fdc_track * SPT + fdc_sec - 1) * SEC_SZ;
-			if (lseek(fd, pos, SEEK_SET) == -1L) {
-				state = FDC_IDLE;	/* abort command */
-				fdc_stat = sRECORD_NOT_FOUND;
-				close(fd);
-				return (BYTE) 0;
-			}
-
 			/* read the sector */
-			if (read(fd, buf, SEC_SZ) != SEC_SZ) {
+			pos = (fdc_track * SPT + fdc_sec - 1) * SEC_SZ;
+			if (blk_read(fd, buf, SEC_SZ, pos) != SEC_SZ) {
 				state = FDC_IDLE;	/* abort read command */
 				fdc_stat = sRECORD_NOT_FOUND;
 				close(fd);
@@ -414,7 +408,7 @@ BYTE fdc1771_data_in(void)
  */
 void fdc1771_data_out(BYTE data)
 {
-	off_t pos;			/* seek position */
+	static off_t pos;		/* position in disk image */
 	static int wrtstat;		/* state while formatting track */
 	static int bcnt;		/* byte counter for sector data */
 	static int secs;		/* # of sectors written so far */
@@ -451,14 +445,8 @@ void fdc1771_data_out(BYTE data)
 				return;
 			}
 
-			/* seek to sector */
+			/* position of sector */
 			pos = (fdc_track * SPT + fdc_sec - 1) * SEC_SZ;
-			if (lseek(fd, pos, SEEK_SET) == -1L) {
-				state = FDC_IDLE;	/* abort command */
-				fdc_stat = sRECORD_NOT_FOUND;
-				close(fd);
-				return;
-			}
 			board_stat = sOUTPUT_READY + sINTERRUPT;
 		}
 
@@ -468,7 +456,7 @@ void fdc1771_data_out(BYTE data)
 		/* last byte? */
 		if (dcnt == SEC_SZ) {
 			state = FDC_IDLE;
-			if (write(fd, buf, SEC_SZ) == SEC_SZ)
+			if (blk_write(fd, buf, SEC_SZ, pos) == SEC_SZ)
 				fdc_stat = 0;
 			else
 				fdc_stat = sWRITE_FAULT;
@@ -490,14 +478,8 @@ void fdc1771_data_out(BYTE data)
 				fdc_stat = sNOT_READY;
 				return;
 			}
-			/* seek to track */
+			/* position of track */
 			pos = fdc_track * SPT  * SEC_SZ;
-			if (lseek(fd, pos, SEEK_SET) == -1L) {
-				state = FDC_IDLE;	/* abort command */
-				fdc_stat = sRECORD_NOT_FOUND;
-				close(fd);
-				return;
-			}
 			/* now wait for sector data */
 			board_stat = sOUTPUT_READY + sINTERRUPT;
 			wrtstat = 1;
@@ -519,10 +501,11 @@ void fdc1771_data_out(BYTE data)
 				return;
 			} else {
 				secs++;
-				if (write(fd, buf, bcnt) == bcnt)
+				if (blk_write(fd, buf, bcnt, pos) == bcnt)
 					fdc_stat = 0;
 				else
 					fdc_stat = sWRITE_FAULT;
+				pos += bcnt;
 				wrtstat = 1;
 			}
 		}
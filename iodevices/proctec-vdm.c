@@ -19,6 +19,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #ifdef WANT_SDL
 #include <SDL.h>
 #else
@@ -39,6 +40,7 @@
 
 #include "proctec-vdm-charset.h"
 #include "proctec-vdm.h"
+#include "generic-chargen.h"
 
 #ifndef WANT_SDL
 #include "log.h"
@@ -56,28 +58,26 @@ int slf = 1;				/* scanlines factor, default no lines */
 uint8_t bg_color[3] = {48, 48, 48};	/* default background color */
 uint8_t fg_color[3] = {255, 255, 255};	/* default foreground color */
 static int xsize, ysize;		/* window size */
-static int sx, sy;
+static uint32_t *pixels;		/* window contents as XRGB8888 */
+static chargen_t chargen;
 #ifdef WANT_SDL
 static int proctec_win_id = -1;
 static SDL_Window *window;
 static SDL_Renderer *renderer;
 static SDL_Texture *texture;
-static uint8_t *pixels;
-static int pitch;
-static uint8_t color[3];
 static char keybuf[KEYBUF_LEN];		/* typeahead buffer */
 static int keyn, keyin, keyout;
 static SDL_mutex *keybuf_mutex;
 #else
 static Display *display;
+static Visual *visual;
 static Window window;
 static int screen;
 static GC gc;
-static XWindowAttributes wa;
-static Pixmap pixmap;
 static Colormap colormap;
-static XColor black, bg, fg;
-static char black_color[] = "#000000";	/* black */
+static XImage *ximage;
+static bool truecolor;		/* XRGB8888 pixels can be put as they are */
+static unsigned long xfg, xbg;	/* pixels of other visuals */
 static XEvent event;
 static KeySym key;
 static char text[10];
@@ -92,18 +92,40 @@ static int kbd_data;			/* keyboard data */
 #endif
 static int first;			/* first displayed screen position */
 static int beg;				/* beginning display line address */
+static bool redraw;			/* draw all of the next frame */
 
 #ifndef WANT_SDL
 /* UNIX stuff */
 static pthread_t thread;
 #endif
 
+#ifndef WANT_SDL
+/* allocate a XRGB8888 color in the colormap, returns its pixel */
+static unsigned long alloc_color(uint32_t rgb)
+{
+	XColor c;
+
+	c.red = ((rgb >> 16) & 0xff) * 0x101;
+	c.green = ((rgb >> 8) & 0xff) * 0x101;
+	c.blue = (rgb & 0xff) * 0x101;
+	c.flags = DoRed | DoGreen | DoBlue;
+	if (!XAllocColor(display, colormap, &c))
+		return BlackPixel(display, screen);
+	return c.pixel;
+}
+#endif
+
 /* create the SDL2 or X11 window for VDM display */
 static void open_display(void)
 {
 	xsize = 576 + (XOFF * 2);
 	ysize = (208 * slf) + (YOFF * 2);
 
+	pixels = (uint32_t *) calloc(xsize * ysize, sizeof(uint32_t));
+	chargen_init(&chargen, &charset[0][0][0], 128, 9, 13,
+		     fg_color, bg_color);
+	chargen_setup(&chargen, 64, 16, 1, 1, slf);
+
 #ifdef WANT_SDL
 	window = SDL_CreateWindow("Processor Technology VDM-1",
 				  SDL_WINDOWPOS_UNDEFINED,
@@ -111,7 +133,7 @@ static void open_display(void)
 				  xsize, ysize, 0);
 	renderer = SDL_CreateRenderer(window, -1, (SDL_RENDERER_ACCELERATED |
 						   SDL_RENDERER_PRESENTVSYNC));
-	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_XRGB8888,
 				    SDL_TEXTUREACCESS_STREAMING, xsize, ysize);
 
 	keybuf_mutex = SDL_CreateMutex();
@@ -120,17 +142,37 @@ static void open_display(void)
 	SDL_RenderPresent(renderer);
 #else /* !WANT_SDL */
 	Window rootwindow;
+	XSetWindowAttributes swa;
 	XSizeHints *size_hints = XAllocSizeHints();
 	Atom wm_delete_window;
-	char buf[8];
+	XVisualInfo vinfo;
 
 	display = XOpenDisplay(NULL);
 	XLockDisplay(display);
 	screen = DefaultScreen(display);
-	rootwindow = RootWindow(display, screen);
-	XGetWindowAttributes(display, rootwindow, &wa);
-	window = XCreateSimpleWindow(display, rootwindow, 0, 0,
-				     xsize, ysize, 1, 0, 0);
+	truecolor = XMatchVisualInfo(display, screen, 24, TrueColor, &vinfo);
+	if (!truecolor) {
+		/* use the default visual with allocated colors */
+		vinfo.visual = DefaultVisual(display, screen);
+		vinfo.depth = DefaultDepth(display, screen);
+		vinfo.screen = screen;
+	}
+	rootwindow = RootWindow(display, vinfo.screen);
+	visual = vinfo.visual;
+	if (truecolor)
+		colormap = XCreateColormap(display, rootwindow, visual,
+					   AllocNone);
+	else {
+		colormap = DefaultColormap(display, screen);
+		xfg = alloc_color(chargen.fg);
+		xbg = alloc_color(chargen.bg);
+	}
+	swa.border_pixel = 0;
+	swa.colormap = colormap;
+	swa.event_mask = KeyPressMask | ExposureMask;
+	window = XCreateWindow(display, rootwindow, 0, 0, xsize, ysize,
+			       1, vinfo.depth, InputOutput, visual,
+			       CWBorderPixel | CWColormap | CWEventMask, &swa);
 	XStoreName(display, window, "Processor Technology VDM-1");
 	size_hints->flags = PSize | PMinSize | PMaxSize;
 	size_hints->min_width = xsize;
@@ -143,23 +185,20 @@ static void open_display(void)
 	XFree(size_hints);
 	wm_delete_window = XInternAtom(display, "WM_DELETE_WINDOW", False);
 	XSetWMProtocols(display, window, &wm_delete_window, 1);
-	XSelectInput(display, window, KeyPressMask);
-	colormap = DefaultColormap(display, 0);
 	gc = XCreateGC(display, window, 0, NULL);
-	pixmap = XCreatePixmap(display, rootwindow, xsize, ysize, wa.depth);
-
-	XParseColor(display, colormap, black_color, &black);
-	XAllocColor(display, colormap, &black);
-	sprintf(buf, "#%02X%02X%02X", bg_color[0], bg_color[1], bg_color[2]);
-	XParseColor(display, colormap, buf, &bg);
-	XAllocColor(display, colormap, &bg);
-	sprintf(buf, "#%02X%02X%02X", fg_color[0], fg_color[1], fg_color[2]);
-	XParseColor(display, colormap, buf, &fg);
-	XAllocColor(display, colormap, &fg);
+	if (truecolor) {
+		ximage = XCreateImage(display, visual, vinfo.depth, ZPixmap,
+				      0, (char *) pixels, xsize, ysize, 32, 0);
+		/* force little-endian pixels, Xlib will convert if necessary */
+		ximage->byte_order = LSBFirst;
+	} else {
+		/* pixels are stored with XPutPixel() in the visual's format */
+		ximage = XCreateImage(display, visual, vinfo.depth, ZPixmap,
+				      0, NULL, xsize, ysize, 32, 0);
+		ximage->data = (char *) malloc(ximage->bytes_per_line * ysize);
+	}
 
 	XMapWindow(display, window);
-	XSetForeground(display, gc, black.pixel);
-	XFillRectangle(display, pixmap, gc, 0, 0, xsize, ysize);
 	XSync(display, True);
 	XUnlockDisplay(display);
 #endif /* !WANT_SDL */
@@ -175,17 +214,26 @@ static void close_display(void)
 	SDL_DestroyWindow(window);
 #else
 	XLockDisplay(display);
-	XFreePixmap(display, pixmap);
+	if (truecolor)
+		ximage->data = NULL;
+	XDestroyImage(ximage);
 	XFreeGC(display, gc);
+	XDestroyWindow(display, window);
+	if (truecolor)
+		XFreeColormap(display, colormap);
 	XUnlockDisplay(display);
 	XCloseDisplay(display);
 #endif
+	chargen_free(&chargen);
+	free(pixels);
+	pixels = NULL;
 }
 
 /* shutdown VDM window */
 void proctec_vdm_off(void)
 {
 	state = false;		/* tell refresh thread to stop */
+	vram_untrack(VRAM_VDM, 0xcc00, 1024);
 
 #ifdef WANT_SDL
 	if (proctec_win_id >= 0) {
@@ -242,6 +290,9 @@ static void process_event(SDL_Event *event)
 			case SDL_WINDOWEVENT_FOCUS_LOST:
 				SDL_StopTextInput();
 				break;
+			case SDL_WINDOWEVENT_EXPOSED:
+				redraw = true;
+				break;
 			default:
 				break;
 			}
@@ -264,30 +315,6 @@ static void process_event(SDL_Event *event)
 	}
 }
 
-static inline void set_fg_color(void)
-{
-	color[0] = fg_color[0];
-	color[1] = fg_color[1];
-	color[2] = fg_color[2];
-}
-
-static inline void set_bg_color(void)
-{
-	color[0] = bg_color[0];
-	color[1] = bg_color[1];
-	color[2] = bg_color[2];
-}
-
-static inline void draw_point(int x, int y)
-{
-	uint8_t *p = pixels + y * pitch + x * 4;
-
-	p[3] = color[0];
-	p[2] = color[1];
-	p[1] = color[2];
-	p[0] = SDL_ALPHA_OPAQUE;
-}
-
 #else /* !WANT_SDL */
 
 /*
@@ -305,79 +332,70 @@ static inline void event_handler(void)
 	/* if there is a keyboard event get it and convert with keymap */
 	if (XEventsQueued(display, QueuedAlready) > 0) {
 		XNextEvent(display, &event);
-		if ((event.type == KeyPress) &&
-		    XLookupString(&event.xkey, text, 1, &key, 0) == 1) {
+		if (event.type == Expose)
+			redraw = true;
+		else if ((event.type == KeyPress) &&
+			 XLookupString(&event.xkey, text, 1, &key, 0) == 1) {
 			kbd_data = text[0];
 			kbd_status = true;
 		}
 	}
 }
 
-static inline void set_fg_color(void)
-{
-	XSetForeground(display, gc, fg.pixel);
-}
-
-static inline void set_bg_color(void)
-{
-	XSetForeground(display, gc, bg.pixel);
-}
-
-static inline void draw_point(int x, int y)
-{
-	XDrawPoint(display, pixmap, gc, x, y);
-}
-
 #endif /* !WANT_SDL */
 
-/* display characters, bit 7 = inverse video */
-static void dc(BYTE c)
+/*
+ * get the 64 byte blocks of the video memory written since the last
+ * frame, all of them if the frame must be drawn completely
+ */
+static uint64_t frame_dirty(void)
 {
-	register int x, y;
-	bool inv = (c & 128) ? true : false;
-
-	for (x = 0; x < 9; x++) {
-		for (y = 0; y < 13; y++) {
-			if (charset[c & 0x7f][y][x] == 1) {
-				if (!inv)
-					set_fg_color();
-				else
-					set_bg_color();
-			} else {
-				if (!inv)
-					set_bg_color();
-				else
-					set_fg_color();
-			}
-			draw_point(sx + x, sy + (y * slf));
-		}
+	uint64_t dirty = vram_dirty(VRAM_VDM, 0xcc00, 1024);
+
+	if (redraw) {
+		redraw = false;
+		dirty = ~((uint64_t) 0);
 	}
+
+	return dirty;
 }
 
-/* refresh the display buffer */
-static void refresh(void)
+/*
+ * refresh the rows of the display buffer in dirty blocks, the changed
+ * pixel rows are returned in y0 - y1, nothing changed if y0 >= y1
+ */
+static void refresh(uint64_t dirty, int *y0, int *y1)
 {
 	register int x, y;
-	static int addr;
-	static BYTE c;
+	int addr;
+	bool changed;
+	BYTE c;
+	uint32_t *fb = pixels + YOFF * xsize + XOFF;
 
-	sy = YOFF;
+	*y0 = ysize;
+	*y1 = 0;
 	addr = 0xcc00 + beg * 64;
 
 	for (y = 0; y < 16; y++) {
-		sx = XOFF;
 #ifndef WANT_SDL
 		event_handler();
 #endif
-		for (x = 0; x < 64; x++) {
-			if (y >= first) {
-				c = getmem(addr + x);
-				dc(c);
-			} else
-				dc(' ');
-			sx += 9;
+		/* a row is one block of 64 characters */
+		if ((dirty >> ((addr - 0xcc00) >> VRAM_SHIFT)) & 1) {
+			changed = false;
+			for (x = 0; x < 64; x++) {
+				/* bit 7 = inverse video */
+				c = (y >= first) ? getmem(addr + x) : ' ';
+				changed |= chargen_put(&chargen, x, y,
+						       c & 0x7f, c & 128,
+						       fb, xsize);
+			}
+			if (changed) {
+				if (*y0 > YOFF + y * chargen.ch)
+					*y0 = YOFF + y * chargen.ch;
+				*y1 = YOFF + (y + 1) * chargen.ch;
+			}
 		}
-		sy += 13 * slf;
 		addr += 64;
 		if (addr >= 0xd000)
 			addr = 0xcc00;
@@ -389,15 +407,27 @@ static void refresh(void)
 /* function for updating the display */
 static void update_display(bool tick)
 {
+	uint64_t dirty;
+	int y0, y1;
+
 	UNUSED(tick);
 
-	if (state) {
-		/* update display window */
-		SDL_LockTexture(texture, NULL, (void **) &pixels, &pitch);
-		refresh();
-		SDL_UnlockTexture(texture);
-		SDL_RenderCopy(renderer, texture, NULL, NULL);
-		SDL_RenderPresent(renderer);
+	/* update display window if video memory was written, */
+	/* only the pixel rows with changed characters are uploaded */
+	if (state && (dirty = frame_dirty())) {
+		refresh(dirty, &y0, &y1);
+		if (dirty == ~((uint64_t) 0)) {
+			y0 = 0;
+			y1 = ysize;
+		}
+		if (y0 < y1) {
+			SDL_Rect r = {0, y0, xsize, y1 - y0};
+
+			SDL_UpdateTexture(texture, &r, pixels + y0 * xsize,
+					  xsize * sizeof(uint32_t));
+			SDL_RenderCopy(renderer, texture, NULL, NULL);
+			SDL_RenderPresent(renderer);
+		}
 	}
 }
 
@@ -410,10 +440,31 @@ static win_funcs_t proctec_funcs = {
 
 #else /* !WANT_SDL */
 
+/* put the pixel rows y0 - y1 into the window */
+static void put_rows(int y0, int y1)
+{
+	int x, y;
+	uint32_t *p;
+
+	if (!truecolor) {
+		/* convert into the pixels of other visuals */
+		for (y = y0; y < y1; y++) {
+			p = pixels + y * xsize;
+			for (x = 0; x < xsize; x++)
+				XPutPixel(ximage, x, y,
+					  p[x] == chargen.fg ? xfg :
+					  p[x] == chargen.bg ? xbg :
+					  BlackPixel(display, screen));
+		}
+	}
+	XPutImage(display, window, gc, ximage, 0, y0, 0, y0, xsize, y1 - y0);
+}
+
 /* thread for updating the display */
 static void *update_display(void *arg)
 {
-	uint64_t t;
+	uint64_t t, dirty;
+	int y0, y1;
 	long tleft;
 
 	UNUSED(arg);
@@ -425,11 +476,17 @@ static void *update_display(void *arg)
 		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 		XLockDisplay(display);
 
-		/* update display window */
-		refresh();
-		XCopyArea(display, pixmap, window, gc, 0, 0,
-			  xsize, ysize, 0, 0);
-		XSync(display, False);
+		/* update display window, only changed pixel rows */
+		dirty = frame_dirty();
+		refresh(dirty, &y0, &y1);
+		if (dirty == ~((uint64_t) 0)) {
+			y0 = 0;
+			y1 = ysize;
+		}
+		if (y0 < y1) {
+			put_rows(y0, y1);
+			XSync(display, False);
+		}
 
 		/* unlock display, thread can be canceled again */
 		XUnlockDisplay(display);
@@ -451,9 +508,15 @@ static void *update_display(void *arg)
 /* I/O port for the VDM */
 void proctec_vdm_ctl_out(BYTE data)
 {
-	mode = data;
-	first = (data & 0xf0) >> 4;
-	beg = data & 0x0f;
+	if (!state)
+		vram_track(VRAM_VDM, 0xcc00, 1024);
+
+	if (data != mode || !state) {
+		mode = data;
+		first = (data & 0xf0) >> 4;
+		beg = data & 0x0f;
+		redraw = true;
+	}
 
 	state = true;
 
@@ -0,0 +1,658 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Common I/O devices used by various simulated machines
+ *
+ * Copyright (C) 2026 by agent
+ *
+ * This module serves the CP/M 2.2 BDOS file functions for drives
+ * mapped to host directories, by trapping calls of the BDOS entry.
+ *
+ * The drives are mapped in the configuration file hostdir.conf, each
+ * line has a drive letter and the path of a host directory. When the
+ * CPU fetches the instruction at the BDOS entry, bdos_trap() is called
+ * with the opcode. If the function in register C is a file function
+ * for a mapped drive, it is done on the host files and a RET opcode is
+ * returned, so that the CPU returns to the caller of the BDOS. All
+ * other calls execute the BDOS of the guest as before. The BDOS
+ * functions which select drives and set the DMA address are watched,
+ * so that FCBs without drive and the DMA buffer are resolved like the
+ * BDOS would. A mapped drive is selected only here and not in the BDOS,
+ * because the BIOS may not have the drive, so the functions which
+ * work on the drive the BDOS has selected are trapped for it too. The
+ * addresses of the allocation vector and disk parameter block can't
+ * be served for a host directory, they return 0FFFFH.
+ *
+ * Host files with names not fitting into 8.3 are not shown, the names
+ * are matched without regard to case and new files are created with
+ * lower case names, like simbdos.c does. User numbers are ignored.
+ *
+ * History:
+ * 18-OCT-2026 first version, used by cpmsim
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simglb.h"
+#include "simmem.h"
+
+#ifdef HAS_BDOS_TRAP
+
+#include "simbdos.h"
+#include "simbdos-trap.h"
+
+#include "log.h"
+static const char *TAG = "BDOS";
+
+/* BDOS functions */
+#define RESETDSK	13	/* reset disk system */
+#define SELDSK		14	/* select disk */
+#define OPENF		15	/* open file */
+#define CLOSEF		16	/* close file */
+#define SEARCHF		17	/* search for first */
+#define SEARCHN		18	/* search for next */
+#define DELETEF		19	/* delete file */
+#define READF		20	/* read sequential */
+#define WRITEF		21	/* write sequential */
+#define MAKEF		22	/* make file */
+#define RENAMEF		23	/* rename file */
+#define GETDSK		25	/* return current disk */
+#define SETDMA		26	/* set DMA address */
+#define GETALV		27	/* get allocation vector address */
+#define WRTPRT		28	/* write protect current disk */
+#define SETATTR		30	/* set file attributes */
+#define GETDPB		31	/* get disk parameter block address */
+#define READR		33	/* read random */
+#define WRITER		34	/* write random */
+#define FILESIZE	35	/* compute file size */
+#define SETRREC		36	/* set random record */
+#define WRITERZ		40	/* write random with zero fill */
+
+/* FCB fields */
+#define FCB_DR		0	/* drive, 0 = current */
+#define FCB_NAME	1	/* file name and type, 11 bytes */
+#define FCB_EX		12	/* extent */
+#define FCB_S2		14	/* extent high bits */
+#define FCB_RC		15	/* records in extent */
+#define FCB_NEW		17	/* new name for rename */
+#define FCB_CR		32	/* current record */
+#define FCB_R0		33	/* random record, 3 bytes */
+
+#define SECLEN		128	/* logical sector length */
+#define EXTRECS		128	/* records of an extent */
+#define CTRL_Z		0x1A	/* CP/M EOF character */
+#define OP_RET		0xC9	/* opcode returned if a call was served */
+
+#define BUFSIZE		256	/* max line length of configuration file */
+#define NDRIVES		16	/* drives A-P */
+#define NFILES		8	/* host files kept open */
+
+bool bdos_trap_on;		/* a drive is mapped to a host directory */
+
+static char *hostdir[NDRIVES];	/* host directory of a drive or NULL */
+static int curdrv;		/* current drive selected by the guest */
+static WORD dmaaddr = 0x80;	/* DMA address set by the guest */
+
+static struct {			/* host files kept open */
+	int drv;
+	BYTE name[11];
+	int fd;			/* -1 if unused */
+	bool rw;		/* opened for writing */
+	unsigned long used;	/* for replacing the least recently used */
+} files[NFILES];
+static unsigned long fuse;
+
+static struct {			/* state of search first/next */
+	bool active;
+	int drv;
+	BYTE pat[11];
+	DIR *dir;
+} srch;
+
+/*
+ * Read the drive mapping from the configuration file
+ */
+void bdos_trap_init(void)
+{
+	FILE *fp;
+	char buf[BUFSIZE];
+	char fn[MAX_LFN];
+	char *s, *e;
+	struct stat sbuf;
+	int i, drv;
+
+	for (i = 0; i < NFILES; i++)
+		files[i].fd = -1;
+
+	strcpy(fn, confdir);
+	strcat(fn, "/hostdir.conf");
+
+	if ((fp = fopen(fn, "r")) == NULL)
+		return;
+
+	while (fgets(buf, BUFSIZE, fp) != NULL) {
+		s = buf;
+		if ((*s == '\n') || (*s == '#'))
+			continue;
+		drv = toupper((unsigned char) *s) - 'A';
+		if ((drv < 0) || (drv >= NDRIVES) ||
+		    ((s[1] != ' ') && (s[1] != '\t'))) {
+			LOGW(TAG, "invalid drive in %s: %s", fn, buf);
+			continue;
+		}
+		s++;
+		while ((*s == ' ') || (*s == '\t'))
+			s++;
+		e = s + strlen(s);
+		while ((e > s) && isspace((unsigned char) e[-1]))
+			*--e = '\0';
+		if ((stat(s, &sbuf) == -1) || !S_ISDIR(sbuf.st_mode)) {
+			LOGW(TAG, "drive %c: %s is not a directory",
+			     drv + 'A', s);
+			continue;
+		}
+		free(hostdir[drv]);
+		hostdir[drv] = strdup(s);
+		bdos_trap_on = true;
+		LOG(TAG, "Drive %c: is host directory %s\r\n", drv + 'A', s);
+	}
+	fclose(fp);
+}
+
+/*
+ * Close all host files
+ */
+void bdos_trap_exit(void)
+{
+	int i;
+
+	for (i = 0; i < NFILES; i++)
+		if (files[i].fd != -1) {
+			close(files[i].fd);
+			files[i].fd = -1;
+		}
+	if (srch.dir != NULL) {
+		closedir(srch.dir);
+		srch.dir = NULL;
+	}
+	srch.active = false;
+}
+
+/* set the BDOS return value in A and HL */
+static BYTE bdos_ret(BYTE a)
+{
+	A = L = a;
+	B = H = 0;
+	return OP_RET;
+}
+
+/* drive of an FCB if it is mapped to a host directory, otherwise -1 */
+static int fcb_drive(WORD fcb)
+{
+	int drv = dma_read(fcb + FCB_DR);
+
+	if ((drv == 0) || (drv == '?'))
+		drv = curdrv;
+	else
+		drv--;
+	return ((drv < NDRIVES) && (hostdir[drv] != NULL)) ? drv : -1;
+}
+
+/* file name and type of an FCB, without attribute bits */
+static void fcb_name(WORD fcb, int off, BYTE *name)
+{
+	int i;
+
+	for (i = 0; i < 11; i++)
+		name[i] = toupper(dma_read(fcb + off + i) & 0x7f);
+}
+
+/* convert a CP/M 8.3 name to a lower case host file name */
+static void cpm_name(const BYTE *name, char *s)
+{
+	int i;
+
+	for (i = 0; i < 8 && name[i] != ' '; i++)
+		*s++ = tolower(name[i]);
+	if (name[8] != ' ') {
+		*s++ = '.';
+		for (i = 8; i < 11 && name[i] != ' '; i++)
+			*s++ = tolower(name[i]);
+	}
+	*s = '\0';
+}
+
+static bool name_match(const BYTE *pat, const BYTE *name)
+{
+	int i;
+
+	for (i = 0; i < 11; i++)
+		if (pat[i] != '?' && pat[i] != name[i])
+			return false;
+	return true;
+}
+
+/* build the path of a file in the directory of a drive */
+static void host_path(int drv, const char *s, char *path)
+{
+	snprintf(path, MAX_LFN, "%s/%s", hostdir[drv], s);
+}
+
+/*
+ * Find the host file with the CP/M name in the directory of a drive,
+ * returns false if there is none
+ */
+static bool find_file(int drv, const BYTE *name, char *path)
+{
+	DIR *dir;
+	struct dirent *de;
+	struct stat sbuf;
+	BYTE n[11];
+	bool found = false;
+
+	if ((dir = opendir(hostdir[drv])) == NULL)
+		return false;
+	while (!found && (de = readdir(dir)) != NULL) {
+		if (!host_cpm_name(de->d_name, n) || memcmp(n, name, 11) != 0)
+			continue;
+		host_path(drv, de->d_name, path);
+		found = (stat(path, &sbuf) == 0) && S_ISREG(sbuf.st_mode);
+	}
+	closedir(dir);
+	return found;
+}
+
+/* close a host file kept open, before it is removed or renamed */
+static void drop_file(int drv, const BYTE *name)
+{
+	int i;
+
+	for (i = 0; i < NFILES; i++)
+		if (files[i].fd != -1 && files[i].drv == drv &&
+		    name_match(name, files[i].name)) {
+			close(files[i].fd);
+			files[i].fd = -1;
+		}
+}
+
+/*
+ * Get a descriptor for the host file with the CP/M name, the files
+ * are kept open until they are replaced by others. Returns -1 if the
+ * file doesn't exist or can't be written if wr is set.
+ */
+static int get_file(int drv, const BYTE *name, bool wr)
+{
+	char path[MAX_LFN];
+	int i, j = 0, fd;
+	bool rw = true;
+
+	for (i = 0; i < NFILES; i++) {
+		if (files[i].fd != -1 && files[i].drv == drv &&
+		    memcmp(files[i].name, name, 11) == 0) {
+			files[i].used = ++fuse;
+			return (wr && !files[i].rw) ? -1 : files[i].fd;
+		}
+		if (files[i].fd == -1 ||
+		    (files[j].fd != -1 && files[i].used < files[j].used))
+			j = i;
+	}
+
+	if (!find_file(drv, name, path))
+		return -1;
+	if ((fd = open(path, O_RDWR)) == -1) {
+		if ((fd = open(path, O_RDONLY)) == -1)
+			return -1;
+		rw = false;
+	}
+
+	if (files[j].fd != -1)
+		close(files[j].fd);
+	files[j].drv = drv;
+	memcpy(files[j].name, name, 11);
+	files[j].fd = fd;
+	files[j].rw = rw;
+	files[j].used = ++fuse;
+
+	return (wr && !rw) ? -1 : fd;
+}
+
+/* number of records of a host file */
+static long file_recs(int fd)
+{
+	struct stat sbuf;
+
+	if (fstat(fd, &sbuf) == -1)
+		return 0;
+	return (sbuf.st_size + SECLEN - 1) / SECLEN;
+}
+
+/* record of the FCB for sequential access */
+static long fcb_seqrec(WORD fcb)
+{
+	return ((long) (dma_read(fcb + FCB_S2) & 0x3f) * 32 +
+		(dma_read(fcb + FCB_EX) & 0x1f)) * EXTRECS +
+	       (dma_read(fcb + FCB_CR) & 0x7f);
+}
+
+/*
+ * Set the FCB to a record for sequential access, the record count of
+ * the extent is set from the size of the file
+ */
+static void fcb_setrec(WORD fcb, long rec, long nrecs)
+{
+	long ext = rec / EXTRECS;
+	long rc = nrecs - ext * EXTRECS;
+
+	if (rc < 0)
+		rc = 0;
+	else if (rc > EXTRECS)
+		rc = EXTRECS;
+
+	dma_write(fcb + FCB_CR, rec % EXTRECS);
+	dma_write(fcb + FCB_EX, ext & 0x1f);
+	dma_write(fcb + FCB_S2, (ext >> 5) & 0x3f);
+	dma_write(fcb + FCB_RC, rc);
+}
+
+/* record of the FCB for random access, -1 if out of range */
+static long fcb_randrec(WORD fcb)
+{
+	if (dma_read(fcb + FCB_R0 + 2) != 0)
+		return -1;
+	return dma_read(fcb + FCB_R0) | (dma_read(fcb + FCB_R0 + 1) << 8);
+}
+
+static void fcb_setrand(WORD fcb, long rec)
+{
+	dma_write(fcb + FCB_R0, rec & 0xff);
+	dma_write(fcb + FCB_R0 + 1, (rec >> 8) & 0xff);
+	dma_write(fcb + FCB_R0 + 2, (rec >> 16) & 0xff);
+}
+
+/* read a record into the DMA buffer, returns BDOS error code */
+static BYTE read_rec(int fd, long rec)
+{
+	BYTE buf[SECLEN];
+	ssize_t n;
+	int i;
+
+	n = pread(fd, buf, SECLEN, (off_t) rec * SECLEN);
+	if (n <= 0)
+		return 1;	/* end of file */
+	for (i = 0; i < n; i++)
+		dma_write(dmaaddr + i, buf[i]);
+	for (; i < SECLEN; i++)
+		dma_write(dmaaddr + i, CTRL_Z);
+	return 0;
+}
+
+/* write a record from the DMA buffer, returns BDOS error code */
+static BYTE write_rec(int fd, long rec)
+{
+	BYTE buf[SECLEN];
+	int i;
+
+	for (i = 0; i < SECLEN; i++)
+		buf[i] = dma_read(dmaaddr + i);
+	if (pwrite(fd, buf, SECLEN, (off_t) rec * SECLEN) != SECLEN)
+		return 2;	/* disk full */
+	return 0;
+}
+
+/* return the next file of a search in the DMA buffer */
+static BYTE search_next(void)
+{
+	struct dirent *de;
+	char path[MAX_LFN];
+	struct stat sbuf;
+	BYTE name[11];
+	long nrecs;
+	int i;
+
+	if (!srch.active || srch.dir == NULL)
+		return 0xff;
+
+	while ((de = readdir(srch.dir)) != NULL) {
+		if (!host_cpm_name(de->d_name, name) ||
+		    !name_match(srch.pat, name))
+			continue;
+		host_path(srch.drv, de->d_name, path);
+		if ((stat(path, &sbuf) == -1) || !S_ISREG(sbuf.st_mode))
+			continue;
+		nrecs = (sbuf.st_size + SECLEN - 1) / SECLEN;
+
+		/* directory entry of the first extent */
+		dma_write(dmaaddr, 0);
+		for (i = 0; i < 11; i++)
+			dma_write(dmaaddr + 1 + i, name[i]);
+		dma_write(dmaaddr + FCB_EX, 0);
+		dma_write(dmaaddr + FCB_EX + 1, 0);
+		dma_write(dmaaddr + FCB_S2, 0);
+		dma_write(dmaaddr + FCB_RC,
+			  (nrecs > EXTRECS) ? EXTRECS : nrecs);
+		for (i = 16; i < 32; i++)
+			dma_write(dmaaddr + i, 0);
+		return 0;
+	}
+
+	closedir(srch.dir);
+	srch.dir = NULL;
+	srch.active = false;
+	return 0xff;
+}
+
+/* BDOS file function for a drive mapped to a host directory */
+static BYTE host_call(int func, int drv, WORD fcb)
+{
+	char path[MAX_LFN], path2[MAX_LFN], s[16];
+	BYTE name[11], name2[11];
+	struct dirent *de;
+	DIR *dir;
+	long rec;
+	int fd;
+	BYTE ret;
+
+	fcb_name(fcb, FCB_NAME, name);
+
+	switch (func) {
+	case OPENF:
+		if ((fd = get_file(drv, name, false)) == -1)
+			return 0xff;
+		fcb_setrec(fcb, fcb_seqrec(fcb), file_recs(fd));
+		return 0;
+
+	case CLOSEF:
+		return find_file(drv, name, path) ? 0 : 0xff;
+
+	case SEARCHF:
+		if (srch.dir != NULL)
+			closedir(srch.dir);
+		srch.active = true;
+		srch.drv = drv;
+		if (dma_read(fcb + FCB_DR) == '?')
+			memset(srch.pat, '?', 11);
+		else
+			memcpy(srch.pat, name, 11);
+		srch.dir = opendir(hostdir[drv]);
+		return search_next();
+
+	case DELETEF:
+		ret = 0xff;
+		drop_file(drv, name);
+		if ((dir = opendir(hostdir[drv])) == NULL)
+			return 0xff;
+		while ((de = readdir(dir)) != NULL) {
+			if (!host_cpm_name(de->d_name, name2) ||
+			    !name_match(name, name2))
+				continue;
+			host_path(drv, de->d_name, path);
+			if (unlink(path) == 0)
+				ret = 0;
+		}
+		closedir(dir);
+		return ret;
+
+	case READF:
+		if ((fd = get_file(drv, name, false)) == -1)
+			return 9;	/* invalid FCB */
+		rec = fcb_seqrec(fcb);
+		if ((ret = read_rec(fd, rec)) == 0)
+			rec++;
+		fcb_setrec(fcb, rec, file_recs(fd));
+		return ret;
+
+	case WRITEF:
+		if ((fd = get_file(drv, name, true)) == -1)
+			return 9;	/* invalid FCB */
+		rec = fcb_seqrec(fcb);
+		if ((ret = write_rec(fd, rec)) == 0)
+			rec++;
+		fcb_setrec(fcb, rec, file_recs(fd));
+		return ret;
+
+	case MAKEF:
+		drop_file(drv, name);
+		if (!find_file(drv, name, path)) {
+			cpm_name(name, s);
+			host_path(drv, s, path);
+		}
+		if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) == -1)
+			return 0xff;
+		close(fd);
+		fcb_setrec(fcb, fcb_seqrec(fcb), 0);
+		return 0;
+
+	case RENAMEF:
+		fcb_name(fcb, FCB_NEW, name2);
+		if (!find_file(drv, name, path))
+			return 0xff;
+		drop_file(drv, name);
+		drop_file(drv, name2);
+		if (!find_file(drv, name2, path2)) {
+			cpm_name(name2, s);
+			host_path(drv, s, path2);
+		}
+		return (rename(path, path2) == 0) ? 0 : 0xff;
+
+	case SETATTR:
+		return find_file(drv, name, path) ? 0 : 0xff;
+
+	case READR:
+		if ((fd = get_file(drv, name, false)) == -1)
+			return 9;	/* invalid FCB */
+		if ((rec = fcb_randrec(fcb)) == -1)
+			return 6;	/* random record out of range */
+		ret = read_rec(fd, rec);
+		fcb_setrec(fcb, rec, file_recs(fd));
+		return ret;
+
+	case WRITER:
+	case WRITERZ:
+		if ((fd = get_file(drv, name, true)) == -1)
+			return 9;	/* invalid FCB */
+		if ((rec = fcb_randrec(fcb)) == -1)
+			return 6;	/* random record out of range */
+		ret = write_rec(fd, rec);
+		fcb_setrec(fcb, rec, file_recs(fd));
+		return ret;
+
+	case FILESIZE:
+		if ((fd = get_file(drv, name, false)) == -1)
+			return 0xff;
+		fcb_setrand(fcb, file_recs(fd));
+		return 0;
+
+	case SETRREC:
+		fcb_setrand(fcb, fcb_seqrec(fcb));
+		return 0;
+
+	default:
+		return 0xff;
+	}
+}
+
+/*
+ * Called with the opcode fetched at the BDOS entry. Returns RET if the
+ * call was served, otherwise the opcode, so that the BDOS is executed.
+ */
+BYTE bdos_trap(BYTE op)
+{
+	WORD fcb = (D << 8) | E;
+	int drv;
+
+	switch (C) {
+	case RESETDSK:
+		curdrv = 0;
+		dmaaddr = 0x80;
+		srch.active = false;
+		return op;
+
+	case SELDSK:
+		curdrv = E & 0x0f;
+		if (hostdir[curdrv] != NULL)
+			return bdos_ret(0);
+		return op;
+
+	case GETDSK:
+		if (hostdir[curdrv] != NULL)
+			return bdos_ret(curdrv);
+		return op;
+
+	case SETDMA:
+		dmaaddr = fcb;
+		return op;
+
+	case GETALV:
+	case GETDPB:
+		if (hostdir[curdrv] != NULL) {
+			bdos_ret(0xff);
+			H = 0xff;
+			return OP_RET;
+		}
+		return op;
+
+	case WRTPRT:
+		if (hostdir[curdrv] != NULL)
+			return bdos_ret(0);
+		return op;
+
+	case SEARCHN:
+		if (srch.active)
+			return bdos_ret(search_next());
+		return op;
+
+	case SEARCHF:
+		srch.active = false;
+		/* fall through */
+	case OPENF:
+	case CLOSEF:
+	case DELETEF:
+	case READF:
+	case WRITEF:
+	case MAKEF:
+	case RENAMEF:
+	case SETATTR:
+	case READR:
+	case WRITER:
+	case FILESIZE:
+	case SETRREC:
+	case WRITERZ:
+		if ((drv = fcb_drive(fcb)) == -1)
+			return op;
+		return bdos_ret(host_call(C, drv, fcb));
+
+	default:
+		return op;
+	}
+}
+
+#endif /* HAS_BDOS_TRAP */
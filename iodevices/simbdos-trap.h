@@ -0,0 +1,29 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Common I/O devices used by various simulated machines
+ *
+ * Copyright (C) 2026 by agent
+ *
+ * This module serves the CP/M 2.2 BDOS file functions for drives
+ * mapped to host directories, by trapping calls of the BDOS entry.
+ *
+ * History:
+ * 18-OCT-2026 first version, used by cpmsim
+ */
+
+#ifndef SIMBDOS_TRAP_INC
+#define SIMBDOS_TRAP_INC
+
+#include "sim.h"
+#include "simdefs.h"
+
+#define BDOS_ENTRY	0x0005	/* address of the BDOS entry jump */
+
+extern bool bdos_trap_on;
+
+extern void bdos_trap_init(void);
+extern void bdos_trap_exit(void);
+extern BYTE bdos_trap(BYTE op);
+
+#endif /* !SIMBDOS_TRAP_INC */
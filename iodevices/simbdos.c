@@ -21,19 +21,33 @@
  * as 128 byte sectors until an EOF character (0x1A, ctrl-z) is found.
  * This results in the last write typically being less than 128 bytes.
  *
+ * READN and WRITEN transfer up to 255 records with one request, DE
+ * is the buffer address and B the number of records. B returns the
+ * number of records transferred, for each record the same is done as
+ * for READF and WRITEF. Host files are opened with large buffers, so
+ * that they are read and written in big chunks.
+ *
+ * SEARCHF and SEARCHN list the files in the host directory matching
+ * the name in the FCB, which may contain '?'. The name of the file
+ * found is returned as directory entry of user 0 at the DMA address.
+ *
  * The CP/M programs R.COM and W.COM use this interface to transfer
- * files between the host and CP/M file systems. Note that on a
- * case-sensitive operating system, file names must be in all caps
- * as used in CP/M.
+ * files between the host and CP/M file systems. Host files are
+ * created with lower case names and are opened without regard to
+ * case.
  *
  * History:
  * 03-OCT-2019 (Mike Douglas) Original
  * 23-JAN-2025 (Thomas Eberhardt) Use DMA memory access
+ * 18-OCT-2026 (agent) Multi-record transfers, directory search
  */
 
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
 
 #include "sim.h"
 #include "simdefs.h"
@@ -46,13 +60,21 @@
 
 #define	OPENF	15		/* open file */
 #define	CLOSEF	16		/* close file */
+#define SEARCHF	17		/* search for first */
+#define SEARCHN	18		/* search for next */
 #define READF	20		/* read file */
 #define WRITEF	21		/* write file */
 #define MAKEF	22		/* make file */
 #define SETDMA	26		/* set DMA address */
 
+/* Host only functions */
+
+#define READN	120		/* read multiple records */
+#define WRITEN	121		/* write multiple records */
+
 #define	SECLEN	128		/* logical sector length */
 #define	CTRL_Z	0x1A		/* CP/M EOF character */
+#define IOBUFSZ	65536		/* size of the host file buffers */
 
 /* The following file types will be treated as text files */
 
@@ -67,6 +89,135 @@ static const char *textExts[] = {
 static FILE *fp = NULL;		/* file pointer */
 static WORD dmaAddr = 0x80;	/* buffer address in emulated space */
 static bool textFile = false;	/* text file flag */
+static DIR *dirp = NULL;	/* host directory being searched */
+static BYTE pattern[11];	/* file name searched for */
+
+/*
+ * host_cpm_name - convert a host file name to CP/M 8.3 form, returns
+ *    false if it doesn't fit, also used by the BDOS trap and the
+ *    host directory disks
+ */
+
+bool host_cpm_name(const char *s, BYTE *name)
+{
+	int i, n = 0, max = 8;
+
+	memset(name, ' ', 11);
+	for (i = 0; s[i] != '\0'; i++) {
+		if (s[i] == '.' && max == 8 && n > 0) {
+			n = 8;
+			max = 11;
+			continue;
+		}
+		if (n == max || !isgraph((unsigned char) s[i]) ||
+		    strchr(".,;:=?*<>|[]", s[i]) != NULL)
+			return false;
+		name[n++] = toupper((unsigned char) s[i]);
+	}
+	return n > 0;
+}
+
+/*
+ * searchNext - return the next host file matching the pattern as
+ *    directory entry at the DMA address
+ */
+
+static void searchNext(void)
+{
+	struct dirent *de;
+	struct stat sbuf;
+	BYTE name[11];
+	int i;
+
+	while (dirp != NULL && (de = readdir(dirp)) != NULL) {
+		if (!host_cpm_name(de->d_name, name))
+			continue;
+		for (i = 0; i < 11; i++)
+			if (pattern[i] != '?' && pattern[i] != name[i])
+				break;
+		if (i < 11 || stat(de->d_name, &sbuf) == -1 ||
+		    !S_ISREG(sbuf.st_mode))
+			continue;
+		dma_write(dmaAddr, 0);
+		for (i = 0; i < 11; i++)
+			dma_write(dmaAddr + 1 + i, name[i]);
+		for (i = 12; i < 32; i++)
+			dma_write(dmaAddr + i, 0);
+		A = 0;
+		return;
+	}
+	if (dirp != NULL) {
+		closedir(dirp);
+		dirp = NULL;
+	}
+}
+
+/*
+ * openHost - open a host file, if it doesn't exist with the lower
+ *    case name look for it without regard to case
+ */
+
+static FILE *openHost(const char *fname)
+{
+	DIR *d;
+	struct dirent *de;
+	BYTE name[11], want[11];
+	FILE *f;
+
+	if ((f = fopen(fname, "rb")) != NULL || !host_cpm_name(fname, want))
+		return f;
+	if ((d = opendir(".")) == NULL)
+		return NULL;
+	while ((de = readdir(d)) != NULL)
+		if (host_cpm_name(de->d_name, name) &&
+		    memcmp(name, want, 11) == 0) {
+			f = fopen(de->d_name, "rb");
+			break;
+		}
+	closedir(d);
+	return f;
+}
+
+/*
+ * readRec - read the next record of the file into memory at addr,
+ *    returns false at EOF
+ */
+
+static bool readRec(WORD addr)
+{
+	BYTE buf[SECLEN];
+	int xferLen;
+	int i;
+
+	xferLen = fread(buf, 1, SECLEN, fp);
+	if (xferLen == 0)
+		return false;
+	for (i = 0; i < xferLen; i++)
+		dma_write(addr + i, buf[i]);
+	for (; i < SECLEN; i++)
+		dma_write(addr + i, CTRL_Z);
+	return true;
+}
+
+/*
+ * writeRec - write the record in memory at addr to the file, a text
+ *    file is written until ctrl-z. Returns false if it failed.
+ */
+
+static bool writeRec(WORD addr)
+{
+	BYTE buf[SECLEN];
+	int xferLen;
+
+	for (xferLen = 0; xferLen < SECLEN; xferLen++) {
+		buf[xferLen] = dma_read(addr + xferLen);
+		if ((buf[xferLen] == CTRL_Z) && textFile)
+			break;	/* ctrl-z (EOF) found */
+	}
+	if (xferLen == 0)	/* record contains only ctrl-z */
+		return true;
+	return (size_t) xferLen == fwrite(buf, 1, xferLen, fp);
+}
 
 /*
  * host_bdos_out - an output to this I/O device is somewhat equivalent
@@ -81,9 +232,7 @@ void host_bdos_out(BYTE outByte)
 	WORD fcbAddr;		/* address of FCB in simulator memory */
 	char fname[16];
 	char extension[8];
-	BYTE buf[128];
 	char openFlags[4];	/* flags for fopen call */
-	int xferLen;
 	int i;
 
 	outByte = ~outByte;	/* compiler requires assignment */
@@ -119,10 +268,8 @@ void host_bdos_out(BYTE outByte)
 			strcpy(openFlags, "wb"); /* MAKEF opens for writing */
 
 #ifdef SIMBDOS_NO_OVERWRITE
-			if (fopen(fname, "rb") != NULL) { /* file exist? */
-				fclose(fp);
+			if (access(fname, F_OK) == 0) /* file exist? */
 				openFlags[0] = 0; /* yes, don't over-write */
-			}
 #endif
 			textFile = false;	/* binary file is assumed */
 			for (i = 0; textExts[i] != NULL; i++)
@@ -133,50 +280,70 @@ void host_bdos_out(BYTE outByte)
 		} else
 			strcpy(openFlags, "rb"); /* OPENF for reading */
 
-		if (openFlags[0] != 0)		/* don't open if null string */
-			if ((fp = fopen(fname, openFlags)) != NULL)
-				A = 0;		/* success */
+		if (fp != NULL) {		/* close a file left open */
+			fclose(fp);
+			fp = NULL;
+		}
+		if (openFlags[0] == 'r')
+			fp = openHost(fname);
+		else if (openFlags[0] != 0)	/* don't open if null string */
+			fp = fopen(fname, openFlags);
+		if (fp != NULL) {
+			setvbuf(fp, NULL, _IOFBF, IOBUFSZ);
+			A = 0;		/* success */
+		}
 	}
 
 	/* CLOSE file */
 
 	else if (C == CLOSEF) {
-		if (fp != NULL)
+		if (fp != NULL) {
 			fclose(fp);
+			fp = NULL;
+		}
 		A = 0;
 	}
 
 	/* READ file */
 
 	else if (C == READF) {
-		if (fp != NULL) {
-			xferLen = fread(buf, 1, SECLEN, fp);
-			if (xferLen != 0) {
-				for (i = 0; i < xferLen; i++)
-					dma_write(dmaAddr + i, buf[i]);
-				for (; i < SECLEN; i++)
-					dma_write(dmaAddr + i, CTRL_Z);
-				A = 0;
-			}
-		}
+		if (fp != NULL && readRec(dmaAddr))
+			A = 0;
 	}
 
 	/* WRITE file */
 
 	else if (C == WRITEF) {
-		if (fp != NULL) {
-			for (xferLen = 0; xferLen < SECLEN; xferLen++) {
-				buf[xferLen] = dma_read(dmaAddr + xferLen);
-				if ((buf[xferLen] == CTRL_Z) && textFile)
-					break;	/* ctrl-z (EOF) found */
-			}
-			if (xferLen == 0)	/* record contains only ctrl-z */
-				A = 0;
-			else if ((size_t) xferLen == fwrite(buf, 1, xferLen, fp))
-				A = 0;
-		}
+		if (fp != NULL && writeRec(dmaAddr))
+			A = 0;
 	}
 
+	/* READ or WRITE multiple records, DE is the buffer address */
+
+	else if ((C == READN) || (C == WRITEN)) {
+		for (i = 0; fp != NULL && i < B; i++)
+			if (!((C == READN) ? readRec(fcbAddr + i * SECLEN)
+					   : writeRec(fcbAddr + i * SECLEN)))
+				break;
+		if (i > 0 && (C == READN || i == B))
+			A = 0;
+		B = i;
+	}
+
+	/* SEARCH for first or next file in the host directory */
+
+	else if (C == SEARCHF) {
+		for (i = 0; i < 11; i++)
+			pattern[i] = toupper(dma_read(fcbAddr + 1 + i) & 0x7f);
+		if (dirp != NULL)
+			closedir(dirp);
+		dirp = opendir(".");
+		searchNext();
+	}
+
+	else if (C == SEARCHN)
+		searchNext();
+
 	/* Set DMA Address */
 
 	else if (C == SETDMA) {
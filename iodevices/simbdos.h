@@ -17,5 +17,6 @@
 #include "simdefs.h"
 
 extern void host_bdos_out(BYTE outByte);
+extern bool host_cpm_name(const char *s, BYTE *name);
 
 #endif /* !SIMBDOS_INC */
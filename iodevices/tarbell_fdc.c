@@ -35,6 +35,7 @@
 #include "simdefs.h"
 #include "simglb.h"
 
+#include "unix_blkio.h"
 #include "tarbell_fdc.h"
 
 #include "log.h"
@@ -282,17 +283,9 @@ BYTE tarbell_data_in(void)
 				return (BYTE) 0;
 			}
 
-			/* seek to sector */
-			pos = (fdc_track * SPT + fdc_sec - 1) * SEC_SZ;
-			if (lseek(fd, pos, SEEK_SET) == -1L) {
-				state = FDC_IDLE;	/* abort command */
-				fdc_stat = 0x10;	/* record not found */
-				close(fd);
-				return (BYTE) 0;
-			}
-
 			/* read the sector */
-			if (read(fd, buf, SEC_SZ) != SEC_SZ) {
+			pos = (fdc_track * SPT + fdc_sec - 1) * SEC_SZ;
+			if (blk_read(fd, buf, SEC_SZ, pos) != SEC_SZ) {
 				state = FDC_IDLE;	/* abort read command */
 				fdc_stat = 0x10;	/* record not found */
 				close(fd);
@@ -341,7 +334,7 @@ BYTE tarbell_data_in(void)
  */
 void tarbell_data_out(BYTE data)
 {
-	off_t pos;			/* seek position */
+	static off_t pos;		/* position in disk image */
 	static int wrtstat;		/* state while formatting track */
 	static int bcnt;		/* byte counter for sector data */
 	static int secs;		/* # of sectors written so far */
@@ -389,14 +382,8 @@ void tarbell_data_out(BYTE data)
 				return;
 			}
 
-			/* seek to sector */
+			/* position of sector */
 			pos = (fdc_track * SPT + fdc_sec - 1) * SEC_SZ;
-			if (lseek(fd, pos, SEEK_SET) == -1L) {
-				state = FDC_IDLE;	/* abort command */
-				fdc_stat = 0x10;	/* record not found */
-				close(fd);
-				return;
-			}
 		}
 
 		/* write data bytes into sector buffer */
@@ -405,7 +392,7 @@ void tarbell_data_out(BYTE data)
 		/* last byte? */
 		if (dcnt == SEC_SZ) {
 			state = FDC_IDLE;		/* reset DRQ */
-			if (write(fd, buf, SEC_SZ) == SEC_SZ)
+			if (blk_write(fd, buf, SEC_SZ, pos) == SEC_SZ)
 				fdc_stat = 0;
 			else
 				fdc_stat = 0x20;	/* write fault */
@@ -427,14 +414,8 @@ void tarbell_data_out(BYTE data)
 				fdc_stat = 0x80;	/* not ready */
 				return;
 			}
-			/* seek to track */
+			/* position of track */
 			pos = fdc_track * SPT  * SEC_SZ;
-			if (lseek(fd, pos, SEEK_SET) == -1L) {
-				state = FDC_IDLE;	/* abort command */
-				fdc_stat = 0x10;	/* record not found */
-				close(fd);
-				return;
-			}
 			/* now wait for sector data */
 			wrtstat = 1;
 			secs = 0;
@@ -455,10 +436,11 @@ void tarbell_data_out(BYTE data)
 				return;
 			} else {
 				secs++;
-				if (write(fd, buf, bcnt) == bcnt)
+				if (blk_write(fd, buf, bcnt, pos) == bcnt)
 					fdc_stat = 0;
 				else
 					fdc_stat = 0x20; /* write fault */
+				pos += bcnt;
 				wrtstat = 1;
 			}
 		}
@@ -0,0 +1,69 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Common I/O devices used by various simulated machines
+ *
+ * Copyright (C) 2026 by agent
+ *
+ * This module implements block I/O on disk image files.
+ *
+ * History:
+ * 18-OCT-2026 first version, used by the disk controllers
+ */
+
+#include <unistd.h>
+#include <errno.h>
+
+#include "unix_blkio.h"
+
+/*
+ * POSIX backend, one pread()/pwrite() per transfer instead of lseek()
+ * followed by read()/write(). Transfers interrupted by a signal or cut
+ * short are continued.
+ */
+static ssize_t posix_read(int fd, void *buf, size_t len, off_t pos)
+{
+	ssize_t n;
+	size_t done = 0;
+
+	while (done < len) {
+		n = pread(fd, (char *) buf + done, len - done, pos + done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (n == 0)
+			break;
+		done += n;
+	}
+
+	return done;
+}
+
+static ssize_t posix_write(int fd, const void *buf, size_t len, off_t pos)
+{
+	ssize_t n;
+	size_t done = 0;
+
+	while (done < len) {
+		n = pwrite(fd, (const char *) buf + done, len - done, pos + done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		done += n;
+	}
+
+	return done;
+}
+
+const blkio_ops_t blkio_posix = {
+	.name = "posix",
+	.read = posix_read,
+	.write = posix_write
+};
+
+/* backend in use */
+const blkio_ops_t *blkio = &blkio_posix;
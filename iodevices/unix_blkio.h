@@ -0,0 +1,45 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Common I/O devices used by various simulated machines
+ *
+ * Copyright (C) 2026 by agent
+ *
+ * This module implements block I/O on disk image files.
+ *
+ * History:
+ * 18-OCT-2026 first version, used by the disk controllers
+ */
+
+#ifndef UNIX_BLKIO_INC
+#define UNIX_BLKIO_INC
+
+#include <sys/types.h>
+
+/*
+ * The disk controllers transfer sectors with blk_read() and blk_write(),
+ * which call the backend in use. A backend transfers len bytes at
+ * offset pos of the image file without moving the file offset, and
+ * returns the number of bytes transferred, which is less than len only
+ * at the end of the file, or -1 with errno set.
+ */
+typedef struct blkio_ops {
+	const char *name;
+	ssize_t (*read)(int fd, void *buf, size_t len, off_t pos);
+	ssize_t (*write)(int fd, const void *buf, size_t len, off_t pos);
+} blkio_ops_t;
+
+extern const blkio_ops_t blkio_posix;
+extern const blkio_ops_t *blkio;
+
+static inline ssize_t blk_read(int fd, void *buf, size_t len, off_t pos)
+{
+	return (*blkio->read)(fd, buf, len, pos);
+}
+
+static inline ssize_t blk_write(int fd, const void *buf, size_t len, off_t pos)
+{
+	return (*blkio->write)(fd, buf, len, pos);
+}
+
+#endif /* !UNIX_BLKIO_INC */
@@ -0,0 +1,372 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Common I/O devices used by various simulated machines
+ *
+ * Copyright (C) 2026 by agent
+ *
+ * This module implements copy-on-write overlays for disk image files.
+ *
+ * An overlay file refers to a base image, which is only read, so many
+ * simulations can share one base image and its pages in the page cache.
+ * A sector written by the guest is stored in the overlay and its bit in
+ * the sector bitmap is set, reads of sectors with the bit set go to
+ * the overlay, all others to the base image. The overlay is a sparse
+ * file, it only needs disk space for the sectors written. A sector
+ * copied into the overlay is synced to disk before its bit is set, so
+ * a crash, even of the host, can't expose a sector which wasn't copied
+ * completely. Writes to sectors already in the overlay aren't synced,
+ * they can be torn by a host crash like writes to a disk image.
+ *
+ * History:
+ * 18-OCT-2026 first version, used by cpmsim and the cowdisk tool
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "unix_blkio.h"
+#include "unix_cowdisk.h"
+
+struct cowdisk {
+	int fd;			/* overlay file */
+	int bfd;		/* base image, read-only */
+	bool rdonly;		/* overlay is opened read-only */
+	cowdisk_hdr_t hdr;
+	uint8_t *map;		/* sector bitmap */
+	size_t mapsz;
+	uint32_t count;		/* sectors in the overlay */
+};
+
+#define ALIGN		4096	/* alignment of the sector data */
+
+#ifdef __APPLE__
+#define st_mtim		st_mtimespec
+#define fdatasync	fsync
+#endif
+
+static size_t map_size(uint32_t nsecs)
+{
+	return (nsecs + 7) / 8;
+}
+
+static bool in_overlay(cowdisk_t *cd, uint32_t s)
+{
+	return cd->map[s >> 3] & (1 << (s & 7));
+}
+
+/*
+ * Remember the identity of the base image with status sb in the header
+ */
+static void set_base(cowdisk_hdr_t *hdr, const struct stat *sb)
+{
+	hdr->size = sb->st_size;
+	hdr->mtime = sb->st_mtim.tv_sec;
+	hdr->mtime_nsec = sb->st_mtim.tv_nsec;
+	hdr->ino = sb->st_ino;
+}
+
+/*
+ * Check that the base image wasn't changed or replaced after the
+ * overlay was created or committed
+ */
+static int check_base(cowdisk_t *cd)
+{
+	struct stat sb;
+
+	if (fstat(cd->bfd, &sb) == -1)
+		return -1;
+	if ((uint64_t) sb.st_size != cd->hdr.size ||
+	    (int64_t) sb.st_mtim.tv_sec != cd->hdr.mtime ||
+	    (int64_t) sb.st_mtim.tv_nsec != cd->hdr.mtime_nsec ||
+	    (uint64_t) sb.st_ino != cd->hdr.ino) {
+		errno = ESTALE;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Create the overlay file path for the base image base, the file
+ * must not exist
+ */
+int cowdisk_create(const char *base, const char *path)
+{
+	cowdisk_hdr_t hdr;
+	struct stat sb;
+	char abs[PATH_MAX];
+	int fd, err;
+
+	if (realpath(base, abs) == NULL || stat(abs, &sb) == -1)
+		return -1;
+	if (!S_ISREG(sb.st_mode)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (strlen(abs) >= COWDISK_PATHLEN) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	if ((uint64_t) sb.st_size / COWDISK_SECLEN >= UINT32_MAX) {
+		errno = EFBIG;
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, COWDISK_MAGIC, sizeof(hdr.magic));
+	hdr.seclen = COWDISK_SECLEN;
+	hdr.nsecs = (sb.st_size + COWDISK_SECLEN - 1) / COWDISK_SECLEN;
+	set_base(&hdr, &sb);
+	hdr.data = (COWDISK_BITMAP + map_size(hdr.nsecs) + ALIGN - 1)
+		   & ~((uint64_t) ALIGN - 1);
+	strcpy(hdr.base, abs);
+
+	if ((fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644)) == -1)
+		return -1;
+	/* the bitmap is a hole, so all sectors come from the base */
+	if (blk_write(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+	    ftruncate(fd, hdr.data) == -1) {
+		err = errno;
+		close(fd);
+		unlink(path);
+		errno = err;
+		return -1;
+	}
+	return close(fd);
+}
+
+/*
+ * Returns true if the open file fd is an overlay file
+ */
+bool cowdisk_probe(int fd)
+{
+	char magic[8];
+
+	return blk_read(fd, magic, sizeof(magic), 0) == sizeof(magic) &&
+	       memcmp(magic, COWDISK_MAGIC, sizeof(magic)) == 0;
+}
+
+cowdisk_t *cowdisk_open(const char *path, bool rdonly)
+{
+	cowdisk_t *cd;
+	uint32_t s;
+	int err;
+
+	if ((cd = calloc(1, sizeof(cowdisk_t))) == NULL)
+		return NULL;
+	cd->bfd = -1;
+	cd->rdonly = rdonly;
+	if ((cd->fd = open(path, rdonly ? O_RDONLY : O_RDWR)) == -1)
+		goto error;
+	if (blk_read(cd->fd, &cd->hdr, sizeof(cd->hdr), 0)
+	    != sizeof(cd->hdr) ||
+	    memcmp(cd->hdr.magic, COWDISK_MAGIC, sizeof(cd->hdr.magic)) ||
+	    cd->hdr.seclen != COWDISK_SECLEN ||
+	    cd->hdr.nsecs != (cd->hdr.size + COWDISK_SECLEN - 1)
+			     / COWDISK_SECLEN) {
+		errno = EINVAL;
+		goto error;
+	}
+	cd->hdr.base[COWDISK_PATHLEN - 1] = '\0';
+	if ((cd->bfd = open(cd->hdr.base, O_RDONLY)) == -1 ||
+	    check_base(cd) == -1)
+		goto error;
+
+	cd->mapsz = map_size(cd->hdr.nsecs);
+	if ((cd->map = malloc(cd->mapsz)) == NULL)
+		goto error;
+	if (blk_read(cd->fd, cd->map, cd->mapsz, COWDISK_BITMAP)
+	    != (ssize_t) cd->mapsz) {
+		errno = EINVAL;
+		goto error;
+	}
+	for (s = 0; s < cd->hdr.nsecs; s++)
+		if (in_overlay(cd, s))
+			cd->count++;
+	return cd;
+
+error:
+	err = errno;
+	cowdisk_close(cd);
+	errno = err;
+	return NULL;
+}
+
+void cowdisk_close(cowdisk_t *cd)
+{
+	if (cd->fd != -1)
+		close(cd->fd);
+	if (cd->bfd != -1)
+		close(cd->bfd);
+	free(cd->map);
+	free(cd);
+}
+
+ssize_t cowdisk_read(cowdisk_t *cd, void *buf, size_t len, off_t pos)
+{
+	uint64_t p;
+	size_t done = 0, n;
+	ssize_t r;
+
+	if (pos < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	while (done < len && (p = pos + done) < cd->hdr.size) {
+		n = COWDISK_SECLEN - p % COWDISK_SECLEN;
+		if (n > len - done)
+			n = len - done;
+		if (n > cd->hdr.size - p)
+			n = cd->hdr.size - p;
+		if (in_overlay(cd, p / COWDISK_SECLEN))
+			r = blk_read(cd->fd, (char *) buf + done, n,
+				     cd->hdr.data + p);
+		else
+			r = blk_read(cd->bfd, (char *) buf + done, n, p);
+		if (r < 0)
+			return -1;
+		done += r;
+		if ((size_t) r < n)
+			break;
+	}
+	return done;
+}
+
+/*
+ * The first write of a sector copies it to the overlay, sectors are
+ * never added to the base image
+ */
+ssize_t cowdisk_write(cowdisk_t *cd, const void *buf, size_t len, off_t pos)
+{
+	static char sec[COWDISK_SECLEN];
+	uint64_t p, spos;
+	size_t done = 0, n, slen;
+	uint32_t s;
+
+	if (cd->rdonly) {
+		errno = EROFS;
+		return -1;
+	}
+	if (pos < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	while (done < len && (p = pos + done) < cd->hdr.size) {
+		n = COWDISK_SECLEN - p % COWDISK_SECLEN;
+		if (n > len - done)
+			n = len - done;
+		if (n > cd->hdr.size - p)
+			n = cd->hdr.size - p;
+		s = p / COWDISK_SECLEN;
+		if (in_overlay(cd, s)) {
+			if (blk_write(cd->fd, (const char *) buf + done, n,
+				      cd->hdr.data + p) != (ssize_t) n)
+				return -1;
+		} else {
+			spos = (uint64_t) s * COWDISK_SECLEN;
+			slen = cd->hdr.size - spos;
+			if (slen > COWDISK_SECLEN)
+				slen = COWDISK_SECLEN;
+			if (n < slen && blk_read(cd->bfd, sec, slen, spos)
+					!= (ssize_t) slen) {
+				errno = EIO;
+				return -1;
+			}
+			memcpy(sec + (p - spos), (const char *) buf + done, n);
+			if (blk_write(cd->fd, sec, slen, cd->hdr.data + spos)
+			    != (ssize_t) slen || fdatasync(cd->fd) == -1)
+				return -1;
+			cd->map[s >> 3] |= 1 << (s & 7);
+			if (blk_write(cd->fd, &cd->map[s >> 3], 1,
+				      COWDISK_BITMAP + (s >> 3)) != 1)
+				return -1;
+			cd->count++;
+		}
+		done += n;
+	}
+	return done;
+}
+
+const char *cowdisk_base(cowdisk_t *cd)
+{
+	return cd->hdr.base;
+}
+
+/*
+ * Returns the number of sectors stored in the overlay
+ */
+uint32_t cowdisk_count(cowdisk_t *cd)
+{
+	return cd->count;
+}
+
+/*
+ * Write the sectors of the overlay into the base image and empty the
+ * overlay. Other overlays of the base image can't be used afterwards.
+ */
+int cowdisk_commit(cowdisk_t *cd)
+{
+	static char sec[COWDISK_SECLEN];
+	struct stat sb;
+	uint64_t spos;
+	size_t slen;
+	uint32_t s;
+	int wfd, err;
+
+	if (cd->rdonly) {
+		errno = EROFS;
+		return -1;
+	}
+	if ((wfd = open(cd->hdr.base, O_WRONLY)) == -1)
+		return -1;
+	for (s = 0; s < cd->hdr.nsecs; s++) {
+		if (!in_overlay(cd, s))
+			continue;
+		spos = (uint64_t) s * COWDISK_SECLEN;
+		slen = cd->hdr.size - spos;
+		if (slen > COWDISK_SECLEN)
+			slen = COWDISK_SECLEN;
+		if (blk_read(cd->fd, sec, slen, cd->hdr.data + spos)
+		    != (ssize_t) slen ||
+		    blk_write(wfd, sec, slen, spos) != (ssize_t) slen)
+			goto error;
+	}
+	if (fsync(wfd) == -1 || fstat(wfd, &sb) == -1)
+		goto error;
+	close(wfd);
+
+	set_base(&cd->hdr, &sb);
+	if (blk_write(cd->fd, &cd->hdr, sizeof(cd->hdr), 0)
+	    != sizeof(cd->hdr))
+		return -1;
+	return cowdisk_discard(cd);
+
+error:
+	err = errno;
+	close(wfd);
+	errno = err;
+	return -1;
+}
+
+/*
+ * Drop all sectors of the overlay, truncating the file releases their
+ * disk space and clears the bitmap
+ */
+int cowdisk_discard(cowdisk_t *cd)
+{
+	if (cd->rdonly) {
+		errno = EROFS;
+		return -1;
+	}
+	if (ftruncate(cd->fd, COWDISK_BITMAP) == -1 ||
+	    ftruncate(cd->fd, cd->hdr.data) == -1 || fsync(cd->fd) == -1)
+		return -1;
+	memset(cd->map, 0, cd->mapsz);
+	cd->count = 0;
+	return 0;
+}
@@ -0,0 +1,66 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Common I/O devices used by various simulated machines
+ *
+ * Copyright (C) 2026 by agent
+ *
+ * This module implements copy-on-write overlays for disk image files.
+ *
+ * History:
+ * 18-OCT-2026 first version, used by cpmsim and the cowdisk tool
+ */
+
+#ifndef UNIX_COWDISK_INC
+#define UNIX_COWDISK_INC
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define COWDISK_MAGIC	"Z80COW2"	/* first bytes of an overlay file */
+#define COWDISK_SECLEN	128		/* sector size of the overlay */
+#define COWDISK_PATHLEN	1024		/* max. length of the base path */
+#define COWDISK_BITMAP	4096		/* offset of the sector bitmap */
+
+/*
+ * Header at the start of an overlay file, in host byte order. It is
+ * followed by a bitmap with one bit for each sector of the base image
+ * at offset COWDISK_BITMAP, set if the sector is in the overlay. The
+ * sectors in the overlay are at offset data + sector * seclen, the file
+ * has holes for the sectors which were never written.
+ */
+typedef struct cowdisk_hdr {
+	char magic[8];
+	uint32_t seclen;		/* sector size */
+	uint32_t nsecs;			/* number of sectors */
+	uint64_t size;			/* size of the base image */
+	int64_t mtime;			/* modification time of the base */
+	int64_t mtime_nsec;		/* and its nanoseconds */
+	uint64_t ino;			/* inode number of the base */
+	uint64_t data;			/* offset of sector 0 */
+	char base[COWDISK_PATHLEN];	/* absolute path of the base image */
+} cowdisk_hdr_t;
+
+typedef struct cowdisk cowdisk_t;
+
+/*
+ * The base image is opened read-only and never written, except by
+ * cowdisk_commit(). Read and write work like blk_read() and blk_write()
+ * on the base image. Functions which fail return -1 or NULL with errno
+ * set, ESTALE if the base image was changed after the overlay was
+ * created.
+ */
+extern int cowdisk_create(const char *base, const char *path);
+extern bool cowdisk_probe(int fd);
+extern cowdisk_t *cowdisk_open(const char *path, bool rdonly);
+extern void cowdisk_close(cowdisk_t *cd);
+extern ssize_t cowdisk_read(cowdisk_t *cd, void *buf, size_t len, off_t pos);
+extern ssize_t cowdisk_write(cowdisk_t *cd, const void *buf, size_t len,
+			     off_t pos);
+extern const char *cowdisk_base(cowdisk_t *cd);
+extern uint32_t cowdisk_count(cowdisk_t *cd);
+extern int cowdisk_commit(cowdisk_t *cd);
+extern int cowdisk_discard(cowdisk_t *cd);
+
+#endif /* !UNIX_COWDISK_INC */
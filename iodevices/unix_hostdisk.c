@@ -0,0 +1,651 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Common I/O devices used by various simulated machines
+ *
+ * Copyright (C) 2026 by agent
+ *
+ * This module implements CP/M disk drives backed by host directories.
+ *
+ * The sectors of the drive are kept in memory in logical order. When
+ * the drive is accessed the first time, a CP/M directory with user 0
+ * entries for the host files with names fitting into 8.3 is generated
+ * and blocks are allocated for the files. The data of a block is read
+ * from its host file when the block is accessed the first time.
+ *
+ * When the guest writes a directory sector, the files with entries in
+ * it are written to the host directory. Of files which exist already
+ * only the blocks written by the guest are written, renamed files are
+ * renamed and files without entries left are removed. Files with data
+ * written but not closed by the guest are written when the drive is
+ * closed. New files get lower case names, like simbdos.c does.
+ *
+ * Host files created or changed by other programs after the directory
+ * was generated are not seen by the guest.
+ *
+ * History:
+ * 18-OCT-2026 first version, used by cpmsim
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simbdos.h"
+#include "unix_blkio.h"
+#include "unix_hostdisk.h"
+
+#include "log.h"
+static const char *TAG = "hostdisk";
+
+#define SECLEN		128	/* logical sector length */
+#define DIRLEN		32	/* size of a directory entry */
+#define EXTRECS		128	/* records of a logical extent */
+#define CTRL_Z		0x1A	/* CP/M EOF character */
+#define EMPTY		0xE5	/* contents of unused sectors */
+
+typedef struct hdfile {
+	BYTE name[11];		/* CP/M file name and type */
+	char *host;		/* host file name, NULL if unused */
+} hdfile_t;
+
+typedef struct hdblock {
+	int file;		/* host file holding the data or -1 */
+	unsigned idx;		/* index of the block in the host file */
+	bool loaded;		/* data was read into the image */
+	bool dirty;		/* written by the guest since the last sync */
+} hdblock_t;
+
+struct hostdisk {
+	char *dir;		/* host directory */
+	hostdisk_dpb_t dpb;
+	unsigned *pxlt;		/* physical to logical sector or NULL */
+	size_t size;		/* size of the image */
+	size_t data;		/* offset of block 0 in the image */
+	unsigned bls;		/* block size */
+	unsigned dirblks;	/* blocks used by the directory */
+	unsigned nptr;		/* block numbers in a directory entry */
+	bool scanned;		/* directory was generated */
+	BYTE *img;		/* sectors in logical order */
+	hdblock_t *blk;		/* state of the blocks */
+	unsigned *layout;	/* blocks of a file, used by hd_sync() */
+	hdfile_t *files;	/* host files of the drive */
+	int nfiles;
+	int fd;			/* host file kept open for reading */
+	int fd_file;		/* its index in files or -1 */
+};
+
+static bool valid_char(BYTE c)
+{
+	return isgraph(c) && strchr("/.,;:=?*<>|[]", c) == NULL;
+}
+
+/*
+ * Convert a CP/M 8.3 name to a lower case host file name, returns
+ * false if it can't be used on the host
+ */
+static bool cpm_name(const BYTE *name, char *s)
+{
+	int i;
+
+	if (name[0] == ' ')
+		return false;
+	for (i = 0; i < 8 && name[i] != ' '; i++) {
+		if (!valid_char(name[i]))
+			return false;
+		*s++ = tolower(name[i]);
+	}
+	if (name[8] != ' ') {
+		*s++ = '.';
+		for (i = 8; i < 11 && name[i] != ' '; i++) {
+			if (!valid_char(name[i]))
+				return false;
+			*s++ = tolower(name[i]);
+		}
+	}
+	*s = '\0';
+	return true;
+}
+
+static void hd_path(hostdisk_t *hd, const char *host, char *path)
+{
+	snprintf(path, MAX_LFN, "%s/%s", hd->dir, host);
+}
+
+static int find_file(hostdisk_t *hd, const BYTE *name)
+{
+	int i;
+
+	for (i = 0; i < hd->nfiles; i++)
+		if (hd->files[i].host != NULL &&
+		    memcmp(hd->files[i].name, name, 11) == 0)
+			return i;
+	return -1;
+}
+
+static int add_file(hostdisk_t *hd, const BYTE *name, const char *host)
+{
+	hdfile_t *p;
+	int i;
+
+	for (i = 0; i < hd->nfiles; i++)
+		if (hd->files[i].host == NULL)
+			break;
+	if (i == hd->nfiles) {
+		if ((p = realloc(hd->files, (i + 1) * sizeof(hdfile_t))) == NULL)
+			return -1;
+		hd->files = p;
+		hd->nfiles++;
+	}
+	if ((hd->files[i].host = strdup(host)) == NULL)
+		return -1;
+	memcpy(hd->files[i].name, name, 11);
+	return i;
+}
+
+static void hd_close_fd(hostdisk_t *hd)
+{
+	if (hd->fd != -1) {
+		close(hd->fd);
+		hd->fd = -1;
+		hd->fd_file = -1;
+	}
+}
+
+/*
+ * access to the directory entries
+ */
+static BYTE *dir_ent(hostdisk_t *hd, unsigned n)
+{
+	return hd->img + hd->data + n * DIRLEN;
+}
+
+static unsigned ent_block(hostdisk_t *hd, const BYTE *ent, unsigned k)
+{
+	if (hd->nptr == 16)
+		return ent[16 + k];
+	return ent[16 + 2 * k] | (ent[17 + 2 * k] << 8);
+}
+
+static void ent_setblock(hostdisk_t *hd, BYTE *ent, unsigned k, unsigned b)
+{
+	if (hd->nptr == 16)
+		ent[16 + k] = b;
+	else {
+		ent[16 + 2 * k] = b & 0xff;
+		ent[17 + 2 * k] = b >> 8;
+	}
+}
+
+/* number of the last logical extent of an entry */
+static unsigned ent_extent(const BYTE *ent)
+{
+	return (ent[12] & 0x1f) | ((ent[14] & 0x3f) << 5);
+}
+
+/* is this an entry of user 0 for the file name? */
+static bool ent_match(const BYTE *ent, const BYTE *name)
+{
+	int i;
+
+	if (ent[0] != 0)
+		return false;
+	for (i = 0; i < 11; i++)
+		if ((ent[1 + i] & 0x7f) != name[i])
+			return false;
+	return true;
+}
+
+static bool hd_has_name(hostdisk_t *hd, const BYTE *name)
+{
+	unsigned n;
+
+	for (n = 0; n <= hd->dpb.drm; n++)
+		if (ent_match(dir_ent(hd, n), name))
+			return true;
+	return false;
+}
+
+/*
+ * Read a block from its host file. The last record of a file is
+ * padded with ^Z, like text files end on CP/M.
+ */
+static void hd_load(hostdisk_t *hd, unsigned b)
+{
+	hdblock_t *bp = &hd->blk[b];
+	BYTE *p = hd->img + hd->data + (size_t) b * hd->bls;
+	char path[MAX_LFN];
+	ssize_t n = 0;
+	size_t r;
+
+	if (bp->file >= 0) {
+		if (hd->fd_file != bp->file) {
+			hd_close_fd(hd);
+			hd_path(hd, hd->files[bp->file].host, path);
+			if ((hd->fd = open(path, O_RDONLY)) != -1)
+				hd->fd_file = bp->file;
+			else
+				LOGW(TAG, "can't read %s", path);
+		}
+		if (hd->fd_file == bp->file)
+			n = blk_read(hd->fd, p, hd->bls,
+				     (off_t) bp->idx * hd->bls);
+		if (n < 0)
+			n = 0;
+	}
+	r = (n + SECLEN - 1) & ~(SECLEN - 1);
+	memset(p + n, CTRL_Z, r - n);
+	memset(p + r, EMPTY, hd->bls - r);
+	bp->loaded = true;
+}
+
+/*
+ * Generate the directory entries for a host file of size bytes, with
+ * consecutive blocks starting at block b
+ */
+static void hd_mkentries(hostdisk_t *hd, unsigned n, const BYTE *name,
+			 off_t size, unsigned b, int fi)
+{
+	off_t esize = (off_t) hd->nptr * hd->bls;
+	unsigned e = 0, k, nb, recs, ext;
+	off_t eb;
+	BYTE *ent;
+
+	do {
+		ent = dir_ent(hd, n + e);
+		eb = size - e * esize;
+		if (eb > esize)
+			eb = esize;
+		recs = (eb + SECLEN - 1) / SECLEN;
+		ext = e * (hd->dpb.exm + 1) + (recs ? (recs - 1) / EXTRECS : 0);
+		memset(ent, 0, DIRLEN);
+		memcpy(ent + 1, name, 11);
+		ent[12] = ext & 0x1f;
+		ent[14] = ext >> 5;
+		ent[15] = recs - (recs ? (recs - 1) / EXTRECS * EXTRECS : 0);
+		nb = (eb + hd->bls - 1) / hd->bls;
+		for (k = 0; k < nb; k++, b++) {
+			ent_setblock(hd, ent, k, b);
+			hd->blk[b].file = fi;
+			hd->blk[b].idx = e * hd->nptr + k;
+			hd->blk[b].loaded = false;
+		}
+		e++;
+	} while (e * esize < size);
+}
+
+/*
+ * Generate the directory from the files in the host directory
+ */
+static void hd_scan(hostdisk_t *hd)
+{
+	DIR *dir;
+	struct dirent *de;
+	struct stat sbuf;
+	char path[MAX_LFN];
+	BYTE name[11];
+	unsigned n = 0, b = hd->dirblks, nb, ne;
+	int fi;
+
+	hd->scanned = true;
+	if ((dir = opendir(hd->dir)) == NULL) {
+		LOGW(TAG, "can't read directory %s", hd->dir);
+		return;
+	}
+	while ((de = readdir(dir)) != NULL) {
+		if (!host_cpm_name(de->d_name, name) || find_file(hd, name) >= 0)
+			continue;
+		hd_path(hd, de->d_name, path);
+		if (stat(path, &sbuf) == -1 || !S_ISREG(sbuf.st_mode))
+			continue;
+		nb = (sbuf.st_size + hd->bls - 1) / hd->bls;
+		ne = nb ? (nb + hd->nptr - 1) / hd->nptr : 1;
+		if (n + ne > hd->dpb.drm + 1 || b + nb > hd->dpb.dsm + 1) {
+			LOGW(TAG, "no space for %s", path);
+			continue;
+		}
+		if ((fi = add_file(hd, name, de->d_name)) < 0)
+			break;
+		hd_mkentries(hd, n, name, sbuf.st_size, b, fi);
+		n += ne;
+		b += nb;
+	}
+	closedir(dir);
+}
+
+/*
+ * Collect the blocks of the file with the name from its directory
+ * entries, returns the number of records or -1 if there are none
+ */
+static long hd_layout(hostdisk_t *hd, const BYTE *name, unsigned *nblk)
+{
+	long recs = -1, r;
+	unsigned n, k, b, p, ext;
+	BYTE *ent;
+
+	memset(hd->layout, 0, (hd->dpb.dsm + 1) * sizeof(unsigned));
+	for (n = 0; n <= hd->dpb.drm; n++) {
+		ent = dir_ent(hd, n);
+		if (!ent_match(ent, name))
+			continue;
+		ext = ent_extent(ent);
+		if ((r = (long) ext * EXTRECS + ent[15]) > recs)
+			recs = r;
+		p = ext / (hd->dpb.exm + 1) * hd->nptr;
+		for (k = 0; k < hd->nptr; k++, p++) {
+			b = ent_block(hd, ent, k);
+			if (b >= hd->dirblks && b <= hd->dpb.dsm &&
+			    p <= hd->dpb.dsm)
+				hd->layout[p] = b;
+		}
+	}
+	*nblk = recs > 0 ? (recs * SECLEN + hd->bls - 1) / hd->bls : 0;
+	return recs;
+}
+
+/*
+ * Write the file with the name to the host directory
+ */
+static void hd_sync(hostdisk_t *hd, const BYTE *name)
+{
+	unsigned *lay = hd->layout, nblk, p, b;
+	hdblock_t *bp;
+	long recs;
+	int fi, fo, fd;
+	size_t len;
+	struct stat sbuf;
+	char host[13], old[MAX_LFN], path[MAX_LFN];
+
+	if ((recs = hd_layout(hd, name, &nblk)) < 0)
+		return;
+	if (!cpm_name(name, host)) {
+		LOGW(TAG, "can't write %.11s to %s", (const char *) name,
+		     hd->dir);
+		return;
+	}
+	hd_close_fd(hd);
+
+	if ((fi = find_file(hd, name)) < 0) {
+		/* the host file of a renamed file is renamed too */
+		for (p = 0; p < nblk && lay[p] == 0; p++)
+			;
+		fo = (p < nblk) ? hd->blk[lay[p]].file : -1;
+		if (fo >= 0 && !hd_has_name(hd, hd->files[fo].name)) {
+			hd_path(hd, hd->files[fo].host, old);
+			hd_path(hd, host, path);
+			if (rename(old, path) == 0) {
+				free(hd->files[fo].host);
+				if ((hd->files[fo].host = strdup(host)) == NULL)
+					return;
+				memcpy(hd->files[fo].name, name, 11);
+				fi = fo;
+			}
+		}
+		if (fi < 0 && (fi = add_file(hd, name, host)) < 0)
+			return;
+	}
+
+	/* blocks of the host file which moved must not be overwritten */
+	for (b = hd->dirblks; b <= hd->dpb.dsm; b++) {
+		bp = &hd->blk[b];
+		if (bp->file != fi || (bp->idx < nblk && lay[bp->idx] == b))
+			continue;
+		if (!bp->loaded)
+			hd_load(hd, b);
+		bp->file = -1;
+	}
+
+	/* nothing to do for files which weren't changed */
+	hd_path(hd, hd->files[fi].host, path);
+	for (p = 0; p < nblk; p++) {
+		bp = &hd->blk[lay[p]];
+		if (lay[p] != 0 && (bp->file != fi || bp->idx != p || bp->dirty))
+			break;
+	}
+	if (p == nblk && stat(path, &sbuf) == 0 &&
+	    (sbuf.st_size + SECLEN - 1) / SECLEN == recs)
+		return;
+
+	if ((fd = open(path, O_WRONLY | O_CREAT, 0644)) == -1) {
+		LOGW(TAG, "can't write %s", path);
+		return;
+	}
+	for (p = 0; p < nblk; p++) {
+		if ((b = lay[p]) == 0)
+			continue;
+		bp = &hd->blk[b];
+		if (bp->file == fi && bp->idx == p && !bp->dirty)
+			continue;
+		if (!bp->loaded)
+			hd_load(hd, b);
+		len = hd->bls;
+		if ((size_t) recs * SECLEN - (size_t) p * hd->bls < len)
+			len = (size_t) recs * SECLEN - (size_t) p * hd->bls;
+		if (blk_write(fd, hd->img + hd->data + (size_t) b * hd->bls,
+			      len, (off_t) p * hd->bls) != (ssize_t) len)
+			LOGW(TAG, "can't write %s", path);
+		bp->file = fi;
+		bp->idx = p;
+		bp->dirty = false;
+	}
+	/* host files may end within the last record */
+	if (fstat(fd, &sbuf) == 0 &&
+	    (sbuf.st_size + SECLEN - 1) / SECLEN != recs)
+		if (ftruncate(fd, (off_t) recs * SECLEN) == -1)
+			LOGW(TAG, "can't truncate %s", path);
+	close(fd);
+}
+
+/*
+ * Remove the host file of a file without directory entries left
+ */
+static void hd_delete(hostdisk_t *hd, const BYTE *name)
+{
+	char path[MAX_LFN];
+	unsigned b;
+	int fi;
+
+	if ((fi = find_file(hd, name)) < 0 || hd_has_name(hd, name))
+		return;
+	hd_close_fd(hd);
+	for (b = hd->dirblks; b <= hd->dpb.dsm; b++)
+		if (hd->blk[b].file == fi)
+			hd->blk[b].file = -1;
+	hd_path(hd, hd->files[fi].host, path);
+	if (unlink(path) == -1)
+		LOGW(TAG, "can't remove %s", path);
+	free(hd->files[fi].host);
+	hd->files[fi].host = NULL;
+}
+
+/*
+ * A directory sector was written, old is the previous contents
+ */
+static void hd_dirsync(hostdisk_t *hd, const BYTE *old, const BYTE *new)
+{
+	BYTE name[11];
+	int i, j;
+
+	for (i = 0; i < SECLEN; i += DIRLEN)
+		if (new[i] == 0) {
+			for (j = 0; j < 11; j++)
+				name[j] = new[i + 1 + j] & 0x7f;
+			hd_sync(hd, name);
+		}
+	for (i = 0; i < SECLEN; i += DIRLEN)
+		if (old[i] == 0) {
+			for (j = 0; j < 11; j++)
+				name[j] = old[i + 1 + j] & 0x7f;
+			hd_delete(hd, name);
+		}
+}
+
+/*
+ * Offset in the image of a position on the disk
+ */
+static size_t hd_offset(hostdisk_t *hd, off_t pos)
+{
+	size_t sec = pos / SECLEN, trk;
+
+	trk = sec / hd->dpb.spt;
+	sec %= hd->dpb.spt;
+	if (hd->pxlt != NULL && trk >= hd->dpb.off)
+		sec = hd->pxlt[sec];
+	return (trk * hd->dpb.spt + sec) * SECLEN + pos % SECLEN;
+}
+
+static void hd_free(hostdisk_t *hd)
+{
+	int i;
+
+	hd_close_fd(hd);
+	for (i = 0; i < hd->nfiles; i++)
+		free(hd->files[i].host);
+	free(hd->files);
+	free(hd->layout);
+	free(hd->blk);
+	free(hd->img);
+	free(hd->pxlt);
+	free(hd->dir);
+	free(hd);
+}
+
+hostdisk_t *hostdisk_open(const char *dir, const hostdisk_dpb_t *dpb,
+			  unsigned tracks)
+{
+	hostdisk_t *hd;
+	unsigned i;
+
+	if ((hd = calloc(1, sizeof(hostdisk_t))) == NULL)
+		return NULL;
+	hd->dpb = *dpb;
+	hd->fd = hd->fd_file = -1;
+	hd->bls = SECLEN << dpb->bsh;
+	hd->nptr = (dpb->dsm > 255) ? 8 : 16;
+	hd->size = (size_t) tracks * dpb->spt * SECLEN;
+	hd->data = (size_t) dpb->off * dpb->spt * SECLEN;
+	hd->dirblks = ((dpb->drm + 1) * DIRLEN + hd->bls - 1) / hd->bls;
+	if (hd->data + (size_t) (dpb->dsm + 1) * hd->bls > hd->size ||
+	    hd->dirblks > dpb->dsm) {
+		LOGE(TAG, "disk parameters don't fit the disk for %s", dir);
+		free(hd);
+		return NULL;
+	}
+
+	hd->dir = strdup(dir);
+	hd->img = malloc(hd->size);
+	hd->blk = calloc(dpb->dsm + 1, sizeof(hdblock_t));
+	hd->layout = malloc((dpb->dsm + 1) * sizeof(unsigned));
+	if (dpb->xlt != NULL &&
+	    (hd->pxlt = malloc(dpb->spt * sizeof(unsigned))) != NULL)
+		for (i = 0; i < dpb->spt; i++)
+			hd->pxlt[dpb->xlt[i] - 1] = i;
+	if (hd->dir == NULL || hd->img == NULL || hd->blk == NULL ||
+	    hd->layout == NULL || (dpb->xlt != NULL && hd->pxlt == NULL)) {
+		LOGE(TAG, "can't allocate memory for %s", dir);
+		hd_free(hd);
+		return NULL;
+	}
+
+	memset(hd->img, EMPTY, hd->size);
+	for (i = 0; i <= dpb->dsm; i++) {
+		hd->blk[i].file = -1;
+		hd->blk[i].loaded = true;
+	}
+	return hd;
+}
+
+/*
+ * Write all files with blocks written by the guest and release the drive
+ */
+void hostdisk_close(hostdisk_t *hd)
+{
+	BYTE name[11], *ent;
+	unsigned b, n, m, i;
+
+	for (b = hd->dirblks; b <= hd->dpb.dsm; b++)
+		if (hd->blk[b].dirty)
+			break;
+	if (b <= hd->dpb.dsm) {
+		for (n = 0; n <= hd->dpb.drm; n++) {
+			ent = dir_ent(hd, n);
+			if (ent[0] != 0)
+				continue;
+			for (i = 0; i < 11; i++)
+				name[i] = ent[1 + i] & 0x7f;
+			/* only once for each file */
+			for (m = 0; m < n; m++)
+				if (ent_match(dir_ent(hd, m), name))
+					break;
+			if (m == n)
+				hd_sync(hd, name);
+		}
+	}
+	hd_free(hd);
+}
+
+ssize_t hostdisk_read(hostdisk_t *hd, void *buf, size_t len, off_t pos)
+{
+	size_t done = 0, n, off;
+	unsigned b;
+
+	if (!hd->scanned)
+		hd_scan(hd);
+	while (done < len && pos >= 0 && (size_t) pos < hd->size) {
+		n = SECLEN - pos % SECLEN;
+		if (n > len - done)
+			n = len - done;
+		off = hd_offset(hd, pos);
+		if (off >= hd->data) {
+			b = (off - hd->data) / hd->bls;
+			if (b <= hd->dpb.dsm && !hd->blk[b].loaded)
+				hd_load(hd, b);
+		}
+		memcpy((BYTE *) buf + done, hd->img + off, n);
+		done += n;
+		pos += n;
+	}
+	return done;
+}
+
+ssize_t hostdisk_write(hostdisk_t *hd, const void *buf, size_t len,
+		       off_t pos)
+{
+	size_t done = 0, n, off, rec;
+	unsigned b;
+	BYTE old[SECLEN];
+
+	if (!hd->scanned)
+		hd_scan(hd);
+	while (done < len && pos >= 0 && (size_t) pos < hd->size) {
+		n = SECLEN - pos % SECLEN;
+		if (n > len - done)
+			n = len - done;
+		off = hd_offset(hd, pos);
+		if (off < hd->data) {
+			memcpy(hd->img + off, (const BYTE *) buf + done, n);
+		} else if ((b = (off - hd->data) / hd->bls) < hd->dirblks) {
+			rec = off - off % SECLEN;
+			memcpy(old, hd->img + rec, SECLEN);
+			memcpy(hd->img + off, (const BYTE *) buf + done, n);
+			hd_dirsync(hd, old, hd->img + rec);
+		} else {
+			if (b <= hd->dpb.dsm) {
+				if (!hd->blk[b].loaded)
+					hd_load(hd, b);
+				hd->blk[b].dirty = true;
+			}
+			memcpy(hd->img + off, (const BYTE *) buf + done, n);
+		}
+		done += n;
+		pos += n;
+	}
+	return done;
+}
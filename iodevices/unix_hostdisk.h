@@ -0,0 +1,51 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Common I/O devices used by various simulated machines
+ *
+ * Copyright (C) 2026 by agent
+ *
+ * This module implements CP/M disk drives backed by host directories.
+ *
+ * History:
+ * 18-OCT-2026 first version, used by cpmsim
+ */
+
+#ifndef UNIX_HOSTDISK_INC
+#define UNIX_HOSTDISK_INC
+
+#include <sys/types.h>
+
+#include "sim.h"
+#include "simdefs.h"
+
+/*
+ * CP/M disk parameters of the drive, as in the DPB of the BIOS
+ */
+typedef struct hostdisk_dpb {
+	unsigned spt;		/* 128 byte sectors per track */
+	unsigned bsh;		/* block shift factor */
+	unsigned exm;		/* extent mask */
+	unsigned dsm;		/* number of the last block */
+	unsigned drm;		/* number of the last directory entry */
+	unsigned off;		/* reserved tracks */
+	const BYTE *xlt;	/* sector translation of the BIOS or NULL */
+} hostdisk_dpb_t;
+
+typedef struct hostdisk hostdisk_t;
+
+/*
+ * The drive is accessed like a disk image file with tracks * spt
+ * sectors of 128 bytes in physical order, pos is the offset in this
+ * image. Read and write return the number of bytes transferred, which
+ * is less than len at the end of the disk, or -1.
+ */
+extern hostdisk_t *hostdisk_open(const char *dir, const hostdisk_dpb_t *dpb,
+				 unsigned tracks);
+extern void hostdisk_close(hostdisk_t *hd);
+extern ssize_t hostdisk_read(hostdisk_t *hd, void *buf, size_t len,
+			     off_t pos);
+extern ssize_t hostdisk_write(hostdisk_t *hd, const void *buf, size_t len,
+			      off_t pos);
+
+#endif /* !UNIX_HOSTDISK_INC */
@@ -0,0 +1,218 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Common I/O devices used by various simulated machines
+ *
+ * Copyright (C) 2026 by agent
+ *
+ * This module implements buffered output to terminals, sockets and files.
+ *
+ * History:
+ * 18-OCT-2026 first version, used for console, socket and printer output
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/poll.h>
+
+#include "sim.h"
+#include "simdefs.h"
+#include "simport.h"
+
+#include "unix_outbuf.h"
+
+/* #define LOG_LOCAL_LEVEL LOG_DEBUG */
+#include "log.h"
+static const char *TAG = "outbuf";
+
+static outbuf_t *outbufs;	/* list of buffers checked by the timer */
+static pthread_mutex_t list_mtx = PTHREAD_MUTEX_INITIALIZER;
+static bool timer_running;
+
+/*
+ * Write the buffered bytes, ob->mtx must be locked. Partial writes are
+ * continued, if the descriptor is non-blocking and would block the rest
+ * stays in the buffer. Returns the number of bytes written or -1 on error.
+ */
+static int flush_locked(outbuf_t *ob)
+{
+	int n, done = 0;
+
+	while (done < ob->len) {
+		n = write(ob->fd, ob->buf + done, ob->len - done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			ob->err = errno;
+			ob->len = 0;
+			return -1;
+		}
+		if (n < ob->len - done)
+			LOGD(TAG, "partial write %d of %d bytes on fd %d",
+			     n, ob->len - done, ob->fd);
+		done += n;
+	}
+
+	if (done < ob->len) {
+		memmove(ob->buf, ob->buf + done, ob->len - done);
+		ob->t = get_clock_us();
+	}
+	ob->len -= done;
+
+	return done;
+}
+
+/*
+ * Thread which writes output held back for more than OUTBUF_DELAY us,
+ * so that output the guest doesn't follow with polling is shown
+ */
+static void *timer_thread(void *arg)
+{
+	outbuf_t *ob;
+	uint64_t t;
+	sigset_t set;
+	struct pollfd p[1];
+
+	UNUSED(arg);
+
+	/* leave the signals of the simulation to the other threads */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	while (true) {
+		sleep_for_us(OUTBUF_DELAY / 2);
+		t = get_clock_us();
+		pthread_mutex_lock(&list_mtx);
+		for (ob = outbufs; ob != NULL; ob = ob->next) {
+			pthread_mutex_lock(&ob->mtx);
+			if (ob->len > 0 && t - ob->t >= OUTBUF_DELAY) {
+				/* don't get stuck on a reader not reading */
+				p[0].fd = ob->fd;
+				p[0].events = POLLOUT;
+				p[0].revents = 0;
+				poll(p, 1, 0);
+				if (p[0].revents & POLLOUT)
+					flush_locked(ob);
+			}
+			pthread_mutex_unlock(&ob->mtx);
+		}
+		pthread_mutex_unlock(&list_mtx);
+	}
+
+	/* never reached */
+	pthread_exit(NULL);
+}
+
+/*
+ * Initialize an output buffer and add it to the buffers checked by the
+ * timer thread, the thread is started with the first buffer
+ */
+void outbuf_init(outbuf_t *ob)
+{
+	pthread_t thread;
+
+	pthread_mutex_init(&ob->mtx, NULL);
+	ob->fd = -1;
+	ob->len = 0;
+	ob->err = 0;
+
+	pthread_mutex_lock(&list_mtx);
+	ob->next = outbufs;
+	outbufs = ob;
+	if (!timer_running) {
+		if (pthread_create(&thread, NULL, timer_thread, (void *) NULL)) {
+			LOGE(TAG, "can't create timer thread, output is "
+			     "only written on flush");
+		} else {
+			pthread_detach(thread);
+			timer_running = true;
+		}
+	}
+	pthread_mutex_unlock(&list_mtx);
+}
+
+/*
+ * Buffer a byte for output to fd. If fd differs from the descriptor
+ * written to before, output buffered for the old one is dropped.
+ * Returns 0, or -1 with errno set if a write failed.
+ */
+int outbuf_put(outbuf_t *ob, int fd, BYTE data)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&ob->mtx);
+	if (fd != ob->fd) {
+		ob->fd = fd;
+		ob->len = 0;
+		ob->err = 0;
+	}
+	if (ob->err) {
+		/* a write from the timer thread failed */
+		errno = ob->err;
+		ob->err = 0;
+		ret = -1;
+	} else if (ob->len == OUTBUF_SIZE && flush_locked(ob) < 0) {
+		errno = ob->err;
+		ob->err = 0;
+		ret = -1;
+	} else if (ob->len == OUTBUF_SIZE) {
+		errno = EAGAIN;
+		ret = -1;
+	} else {
+		if (ob->len == 0)
+			ob->t = get_clock_us();
+		ob->buf[ob->len++] = data;
+	}
+	pthread_mutex_unlock(&ob->mtx);
+
+	return ret;
+}
+
+/*
+ * Write all buffered output now. Returns the number of bytes written,
+ * or -1 with errno set if a write failed, the error is also reported
+ * by the next outbuf_put().
+ */
+int outbuf_flush(outbuf_t *ob)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&ob->mtx);
+	if (ob->len > 0)
+		ret = flush_locked(ob);
+	pthread_mutex_unlock(&ob->mtx);
+
+	return ret;
+}
+
+/*
+ * Write the output of all buffers now, before messages of the simulator
+ * are printed
+ */
+void outbuf_flush_all(void)
+{
+	outbuf_t *ob;
+
+	pthread_mutex_lock(&list_mtx);
+	for (ob = outbufs; ob != NULL; ob = ob->next)
+		outbuf_flush(ob);
+	pthread_mutex_unlock(&list_mtx);
+}
+
+/*
+ * Discard buffered output, must be called before the descriptor
+ * is closed
+ */
+void outbuf_drop(outbuf_t *ob)
+{
+	pthread_mutex_lock(&ob->mtx);
+	ob->fd = -1;
+	ob->len = 0;
+	ob->err = 0;
+	pthread_mutex_unlock(&ob->mtx);
+}
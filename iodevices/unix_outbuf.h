@@ -0,0 +1,47 @@
+/*
+ * Z80SIM  -  a Z80-CPU simulator
+ *
+ * Common I/O devices used by various simulated machines
+ *
+ * Copyright (C) 2026 by agent
+ *
+ * This module implements buffered output to terminals, sockets and files.
+ *
+ * History:
+ * 18-OCT-2026 first version, used for console, socket and printer output
+ */
+
+#ifndef UNIX_OUTBUF_INC
+#define UNIX_OUTBUF_INC
+
+#include <pthread.h>
+
+#include "sim.h"
+#include "simdefs.h"
+
+#define OUTBUF_SIZE	4096	/* size of an output buffer */
+#define OUTBUF_DELAY	20000	/* max. time output is held back in us */
+
+/*
+ * Output of a device is collected in a buffer and written with one
+ * system call when the buffer is full, when the device driver calls
+ * outbuf_flush() because the guest polls for input or is idle, or
+ * when the oldest byte in the buffer is OUTBUF_DELAY us old.
+ */
+typedef struct outbuf {
+	pthread_mutex_t mtx;	/* buffer is also flushed by timer thread */
+	int fd;			/* file descriptor written to */
+	int len;		/* number of bytes buffered */
+	int err;		/* errno of a failed write, 0 if none */
+	uint64_t t;		/* time the oldest byte was buffered */
+	struct outbuf *next;	/* next buffer checked by the timer */
+	BYTE buf[OUTBUF_SIZE];
+} outbuf_t;
+
+extern void outbuf_init(outbuf_t *ob);
+extern int outbuf_put(outbuf_t *ob, int fd, BYTE data);
+extern int outbuf_flush(outbuf_t *ob);
+extern void outbuf_flush_all(void);
+extern void outbuf_drop(outbuf_t *ob);
+
+#endif /* !UNIX_OUTBUF_INC */
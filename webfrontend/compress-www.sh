@@ -0,0 +1,41 @@
+#!/bin/sh
+
+# Create precompressed variants file.gz and file.br of the web frontend
+# files, the web server sends them to browsers accepting the encoding.
+# Files which only exist compressed (the webpack bundles *.js.gz) get a
+# brotli variant too. Images and fonts in compressed formats are skipped.
+# brotli variants are only created if the brotli command is installed.
+
+WWW=${1:-$(dirname "$0")/www}
+
+if command -v brotli >/dev/null 2>&1; then
+	BROTLI=yes
+else
+	echo "brotli not found, creating gzip variants only"
+	BROTLI=no
+fi
+
+find "$WWW" -type f \( -name '*.html' -o -name '*.css' -o -name '*.js' \
+	-o -name '*.json' -o -name '*.svg' -o -name '*.txt' \
+	-o -name '*.ttf' -o -name '*.eot' -o -name '*.ico' \) |
+while read -r f; do
+	if [ ! -f "$f.gz" ] || [ "$f" -nt "$f.gz" ]; then
+		echo "$f.gz"
+		gzip -9 -n -c "$f" > "$f.gz"
+	fi
+	if [ $BROTLI = yes ] && { [ ! -f "$f.br" ] || [ "$f" -nt "$f.br" ]; }; then
+		echo "$f.br"
+		brotli -q 11 -c "$f" > "$f.br"
+	fi
+done
+
+[ $BROTLI = yes ] || exit 0
+
+find "$WWW" -type f -name '*.gz' |
+while read -r f; do
+	b=${f%.gz}
+	if [ ! -f "$b" ] && { [ ! -f "$b.br" ] || [ "$f" -nt "$b.br" ]; }; then
+		echo "$b.br"
+		gzip -d -c "$f" | brotli -q 11 -c > "$b.br"
+	fi
+done
@@ -0,0 +1,131 @@
+/**
+ * fbdiff.c
+ *
+ * Copyright (C) 2026 by agent
+ *
+ * History:
+ * 18-OCT-2026	1.0	Initial Release
+ */
+
+/**
+ * This module finds the bytes of a video memory snapshot changed since
+ * the previous frame. The comparison is done 32 bytes at a time with
+ * AVX2 or 16 bytes at a time with SSE2 if the compiler targets it,
+ * otherwise 8 bytes at a time with plain 64 bit words.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "fbdiff.h"
+
+#define ONES	0x0101010101010101ULL
+#define HIGHS	0x8080808080808080ULL
+
+/* return the index of the first byte from i on which differs, or len */
+static inline int next_diff(const uint8_t *a, const uint8_t *b, int i, int len)
+{
+	uint64_t x, y;
+	unsigned m;
+
+#ifdef __AVX2__
+	for (; i + 32 <= len; i += 32) {
+		m = ~(unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+			_mm256_loadu_si256((const __m256i *) (a + i)),
+			_mm256_loadu_si256((const __m256i *) (b + i))));
+		if (m)
+			return i + __builtin_ctz(m);
+	}
+#endif
+#ifdef __SSE2__
+	for (; i + 16 <= len; i += 16) {
+		m = ~(unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i *) (a + i)),
+			_mm_loadu_si128((const __m128i *) (b + i)))) & 0xffff;
+		if (m)
+			return i + __builtin_ctz(m);
+	}
+#endif
+	for (; i + 8 <= len; i += 8) {
+		memcpy(&x, a + i, 8);
+		memcpy(&y, b + i, 8);
+		if (x != y)
+			break;
+	}
+	while (i < len && a[i] == b[i])
+		i++;
+	return i;
+}
+
+/* return the index of the first byte from i on which is equal, or len */
+static inline int next_same(const uint8_t *a, const uint8_t *b, int i, int len)
+{
+	uint64_t x, y;
+	unsigned m;
+
+#ifdef __AVX2__
+	for (; i + 32 <= len; i += 32) {
+		m = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+			_mm256_loadu_si256((const __m256i *) (a + i)),
+			_mm256_loadu_si256((const __m256i *) (b + i))));
+		if (m)
+			return i + __builtin_ctz(m);
+	}
+#endif
+#ifdef __SSE2__
+	for (; i + 16 <= len; i += 16) {
+		m = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_loadu_si128((const __m128i *) (a + i)),
+			_mm_loadu_si128((const __m128i *) (b + i))));
+		if (m)
+			return i + __builtin_ctz(m);
+	}
+#endif
+	for (; i + 8 <= len; i += 8) {
+		memcpy(&x, a + i, 8);
+		memcpy(&y, b + i, 8);
+		x ^= y;
+		/* stop if one of the bytes is zero */
+		if ((x - ONES) & ~x & HIGHS)
+			break;
+	}
+	while (i < len && a[i] != b[i])
+		i++;
+	return i;
+}
+
+/*
+ * Encode the bytes of cur which differ from prev as spans into out and
+ * update prev. Spans separated by no more unchanged bytes than a header
+ * takes are merged. Returns the length of the encoded data, 0 if
+ * nothing changed.
+ */
+int fbdiff_encode(const uint8_t *cur, uint8_t *prev, int len,
+		  int hdrlen, fbdiff_hdr_t hdr, uint8_t *out)
+{
+	int beg, end, next, n = 0;
+
+	beg = next_diff(cur, prev, 0, len);
+	while (beg < len) {
+		end = next_same(cur, prev, beg, len);
+		while (end < len) {
+			next = next_diff(cur, prev, end, len);
+			if (next == len || next - end > hdrlen)
+				break;
+			end = next_same(cur, prev, next, len);
+		}
+
+		(*hdr)(out + n, beg, end - beg);
+		n += hdrlen;
+		memcpy(out + n, cur + beg, end - beg);
+		memcpy(prev + beg, cur + beg, end - beg);
+		n += end - beg;
+
+		beg = next_diff(cur, prev, end, len);
+	}
+
+	return n;
+}
@@ -0,0 +1,30 @@
+/**
+ * fbdiff.h
+ *
+ * Copyright (C) 2026 by agent
+ *
+ * History:
+ * 18-OCT-2026	1.0	Initial Release
+ */
+
+#ifndef FBDIFF_INC
+#define FBDIFF_INC
+
+/**
+ * Encoder for the video memory of display devices with a web client.
+ * A snapshot of the video memory is compared with the previous frame
+ * and the changed spans are packed into one message, each span with a
+ * device specific header followed by the changed bytes.
+ */
+#include <stdint.h>
+
+/* write the header of a span at offset off with len bytes into p */
+typedef void (*fbdiff_hdr_t)(uint8_t *p, int off, int len);
+
+/* out must hold at least 2 * len + hdrlen bytes */
+#define FBDIFF_BUFSIZE(len, hdrlen)	(2 * (len) + (hdrlen))
+
+extern int fbdiff_encode(const uint8_t *cur, uint8_t *prev, int len,
+			 int hdrlen, fbdiff_hdr_t hdr, uint8_t *out);
+
+#endif /* !FBDIFF_INC */
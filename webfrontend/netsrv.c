@@ -14,13 +14,18 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <limits.h>
 #include <time.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <dirent.h>
-#include <sys/ipc.h>
-#include <sys/msg.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/utsname.h>
 
 #include "sim.h"
@@ -31,6 +36,7 @@
 
 #include "civetweb.h"
 #include "netsrv.h"
+#include "generic-ring.h"
 
 #ifdef IMSAISIM
 #ifdef HAS_HAL
@@ -45,6 +51,9 @@
 #include "cromemco-tu-art.h"
 #endif
 #include "diskmanager.h"
+#ifdef FRONTPANEL
+#include "frontpanel.h"
+#endif
 
 #ifdef HAS_NETSERVER
 
@@ -53,24 +62,52 @@ static const char *TAG = "netsrv";
 
 #define MAX_WS_CLIENTS (_DEV_MAX)
 
-typedef struct msgbuf_s {
-	long mtype;
-	unsigned char mtext[128];
-} msgbuf_t;
+#define MAX_WS_VIEWERS 16	/* read-only clients of a device */
 
-static msgbuf_t msg;
+#define RX_BUFSIZE 4096	/* size of the input ring of a device, power of 2 */
+#define TX_BUFSIZE 16384	/* size of the output ring of a device, power of 2 */
+#define TX_DELAY 5000		/* max. time stream output is held back in us */
 
 typedef struct ws_client {
 	struct mg_connection *conn;
 	int state;
+	pthread_mutex_t wr_mtx;		/* held while writing outside the lock */
 } ws_client_t;
 
+/*
+ * Input from a websocket is put into the ring of the device by the
+ * civetweb thread of the connection and taken out by the CPU thread,
+ * so polling the device for input doesn't need a system call. The
+ * mutex and condition are only used to wait for input.
+ *
+ * Output is put into another ring and written to the websockets by
+ * the output thread, so the CPU thread never waits for a client.
+ * The first client of a device owns it, further clients of devices
+ * which only display something are viewers, they get the same output
+ * but their input is ignored.
+ */
 static struct {
-	int queue;
+	bool alive;
+	bool resync;
+	ring_t rx;
+	pthread_mutex_t rx_mtx;
+	pthread_cond_t rx_cond;
+	ring_t tx;
+	pthread_mutex_t tx_mtx;
 	ws_client_t ws_client;
+	ws_client_t viewer[MAX_WS_VIEWERS];
+	int viewers;			/* number of connected viewers */
 	void (*cbfunc)(BYTE *);
+	uint8_t rxbuf[RX_BUFSIZE];
+	uint8_t txbuf[TX_BUFSIZE];
 } dev[MAX_WS_CLIENTS];
 
+static pthread_t tx_thread;
+static pthread_mutex_t tx_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tx_cond = PTHREAD_COND_INITIALIZER;
+static bool tx_running;
+static bool tx_kick;
+
 static net_device_t net_device_a[_DEV_MAX] = {
 	DEV_TTY, DEV_TTY2, DEV_TTY3,
 	DEV_LPT, DEV_VIO, DEV_CPA,
@@ -99,11 +136,21 @@ extern void quit_callback(void);
 */
 
 /**
- * Check if a queue is provisioned
+ * Check if a websocket is connected
  */
 bool net_device_alive(net_device_t device)
 {
-	return dev[device].queue >= 0;
+	return __atomic_load_n(&dev[device].alive, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Check if the owner or a viewer of a device is connected,
+ * output is only sent if so
+ */
+bool net_device_watched(net_device_t device)
+{
+	return net_device_alive(device)
+		|| __atomic_load_n(&dev[device].viewers, __ATOMIC_ACQUIRE) > 0;
 }
 
 void net_device_service(net_device_t device, void (*cbfunc)(BYTE *data))
@@ -111,14 +158,94 @@ void net_device_service(net_device_t device, void (*cbfunc)(BYTE *data))
 	dev[device].cbfunc = cbfunc;
 }
 
+/**
+ * Websockets are written without holding the context lock, so a
+ * slow client doesn't stall the others. With the context locked,
+ * the write mutex of a connected client is taken and the connection
+ * returned, the close handler waits for the mutex before the
+ * connection goes away.
+ * returns:
+ *	connection	if the client is connected, its write mutex is held
+ *	NULL		if the client isn't connected
+ */
+static struct mg_connection *ws_client_hold(ws_client_t *client)
+{
+	if (client->state != 2)
+		return NULL;
+	pthread_mutex_lock(&client->wr_mtx);
+	return client->conn;
+}
+
+/**
+ * Write to a connection returned by ws_client_hold() and release it
+ */
+static void ws_client_write(ws_client_t *client, struct mg_connection *conn,
+			    int op_code, const void *buf, int len)
+{
+	mg_websocket_write(conn, op_code, (const char *) buf, len);
+	pthread_mutex_unlock(&client->wr_mtx);
+}
+
+/**
+ * Check if a new client or lost output needs a full frame and
+ * clear the request
+ */
+bool net_device_resync(net_device_t device)
+{
+	return __atomic_exchange_n(&dev[device].resync, false, __ATOMIC_ACQ_REL);
+}
+
+/**
+ * Devices with a stream of bytes as output, they are sent
+ * in one message every TX_DELAY us
+ */
+static bool net_device_stream(net_device_t device)
+{
+	switch (device) {
+	case DEV_TTY:
+	case DEV_TTY2:
+	case DEV_TTY3:
+	case DEV_PTR:
+	case DEV_LPT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * Devices which can have viewers besides the client owning it
+ */
+static bool net_device_viewable(net_device_t device)
+{
+	switch (device) {
+	case DEV_TTY:
+	case DEV_TTY2:
+	case DEV_TTY3:
+	case DEV_LPT:
+	case DEV_VIO:
+	case DEV_DZLR:
+		return true;
+	default:
+		return false;
+	}
+}
+
 /**
  * Assumes the data is:
  *	TEXT	if only a single byte
  *	BINARY	if there are multiple bytes
  *	TTY & LPT are always BINARY now
+ *
+ * Output of stream devices only waits if the client can't keep up
+ * with it, other messages are frames and are queued as a 4 byte
+ * header [opcode, length] followed by the data. A frame which doesn't
+ * fit is dropped and the device is asked to resync.
  */
 void net_device_send(net_device_t device, char *msg, int len)
 {
+	ring_t *tx = &dev[device].tx;
+	BYTE hdr[4];
 	int op_code;
 
 	switch (device) {
@@ -127,6 +254,7 @@ void net_device_send(net_device_t device, char *msg, int len)
 	case DEV_TTY3:
 	case DEV_PTR:
 	case DEV_LPT:
+	case DEV_CPA:
 		op_code = MG_WEBSOCKET_OPCODE_BINARY;
 		break;
 	default:
@@ -134,70 +262,251 @@ void net_device_send(net_device_t device, char *msg, int len)
 		break;
 	}
 
-	if (dev[device].queue >= 0)
-		mg_websocket_write(dev[device].ws_client.conn,
-				   op_code,
-				   msg, len);
+	if (!net_device_watched(device) || len <= 0 || len > TX_BUFSIZE - 4)
+		return;
+
+	if (net_device_stream(device)) {
+		while (ring_space(tx) < (unsigned) len) {
+			if (!net_device_watched(device))
+				return;
+			sleep_for_us(TX_DELAY / 5);
+		}
+		pthread_mutex_lock(&dev[device].tx_mtx);
+		ring_put(tx, msg, len);
+		pthread_mutex_unlock(&dev[device].tx_mtx);
+		return;
+	}
+
+	pthread_mutex_lock(&dev[device].tx_mtx);
+	if (ring_space(tx) < (unsigned) len + 4) {
+		pthread_mutex_unlock(&dev[device].tx_mtx);
+		LOGD(TAG, "%s output dropped", dev_name[device]);
+		__atomic_store_n(&dev[device].resync, true, __ATOMIC_RELEASE);
+		return;
+	}
+	hdr[0] = op_code;
+	hdr[1] = len & 0xff;
+	hdr[2] = (len >> 8) & 0xff;
+	hdr[3] = (len >> 16) & 0xff;
+	ring_put(tx, hdr, 4);
+	ring_put(tx, msg, len);
+	pthread_mutex_unlock(&dev[device].tx_mtx);
+
+	/* frames are sent right away */
+	pthread_mutex_lock(&tx_mtx);
+	tx_kick = true;
+	pthread_cond_signal(&tx_cond);
+	pthread_mutex_unlock(&tx_mtx);
+}
+
+/**
+ * Input left over from a closed connection is discarded here by the
+ * CPU thread, the only one taking data out of the ring
+ * returns:
+ *	true	if the device is connected
+ */
+static bool net_device_rx_ready(net_device_t device)
+{
+	if (net_device_alive(device))
+		return true;
+	if (ring_count(&dev[device].rx))
+		ring_flush(&dev[device].rx);
+	return false;
 }
 
 /**
- * Always removes something from the queue is data waiting
+ * Always removes something from the ring if data is waiting
  * returns:
- *	char	if data is waiting in the queue
- *	-1	if the queue is not open, is empty
+ *	char	if data is waiting in the ring
+ *	-1	if the device is not connected, or the ring is empty
  */
 int net_device_get(net_device_t device)
 {
-	ssize_t res;
-	msgbuf_t msg;
+	BYTE c;
 
-	if (dev[device].queue >= 0) {
-		res = msgrcv(dev[device].queue, &msg, 2, 1L, IPC_NOWAIT);
-		LOGD(TAG, "GET: device[%d] res[%ld] msg[%ld, %s]",
-		     device, res, msg.mtype, msg.mtext);
-		if (res == 2)
-			return msg.mtext[0];
+	if (net_device_rx_ready(device) && ring_get(&dev[device].rx, &c, 1)) {
+		LOGD(TAG, "GET: device[%d] char[%02X]", device, c);
+		return c;
 	}
 
 	return -1;
 }
 
+/**
+ * Waits until len bytes are received or the connection is closed
+ * returns:
+ *	number of bytes copied to dst
+ *	-1	if the device is not connected
+ */
 int net_device_get_data(net_device_t device, char *dst, int len)
 {
-	ssize_t res;
-	msgbuf_t msg;
+	int n = 0;
+
+	if (!net_device_rx_ready(device))
+		return -1;
 
-	if (dev[device].queue >= 0) {
-		res = msgrcv(dev[device].queue, &msg, len, 1L, MSG_NOERROR);
-		memcpy((void *)dst, (void *)msg.mtext, res);
-		return res;
+	while (n < len) {
+		n += ring_get(&dev[device].rx, dst + n, len - n);
+		if (n < len && !net_device_wait(device, 100000)
+		    && !net_device_alive(device))
+			break;
 	}
 
-	return -1;
+	return n;
 }
 
 /**
- * Doesn't remove data from the queue
+ * Doesn't remove data from the ring
  * returns:
- *	1	if data is waiting in the queue
- *	0	if the queue is not open or is empty
+ *	1	if data is waiting in the ring
+ *	0	if the device is not connected or the ring is empty
  */
 int net_device_poll(net_device_t device)
 {
-	ssize_t res;
-	msgbuf_t msg;
-
-	if (dev[device].queue >= 0) {
-		res = msgrcv(dev[device].queue, &msg, 1, 1L, IPC_NOWAIT);
-		LOGV(TAG, "POLL: device[%d] res[%ld] errno[%d]", device, res, errno);
-		if (res == -1 && errno == E2BIG) {
-			LOGD(TAG, "CHARACTERS WAITING");
-			return 1;
-		}
+	if (net_device_rx_ready(device) && ring_count(&dev[device].rx)) {
+		LOGV(TAG, "POLL: device[%d] CHARACTERS WAITING", device);
+		return 1;
 	}
+
 	return 0;
 }
 
+/**
+ * Hook for the idle path of a device, sleeps until input arrives, the
+ * connection is closed, or timeout_us has passed
+ * returns:
+ *	true	if data is waiting in the ring
+ */
+bool net_device_wait(net_device_t device, int timeout_us)
+{
+	struct timeval tv;
+	struct timespec ts;
+	bool ready;
+
+	if (!net_device_rx_ready(device))
+		return false;
+	if (ring_count(&dev[device].rx))
+		return true;
+
+	gettimeofday(&tv, NULL);
+	ts.tv_sec = tv.tv_sec + (tv.tv_usec + timeout_us) / 1000000;
+	ts.tv_nsec = ((tv.tv_usec + timeout_us) % 1000000) * 1000;
+
+	pthread_mutex_lock(&dev[device].rx_mtx);
+	while (!(ready = ring_count(&dev[device].rx) > 0)
+	       && net_device_alive(device))
+		if (pthread_cond_timedwait(&dev[device].rx_cond,
+					   &dev[device].rx_mtx, &ts) == ETIMEDOUT)
+			break;
+	pthread_mutex_unlock(&dev[device].rx_mtx);
+
+	return ready;
+}
+
+/**
+ * Put received data into the ring of a device and wake up a CPU
+ * thread waiting for it, called by the civetweb thread
+ */
+static void net_device_put(net_device_t d, const char *data, size_t len)
+{
+	if (ring_put(&dev[d].rx, data, len) < len)
+		LOGW(TAG, "%s Overflow", dev_name[d]);
+
+	pthread_mutex_lock(&dev[d].rx_mtx);
+	pthread_cond_broadcast(&dev[d].rx_cond);
+	pthread_mutex_unlock(&dev[d].rx_mtx);
+}
+
+/**
+ * Write a message to the owner and the viewers of a device,
+ * called by the output thread, the connected clients are taken
+ * with the context locked and written to after it is unlocked
+ */
+static void net_device_fanout(struct mg_context *ctx, net_device_t d,
+			      int op_code, const uint8_t *buf, int len)
+{
+	ws_client_t *client[MAX_WS_VIEWERS + 1];
+	struct mg_connection *conn[MAX_WS_VIEWERS + 1];
+	int i, n = 0;
+
+	mg_lock_context(ctx);
+	if ((conn[n] = ws_client_hold(&dev[d].ws_client)) != NULL)
+		client[n++] = &dev[d].ws_client;
+	for (i = 0; i < MAX_WS_VIEWERS; i++)
+		if ((conn[n] = ws_client_hold(&dev[d].viewer[i])) != NULL)
+			client[n++] = &dev[d].viewer[i];
+	mg_unlock_context(ctx);
+
+	for (i = 0; i < n; i++)
+		ws_client_write(client[i], conn[i], op_code, buf, len);
+}
+
+/**
+ * Send the output queued for a device, the bytes of a stream device
+ * are sent as one message
+ */
+static void net_device_flush(struct mg_context *ctx, net_device_t d,
+			     uint8_t *buf)
+{
+	ring_t *tx = &dev[d].tx;
+	BYTE hdr[4];
+	unsigned len;
+
+	if (net_device_stream(d)) {
+		if ((len = ring_get(tx, buf, TX_BUFSIZE)) > 0)
+			net_device_fanout(ctx, d, MG_WEBSOCKET_OPCODE_BINARY,
+					  buf, len);
+		return;
+	}
+
+	while (ring_peek(tx, hdr, 4) == 4) {
+		len = hdr[1] | (hdr[2] << 8) | (hdr[3] << 16);
+		/* the sender may not have queued the data yet */
+		if (ring_count(tx) < len + 4)
+			break;
+		ring_skip(tx, 4);
+		ring_get(tx, buf, len);
+		net_device_fanout(ctx, d, hdr[0], buf, len);
+	}
+}
+
+/**
+ * Thread which sends the output of all devices, frames when they
+ * are queued and streams every TX_DELAY us
+ */
+static void *net_device_tx(void *arg)
+{
+	struct mg_context *ctx = (struct mg_context *) arg;
+	static uint8_t buf[TX_BUFSIZE];
+	struct timeval tv;
+	struct timespec ts;
+	sigset_t set;
+	bool running = true;
+	int i;
+
+	/* leave the signals of the simulation to the other threads */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	while (running) {
+		gettimeofday(&tv, NULL);
+		ts.tv_sec = tv.tv_sec + (tv.tv_usec + TX_DELAY) / 1000000;
+		ts.tv_nsec = ((tv.tv_usec + TX_DELAY) % 1000000) * 1000;
+
+		pthread_mutex_lock(&tx_mtx);
+		if (!tx_kick && tx_running)
+			pthread_cond_timedwait(&tx_cond, &tx_mtx, &ts);
+		tx_kick = false;
+		running = tx_running;
+		pthread_mutex_unlock(&tx_mtx);
+
+		for (i = 0; i < MAX_WS_CLIENTS; i++)
+			net_device_flush(ctx, (net_device_t) i, buf);
+	}
+
+	return NULL;
+}
+
 request_t *get_request(const HttpdConnection_t *conn)
 {
 	static request_t req;
@@ -234,7 +543,7 @@ static void InformWebsockets(struct mg_context *ctx)
 {
 	static unsigned long cnt = 0;
 	char text[32];
-	int i;
+	int i, j;
 
 	UNUSED(cnt);
 
@@ -248,6 +557,12 @@ static void InformWebsockets(struct mg_context *ctx)
 					   MG_WEBSOCKET_OPCODE_TEXT,
 					   text,
 					   strlen(text));
+		for (j = 0; j < MAX_WS_VIEWERS; j++)
+			if (dev[i].viewer[j].state == 2)
+				mg_websocket_write(dev[i].viewer[j].conn,
+						   MG_WEBSOCKET_OPCODE_TEXT,
+						   text,
+						   strlen(text));
 	}
 	mg_unlock_context(ctx);
 }
@@ -573,11 +888,406 @@ static int ConfigHandler(HttpdConnection_t *conn, void *path)
 	return 1;
 }
 
+/**
+ * Static files below the document root are memory mapped at startup,
+ * together with the precompressed variants file.gz and file.br created
+ * by webfrontend/compress-www.sh. A request gets the smallest variant
+ * the browser accepts, with a strong ETag computed from the content.
+ * Files with a content hash in the name are versioned and may be
+ * cached forever, all other files are revalidated with the ETag.
+ * Files changed while the server runs are only seen after a restart.
+ */
+
+enum {
+	ASSET_IDENTITY,
+	ASSET_GZIP,
+	ASSET_BR,
+	ASSET_NENC
+};
+
+static const char *asset_encoding[ASSET_NENC] = { NULL, "gzip", "br" };
+
+typedef struct asset {
+	char *uri;		/* path below the document root */
+	bool versioned;		/* name contains a content hash */
+	struct {
+		void *data;	/* mapped file, NULL if there is none */
+		size_t len;
+		char etag[20];
+	} enc[ASSET_NENC];
+} asset_t;
+
+static asset_t *assets;
+static int num_assets, max_assets;
+
+static int asset_cmp(const void *a, const void *b)
+{
+	return strcmp(((const asset_t *) a)->uri, ((const asset_t *) b)->uri);
+}
+
+/**
+ * Webpack names files with a hash of 20 or 32 hex digits,
+ * followed by the extension
+ */
+static bool asset_versioned(const char *name)
+{
+	int n;
+
+	for (n = 0; isxdigit((unsigned char) name[n]); n++)
+		;
+
+	return name[n] == '.' && (n == 20 || n == 32);
+}
+
+static void asset_add(const char *path, const char *uri, int enc)
+{
+	asset_t *a = NULL;
+	struct stat sbuf;
+	uint64_t h;
+	void *data;
+	size_t i;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return;
+	if (fstat(fd, &sbuf) == -1 || sbuf.st_size == 0) {
+		close(fd);
+		return;
+	}
+	data = mmap(NULL, sbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		LOGW(TAG, "can't map %s", path);
+		return;
+	}
+
+	for (i = 0; i < (size_t) num_assets; i++)
+		if (!strcmp(assets[i].uri, uri)) {
+			a = &assets[i];
+			break;
+		}
+	if (a == NULL) {
+		if (num_assets == max_assets) {
+			max_assets = max_assets ? 2 * max_assets : 64;
+			assets = (asset_t *) realloc(assets,
+						     max_assets * sizeof(asset_t));
+		}
+		a = &assets[num_assets++];
+		memset(a, 0, sizeof(asset_t));
+		a->uri = strdup(uri);
+		a->versioned = asset_versioned(strrchr(uri, '/') + 1);
+	}
+
+	/* FNV-1a hash of the content */
+	h = 0xcbf29ce484222325ULL;
+	for (i = 0; i < (size_t) sbuf.st_size; i++)
+		h = (h ^ ((BYTE *) data)[i]) * 0x100000001b3ULL;
+
+	a->enc[enc].data = data;
+	a->enc[enc].len = sbuf.st_size;
+	snprintf(a->enc[enc].etag, sizeof(a->enc[enc].etag), "\"%016llx\"",
+		 (unsigned long long) h);
+}
+
+static void assets_scan(const char *dir, const char *uri)
+{
+	DIR *d;
+	struct dirent *e;
+	struct stat sbuf;
+	char path[PATH_MAX], name[PATH_MAX];
+	size_t len;
+	int enc;
+
+	if ((d = opendir(dir)) == NULL)
+		return;
+
+	while ((e = readdir(d)) != NULL) {
+		if (e->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+		snprintf(name, sizeof(name), "%s/%s", uri, e->d_name);
+		if (stat(path, &sbuf) == -1)
+			continue;
+		if (S_ISDIR(sbuf.st_mode)) {
+			assets_scan(path, name);
+			continue;
+		}
+		if (!S_ISREG(sbuf.st_mode))
+			continue;
+
+		len = strlen(name);
+		enc = ASSET_IDENTITY;
+		if (len > 3 && !strcmp(name + len - 3, ".gz")) {
+			enc = ASSET_GZIP;
+			name[len - 3] = '\0';
+		} else if (len > 3 && !strcmp(name + len - 3, ".br")) {
+			enc = ASSET_BR;
+			name[len - 3] = '\0';
+		}
+		asset_add(path, name, enc);
+	}
+
+	closedir(d);
+}
+
+static void assets_load(const char *docroot)
+{
+	assets_scan(docroot, "");
+	qsort(assets, num_assets, sizeof(asset_t), asset_cmp);
+	LOGI(TAG, "%d files of %s mapped", num_assets, docroot);
+}
+
+static void assets_free(void)
+{
+	int i, j;
+
+	for (i = 0; i < num_assets; i++) {
+		for (j = 0; j < ASSET_NENC; j++)
+			if (assets[i].enc[j].data != NULL)
+				munmap(assets[i].enc[j].data, assets[i].enc[j].len);
+		free(assets[i].uri);
+	}
+	free(assets);
+	assets = NULL;
+	num_assets = max_assets = 0;
+}
+
+/**
+ * Check if enc is listed in an Accept-Encoding header, without q=0
+ */
+static bool accepts_encoding(const char *hdr, const char *enc)
+{
+	size_t len = strlen(enc);
+	const char *p, *end, *q;
+
+	for (p = hdr; p != NULL && *p; p = strchr(p, ',')) {
+		while (*p == ',' || *p == ' ' || *p == '\t')
+			p++;
+		if (strncasecmp(p, enc, len))
+			continue;
+		p += len;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (*p == '\0' || *p == ',')
+			return true;
+		if (*p == ';') {
+			end = strchr(p, ',');
+			q = strstr(p, "q=");
+			return q == NULL || (end != NULL && q > end)
+			       || strtod(q + 2, NULL) > 0;
+		}
+	}
+
+	return false;
+}
+
+static int AssetHandler(HttpdConnection_t *conn, void *unused)
+{
+	const struct mg_request_info *ri = mg_get_request_info(conn);
+	const char *hdr;
+	char uri[PATH_MAX];
+	asset_t key, *a;
+	bool modified;
+	int enc;
+
+	UNUSED(unused);
+
+	if (strcmp(ri->request_method, "GET") && strcmp(ri->request_method, "HEAD"))
+		return 0;
+
+	/* a directory is served by its index.html */
+	snprintf(uri, sizeof(uri), "%s%s", ri->local_uri,
+		 ri->local_uri[strlen(ri->local_uri) - 1] == '/' ? "index.html" : "");
+	key.uri = uri;
+	a = (asset_t *) bsearch(&key, assets, num_assets, sizeof(asset_t), asset_cmp);
+	if (a == NULL)
+		return 0;	/* leave it to civetweb */
+
+	hdr = mg_get_header(conn, "Accept-Encoding");
+	if (a->enc[ASSET_BR].data && accepts_encoding(hdr, "br"))
+		enc = ASSET_BR;
+	else if (a->enc[ASSET_GZIP].data && accepts_encoding(hdr, "gzip"))
+		enc = ASSET_GZIP;
+	else if (a->enc[ASSET_IDENTITY].data)
+		enc = ASSET_IDENTITY;
+	else
+		return 0;
+
+	hdr = mg_get_header(conn, "If-None-Match");
+	modified = (hdr == NULL || strstr(hdr, a->enc[enc].etag) == NULL);
+	if (!modified)
+		httpdPrintf(conn, "HTTP/1.1 304 Not Modified\r\n");
+	else {
+		httpdStartResponse(conn, 200);
+		httpdHeader(conn, "Content-Type", mg_get_builtin_mime_type(uri));
+		httpdPrintf(conn, "Content-Length: %lu\r\n",
+			    (unsigned long) a->enc[enc].len);
+		if (asset_encoding[enc] != NULL)
+			httpdHeader(conn, "Content-Encoding", asset_encoding[enc]);
+	}
+	httpdHeader(conn, "ETag", a->enc[enc].etag);
+	httpdHeader(conn, "Cache-Control", a->versioned ?
+		    "public, max-age=31536000, immutable" : "no-cache");
+	httpdHeader(conn, "Vary", "Accept-Encoding");
+	httpdEndHeaders(conn);
+
+	if (modified && strcmp(ri->request_method, "HEAD"))
+		mg_write(conn, a->enc[enc].data, a->enc[enc].len);
+
+	return 1;
+}
+
+#ifdef FRONTPANEL
+/**
+ * Headless front panel (-H option):
+ *
+ * When a client connects to /cpa it first gets a TEXT frame with the
+ * JSON description of the lights and switches from fp_describe(), after
+ * that a BINARY frame with the changed lights is sent fp_fps times per
+ * second. The frame is a sequence of runs:
+ *
+ *	first light (2 bytes little endian), count (1 byte), count levels
+ *
+ * Levels are 0 - 255, nothing is sent if no light changed. Small gaps
+ * of unchanged lights are included in a run, that is cheaper than
+ * starting a new one. The client operates a switch with a 2 byte BINARY
+ * frame: switch number, FP_SW_DOWN/FP_SW_UP/FP_SW_CENTER.
+ */
+
+#define CPA_MAX_RUN	255	/* maximum lights in one run */
+#define CPA_MAX_GAP	3	/* merge runs with a gap up to the header size */
+
+static pthread_t cpa_thread;
+static bool cpa_running;
+static int cpa_generation;
+
+static int cpa_encode(const BYTE *levels, BYTE *last, int n, bool all, BYTE *buf)
+{
+	int i, j, k, len = 0;
+
+	i = 0;
+	while (i < n) {
+		if (!all && levels[i] == last[i]) {
+			i++;
+			continue;
+		}
+
+		/* extend the run while changes are close enough */
+		j = k = i + 1;
+		while (j < n && j - i < CPA_MAX_RUN && j - k < CPA_MAX_GAP) {
+			if (all || levels[j] != last[j])
+				k = j + 1;
+			j++;
+		}
+
+		buf[len++] = i & 0xff;
+		buf[len++] = (i >> 8) & 0xff;
+		buf[len++] = k - i;
+		memcpy(&buf[len], &levels[i], k - i);
+		memcpy(&last[i], &levels[i], k - i);
+		len += k - i;
+		i = k;
+	}
+
+	return len;
+}
+
+static void *cpa_stream(void *arg)
+{
+	struct mg_context *ctx = (struct mg_context *) arg;
+	ws_client_t *client = &dev[DEV_CPA].ws_client;
+	struct mg_connection *conn;
+	int n, len, gen = -1;
+	BYTE *levels, *last, *buf;
+	uint64_t t, period;
+
+	n = fp_numLights();
+	levels = (BYTE *) malloc(n);
+	last = (BYTE *) malloc(n);
+	buf = (BYTE *) malloc(4 * n + 3);	/* worst case, one run per light */
+	if (levels == NULL || last == NULL || buf == NULL)
+		LOGW(TAG, "can't allocate front panel buffers");
+
+	period = (fp_fps > 0) ? (uint64_t) (1000000.0 / fp_fps) : 33333;
+
+	for (;;) {
+		t = get_clock_us();
+
+		if (levels && last && buf)
+			fp_getLights(levels);
+
+		/* the thread ends when the client is gone */
+		mg_lock_context(ctx);
+		if (client->state != 2 || !levels || !last || !buf) {
+			cpa_running = false;
+			mg_unlock_context(ctx);
+			break;
+		}
+		/* a new client gets all lights */
+		len = cpa_encode(levels, last, n, gen != cpa_generation, buf);
+		gen = cpa_generation;
+		conn = len ? ws_client_hold(client) : NULL;
+		mg_unlock_context(ctx);
+
+		if (conn)
+			ws_client_write(client, conn, MG_WEBSOCKET_OPCODE_BINARY,
+					buf, len);
+
+		t = get_clock_us() - t;
+		if (t < period)
+			sleep_for_ms((period - t) / 1000);
+	}
+
+	free(levels);
+	free(last);
+	free(buf);
+
+	return NULL;
+}
+
+static void cpa_connect(HttpdConnection_t *conn)
+{
+	struct mg_context *ctx = mg_get_context(conn);
+	char *desc;
+	int size, len;
+
+	if (fp_numLights() == 0) {
+		LOGW(TAG, "front panel not running headless");
+		return;
+	}
+
+	size = 16384;
+	desc = NULL;
+	do {
+		free(desc);
+		if ((desc = (char *) malloc(size)) == NULL)
+			return;
+		len = fp_describe(desc, size);
+		size *= 2;
+	} while (len < 0);
+
+	mg_websocket_write(conn, MG_WEBSOCKET_OPCODE_TEXT, desc, len);
+	free(desc);
+
+	mg_lock_context(ctx);
+	cpa_generation++;
+	if (!cpa_running) {
+		if (pthread_create(&cpa_thread, NULL, cpa_stream, (void *) ctx))
+			LOGW(TAG, "can't create front panel thread");
+		else {
+			pthread_detach(cpa_thread);
+			cpa_running = true;
+		}
+	}
+	mg_unlock_context(ctx);
+}
+#endif /* FRONTPANEL */
+
 static int WebSocketConnectHandler(const HttpdConnection_t *conn, void *device)
 {
 	struct mg_context *ctx = mg_get_context(conn);
 	int reject = 1;
-	int res;
+	int i;
 	net_device_t d = *(net_device_t *) device;
 
 	mg_lock_context(ctx);
@@ -596,16 +1306,23 @@ static int WebSocketConnectHandler(const HttpdConnection_t *conn, void *device)
 		case DEV_DZLR:
 		case DEV_88ACC:
 		case DEV_D7AIO:
-			res = msgget(IPC_PRIVATE, 0644 | IPC_CREAT); //TODO: check flags
-			if (res < 0)
-				perror("msgget()");
-			else
-				dev[d].queue = res;
+			__atomic_store_n(&dev[d].alive, true, __ATOMIC_RELEASE);
 			break;
 		default:
 			break;
 		}
 		reject = 0;
+	} else if (net_device_viewable(d)) {
+		for (i = 0; i < MAX_WS_VIEWERS; i++) {
+			if (dev[d].viewer[i].conn == NULL) {
+				dev[d].viewer[i].conn = (struct mg_connection *) conn;
+				dev[d].viewer[i].state = 1;
+				mg_set_user_connection_data(dev[d].viewer[i].conn,
+							    (void *) (&(dev[d].viewer[i])));
+				reject = 0;
+				break;
+			}
+		}
 	}
 	mg_unlock_context(ctx);
 
@@ -623,17 +1340,23 @@ static void WebSocketReadyHandler(HttpdConnection_t *conn, void *device)
 	if (d == DEV_TTY || d == DEV_TTY2 || d == DEV_TTY3)
 		mg_websocket_write(conn, MG_WEBSOCKET_OPCODE_TEXT, text, strlen(text));
 
-	if (d == DEV_VIO) {
-		BYTE mode = dma_read(0xf7ff);
+	/* the new client needs a full frame */
+	if (d == DEV_VIO || d == DEV_DZLR)
+		__atomic_store_n(&dev[d].resync, true, __ATOMIC_RELEASE);
 
-		dma_write(0xf7ff, 0x00);
-		sleep_for_ms(100);
-		dma_write(0xf7ff, mode);
+	if (client == &dev[d].ws_client)
+		LOGI(TAG, "WS CLIENT CONNECTED to %s", dev_name[d]);
+	else {
+		LOGI(TAG, "WS VIEWER CONNECTED to %s", dev_name[d]);
+		__atomic_add_fetch(&dev[d].viewers, 1, __ATOMIC_ACQ_REL);
 	}
 
-	LOGI(TAG, "WS CLIENT CONNECTED to %s", dev_name[d]);
-
 	client->state = 2;
+
+#ifdef FRONTPANEL
+	if (d == DEV_CPA && H_flag)
+		cpa_connect(conn);
+#endif
 }
 
 static int WebsocketDataHandler(HttpdConnection_t *conn,
@@ -641,8 +1364,6 @@ static int WebsocketDataHandler(HttpdConnection_t *conn,
 {
 	net_device_t d = *(net_device_t *) device;
 
-	UNUSED(conn);
-
 #ifdef DEBUG
 	fprintf(stdout, "Websocket [%d] got %z bytes of ", (int) device, len);
 	switch (((unsigned char) bits) & 0x0F) {
@@ -673,6 +1394,10 @@ static int WebsocketDataHandler(HttpdConnection_t *conn,
 	fprintf(stdout, "\r\n");
 #endif
 
+	/* input of viewers is ignored */
+	if (mg_get_user_connection_data(conn) != (void *) &dev[d].ws_client)
+		return 1;
+
 	if ((((unsigned char) bits) & 0x0F) == MG_WEBSOCKET_OPCODE_BINARY) {
 		switch (d) {
 		case DEV_D7AIO:
@@ -680,34 +1405,23 @@ static int WebsocketDataHandler(HttpdConnection_t *conn,
 				(*(dev[DEV_D7AIO].cbfunc))((BYTE *) data);
 			}
 			break;
+#ifdef FRONTPANEL
+		case DEV_CPA:
+			if (H_flag && len == 2)
+				fp_switchAction((BYTE) data[0], (BYTE) data[1]);
+			break;
+#endif
 		case DEV_PTR:
 			if (len != 1) {
 				LOGW(TAG, "Websocket received too many [%d] characters",
 				     (int) len);
 				return 0;
 			}
-			msg.mtype = 1L;
-			msg.mtext[0] = data[0];
-			msg.mtext[1] = '\0';
-			if (msgsnd(dev[d].queue, &msg, 2, IPC_NOWAIT)) {
-				if (errno == EAGAIN) {
-					LOGW(TAG, "%s Overflow", dev_name[d]);
-				} else
-					perror("msgsnd()");
-				return 0;
-			};
+			net_device_put(d, data, 1);
 			break;
 		case DEV_88ACC:
 			// LOGI(TAG, "rec: %d, %d", (int)len, (BYTE)*data);
-			msg.mtype = 1L;
-			memcpy(msg.mtext, data, len);
-			if (msgsnd(dev[d].queue, &msg, len, IPC_NOWAIT)) {
-				if (errno == EAGAIN) {
-					LOGW(TAG, "%s Overflow", dev_name[d]);
-				} else
-					perror("msgsnd()");
-				return 0;
-			};
+			net_device_put(d, data, len);
 			break;
 		default:
 			break;
@@ -728,16 +1442,7 @@ static int WebsocketDataHandler(HttpdConnection_t *conn,
 				     (int) len);
 				return 0;
 			}
-			msg.mtype = 1L;
-			msg.mtext[0] = data[0];
-			msg.mtext[1] = '\0';
-			if (msgsnd(dev[d].queue, &msg, 2, IPC_NOWAIT)) {
-				if (errno == EAGAIN) {
-					LOGW(TAG, "%s Overflow", dev_name[d]);
-				} else
-					perror("msgsnd()");
-				return 0;
-			};
+			net_device_put(d, data, 1);
 			break;
 		default:
 			break;
@@ -754,18 +1459,29 @@ static void WebSocketCloseHandler(const HttpdConnection_t *conn, void *device)
 	net_device_t d = *(net_device_t *) device;
 
 	mg_lock_context(ctx);
+	if (client == &dev[d].ws_client)
+		__atomic_store_n(&dev[d].alive, false, __ATOMIC_RELEASE);
+	else if (client->state == 2)
+		__atomic_sub_fetch(&dev[d].viewers, 1, __ATOMIC_ACQ_REL);
 	client->state = 0;
 	client->conn = NULL;
 	mg_unlock_context(ctx);
 
-	LOGI(TAG, "WS CLIENT CLOSED %s", dev_name[d]);
+	/* wait for a write to the connection in progress */
+	pthread_mutex_lock(&client->wr_mtx);
+	pthread_mutex_unlock(&client->wr_mtx);
 
-	if (dev[d].queue >= 0 && msgctl(dev[d].queue, IPC_RMID, NULL) == -1)
-		perror("msgctl()");
+	if (client != &dev[d].ws_client) {
+		LOGI(TAG, "WS VIEWER CLOSED %s", dev_name[d]);
+		return;
+	}
 
-	LOGD(TAG, "Message queue closed (%d) [%08X]", d, dev[d].queue);
+	LOGI(TAG, "WS CLIENT CLOSED %s", dev_name[d]);
 
-	dev[d].queue = -1;
+	/* wake up a CPU thread waiting for input */
+	pthread_mutex_lock(&dev[d].rx_mtx);
+	pthread_cond_broadcast(&dev[d].rx_cond);
+	pthread_mutex_unlock(&dev[d].rx_mtx);
 }
 
 static struct mg_context *ctx = NULL;
@@ -773,10 +1489,20 @@ static struct mg_context *ctx = NULL;
 void stop_net_services(void)
 {
 	if (ctx != NULL) {
+		/* send the remaining output and stop the output thread */
+		if (tx_running) {
+			pthread_mutex_lock(&tx_mtx);
+			tx_running = false;
+			pthread_cond_signal(&tx_cond);
+			pthread_mutex_unlock(&tx_mtx);
+			pthread_join(tx_thread, NULL);
+		}
+
 		InformWebsockets(ctx);
 
 		/* Stop the server */
 		mg_stop(ctx);
+		assets_free();
 		LOGI(TAG, "Server stopped.");
 		LOGI(TAG, "Bye!");
 
@@ -788,7 +1514,7 @@ int start_net_services(int port)
 {
 	//TODO: add config for DOCUMENT_ROOT
 
-	int i;
+	int i, j;
 	char sport[6];
 #ifdef SYSDOCROOT
 	struct stat sbuf;
@@ -822,8 +1548,17 @@ int start_net_services(int port)
 	const struct mg_option *opts;
 #endif
 
-	for (i = 0; i < MAX_WS_CLIENTS; i++)
-		dev[i].queue = -1;
+	for (i = 0; i < MAX_WS_CLIENTS; i++) {
+		dev[i].alive = false;
+		ring_init(&dev[i].rx, dev[i].rxbuf, RX_BUFSIZE);
+		pthread_mutex_init(&dev[i].rx_mtx, NULL);
+		pthread_cond_init(&dev[i].rx_cond, NULL);
+		ring_init(&dev[i].tx, dev[i].txbuf, TX_BUFSIZE);
+		pthread_mutex_init(&dev[i].tx_mtx, NULL);
+		pthread_mutex_init(&dev[i].ws_client.wr_mtx, NULL);
+		for (j = 0; j < MAX_WS_VIEWERS; j++)
+			pthread_mutex_init(&dev[i].viewer[j].wr_mtx, NULL);
+	}
 
 	atexit(stop_net_services);
 
@@ -846,11 +1581,20 @@ int start_net_services(int port)
 		return EXIT_FAILURE;
 	}
 
+	assets_load(options[1]);
+
+	tx_running = true;
+	if (pthread_create(&tx_thread, NULL, net_device_tx, (void *) ctx)) {
+		LOGE(TAG, "can't create output thread");
+		exit(EXIT_FAILURE);
+	}
+
 	//TODO: sort out all the paths for the handlers
 	mg_set_request_handler(ctx, "/system", 	SystemHandler, 	0);
 	mg_set_request_handler(ctx, "/conf", 	ConfigHandler,	(void *) "conf");
 	mg_set_request_handler(ctx, "/library", LibraryHandler, 0);
 	mg_set_request_handler(ctx, "/disks", 	DiskHandler, 	0);
+	mg_set_request_handler(ctx, "**",	AssetHandler,	0);
 
 	mg_set_websocket_handler(ctx, "/tty",
 				 WebSocketConnectHandler,
@@ -33,11 +33,14 @@ typedef enum net_device {
 } net_device_t;
 
 extern bool net_device_alive(net_device_t device);
+extern bool net_device_watched(net_device_t device);
 extern void net_device_service(net_device_t device, void (*cbfunc)(BYTE *data));
 extern void net_device_send(net_device_t device, char *msg, int len);
+extern bool net_device_resync(net_device_t device);
 extern int net_device_get(net_device_t device);
 extern int net_device_get_data(net_device_t device, char *dst, int len);
 extern int net_device_poll(net_device_t device);
+extern bool net_device_wait(net_device_t device, int timeout_us);
 
 /*
  * convenience macros for http output
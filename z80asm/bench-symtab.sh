@@ -0,0 +1,24 @@
+#!/bin/sh
+
+# Benchmark for the symbol table: assembles a generated source with
+# 100000 labels, each referring to another label defined before or after
+
+LABELS=${1:-100000}
+
+awk -v n="$LABELS" 'BEGIN {
+	for (i = 0; i < n; i++)
+		printf "L%06d:\tDEFW\tL%06d\n", i, (i * 7919) % n
+	print "\tEND"
+}' > bench-tmp.asm
+
+echo "Assembling $LABELS labels"
+./z80asm -e16 -l -sn bench-tmp.asm > /dev/null
+RESULT=$?
+
+# the second line is the user and system time used by z80asm
+echo "CPU times user/system of shell and z80asm:"
+times
+
+rm -f bench-tmp.asm bench-tmp.hex bench-tmp.lis
+
+exit $RESULT
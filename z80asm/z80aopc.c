@@ -19,8 +19,6 @@
 #include "z80arfun.h"
 #include "z80aopc.h"
 
-static int opccmp(const void *p1, const void *p2);
-
 /*
  *	structure operand table
  */
@@ -188,7 +186,6 @@ static int no_opc_z80 = sizeof(opctab_z80) / sizeof(opc_t);
 
 /*
  *	table with reserved Z80 register and flag operand words
- *	must be sorted in ascending order!
  */
 static ope_t opetab_z80[] = {
 	{ "(BC)",	REGIBC,	0	  },
@@ -318,7 +315,6 @@ static int no_opc_8080 = sizeof(opctab_8080) / sizeof(opc_t);
 
 /*
  *	table with reserved 8080 register and flag operand words
- *	must be sorted in ascending order!
  */
 static ope_t opetab_8080[] = {
 	{ "A",		REGA,	0 },
@@ -334,118 +330,190 @@ static ope_t opetab_8080[] = {
 };
 static int no_ope_8080 = sizeof(opetab_8080) / sizeof(ope_t);
 
-static int curr_instrset;	/* current instructions set */
-static opc_t **opctab;		/* current sorted operations table */
-static int no_opcodes;		/* current of operations */
-static ope_t *opetab;		/* current sorted register/flags table */
-static int no_operands;		/* current number of register/flags */
+/*
+ *	perfect hash table, the slot for a name is selected by the
+ *	hash of the name with seed, and contains the index of the
+ *	table entry with this name or -1, no two names of a table
+ *	have the same slot
+ */
+typedef struct phtab {
+	unsigned long seed;	/* seed of hash function */
+	unsigned long mask;	/* number of slots - 1 */
+	short *slot;		/* table entry indices */
+} phtab_t;
 
 /*
- *	build sorted table opctab for instruction set is
+ *	structure instruction set, with the pseudo ops
+ */
+typedef struct iset {
+	opc_t **opc;		/* operations */
+	int no_opc;		/* number of operations */
+	phtab_t opc_ph;		/* hash table for opc */
+	ope_t *ope;		/* register/flags */
+	int no_ope;		/* number of register/flags */
+	phtab_t ope_ph;		/* hash table for ope */
+} iset_t;
+
+static unsigned long ph_hash(const char *s, unsigned long seed);
+static void ph_build(phtab_t *ph, const char **names, int n);
+static int ph_find(phtab_t *ph, const char *s);
+
+static iset_t iset_z80;		/* Z80 instruction set */
+static iset_t iset_8080;	/* 8080 instruction set */
+static iset_t *curr_iset;	/* current instruction set */
+
+/*
+ *	select instruction set is, the hash tables for the instruction
+ *	set are built when it is selected for the first time
  */
 void instrset(int is)
 {
-	register opc_t *p, **q;
+	register iset_t *set;
 	register int i;
 	opc_t *opc;
-	int nopc;
+	ope_t *ope;
+	int nopc, nope, n;
+	const char **names;
 
-	if (is == curr_instrset)
-		return;
 	switch (is) {
 	case INSTR_Z80:
+		set = &iset_z80;
 		opc = opctab_z80;
 		nopc = no_opc_z80;
-		opetab = opetab_z80;
-		no_operands = no_ope_z80;
+		ope = opetab_z80;
+		nope = no_ope_z80;
 		break;
 	case INSTR_8080:
+		set = &iset_8080;
 		opc = opctab_8080;
 		nopc = no_opc_8080;
-		opetab = opetab_8080;
-		no_operands = no_ope_8080;
+		ope = opetab_8080;
+		nope = no_ope_8080;
 		break;
 	default:
 		fatal(F_INTERN, "invalid instr. set for function opc_conf");
 		break;
 	}
-	if (opctab == NULL) {
-		i = no_opc_psd;
-		i += (no_opc_z80 > no_opc_8080 ? no_opc_z80 : no_opc_8080);
-		opctab = (opc_t **) malloc(sizeof(opc_t *) * i);
-		if (opctab == NULL)
+	if (set->opc == NULL) {
+		set->no_opc = no_opc_psd + nopc;
+		set->ope = ope;
+		set->no_ope = nope;
+		n = (set->no_opc > nope) ? set->no_opc : nope;
+		set->opc = (opc_t **) malloc(sizeof(opc_t *) * set->no_opc);
+		names = (const char **) malloc(sizeof(char *) * n);
+		if (set->opc == NULL || names == NULL)
+			fatal(F_OUTMEM, "operations table");
+		for (i = 0; i < no_opc_psd; i++)
+			set->opc[i] = &opctab_psd[i];
+		for (i = 0; i < nopc; i++)
+			set->opc[no_opc_psd + i] = &opc[i];
+		for (i = 0; i < set->no_opc; i++)
+			names[i] = set->opc[i]->op_name;
+		ph_build(&set->opc_ph, names, set->no_opc);
+		for (i = 0; i < nope; i++)
+			names[i] = ope[i].ope_name;
+		ph_build(&set->ope_ph, names, nope);
+		free(names);
+	}
+	curr_iset = set;
+}
+
+/*
+ *	calculate the hash value of the string s with seed
+ *	returns hash value
+ */
+static unsigned long ph_hash(const char *s, unsigned long seed)
+{
+	register unsigned long h;
+
+	for (h = seed; *s != '\0';)
+		h = ((h ^ (BYTE) *s++) * 16777619UL) & 0xffffffffUL;
+	return h ^ (h >> 15);
+}
+
+/*
+ *	build perfect hash table ph for the n names, tries seeds
+ *	until no two names have the same slot, the table size
+ *	is doubled if no seed is found
+ */
+static void ph_build(phtab_t *ph, const char **names, int n)
+{
+	register unsigned long j;
+	register int i, tries;
+	unsigned long size;
+
+	for (size = 16; size < (unsigned long) n * n / 4; size <<= 1)
+		;
+	for (;;) {
+		ph->mask = size - 1;
+		ph->slot = (short *) malloc(sizeof(short) * size);
+		if (ph->slot == NULL)
 			fatal(F_OUTMEM, "operations table");
+		ph->seed = 2166136261UL;
+		for (tries = 0; tries < 1000; tries++) {
+			for (j = 0; j < size; j++)
+				ph->slot[j] = -1;
+			for (i = 0; i < n; i++) {
+				j = ph_hash(names[i], ph->seed) & ph->mask;
+				if (ph->slot[j] != -1)
+					break;
+				ph->slot[j] = i;
+			}
+			if (i == n)
+				return;
+			ph->seed = (ph->seed + 0x9e3779b9UL) & 0xffffffffUL;
+		}
+		free(ph->slot);
+		size <<= 1;
 	}
-	no_opcodes = no_opc_psd + nopc;
-	q = opctab;
-	for (i = 0, p = opctab_psd; i < no_opc_psd; i++)
-		*q++ = p++;
-	for (i = 0, p = opc; i < nopc; i++)
-		*q++ = p++;
-	qsort(opctab, no_opcodes, sizeof(opc_t *), opccmp);
-	curr_instrset = is;
 }
 
 /*
- *	compares two opcodes for qsort()
+ *	returns index of the table entry in slot for s in ph, or -1,
+ *	the caller must compare s with the name of the entry
  */
-static int opccmp(const void *p1, const void *p2)
+static int ph_find(phtab_t *ph, const char *s)
 {
-	return strcmp((*(const opc_t **) p1)->op_name,
-		      (*(const opc_t **) p2)->op_name);
+	return ph->slot[ph_hash(s, ph->seed) & ph->mask];
 }
 
 /*
- *	do binary search for op_name in sorted table opctab
+ *	search op_name in hash table of current instruction set
  *	returns pointer to table element, or NULL if not found
  */
 opc_t *search_op(char *op_name)
 {
-	register opc_t **low, **mid;
-	register opc_t **high;
-	int cond;
+	register opc_t *op;
+	register int i;
 
-	low = opctab;
-	high = opctab + no_opcodes - 1;
-	while (low <= high) {
-		mid = low + (high - low) / 2;
-		if ((cond = strcmp(op_name, (*mid)->op_name)) < 0)
-			high = mid - 1;
-		else if (cond > 0)
-			low = mid + 1;
-		else if (!undoc_allowed() && ((*mid)->op_flags & OP_UNDOC))
-			return NULL;
-		else
-			return *mid;
-	}
-	return NULL;
+	if ((i = ph_find(&curr_iset->opc_ph, op_name)) == -1)
+		return NULL;
+	op = curr_iset->opc[i];
+	if (strcmp(op_name, op->op_name) != 0)
+		return NULL;
+	if (!undoc_allowed() && (op->op_flags & OP_UNDOC))
+		return NULL;
+	return op;
 }
 
 /*
- *	do binary search for operand s in sorted table opetab
+ *	search operand s in hash table of current instruction set
  *	returns symbol for operand, NOOPERA if empty operand,
  *	or NOREG if operand not found
  */
 BYTE get_reg(char *s)
 {
-	register ope_t *low, *mid;
-	register ope_t *high;
-	int cond;
+	register ope_t *ope;
+	register int i;
 
 	if (s == NULL || *s == '\0')
 		return NOOPERA;
-	low = opetab;
-	high = opetab + no_operands - 1;
-	while (low <= high) {
-		mid = low + (high - low) / 2;
-		if ((cond = strcmp(s, mid->ope_name)) < 0)
-			high = mid - 1;
-		else if (cond > 0)
-			low = mid + 1;
-		else if (!undoc_allowed() && (mid->ope_flags & OPE_UNDOC))
-			return NOREG;
-		else
-			return mid->ope_sym;
-	}
-	return NOREG;
+	if ((i = ph_find(&curr_iset->ope_ph, s)) == -1)
+		return NOREG;
+	ope = &curr_iset->ope[i];
+	if (strcmp(s, ope->ope_name) != 0)
+		return NOREG;
+	if (!undoc_allowed() && (ope->ope_flags & OPE_UNDOC))
+		return NOREG;
+	return ope->ope_sym;
 }
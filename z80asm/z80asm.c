@@ -14,6 +14,8 @@
 #include <string.h>
 #ifdef _POSIX_C_SOURCE
 #include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 #endif
 
 #include "z80asm.h"
@@ -23,17 +25,24 @@
 #include "z80aobj.h"
 #include "z80aopc.h"
 #include "z80apfun.h"
+#include "z80asrc.h"
 #include "z80atab.h"
 
 static void init(void);
+static int assemble(int argc, char *argv[]);
+#ifdef _POSIX_C_SOURCE
+static int batch(char *fn, char *prog, int njobs);
+static int wait_job(void);
+#endif
 static void options(int argc, char *argv[]);
 static void usage(void);
 static void do_pass(int p);
-static int process_line(char *line);
+static int process_line(char *line, srcline_t *sl);
 static void process_file(char *fn);
 static void process_include(char *line, char *operand, int expn_flag);
 static char *get_fn(char *src, const char *ext, int replace);
 static char *get_symbol(char *s, char *line, int lbl_flag);
+static void copy_symbol(char *s, const char *p, int n);
 static void get_operand(char *s, char *line, int nopre_flag);
 
 static const char *fatalmsg[] = {	/* error messages for fatal() */
@@ -42,7 +51,8 @@ static const char *fatalmsg[] = {	/* error messages for fatal() */
 	 "usage: z80asm -8 -u -v -U -e<num> -f{b|m|h|c} -x "
 	 "-h<num> -c<num> -m -T -p<num>\n"
 	 "              -s[n|a] -o<file> -l[<file>] "
-	 "-d<symbol>[=<expr>] ... <file> ..."), /* 1 */
+	 "-d<symbol>[=<expr>] ... <file> ...\n"
+	 "       z80asm -B[<file>] [-j<num>]"), /* 1 */
 	"Assembly halted",		/* 2 */
 	"can't open file %s",		/* 3 */
 	"error writing object file %s",	/* 4 */
@@ -50,7 +60,8 @@ static const char *fatalmsg[] = {	/* error messages for fatal() */
 	"invalid page length: %s",	/* 6 */
 	"invalid symbol length: %s",	/* 7 */
 	"invalid C bytes per line: %s",	/* 8 */
-	"invalid HEX record length: %s"	/* 9 */
+	"invalid HEX record length: %s", /* 9 */
+	"can't start job: %s"		/* 10 */
 };
 
 static const char *errmsg[] = {		/* error messages for asmerr() */
@@ -108,13 +119,38 @@ static WORD rpc;			/* real program counter */
 static WORD pc;				/* logical program counter, normally */
 					/* equal to rpc, except when inside */
 					/* a .PHASE section */
-static FILE *srcfp;			/* file pointer for current source */
 static FILE *errfp;			/* file pointer for error output */
 static unsigned long c_line;		/* current line # in current source */
 
 int main(int argc, char *argv[])
 {
+#ifdef _POSIX_C_SOURCE
+	int njobs;
+#endif
+
 	init();
+#ifdef _POSIX_C_SOURCE
+	if (argc > 1 && argv[1][0] == '-' && argv[1][1] == 'B') {
+		njobs = 1;
+		if (argc == 3 && argv[2][0] == '-' && argv[2][1] == 'j')
+			njobs = atoi(&argv[2][2]);
+		else if (argc != 2)
+			usage();
+		if (njobs < 1)
+			usage();
+		return batch(&argv[1][2], argv[0], njobs) ? EXIT_FAILURE
+							    : EXIT_SUCCESS;
+	}
+#endif
+	return assemble(argc, argv);
+}
+
+/*
+ *	assemble the sources given on the command line
+ *	returns number of errors
+ */
+static int assemble(int argc, char *argv[])
+{
 	options(argc, argv);
 	printf("Z80/8080-Macro-Assembler  Release %s\n%s\n", RELEASE, COPYR);
 	do_pass(1);
@@ -136,6 +172,124 @@ static void init(void)
 	errfp = stdout;
 }
 
+#ifdef _POSIX_C_SOURCE
+/*
+ *	batch mode, reads jobs from file fn, or from stdin if fn is
+ *	empty or "-", one job per line with the arguments of a z80asm
+ *	command line, empty lines and lines starting with # are ignored
+ *	all jobs are read before the first is started, since the exit of
+ *	a child moves the file offset it shares with the parent
+ *	each job is assembled in a child process starting with the
+ *	initialized state of this process, up to njobs in parallel
+ *	returns number of failed jobs
+ */
+static int batch(char *fn, char *prog, int njobs)
+{
+	register char *s;
+	register int n;
+	FILE *fp;
+	int running, failed;
+	size_t len, size;
+	char *jobs, *line, *next;
+	char *jargv[JOBARGS + 1];
+	static char jline[JOBLINE + 2];
+
+	if (*fn == '\0' || strcmp(fn, "-") == 0)
+		fp = stdin;
+	else if ((fp = fopen(fn, READA)) == NULL)
+		fatal(F_FOPEN, fn);
+
+	jobs = NULL;
+	len = size = 0;
+	while (fgets(jline, JOBLINE + 2, fp) != NULL) {
+		n = strlen(jline);
+		if (jline[n - 1] != '\n' && (n > JOBLINE || !feof(fp)))
+			fatal(F_JOB, "line too long");
+		if (len + n + 2 > size) {
+			size = (len + n + 2) * 2;
+			if ((jobs = (char *) realloc(jobs, size)) == NULL)
+				fatal(F_OUTMEM, "batch jobs");
+		}
+		strcpy(jobs + len, jline);
+		len += n;
+		if (jline[n - 1] != '\n')
+			jobs[len++] = '\n';
+	}
+	if (fp != stdin)
+		fclose(fp);
+	if (jobs == NULL)
+		return 0;
+
+	/* build the tables of both instruction sets only once */
+	instrset(INSTR_8080);
+	instrset(INSTR_Z80);
+
+	running = failed = 0;
+	for (line = jobs; line < jobs + len; line = next) {
+		next = strchr(line, '\n');
+		*next++ = '\0';
+		jargv[0] = prog;
+		n = 1;
+		for (s = line; *s != '\0' && n <= JOBARGS;) {
+			while (*s == ' ' || *s == '\t' || *s == '\r')
+				*s++ = '\0';
+			if (*s == '\0')
+				break;
+			jargv[n++] = s;
+			while (*s != '\0' && *s != ' ' && *s != '\t'
+			       && *s != '\r')
+				s++;
+		}
+		if (n == 1 || *jargv[1] == '#')
+			continue;
+		while (*s == ' ' || *s == '\t' || *s == '\r')
+			s++;
+		if (*s != '\0')
+			fatal(F_JOB, "too many arguments");
+		jargv[n] = NULL;
+
+		if (running == njobs) {
+			failed += wait_job();
+			running--;
+		}
+		fflush(stdout);
+		switch (fork()) {
+		case -1:
+			fatal(F_JOB, jargv[n - 1]);
+			break;
+		case 0:
+			/* keep the messages of parallel jobs together */
+			if (njobs > 1)
+				setvbuf(stdout, NULL, _IOFBF, BUFSIZ);
+			exit(assemble(n, jargv) ? EXIT_FAILURE : EXIT_SUCCESS);
+			break;
+		default:
+			running++;
+			break;
+		}
+	}
+	while (running-- > 0)
+		failed += wait_job();
+	free(jobs);
+	if (failed > 0)
+		printf("%d job(s) failed\n", failed);
+	return failed;
+}
+
+/*
+ *	wait for a job to finish
+ *	returns 1 if the job failed, otherwise 0
+ */
+static int wait_job(void)
+{
+	int status;
+
+	if (wait(&status) == -1)
+		return 1;
+	return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+#endif
+
 /*
  *	process options
  */
@@ -406,37 +560,29 @@ static void do_pass(int p)
  */
 static void process_file(char *fn)
 {
-	register char *s;
-	register int i;
+	register srcfile_t *sf;
+	register srcline_t *sl;
 	register char *l;
+	unsigned long n;
 
 	c_line = 0;
 	srcfn = fn;
 	lst_set_srcfn(fn);
-	if ((srcfp = fopen(fn, READA)) == NULL)
-		fatal(F_FOPEN, fn);
+	sf = src_load(fn, upcase_flag);
+	n = 0;
 	do {
 		l = NULL;
+		sl = NULL;
 		while (mac_get_exp_nest() > 0
 		       && (l = mac_expand(line)) == NULL)
 			;
 		if (l == NULL) {
-			if ((l = fgets(line, MAXLINE + 2, srcfp)) == NULL)
+			if (n == sf->src_nlines)
 				break;
-			i = strlen(line) - 1;
-			if (line[i] == '\n')
-				line[i] = '\0';
-			else if (i == MAXLINE) {
-				line[i] = '\0';
-				while ((i = fgetc(srcfp)) != EOF && i != '\n')
-					;
-			}
-			if (upcase_flag)
-				for (s = l; *s; s++)
-					*s = TO_UPP(*s);
+			sl = &sf->src_lines[n++];
+			l = strcpy(line, sl->text);
 		}
-	} while (process_line(l));
-	fclose(srcfp);
+	} while (process_line(l, sl));
 	if (in_phase_section())
 		asmerr(E_MISDPH);
 	if (in_cond_section())
@@ -446,10 +592,11 @@ static void process_file(char *fn)
 }
 
 /*
- *	process one line of source from line
+ *	process one line of source from line, sl has the label and
+ *	opcode spans of a source file line or is NULL
  *	returns FALSE when END encountered, otherwise TRUE
  */
-static int process_line(char *line)
+static int process_line(char *line, srcline_t *sl)
 {
 	register opc_t *op;
 	register WORD op_count;
@@ -474,8 +621,14 @@ static int process_line(char *line)
 		/* a line comment, nothing to do */
 		a_mode = A_NONE;
 	} else {
-		p = get_symbol(label, line, TRUE);
-		p = get_symbol(opcode, p, FALSE);
+		if (sl != NULL) {
+			copy_symbol(label, line, sl->lbl_len);
+			copy_symbol(opcode, line + sl->opc_off, sl->opc_len);
+			p = line + sl->opr_off;
+		} else {
+			p = get_symbol(label, line, TRUE);
+			p = get_symbol(opcode, p, FALSE);
+		}
 		genc_lbl_flag = (gencode && label[0] != '\0');
 
 		if (mac_get_def_nest() > 0) {
@@ -611,7 +764,6 @@ static void process_include(char *line, char *operand, int expn_flag)
 	register char *p;
 	unsigned long inc_line;
 	char *inc_fn, *fn;
-	FILE *inc_fp;
 	static int incnest;
 
 	if (incnest >= INCNEST) {
@@ -620,7 +772,6 @@ static void process_include(char *line, char *operand, int expn_flag)
 	}
 	inc_line = c_line;
 	inc_fn = srcfn;
-	inc_fp = srcfp;
 	incnest++;
 	p = operand;
 	while (!IS_SPC(*p) && *p != COMMENT && *p != '\0')
@@ -637,7 +788,6 @@ static void process_include(char *line, char *operand, int expn_flag)
 	incnest--;
 	c_line = inc_line;
 	srcfn = inc_fn;
-	srcfp = inc_fp;
 	if (verb_flag)
 		printf("   Resume  %s\n", srcfn);
 	if (list_active && pass == 2)
@@ -716,6 +866,21 @@ static char *get_symbol(char *s, char *line, int lbl_flag)
 	return line;
 }
 
+/*
+ *	copy symbol of length n at p into s, converted to upper
+ *	case and truncated like get_symbol() does
+ */
+static void copy_symbol(char *s, const char *p, int n)
+{
+	if (n > symlen)
+		n = symlen;
+	while (n-- > 0) {
+		*s++ = TO_UPP(*p);
+		p++;
+	}
+	*s = '\0';
+}
+
 /*
  *	get operand into s from source line
  *	if nopre_flag is FALSE converts to upper case, and
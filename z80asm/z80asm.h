@@ -37,7 +37,9 @@
 #define PLENGTH		65	/* default lines/page in listing */
 #define SYMLEN		8	/* default max. symbol length */
 #define INCNEST		10	/* max. INCLUDE nesting depth */
-#define HASHSIZE	503	/* max. entries in symbol hash array */
+#define JOBLINE		1024	/* max. line length of a batch job */
+#define JOBARGS		64	/* max. arguments of a batch job */
+#define HASHSIZE	1024	/* initial size of symbol hash table, power of 2 */
 #define OPCARRAY	128	/* size of object buffer */
 #define MAXHEX		32	/* max. no bytes per HEX record */
 #define MACNEST		50	/* max. expansion nesting */
@@ -58,6 +60,7 @@
 #define F_SYMLEN	7	/* symbol length out of range */
 #define F_CARYLEN	8	/* C array bytes per line out of range */
 #define F_HEXLEN	9	/* HEX record length out of range */
+#define F_JOB		10	/* can't start batch job */
 
 /*
  *	definition of error numbers for error messages in listfile
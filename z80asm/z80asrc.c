@@ -0,0 +1,142 @@
+/*
+ *	Z80/8080-Macro-Assembler
+ *	Copyright (C) 1987-2022 by Udo Munk
+ *	Copyright (C) 2022-2024 by Thomas Eberhardt
+ *	Copyright (C) 2026 by agent
+ */
+
+/*
+ *	source file module, reads each source or INCLUDE file once
+ *	into memory and splits it into lines, both passes and
+ *	repeated INCLUDEs of the same file use the lines kept
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "z80asm.h"
+#include "z80anum.h"
+#include "z80asrc.h"
+
+#define SRCBUF		16384	/* initial size of text buffer */
+
+static char *src_read(const char *fn, unsigned long *size);
+static void src_split(srcfile_t *sf, unsigned long size, int upcase);
+static void src_tokens(srcline_t *sl);
+
+static srcfile_t *src_files;		/* source files read */
+
+/*
+ *	get source file fn, it is read when used for the first time,
+ *	if upcase is TRUE the lines are converted to upper case
+ *	returns pointer to the source file
+ */
+srcfile_t *src_load(const char *fn, int upcase)
+{
+	register srcfile_t *sf;
+	unsigned long size;
+
+	for (sf = src_files; sf != NULL; sf = sf->src_next)
+		if (strcmp(sf->src_fn, fn) == 0)
+			return sf;
+	if ((sf = (srcfile_t *) malloc(sizeof(srcfile_t))) == NULL)
+		fatal(F_OUTMEM, "source file");
+	sf->src_fn = strsave(fn);
+	sf->src_text = src_read(fn, &size);
+	src_split(sf, size, upcase);
+	sf->src_next = src_files;
+	src_files = sf;
+	return sf;
+}
+
+/*
+ *	read file fn into allocated memory, store its size in *size
+ *	returns pointer to the text, terminated by an extra '\0'
+ */
+static char *src_read(const char *fn, unsigned long *size)
+{
+	register char *buf;
+	register unsigned long n, len;
+	FILE *fp;
+
+	if ((fp = fopen(fn, READA)) == NULL)
+		fatal(F_FOPEN, fn);
+	len = SRCBUF;
+	n = 0;
+	if ((buf = (char *) malloc(len + 1)) == NULL)
+		fatal(F_OUTMEM, "source file");
+	while ((n += fread(buf + n, 1, len - n, fp)) == len) {
+		len *= 2;
+		if ((buf = (char *) realloc(buf, len + 1)) == NULL)
+			fatal(F_OUTMEM, "source file");
+	}
+	fclose(fp);
+	buf[n] = '\0';
+	*size = n;
+	return buf;
+}
+
+/*
+ *	split the text of sf into lines, the newlines are replaced
+ *	by '\0', lines longer than MAXLINE are truncated like
+ *	reading them with fgets() did
+ */
+static void src_split(srcfile_t *sf, unsigned long size, int upcase)
+{
+	register char *p, *s;
+	register srcline_t *sl;
+	char *end;
+	unsigned long n;
+
+	end = sf->src_text + size;
+	for (n = 0, p = sf->src_text; p < end; p++)
+		if (*p == '\n')
+			n++;
+	if (size > 0 && *(end - 1) != '\n')
+		n++;
+	sf->src_nlines = n;
+	sf->src_lines = (srcline_t *) malloc(sizeof(srcline_t) * (n + 1));
+	if (sf->src_lines == NULL)
+		fatal(F_OUTMEM, "source file");
+	for (sl = sf->src_lines, p = sf->src_text; p < end; sl++) {
+		sl->text = p;
+		while (p < end && *p != '\n')
+			p++;
+		*p++ = '\0';
+		if (strlen(sl->text) > MAXLINE)
+			sl->text[MAXLINE] = '\0';
+		if (upcase)
+			for (s = sl->text; *s; s++)
+				*s = TO_UPP(*s);
+		src_tokens(sl);
+	}
+}
+
+/*
+ *	find label and opcode in source line sl, like get_symbol()
+ *	in the main module does
+ */
+static void src_tokens(srcline_t *sl)
+{
+	register char *p;
+
+	p = sl->text;
+	if (IS_FSYM(*p)) {
+		for (p++; IS_SYM(*p); p++)
+			;
+		sl->lbl_len = p - sl->text;
+		if (*p == LABSEP)
+			p++;
+	} else
+		sl->lbl_len = 0;
+	while (IS_SPC(*p))
+		p++;
+	sl->opc_off = p - sl->text;
+	if (IS_FSYM(*p))
+		for (p++; IS_SYM(*p); p++)
+			;
+	sl->opc_len = p - sl->text - sl->opc_off;
+	sl->opr_off = p - sl->text;
+}
@@ -0,0 +1,38 @@
+/*
+ *	Z80/8080-Macro-Assembler
+ *	Copyright (C) 1987-2022 by Udo Munk
+ *	Copyright (C) 2022-2024 by Thomas Eberhardt
+ *	Copyright (C) 2026 by agent
+ */
+
+#ifndef Z80ASRC_INC
+#define Z80ASRC_INC
+
+#include "z80asm.h"
+
+/*
+ *	structure type source line, with the spans of label and
+ *	opcode found in the line, as used by process_line()
+ */
+typedef struct srcline {
+	char *text;		/* text of the line */
+	BYTE lbl_len;		/* length of label at start of line */
+	BYTE opc_off;		/* offset of opcode */
+	BYTE opc_len;		/* length of opcode */
+	BYTE opr_off;		/* offset of text following the opcode */
+} srcline_t;
+
+/*
+ *	structure type source file, read once and kept for both passes
+ */
+typedef struct srcfile {
+	char *src_fn;		/* file name */
+	char *src_text;		/* text of all lines */
+	srcline_t *src_lines;	/* lines */
+	unsigned long src_nlines; /* number of lines */
+	struct srcfile *src_next; /* next source file */
+} srcfile_t;
+
+extern srcfile_t *src_load(const char *fn, int upcase);
+
+#endif /* !Z80ASRC_INC */
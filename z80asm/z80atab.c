@@ -16,16 +16,48 @@
 #include "z80alst.h"
 #include "z80atab.h"
 
-static int hash(const char *name);
+/*
+ *	The symbols are stored in blocks of sym_t in the order in which
+ *	they were defined, their names in blocks of characters. The hash
+ *	table has an entry with the hash value and a pointer for each
+ *	symbol, collisions are resolved by linear probing. The table
+ *	doubles its size when it gets half full.
+ */
+
+#define SYMBLK		1024	/* symbols per symbol block */
+#define NAMEBLK		16384	/* characters per name block */
+
+typedef struct symblk {
+	sym_t syms[SYMBLK];	/* symbols */
+	int cnt;		/* symbols used in this block */
+	struct symblk *next;	/* next block */
+} symblk_t;
+
+typedef struct slot {
+	unsigned long hash;	/* hash value of the symbol name */
+	sym_t *sym;		/* symbol or NULL if slot is free */
+} slot_t;
+
+static unsigned long hash(const char *name);
+static slot_t *find_slot(const char *name, unsigned long h);
+static void grow_symtab(void);
+static char *new_name(const char *name, int n);
 static int namecmp(const void *p1, const void *p2);
 static int valcmp(const void *p1, const void *p2);
 
-static sym_t *symtab[HASHSIZE];		/* symbol table */
+static slot_t *symtab;			/* symbol hash table */
+static unsigned long symsize;		/* size of hash table, power of 2 */
+static symblk_t *symfirst;		/* first symbol block */
+static symblk_t *symlast;		/* last symbol block */
+static char *nameptr;			/* free space in name block */
+static int namefree;			/* size of free space */
 static int symcnt;			/* number of symbols defined */
 static sym_t **symarray;		/* sorted symbol table */
+static int symarray_cnt;		/* symbols in symarray */
+static int symarray_sort;		/* sort mode of symarray */
 static int symsort;			/* sort mode for iterator */
-static int symidx;			/* hash table index for iterator */
-static sym_t *symptr;			/* symbol pointer for iterator */
+static int symidx;			/* symbol index for iterator */
+static symblk_t *symblkp;		/* symbol block for iterator */
 static int symmax;			/* max. symbol name length observed */
 static WORD last_symval;		/* value of last used symbol */
 
@@ -37,12 +69,11 @@ sym_t *look_sym(const char *sym_name)
 {
 	register sym_t *sp;
 
-	for (sp = symtab[hash(sym_name)]; sp != NULL; sp = sp->sym_next)
-		if (strcmp(sym_name, sp->sym_name) == 0) {
-			last_symval = sp->sym_val;
-			return sp;
-		}
-	return NULL;
+	if (symtab == NULL)
+		return NULL;
+	if ((sp = find_slot(sym_name, hash(sym_name))->sym) != NULL)
+		last_symval = sp->sym_val;
+	return sp;
 }
 
 /*
@@ -73,19 +104,33 @@ WORD sym_lastval(void)
 void new_sym(const char *sym_name, WORD sym_val)
 {
 	register sym_t *sp;
+	register slot_t *tp;
+	register symblk_t *bp;
 	register int n;
-	register int hashval;
+	unsigned long h;
 
+	if (symtab == NULL || (unsigned long) (symcnt + 1) * 2 > symsize)
+		grow_symtab();
+	if (symlast == NULL || symlast->cnt == SYMBLK) {
+		if ((bp = (symblk_t *) malloc(sizeof(symblk_t))) == NULL)
+			fatal(F_OUTMEM, "symbols");
+		bp->cnt = 0;
+		bp->next = NULL;
+		if (symlast == NULL)
+			symfirst = bp;
+		else
+			symlast->next = bp;
+		symlast = bp;
+	}
+	sp = &symlast->syms[symlast->cnt++];
 	n = strlen(sym_name);
-	sp = (sym_t *) malloc(sizeof(sym_t));
-	if (sp == NULL || (sp->sym_name = (char *) malloc(n + 1)) == NULL)
-		fatal(F_OUTMEM, "symbols");
-	strcpy(sp->sym_name, sym_name);
+	sp->sym_name = new_name(sym_name, n);
 	sp->sym_val = last_symval = sym_val;
-	hashval = hash(sym_name);
-	sp->sym_next = symtab[hashval];
-	symtab[hashval] = sp;
 	sp->sym_refflg = FALSE;
+	h = hash(sym_name);
+	tp = find_slot(sym_name, h);
+	tp->hash = h;
+	tp->sym = sp;
 	if (n > symmax)
 		symmax = n;
 	symcnt++;
@@ -120,16 +165,79 @@ void put_label(const char *label, WORD addr, int pass)
 }
 
 /*
- *	calculate the hash value of the string name
+ *	calculate the hash value of the string name (FNV-1a)
  *	returns hash value
  */
-static int hash(const char *name)
+static unsigned long hash(const char *name)
+{
+	register unsigned long h;
+
+	for (h = 2166136261UL; *name != '\0';)
+		h = ((h ^ (BYTE) *name++) * 16777619UL) & 0xffffffffUL;
+	return h;
+}
+
+/*
+ *	search the slot of name with hash value h in symtab
+ *	returns pointer to the slot, or to the free slot where
+ *	the symbol belongs if not found
+ */
+static slot_t *find_slot(const char *name, unsigned long h)
 {
-	register unsigned h;
+	register slot_t *tp;
+	register unsigned long i;
 
-	for (h = 0; *name != '\0';)
-		h = ((h << 5) | (h >> (sizeof(h) * 8 - 5))) ^ (BYTE) *name++;
-	return h % HASHSIZE;
+	for (i = h & (symsize - 1); (tp = &symtab[i])->sym != NULL;
+	     i = (i + 1) & (symsize - 1))
+		if (tp->hash == h && strcmp(name, tp->sym->sym_name) == 0)
+			break;
+	return tp;
+}
+
+/*
+ *	allocate symtab with HASHSIZE slots or double its size,
+ *	the symbols are moved into the new table
+ */
+static void grow_symtab(void)
+{
+	register slot_t *old, *tp;
+	register unsigned long i, j, n;
+
+	old = symtab;
+	n = symsize;
+	symsize = (old == NULL) ? HASHSIZE : symsize * 2;
+	symtab = (slot_t *) calloc(symsize, sizeof(slot_t));
+	if (symtab == NULL)
+		fatal(F_OUTMEM, "symbols");
+	for (i = 0; i < n; i++) {
+		if (old[i].sym == NULL)
+			continue;
+		for (j = old[i].hash & (symsize - 1); (tp = &symtab[j])->sym
+		     != NULL; j = (j + 1) & (symsize - 1))
+			;
+		*tp = old[i];
+	}
+	free(old);
+}
+
+/*
+ *	copy the symbol name name with length n into a name block
+ *	returns pointer to the copy
+ */
+static char *new_name(const char *name, int n)
+{
+	register char *p;
+
+	if (n + 1 > namefree) {
+		namefree = (n + 1 > NAMEBLK) ? n + 1 : NAMEBLK;
+		if ((nameptr = (char *) malloc(namefree)) == NULL)
+			fatal(F_OUTMEM, "symbols");
+	}
+	p = nameptr;
+	memcpy(p, name, n + 1);
+	nameptr += n + 1;
+	namefree -= n + 1;
+	return p;
 }
 
 /*
@@ -141,36 +249,40 @@ int get_symmax(void)
 }
 
 /*
- *	get first symbol for listing, sorted as specified in sort_mode
+ *	get first symbol for listing, sorted as specified in sort_mode,
+ *	the sorted table is kept for further listings
  */
 sym_t *first_sym(int sort_mode)
 {
-	register sym_t *sp;
-	register int j;
-	register int i;
+	register symblk_t *bp;
+	register int i, j;
 
 	if (symcnt == 0)
 		return NULL;
 	symsort = sort_mode;
+	symidx = 0;
 	switch (sort_mode) {
 	case SYM_UNSORT:
-		symidx = 0;
-		while ((symptr = symtab[symidx]) == NULL)
-			if (++symidx == HASHSIZE)
-				break;
-		return symptr;
+		symblkp = symfirst;
+		return &symblkp->syms[0];
 	case SYM_SORTN:
 	case SYM_SORTA:
+		if (symarray != NULL && symarray_cnt == symcnt
+		    && symarray_sort == sort_mode)
+			return symarray[0];
+		free(symarray);
 		symarray = (sym_t **) malloc(sizeof(sym_t *) * symcnt);
 		if (symarray == NULL)
 			fatal(F_OUTMEM, "sorting symbol table");
-		for (i = 0, j = 0; i < HASHSIZE; i++)
-			for (sp = symtab[i]; sp != NULL; sp = sp->sym_next)
-				symarray[j++] = sp;
+		for (bp = symfirst, j = 0; bp != NULL && j < symcnt;
+		     bp = bp->next)
+			for (i = 0; i < bp->cnt; i++)
+				symarray[j++] = &bp->syms[i];
 		qsort(symarray, symcnt, sizeof(sym_t *),
 		      sort_mode == SYM_SORTN ? namecmp : valcmp);
-		symidx = 0;
-		return symarray[symidx];
+		symarray_cnt = symcnt;
+		symarray_sort = sort_mode;
+		return symarray[0];
 	default:
 		fatal(F_INTERN, "unknown sort mode in first_sym");
 		break;
@@ -183,15 +295,13 @@ sym_t *first_sym(int sort_mode)
 sym_t *next_sym(void)
 {
 	if (symsort == SYM_UNSORT) {
-		if ((symptr = symptr->sym_next) == NULL) {
-			do {
-				if (++symidx == HASHSIZE)
-					break;
-				else
-					symptr = symtab[symidx];
-			} while (symptr == NULL);
+		if (++symidx == symblkp->cnt) {
+			if (symblkp == symlast)
+				return NULL;
+			symblkp = symblkp->next;
+			symidx = 0;
 		}
-		return symptr;
+		return &symblkp->syms[symidx];
 	} else if (++symidx < symcnt)
 		return symarray[symidx];
 	return NULL;
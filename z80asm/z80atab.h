@@ -16,7 +16,6 @@ typedef struct sym {
 	char *sym_name;		/* symbol name */
 	WORD sym_val;		/* symbol value */
 	int sym_refflg;		/* symbol reference flag */
-	struct sym *sym_next;	/* next entry */
 } sym_t;
 
 extern sym_t *look_sym(const char *sym_name);
@@ -119,6 +119,9 @@ bool F_flag = true;		/* flag for -F option */
 #ifdef HAS_NETSERVER
 bool n_flag;			/* flag for -n option */
 #endif
+#if defined(FRONTPANEL) && defined(HAS_NETSERVER)
+bool H_flag;			/* flag for -H option */
+#endif
 #ifdef INFOPANEL
 #ifdef FRONTPANEL
 bool p_flag = true;		/* flag for -p option */
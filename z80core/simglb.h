@@ -89,6 +89,9 @@ extern bool	F_flag;
 #ifdef HAS_NETSERVER
 extern bool	n_flag;
 #endif
+#if defined(FRONTPANEL) && defined(HAS_NETSERVER)
+extern bool	H_flag;
+#endif
 #ifdef INFOPANEL
 extern bool	p_flag;
 #endif
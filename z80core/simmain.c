@@ -249,6 +249,12 @@ int main(int argc, char *argv[])
 				n_flag = true;
 				break;
 #endif
+#if defined(FRONTPANEL) && defined(HAS_NETSERVER)
+			case 'H':	/* front panel on web-based frontend */
+				H_flag = true;
+				n_flag = true;
+				break;
+#endif
 #ifdef INFOPANEL
 			case 'p':	/* toggle introspection panel */
 				p_flag = !p_flag;
@@ -294,6 +300,9 @@ usage:
 #endif
 #ifdef HAS_NETSERVER
 				fputs(" -n", stdout);
+#endif
+#if defined(FRONTPANEL) && defined(HAS_NETSERVER)
+				fputs(" -H", stdout);
 #endif
 				fputs("\n\n", stdout);
 #ifndef EXCLUDE_Z80
@@ -346,6 +355,10 @@ usage:
 #ifdef HAS_NETSERVER
 				puts("\t-n = enable web-based frontend");
 #endif
+#if defined(FRONTPANEL) && defined(HAS_NETSERVER)
+				puts("\t-H = run front panel headless on "
+				     "web-based frontend");
+#endif
 #ifdef INFOPANEL
 				puts("\t-p = toggle introspection panel");
 #endif
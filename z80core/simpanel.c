@@ -87,11 +87,23 @@ typedef const struct font {
 #include "fonts/font28.h"
 #include "fonts/font32.h"
 
+/*
+ *	Character cell type, remembers what was drawn into a grid cell.
+ */
+typedef struct cell {
+	char c;
+	uint32_t fgc;
+	uint32_t bgc;
+} cell_t;
+
 /*
  *	Grid type for drawing text with character based coordinates.
+ *	If cells is not NULL only characters which differ from the ones
+ *	drawn before are drawn.
  */
 typedef struct grid {
 	const font_t *font;
+	cell_t *cells;
 	unsigned xoff;
 	unsigned yoff;
 	unsigned spc;
@@ -183,6 +195,20 @@ static WORD mbase;		/* memory panel base address */
 static bool sticky;		/* I/O ports panel sticky flag */
 static bool showfps;		/* show FPS flag */
 
+/*
+ * The pixels are kept between frames, only characters and LEDs which
+ * changed are drawn and only the changed pixel rows are put into the
+ * window. Everything is drawn again if the layout changes.
+ */
+static bool full_redraw = true;	/* draw everything in the next frame */
+static unsigned dirty_y0;	/* first pixel row changed in this frame */
+static unsigned dirty_y1;	/* last pixel row + 1 changed */
+static cell_t reg_cells[47 * 3];
+static cell_t mem_cells[71 * 17];
+static cell_t port_cells[67 * 17];
+static char info_cells[64];
+static uint32_t port_leds[256][2];
+
 /*
  * Create the SDL2 or X11 window for panel display
  */
@@ -218,6 +244,9 @@ static void open_display(void)
 		window = NULL;
 		return;
 	}
+	pixels = (uint32_t *) malloc(xsize * ysize * sizeof(uint32_t));
+	pitch = xsize;
+	full_redraw = true;
 #else /* !WANT_SDL */
 	Window rootwindow;
 	XSetWindowAttributes swa;
@@ -246,7 +275,7 @@ static void open_display(void)
 	swa.colormap = colormap;
 	swa.event_mask = KeyPressMask | KeyReleaseMask |
 			 ButtonPressMask | ButtonReleaseMask |
-			 PointerMotionMask;
+			 PointerMotionMask | ExposureMask;
 	window = XCreateWindow(display, rootwindow, 0, 0, xsize, ysize,
 			       1, vinfo.depth, InputOutput, visual,
 			       CWBorderPixel | CWColormap | CWEventMask, &swa);
@@ -269,6 +298,7 @@ static void open_display(void)
 	/* force little-endian pixels, Xlib will convert if necessary */
 	ximage->byte_order = LSBFirst;
 	pitch = ximage->bytes_per_line / 4;
+	full_redraw = true;
 
 	XMapWindow(display, window);
 	XUnlockDisplay(display);
@@ -284,6 +314,8 @@ static void close_display(void)
 	if (texture != NULL) {
 		SDL_DestroyTexture(texture);
 		texture = NULL;
+		free(pixels);
+		pixels = NULL;
 	}
 	if (renderer != NULL) {
 		SDL_DestroyRenderer(renderer);
@@ -319,6 +351,12 @@ static void process_event(SDL_Event *event)
 	int n;
 
 	switch (event->type) {
+	case SDL_WINDOWEVENT:
+		if (event->window.windowID == SDL_GetWindowID(window) &&
+		    event->window.event == SDL_WINDOWEVENT_EXPOSED)
+			full_redraw = true;
+		break;
+
 	case SDL_MOUSEBUTTONDOWN:
 		if (event->window.windowID != SDL_GetWindowID(window))
 			break;
@@ -442,6 +480,10 @@ static inline void process_events(void)
 	while (XPending(display)) {
 		XNextEvent(display, &event);
 		switch (event.type) {
+		case Expose:
+			full_redraw = true;
+			break;
+
 		case ButtonPress:
 			if (event.xbutton.button < 4)
 				check_buttons(event.xbutton.x, event.xbutton.y,
@@ -565,6 +607,17 @@ static inline void draw_clear(const uint32_t color)
 	}
 }
 
+/*
+ *	Mark h pixel rows starting at y as changed.
+ */
+static inline void draw_dirty(const unsigned y, const unsigned h)
+{
+	if (y < dirty_y0)
+		dirty_y0 = y;
+	if (y + h > dirty_y1)
+		dirty_y1 = y + h;
+}
+
 /*
  *	Draw a pixel in the specified color.
  */
@@ -697,11 +750,12 @@ static inline void draw_vline(const unsigned x, const unsigned y, unsigned h,
  *	Setup a text grid defined by font and spacing.
  *	If col < 0 then use the entire pixels texture width.
  *	If row < 0 then use the entire pixels texture height.
+ *	If cells is not NULL it must hold cols * rows cells.
  */
 static inline void draw_setup_grid(grid_t *grid, const unsigned xoff,
 				   const unsigned yoff, const int cols,
 				   const int rows, const font_t *font,
-				   const unsigned spc)
+				   const unsigned spc, cell_t *cells)
 {
 #ifdef DRAW_DEBUG
 	if (pixels == NULL) {
@@ -737,6 +791,7 @@ static inline void draw_setup_grid(grid_t *grid, const unsigned xoff,
 	}
 #endif
 	grid->font = font;
+	grid->cells = cells;
 	grid->xoff = xoff;
 	grid->yoff = yoff;
 	grid->spc = spc;
@@ -769,9 +824,20 @@ static inline void draw_grid_char(const unsigned x, const unsigned y,
 		return;
 	}
 #endif
+	cell_t *p;
+
+	if (grid->cells != NULL) {
+		p = &grid->cells[y * grid->cols + x];
+		if (p->c == c && p->fgc == fgc && p->bgc == bgc)
+			return;
+		p->c = c;
+		p->fgc = fgc;
+		p->bgc = bgc;
+	}
 	draw_char(x * grid->cwidth + grid->xoff,
 		  y * grid->cheight + grid->yoff,
 		  c, grid->font, fgc, bgc);
+	draw_dirty(y * grid->cheight + grid->yoff, grid->font->height);
 }
 
 /*
@@ -854,6 +920,7 @@ static inline void draw_led(const unsigned x, const unsigned y,
 		else
 			draw_hline(x + 1, y + i, 8, col);
 	}
+	draw_dirty(y, 10);
 }
 
 /*
@@ -988,31 +1055,37 @@ static void draw_cpu_regs(void)
 	/* setup text grid and draw grid lines */
 #ifndef EXCLUDE_Z80
 	if (cpu_type == Z80) {
-		draw_setup_grid(&grid, RXOFF, RYOFF, 47, 3, &font18, RSPC);
-
-		/* draw vertical grid lines */
-		draw_grid_vline(7, 0, 2, &grid, C_ALUM_4);
-		draw_grid_vline(15, 0, 3, &grid, C_ALUM_4);
-		draw_grid_vline(23, 0, 3, &grid, C_ALUM_4);
-		draw_grid_vline(31, 0, 3, &grid, C_ALUM_4);
-		draw_grid_vline(39, 0, 2, &grid, C_ALUM_4);
-		/* draw horizontal grid lines */
-		draw_grid_hline(0, 1, grid.cols, &grid, C_ALUM_4);
-		draw_grid_hline(0, 2, grid.cols, &grid, C_ALUM_4);
+		draw_setup_grid(&grid, RXOFF, RYOFF, 47, 3, &font18, RSPC,
+				reg_cells);
+
+		if (full_redraw) {
+			/* draw vertical grid lines */
+			draw_grid_vline(7, 0, 2, &grid, C_ALUM_4);
+			draw_grid_vline(15, 0, 3, &grid, C_ALUM_4);
+			draw_grid_vline(23, 0, 3, &grid, C_ALUM_4);
+			draw_grid_vline(31, 0, 3, &grid, C_ALUM_4);
+			draw_grid_vline(39, 0, 2, &grid, C_ALUM_4);
+			/* draw horizontal grid lines */
+			draw_grid_hline(0, 1, grid.cols, &grid, C_ALUM_4);
+			draw_grid_hline(0, 2, grid.cols, &grid, C_ALUM_4);
+		}
 	}
 #endif
 #ifndef EXCLUDE_I8080
 	if (cpu_type == I8080) {
-		draw_setup_grid(&grid, RXOFF, RYOFF, 47, 2, &font18, RSPC);
-
-		/* draw vertical grid lines */
-		draw_grid_vline(7, 0, 1, &grid, C_ALUM_4);
-		draw_grid_vline(15, 0, 2, &grid, C_ALUM_4);
-		draw_grid_vline(23, 0, 1, &grid, C_ALUM_4);
-		draw_grid_vline(31, 0, 1, &grid, C_ALUM_4);
-		draw_grid_vline(39, 0, 1, &grid, C_ALUM_4);
-		/* draw horizontal grid line */
-		draw_grid_hline(0, 1, grid.cols, &grid, C_ALUM_4);
+		draw_setup_grid(&grid, RXOFF, RYOFF, 47, 2, &font18, RSPC,
+				reg_cells);
+
+		if (full_redraw) {
+			/* draw vertical grid lines */
+			draw_grid_vline(7, 0, 1, &grid, C_ALUM_4);
+			draw_grid_vline(15, 0, 2, &grid, C_ALUM_4);
+			draw_grid_vline(23, 0, 1, &grid, C_ALUM_4);
+			draw_grid_vline(31, 0, 1, &grid, C_ALUM_4);
+			draw_grid_vline(39, 0, 1, &grid, C_ALUM_4);
+			/* draw horizontal grid line */
+			draw_grid_hline(0, 1, grid.cols, &grid, C_ALUM_4);
+		}
 	}
 #endif
 	/* draw register labels & contents */
@@ -1088,11 +1161,16 @@ static void draw_memory_panel(void)
 	WORD a;
 	grid_t grid;
 
-	draw_setup_grid(&grid, MXOFF, MYOFF, 71, 17, &font16, MSPC);
+	draw_setup_grid(&grid, MXOFF, MYOFF, 71, 17, &font16, MSPC, mem_cells);
 
-	/* draw vertical grid lines */
-	for (i = 0; i < 17; i++)
-		draw_grid_vline(5 + i * 3, 0, grid.rows, &grid, C_ALUM_4);
+	if (full_redraw) {
+		/* draw vertical and horizontal grid lines */
+		for (i = 0; i < 17; i++)
+			draw_grid_vline(5 + i * 3, 0, grid.rows, &grid,
+					C_ALUM_4);
+		for (j = 0; j < 16; j++)
+			draw_grid_hline(0, j + 1, grid.cols, &grid, C_ALUM_4);
+	}
 
 	a = mbase;
 	for (i = 0; i < 16; i++) {
@@ -1101,7 +1179,6 @@ static void draw_memory_panel(void)
 		draw_grid_char(7 + i * 3, 0, c, &grid, C_ALUM_2, C_ALUM_6);
 	}
 	for (j = 0; j < 16; j++) {
-		draw_grid_hline(0, j + 1, grid.cols, &grid, C_ALUM_4);
 		c = (a >> 12) & 0xf;
 		c += (c < 10 ? '0' : 'A' - 10);
 		draw_grid_char(0, j + 1, c, &grid, C_ALUM_2, C_ALUM_6);
@@ -1156,28 +1233,40 @@ static void draw_ports_panel(void)
 	char c;
 	int i, j;
 	unsigned x, y;
+	uint32_t cin, cout, *led;
 	grid_t grid;
 
-	draw_setup_grid(&grid, IOXOFF, IOYOFF, 67, 17, &font16, IOSPC);
+	draw_setup_grid(&grid, IOXOFF, IOYOFF, 67, 17, &font16, IOSPC,
+			port_cells);
 
-	/* draw vertical grid lines */
-	for (i = 0; i < 16; i++)
-		draw_grid_vline(3 + i * 4, 0, grid.rows, &grid, C_ALUM_4);
+	if (full_redraw) {
+		/* draw vertical and horizontal grid lines */
+		for (i = 0; i < 16; i++)
+			draw_grid_vline(3 + i * 4, 0, grid.rows, &grid,
+					C_ALUM_4);
+		for (j = 0; j < 16; j++)
+			draw_grid_hline(0, j + 1, grid.cols, &grid, C_ALUM_4);
+	}
 
 	for (i = 0; i < 16; i++) {
 		c = i + (i < 10 ? '0' : 'A' - 10);
 		draw_grid_char(5 + i * 4, 0, c, &grid, C_ALUM_2, C_ALUM_6);
 	}
+	led = &port_leds[0][0];
 	for (j = 0; j < 16; j++) {
-		draw_grid_hline(0, j + 1, grid.cols, &grid, C_ALUM_4);
 		c = j + (j < 10 ? '0' : 'A' - 10);
 		draw_grid_char(0, j + 1, c, &grid, C_ALUM_2, C_ALUM_6);
 		draw_grid_char(1, j + 1, '0', &grid, C_ALUM_2, C_ALUM_6);
 		for (i = 0; i < 16; i++) {
 			x = (4 + i * 4) * grid.cwidth + grid.xoff + 1;
 			y = (j + 1) * grid.cheight + grid.yoff + 3;
-			draw_led(x, y, p->in ? C_CHAM_2 : C_ALUM_6);
-			draw_led(x + 13, y, p->out ? C_RED_2 : C_ALUM_6);
+			cin = p->in ? C_CHAM_2 : C_ALUM_6;
+			cout = p->out ? C_RED_2 : C_ALUM_6;
+			if (full_redraw || led[0] != cin)
+				draw_led(x, y, led[0] = cin);
+			if (full_redraw || led[1] != cout)
+				draw_led(x + 13, y, led[1] = cout);
+			led += 2;
 			p++;
 		}
 	}
@@ -1187,6 +1276,26 @@ static void draw_ports_panel(void)
 		memset(port_flags, 0, sizeof(port_flags));
 }
 
+/*
+ *	Draw a character of the info line at column i, if it changed.
+ */
+static inline void draw_info_char(const unsigned i, const char c)
+{
+	const font_t *font = &font18;
+	const unsigned w = font->width;
+	const unsigned n = xsize / w;
+	const unsigned x = (xsize - n * w) / 2;
+	const unsigned y = ysize - font->height;
+
+	if (i < sizeof(info_cells)) {
+		if (info_cells[i] == c)
+			return;
+		info_cells[i] = c;
+	}
+	draw_char(i * w + x, y, c, font, C_ORANGE_1, C_ALUM_6);
+	draw_dirty(y, font->height);
+}
+
 /*
  *	Draw the info line:
  *
@@ -1198,24 +1307,20 @@ static void draw_info(bool tick)
 	int i, f, digit;
 	bool onlyz;
 	const char *s;
-	const font_t *font = &font18;
-	const unsigned w = font->width;
-	const unsigned n = xsize / w;
-	const unsigned x = (xsize - n * w) / 2;
-	const unsigned y = ysize - font->height;
+	const unsigned n = xsize / font18.width;
 	static unsigned count, fps;
 	static uint64_t freq;
 
 	/* draw product info */
 	s = "Z80pack " RELEASE;
 	for (i = 0; *s; i++)
-		draw_char(i * w + x, y, *s++, font, C_ORANGE_1, C_ALUM_6);
+		draw_info_char(i, *s++);
 
 	/* draw frequency label */
-	draw_char((n - 7) * w + x, y, '.', font, C_ORANGE_1, C_ALUM_6);
-	draw_char((n - 3) * w + x, y, 'M', font, C_ORANGE_1, C_ALUM_6);
-	draw_char((n - 2) * w + x, y, 'H', font, C_ORANGE_1, C_ALUM_6);
-	draw_char((n - 1) * w + x, y, 'z', font, C_ORANGE_1, C_ALUM_6);
+	draw_info_char(n - 7, '.');
+	draw_info_char(n - 3, 'M');
+	draw_info_char(n - 2, 'H');
+	draw_info_char(n - 1, 'z');
 
 	/* update fps every second */
 	count++;
@@ -1224,15 +1329,12 @@ static void draw_info(bool tick)
 		count = 0;
 	}
 	if (showfps) {
-		draw_char(30 * w + x, y, fps > 99 ? fps / 100 + '0' : ' ',
-			  font, C_ORANGE_1, C_ALUM_6);
-		draw_char(31 * w + x, y, fps > 9 ? (fps / 10) % 10 + '0' : ' ',
-			  font, C_ORANGE_1, C_ALUM_6);
-		draw_char(32 * w + x, y, fps % 10 + '0',
-			  font, C_ORANGE_1, C_ALUM_6);
-		draw_char(34 * w + x, y, 'f', font, C_ORANGE_1, C_ALUM_6);
-		draw_char(35 * w + x, y, 'p', font, C_ORANGE_1, C_ALUM_6);
-		draw_char(36 * w + x, y, 's', font, C_ORANGE_1, C_ALUM_6);
+		draw_info_char(30, fps > 99 ? fps / 100 + '0' : ' ');
+		draw_info_char(31, fps > 9 ? (fps / 10) % 10 + '0' : ' ');
+		draw_info_char(32, fps % 10 + '0');
+		draw_info_char(34, 'f');
+		draw_info_char(35, 'p');
+		draw_info_char(36, 's');
 	}
 
 	/* update frequency every second */
@@ -1251,8 +1353,7 @@ static void draw_info(bool tick)
 			c = ' ';
 		else
 			onlyz = false;
-		draw_char((n - 11 + i) * w + x, y, c,
-			  font, C_ORANGE_1, C_ALUM_6);
+		draw_info_char(n - 11 + i, c);
 		if (i < 6)
 			digit /= 10;
 		if (i == 3)
@@ -1390,20 +1491,67 @@ static void check_buttons(unsigned x, unsigned y, int event)
 }
 
 /*
- *	Refresh the display buffer
+ *	Get the states of all buttons as bit mask
+ */
+static unsigned buttons_state(void)
+{
+	int i;
+	unsigned state = 0;
+	const button_t *p = buttons;
+
+	for (i = 0; i < nbuttons; i++) {
+		state = (state << 4) | (p->enabled << 3) | (p->active << 2) |
+			(p->pressed << 1) | p->hilighted;
+		p++;
+	}
+
+	return state;
+}
+
+/*
+ *	Refresh the display buffer, the changed pixel rows are
+ *	dirty_y0 to dirty_y1 - 1 afterwards
  */
 static void refresh(bool tick)
 {
-	draw_clear(C_ALUM_6);
+	static int drawn_panel = -1, drawn_cpu = -1;
+	static unsigned drawn_buttons;
+	static bool drawn_showfps;
+	unsigned bstate;
 
 	update_buttons();
-	draw_buttons();
+
+	/* draw everything if the layout changed */
+	bstate = buttons_state();
+	if (panel != drawn_panel || cpu != drawn_cpu ||
+	    bstate != drawn_buttons || showfps != drawn_showfps) {
+		drawn_panel = panel;
+		drawn_cpu = cpu;
+		drawn_buttons = bstate;
+		drawn_showfps = showfps;
+		full_redraw = true;
+	}
+
+	dirty_y0 = ysize;
+	dirty_y1 = 0;
+	if (full_redraw) {
+		draw_clear(C_ALUM_6);
+		memset(reg_cells, 0, sizeof(reg_cells));
+		memset(mem_cells, 0, sizeof(mem_cells));
+		memset(port_cells, 0, sizeof(port_cells));
+		memset(info_cells, 0, sizeof(info_cells));
+		draw_buttons();
+		draw_dirty(0, ysize);
+	}
+
 	draw_cpu_regs();
 	if (panel == MEMORY_PANEL)
 		draw_memory_panel();
 	else if (panel == PORTS_PANEL)
 		draw_ports_panel();
 	draw_info(tick);
+
+	full_redraw = false;
 }
 
 #ifdef WANT_SDL
@@ -1411,12 +1559,21 @@ static void refresh(bool tick)
 /* function for updating the display */
 static void update_display(bool tick)
 {
-	SDL_LockTexture(texture, NULL, (void **) &pixels, &pitch);
-	pitch /= 4;
+	SDL_Rect r;
+
 	refresh(tick);
-	SDL_UnlockTexture(texture);
-	SDL_RenderCopy(renderer, texture, NULL, NULL);
-	SDL_RenderPresent(renderer);
+
+	/* upload only the changed pixel rows */
+	if (dirty_y0 < dirty_y1) {
+		r.x = 0;
+		r.y = dirty_y0;
+		r.w = xsize;
+		r.h = dirty_y1 - dirty_y0;
+		SDL_UpdateTexture(texture, &r, pixels + dirty_y0 * pitch,
+				  pitch * sizeof(uint32_t));
+		SDL_RenderCopy(renderer, texture, NULL, NULL);
+		SDL_RenderPresent(renderer);
+	}
 }
 
 static win_funcs_t panel_funcs = {
@@ -1458,11 +1615,13 @@ static void *update_display(void *arg)
 		/* process X11 event queue */
 		process_events();
 
-		/* update display window */
+		/* update display window, only the changed pixel rows */
 		refresh(tick);
-		XPutImage(display, window, gc, ximage, 0, 0, 0, 0,
-			  xsize, ysize);
-		XSync(display, False);
+		if (dirty_y0 < dirty_y1) {
+			XPutImage(display, window, gc, ximage, 0, dirty_y0,
+				  0, dirty_y0, xsize, dirty_y1 - dirty_y0);
+			XSync(display, False);
+		}
 
 		/* unlock display, thread can be canceled again */
 		XUnlockDisplay(display);